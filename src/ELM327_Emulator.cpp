@@ -47,14 +47,15 @@ ELM327Emu::ELM327Emu()
 {
     tickCounter = 0;
     ibWritePtr = 0;
-    ecuAddress = 0x7E0;
     mClient = 0;
-    bEcho = false;
-    bHeader = false;
-    bLineFeed = true;
-    bMonitorMode = false;
-    bDLC = false;
+    ElmCommands::reset(elm);
     sendingBus = 0;
+    waiting = false;
+    expecting = false;
+    expectTime = 0;
+    for (int i = 0; i < ELM_SESSIONS; i++) sessions[i] = -1;
+    nextSession = 0;
+    listener = -1;
 }
 
 /*
@@ -73,7 +74,72 @@ void ELM327Emu::setWiFiClient(WiFiClient *client)
 
 bool ELM327Emu::getMonitorMode()
 {
-    return bMonitorMode;
+    return elm.monitorMode;
+}
+
+void ELM327Emu::setSendingBus(int bus)
+{
+    sendingBus = bus;
+    if (listener >= 0) applyReceiveFilter();
+}
+
+//Answers are routed by the receive filter rather than a fixed range of IDs. Every ECU that gets through it has a
+//session of its own so multi-frame answers (VIN, DTC lists, UDS) come back whole, never mixed up with another
+//ECU's. They only get flow control from us while a request of ours is pending, see expectAnswers()
+void ELM327Emu::applyReceiveFilter()
+{
+    IsoTpEngine &isotp = canManager.getIsoTp();
+    for (int i = 0; i < ELM_SESSIONS; i++)
+    {
+        isotp.close(sessions[i]);
+        sessions[i] = -1;
+    }
+    isotp.unlisten(listener);
+    uint32_t id, mask;
+    ElmCommands::getReceiveFilter(elm, id, mask);
+    listener = isotp.listen(sendingBus, id, mask, ElmCommands::isExtended(elm), ELM327Emu::acceptReply, this);
+    expecting = false;
+}
+
+int ELM327Emu::openSession(uint32_t rxId)
+{
+    IsoTpEngine &isotp = canManager.getIsoTp();
+    bool extended = ElmCommands::isExtended(elm);
+    uint32_t txId = ElmCommands::requestId(rxId, elm.ecuAddress);
+    int slot = -1;
+    for (int i = 0; i < ELM_SESSIONS; i++)
+    {
+        if (sessions[i] < 0)
+        {
+            if (slot < 0) slot = i;
+            continue;
+        }
+        const ISOTP_SESSION &s = isotp.getSession(sessions[i]);
+        if (s.rxId == rxId && s.txId == txId) return sessions[i];
+    }
+    if (slot < 0)
+    {
+        slot = nextSession;
+        nextSession = (nextSession + 1) % ELM_SESSIONS;
+        isotp.close(sessions[slot]);
+    }
+    sessions[slot] = isotp.open(sendingBus, txId, rxId, extended, ELM327Emu::isoTpReceive, this);
+    return sessions[slot];
+}
+
+//Outside our own requests the listener and the sessions only listen in. Other testers' traffic, 7E8 - 7EF and
+//18DAF1xx alike, and the passive cache fill it gives must never get a flow control from us
+void ELM327Emu::expectAnswers(bool e)
+{
+    IsoTpEngine &isotp = canManager.getIsoTp();
+    isotp.expectAnswers(listener, e);
+    for (int i = 0; i < ELM_SESSIONS; i++) isotp.expectAnswer(sessions[i], e);
+    expecting = e;
+}
+
+int ELM327Emu::acceptReply(void *context, int bus, uint32_t id, bool extended)
+{
+    return ((ELM327Emu *)context)->openSession(id);
 }
 
 /*
@@ -98,12 +164,14 @@ void ELM327Emu::sendCmd(String cmd) {
 
 void ELM327Emu::loop() {
     int incoming;
+    checkResponse();
     if (!mClient) //bluetooth
     {
 #ifndef CONFIG_IDF_TARGET_ESP32S3
         while (serialBT.available()) {
             incoming = serialBT.read();
             if (incoming != -1) { //and there is no reason it should be -1
+                if (waiting && incoming != 10) finishWaiting("STOPPED"); //a real ELM327 gives up as soon as a character comes in
                 if (incoming == 13 || ibWritePtr > 126) { // on CR or full buffer, process the line
                     incomingBuffer[ibWritePtr] = 0; //null terminate the string
                     ibWritePtr = 0; //reset the write pointer
@@ -114,10 +182,10 @@ void ELM327Emu::loop() {
                     processCmd();
 
                 } else { // add more characters
-                    if (incoming > 20 && bMonitorMode) 
+                    if (incoming > 20 && elm.monitorMode) 
                     {
                         Logger::debug("Exiting monitor mode");
-                        bMonitorMode = false;
+                        elm.monitorMode = false;
                     }
                     if (incoming != 10 && incoming != ' ') // don't add a LF character or spaces. Strip them right out
                         incomingBuffer[ibWritePtr++] = (char)tolower(incoming); //force lowercase to make processing easier
@@ -132,6 +200,7 @@ void ELM327Emu::loop() {
         while (mClient->available()) {
             incoming = mClient->read();
             if (incoming != -1) { //and there is no reason it should be -1
+                if (waiting && incoming != 10) finishWaiting("STOPPED");
                 if (incoming == 13 || ibWritePtr > 126) { // on CR or full buffer, process the line
                     incomingBuffer[ibWritePtr] = 0; //null terminate the string
                     ibWritePtr = 0; //reset the write pointer
@@ -153,23 +222,26 @@ void ELM327Emu::loop() {
 
 void ELM327Emu::sendTxBuffer()
 {
-    if (mClient)
+    size_t spanLength;
+    while ((spanLength = txBuffer.numContiguousBytes()) > 0)
     {
-        size_t wifiLength = txBuffer.numAvailableBytes();
         uint8_t* buff = txBuffer.getBufferedBytes();
-        if (mClient->connected())
+        if (mClient)
         {
-            mClient->write(buff, wifiLength);
+            if (mClient->connected())
+            {
+                mClient->write(buff, spanLength);
+            }
         }
-    }
-    else //bluetooth then
-    {
+        else //bluetooth then
+        {
 #ifndef CONFIG_IDF_TARGET_ESP32S3
-        serialBT.write(txBuffer.getBufferedBytes(), txBuffer.numAvailableBytes());
-        //Serial.write(txBuffer.getBufferedBytes(), txBuffer.numAvailableBytes());
+            serialBT.write(buff, spanLength);
+            //Serial.write(buff, spanLength);
 #endif
+        }
+        txBuffer.consumeBytes(spanLength);
     }
-    txBuffer.clearBufferedBytes();
 }
 
 /*
@@ -177,137 +249,42 @@ void ELM327Emu::sendTxBuffer()
 *   But, for reference, this cmd processes the command in incomingBuffer
 */
 void ELM327Emu::processCmd() {
-    String retString = processELMCmd(incomingBuffer);
-
-    txBuffer.sendString(retString);
+    reply.clear();
+    processELMCmd(incomingBuffer);
+    queueReply();
     sendTxBuffer();
-    if (Logger::isDebug()) {
-        char buff[300];
-        retString = "Reply:" + retString;
-        retString.toCharArray(buff, 300);
-        Logger::debug(buff);
-    }
-
+    if (Logger::isDebug()) Logger::debug("Reply:%s", reply.getText());
 }
 
-String ELM327Emu::processELMCmd(char *cmd) 
+void ELM327Emu::queueReply()
 {
-    String retString = String();
-    String lineEnding;
-    if (bLineFeed) lineEnding = String("\r\n");
-    else lineEnding = String("\r");
+    if (reply.isTruncated()) Logger::debug("ELM reply cut off at %i bytes", reply.getLength());
+    txBuffer.sendBytesToBuffer((uint8_t *)reply.getText(), reply.getLength());
+}
 
-    if (bEcho)
+void ELM327Emu::processELMCmd(char *cmd) 
+{
+    if (elm.echo)
     {
-        retString.concat(cmd);
-        retString.concat(lineEnding);
+        reply.add(cmd);
+        reply.add(ElmCommands::lineEnding(elm));
     }
 
-    if (!strncmp(cmd, "at", 2)) 
+    ELM_STATE old = elm;
+    if (ElmCommands::dispatch(cmd, elm, reply))
     {
-
-        if (!strcmp(cmd, "atz")) 
-        { //reset hardware
-            retString.concat(lineEnding);
-            retString.concat("ELM327 v1.3a");
-        }
-        else if (!strncmp(cmd, "atsh",4)) //set header address (address we send queries to)
-        { 
-            size_t idSize = strlen(cmd+4);
-            ecuAddress = Utility::parseHexString(cmd+4, idSize);
-            Logger::debug("New ECU address: %x", ecuAddress);
-            retString.concat("OK");
-        }
-        else if (!strncmp(cmd, "ate",3)) 
-        { //turn echo on/off
-            if (cmd[3] == '1') bEcho = true;
-            if (cmd[3] == '0') bEcho = false;
-            //retString.concat("OK");
-        }
-        else if (!strncmp(cmd, "ath",3)) 
-        { //turn headers on/off
-            if (cmd[3] == '1') bHeader = true;
-            else bHeader = false;
-            retString.concat("OK");
-        }
-        else if (!strncmp(cmd, "atl",3)) 
-        { //turn linefeeds on/off
-            if (cmd[3] == '1') bLineFeed = true;
-            else bLineFeed = false;
-            retString.concat("OK");
-        }
-        else if (!strcmp(cmd, "at@1")) 
-        { //send device description
-            retString.concat("OBDLink MX");
-        }
-        else if (!strcmp(cmd, "ati")) 
-        { //send chip ID
-            retString.concat("ELM327 v1.5");
-        }
-        else if (!strncmp(cmd, "atat",4)) 
-        { //set adaptive timing
-            //don't intend to support adaptive timing at all
-            retString.concat("OK");
-        }
-        else if (!strncmp(cmd, "atsp",4)) 
-        { //set protocol
-            //theoretically we can ignore this
-            retString.concat("OK");
-        }
-        else if (!strcmp(cmd, "atdp")) 
-        { //show description of protocol
-            retString.concat("can11/500");
-        }
-        else if (!strcmp(cmd, "atdpn")) 
-        { //show protocol number (same as passed to sp)
-            retString.concat("6");
-        }
-        else if (!strncmp(cmd, "atd0", 4)) 
-        { 
-            bDLC = false;
-            retString.concat("OK");
-        }
-        else if (!strncmp(cmd, "atd1", 4)) 
-        { 
-            bDLC = true;
-            retString.concat("OK");
-        }
-        else if (!strcmp(cmd, "atd")) 
-        { //set to defaults
-            retString.concat("OK");
-        }
-        else if (!strncmp(cmd, "atma", 4)) //monitor all mode
-        {
-            Logger::debug("ENTERING monitor mode");
-            bMonitorMode = true;
-        }
-        else if (!strncmp(cmd, "atm", 3)) 
-        { //turn memory on/off
-            retString.concat("OK");
-        }
-        else if (!strcmp(cmd, "atrv")) 
-        { //show 12v rail voltage
-            //TODO: the system should actually have this value so it wouldn't hurt to
-            //look it up and report the real value.
-            retString.concat("14.2V");
-        }
-        else 
-        { //by default respond to anything not specifically handled by just saying OK and pretending.
-            retString.concat("OK");
-        }
+        if (elm.ecuAddress != old.ecuAddress) Logger::debug("New ECU address: %x", elm.ecuAddress);
+        if (elm.monitorMode && !old.monitorMode) Logger::debug("ENTERING monitor mode");
+        //flow control for answers from outside the standard ranges goes to the header, so that counts too
+        if (listener >= 0 && (elm.protocol != old.protocol || elm.rxFilter != old.rxFilter || elm.rxMask != old.rxMask ||
+                              elm.ecuAddress != old.ecuAddress)) applyReceiveFilter();
     }
     else 
     { //if no AT then assume it is a PID request. This takes the form of four bytes which form the alpha hex digit encoding for two bytes
         //there should be four or six characters here forming the ascii representation of the PID request. Easiest for now is to turn the ascii into
         //a 16 bit number and mask off to get the bytes
-        CAN_FRAME outFrame;
-        outFrame.id = ecuAddress;
-        outFrame.extended = false;
-        outFrame.length = 8;
-        outFrame.rtr = 0;
-        outFrame.data.byte[3] = 0xAA; outFrame.data.byte[4] = 0xAA;
-        outFrame.data.byte[5] = 0xAA; outFrame.data.byte[6] = 0xAA;
-        outFrame.data.byte[7] = 0xAA;
+        uint8_t request[3];
+        uint8_t requestLength = 0;
         size_t cmdSize = strlen(cmd);
         if (cmdSize == 4) //generic OBDII codes
         {
@@ -315,54 +292,167 @@ String ELM327Emu::processELMCmd(char *cmd)
             uint8_t pidnum = (uint8_t)(valu & 0xFF);
             uint8_t mode = (uint8_t)((valu >> 8) & 0xFF);
             Logger::debug("Mode: %i, PID: %i", mode, pidnum);
-            outFrame.data.byte[0] = 2;
-            outFrame.data.byte[1] = mode;
-            outFrame.data.byte[2] = pidnum;            
+            request[0] = mode;
+            request[1] = pidnum;
+            requestLength = 2;
         }
         if (cmdSize == 6) //custom PIDs for specific vehicles
         {
             uint32_t valu = strtol((char *) cmd, NULL, 16); //the pid format is always in hex
-            uint16_t pidnum = (uint8_t)(valu & 0xFFFF);
+            uint16_t pidnum = (uint16_t)(valu & 0xFFFF);
             uint8_t mode = (uint8_t)((valu >> 16) & 0xFF);
             Logger::debug("Mode: %i, PID: %i", mode, pidnum);
-            outFrame.data.byte[0] = 3;
-            outFrame.data.byte[1] = mode;
-            outFrame.data.byte[2] = pidnum >> 8;
-            outFrame.data.byte[3] = pidnum & 0xFF;
+            request[0] = mode;
+            request[1] = pidnum >> 8;
+            request[2] = pidnum & 0xFF;
+            requestLength = 3;
+        }
+        if (requestLength == 0) reply.add("?");
+        else if (!answerFromCache(request, requestLength))
+        {
+            if (!sendRequest(request, requestLength)) reply.add("CAN ERROR");
+            else
+            {
+                //the prompt waits until the answer is in, see checkResponse()
+                if (settings.elmCacheMode != ELM_CACHE_OFF) cache.beginRequest(elm.ecuAddress, request, requestLength, millis());
+                startWaiting(request, requestLength, ElmCommands::isPhysical(elm.ecuAddress, ElmCommands::isExtended(elm)));
+                return;
+            }
         }
-        /* //only for debugging!
-        canManager.setSendToConsole(true);
-        canManager.displayFrame(outFrame, sendingBus);
-        canManager.setSendToConsole(false);
-        */
-        canManager.sendFrame(canBuses[sendingBus], outFrame);
     }
 
-    retString.concat(lineEnding);
-    retString.concat(">"); //prompt to show we're ready to receive again
+    reply.add(ElmCommands::lineEnding(elm));
+    reply.add(">"); //prompt to show we're ready to receive again
+}
 
-    return retString;
+//A physical header goes through that ECU's session, which expects the answer from then on. Anything else, 7DF and
+//18DB33F1 included, is a single frame and the answers come in through the receive filter, so the listener and every
+//session expect them
+bool ELM327Emu::sendRequest(const uint8_t *data, uint8_t length)
+{
+    IsoTpEngine &isotp = canManager.getIsoTp();
+    bool extended = ElmCommands::isExtended(elm);
+    if (listener < 0) applyReceiveFilter();
+    expectTime = millis();
+    if (ElmCommands::isPhysical(elm.ecuAddress, extended))
+    {
+        expecting = true;
+        int session = openSession(ElmCommands::responseId(elm.ecuAddress, extended));
+        return isotp.send(session, data, length, micros());
+    }
+    expectAnswers(true);
+    return isotp.sendFunctional(sendingBus, elm.ecuAddress, extended, data, length);
 }
 
-void ELM327Emu::processCANReply(CAN_FRAME &frame)
+//False if the request has to go to the ECU. A stale answer is still used in refresh mode but the ECU is asked
+//again behind it so the next poll finds a fresh one
+bool ELM327Emu::answerFromCache(const uint8_t *data, uint8_t length)
 {
-    //at the moment assume anything sent here is a legit reply to something we sent. Package it up properly
-    //and send it down the line
-    char buff[8];
-    if (bHeader || bMonitorMode)
+    if (settings.elmCacheMode == ELM_CACHE_OFF) return false;
+    const ELM_CACHE_ENTRY *entry;
+    ELM_CACHE_RESULT result = cache.lookup(elm.ecuAddress, data, length, settings.elmCacheMode, settings.elmCacheTtl, millis(), &entry);
+    if (result == ELM_CACHE_MISS) return false;
+
+    for (int i = 0; i < entry->numResponses; i++)
     {
-        sprintf(buff, "%03X", frame.id);
-        txBuffer.sendString(buff);
+        const ELM_CACHED_RESPONSE &r = entry->responses[i];
+        addResponse(r.rxId, r.data, r.length);
     }
-    if (bDLC)
+    if (result == ELM_CACHE_STALE && sendRequest(data, length)) cache.beginRequest(elm.ecuAddress, data, length, millis());
+    return true;
+}
+
+//Adds one answer to the reply the way the ELM327 prints them. Anything longer than the reply buffer goes out a
+//piece at a time
+void ELM327Emu::addResponse(uint32_t rxId, const uint8_t *data, uint16_t length)
+{
+    if (elm.header) reply.addHex(rxId, (rxId > 0x7FF) ? 8 : 3);
+    if (elm.dlc) reply.addDecimal(length);
+    for (int i = 0; i < length; i++)
     {
-        sprintf(buff, "%u", frame.length);
-        txBuffer.sendString(buff);
+        if (reply.getFree() < 2)
+        {
+            queueReply();
+            reply.clear();
+        }
+        reply.addHex(data[i], 2);
     }
-    for (int i = 0; i < frame.data.byte[0]; i++)
+    reply.add(ElmCommands::lineEnding(elm));
+}
+
+//Whole ISO-TP messages from the ECU sessions, however many frames they took. Only answers to the request being
+//waited for are printed. Everything else, background refreshes and other testers' traffic included, can only
+//fill the cache
+void ELM327Emu::isoTpReceive(void *context, int session, const uint8_t *data, uint16_t length)
+{
+    ELM327Emu *elm = (ELM327Emu *)context;
+    uint32_t rxId = canManager.getIsoTp().getSession(session).rxId;
+    uint32_t now = micros();
+    if (settings.elmCacheMode != ELM_CACHE_OFF) elm->cache.addResponse(rxId, data, length, millis());
+
+    if (!elm->waiting || !ElmCache::isAnswerTo(elm->lastRequest, elm->lastRequestLength, data, length)) return;
+    elm->reply.clear();
+    elm->addResponse(rxId, data, length);
+    elm->queueReply();
+    elm->sendTxBuffer();
+
+    elm->responses++;
+    elm->timing.noteLatency(elm->lastAddress, elm->lastRequest, elm->lastRequestLength, now - elm->requestTime);
+    if (elm->physical) elm->finishWaiting(nullptr); //only the one ECU was asked
+}
+
+void ELM327Emu::startWaiting(const uint8_t *data, uint8_t length, bool toOneEcu)
+{
+    waiting = true;
+    physical = toOneEcu;
+    responses = 0;
+    requestTime = micros();
+    lastAddress = elm.ecuAddress;
+    memcpy(lastRequest, data, length);
+    lastRequestLength = length;
+    waitTimeout = timing.getTimeout(lastAddress, lastRequest, length, elm.adaptiveTiming, elm.stTimeout);
+}
+
+//Called every loop(). Broadcast requests can be answered by any number of ECUs so they always wait out the timeout,
+//which adaptive timing brings down to what the slowest of them has needed so far. Once nothing is waited for and
+//the cache has stopped collecting, the sessions go back to only listening
+void ELM327Emu::checkResponse()
+{
+    if (expecting && !waiting && (millis() - expectTime) >= ELM_CACHE_COLLECT) expectAnswers(false);
+    if (!waiting) return;
+    if ((micros() - requestTime) < waitTimeout) return;
+    //a multi-frame answer still coming in gets to finish, the ISO-TP timeout looks after it
+    IsoTpEngine &isotp = canManager.getIsoTp();
+    for (int i = 0; i < ELM_SESSIONS; i++)
     {
-        sprintf(buff, "%02X", frame.data.byte[1+i]);
-        txBuffer.sendString(buff);
+        if (sessions[i] >= 0 && isotp.isBusy(sessions[i])) return;
     }
+    finishWaiting(responses ? nullptr : "NO DATA");
+}
+
+void ELM327Emu::finishWaiting(const char *message)
+{
+    waiting = false;
+    reply.clear();
+    if (message)
+    {
+        reply.add(message);
+        reply.add(ElmCommands::lineEnding(elm));
+    }
+    reply.add(ElmCommands::lineEnding(elm));
+    reply.add(">");
+    queueReply();
+    sendTxBuffer();
+}
+
+//Only monitor mode sends frames here now, so they are printed as they are
+void ELM327Emu::processCANReply(CAN_FRAME &frame)
+{
+    reply.clear();
+    reply.addHex(frame.id, frame.extended ? 8 : 3);
+    if (elm.dlc) reply.addDecimal(frame.length);
+    for (int i = 0; i < frame.length; i++) reply.addHex(frame.data.byte[i], 2);
+    reply.add(ElmCommands::lineEnding(elm));
+    queueReply();
     sendTxBuffer();
 }
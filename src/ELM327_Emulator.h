@@ -36,13 +36,18 @@ AT E0 (turn echo off)
 AT H (0/1) - Turn headers on or off - headers are used to determine how many ECU√≠s present (hint: only send one response to 0100 and emulate a single ECU system to save time coding)
 AT L0 (Turn linefeeds off - just use CR)
 AT Z (reset)
-AT SH - Set header address - seems to set the ECU address to send to (though you may be able to ignore this if you wish)
+AT SH - Set header address. hhh for 11 bit IDs, hhhhhh (under the AT CP priority) or hhhhhhhh for 29 bit IDs
+AT CP hh - Priority bits for six digit headers, 18 by default
+AT CRA hhh / hhhhhhhh - Only take answers from this ID, X for any digit. No ID goes back to every ECU
+AT CF hhh / AT CM hhh - Receive filter and mask, the long way round to the same thing
 AT @1 - Display device description - ELM327 returns: Designed by Andy Honecker 2011
 AT I - Cause chip to output its ID: ELM327 says: ELM327 v1.3a
-AT AT (0/1/2) - Set adaptive timing (though you can ignore this)
-AT SP (set protocol) - you can ignore this
-AT DP (get protocol by name) - (always return can11/500)
-AT DPN (get protocol by number) - (always return 6)
+AT AT (0/1/2) - Set adaptive timing. Off, normal or aggressive, see elm_timing.h
+AT ST hh - Longest wait for an answer in 4.096ms units
+AT SP (set protocol) - 6 / 7 / 8 / 9 = CAN 11/500, 29/500, 11/250, 29/250. 0 picks 6. Only the ID size matters, the bus
+    keeps the speed it was set to
+AT DP (get protocol by name) - can11/500, can29/500 and so on
+AT DPN (get protocol by number)
 AT RV (adapter voltage) - Send something like 14.4V
 */
 
@@ -53,12 +58,17 @@ AT RV (adapter voltage) - Send something like 14.4V
 #include <Arduino.h>
 #include <WiFi.h>
 #include "commbuffer.h"
+#include "elm_commands.h"
+#include "elm_timing.h"
+#include "elm_cache.h"
 #ifndef CONFIG_IDF_TARGET_ESP32S3
 #include "BluetoothSerial.h"
 #endif
 
 class CAN_FRAME;
 
+#define ELM_SESSIONS    8   //ISO-TP sessions for the ECUs answering us. The oldest goes when a ninth turns up
+
 class ELM327Emu {
 public:
 
@@ -70,7 +80,8 @@ public:
     void sendCmd(String cmd);
     void processCANReply(CAN_FRAME &frame);
     bool getMonitorMode();
-    void setSendingBus(int bus) { sendingBus = bus; }
+    void setSendingBus(int bus);
+    ElmCache &getCache() { return cache; }
 
 private:
 #ifndef CONFIG_IDF_TARGET_ESP32S3
@@ -80,19 +91,42 @@ private:
     CommBuffer txBuffer;
     char incomingBuffer[128]; //storage for one incoming line
     char buffer[30]; // a buffer for various string conversions
-    bool bLineFeed; //should we use line feeds?
-    bool bHeader; //should we produce a header?
-    bool bEcho; //should we echo back anything sent to us?
-    bool bMonitorMode; //should we output all frames?
-    bool bDLC; //output DLC?
-    uint32_t ecuAddress;
+    ELM_STATE elm; //everything the AT commands set
+    ElmReply reply; //the reply being built, only ever used from loop()
     int tickCounter;
     int ibWritePtr;
     int currReply;
     int sendingBus;
+    int sessions[ELM_SESSIONS]; //-1 until an ECU answers or is asked directly
+    int nextSession;            //slot to reuse when they're all taken
+    int listener;               //ISO-TP listener for the ATCRA / ATCF / ATCM filter, -1 until the first request
+    ElmTiming timing;
+    ElmCache cache;
+    bool waiting;               //request sent, prompt held back until it's answered or times out
+    bool physical;              //sent to one ECU so its answer ends the wait
+    bool expecting;             //flow control may be sent, from a request until its answers are collected
+    uint32_t expectTime;        //millis() of the last request
+    uint8_t responses;
+    uint32_t requestTime;
+    uint32_t waitTimeout;
+    uint32_t lastAddress;       //what the request was, adaptive timing learns per request
+    uint8_t lastRequest[3];
+    uint8_t lastRequestLength;
 
     void processCmd();
-    String processELMCmd(char *cmd);
+    void applyReceiveFilter();
+    int openSession(uint32_t rxId);
+    void expectAnswers(bool expecting);
+    static int acceptReply(void *context, int bus, uint32_t id, bool extended);
+    static void isoTpReceive(void *context, int session, const uint8_t *data, uint16_t length);
+    void processELMCmd(char *cmd);
+    void queueReply();
+    bool sendRequest(const uint8_t *data, uint8_t length);
+    bool answerFromCache(const uint8_t *data, uint8_t length);
+    void addResponse(uint32_t rxId, const uint8_t *data, uint16_t length);
+    void startWaiting(const uint8_t *data, uint8_t length, bool toOneEcu);
+    void checkResponse();
+    void finishWaiting(const char *message);
     void sendTxBuffer();
 };
 
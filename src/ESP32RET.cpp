@@ -34,11 +34,11 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "wifi_manager.h"
 #include "gvret_comm.h"
 #include "can_manager.h"
+#include "transport_writer.h"
+#include "tx_scheduler.h"
 
 byte i = 0;
 
-uint32_t lastFlushMicros = 0;
-
 bool markToggle[6];
 uint32_t lastMarkTrigger = 0;
 
@@ -58,6 +58,8 @@ WiFiManager wifiManager;
 GVRET_Comm_Handler serialGVRET; // gvret protocol over the serial to USB connection
 GVRET_Comm_Handler wifiGVRET;   // GVRET over the wifi telnet port
 CANManager canManager;          // keeps track of bus load and abstracts away some details of how things are done
+TransportWriter transportWriter; // flushes the GVRET buffers to USB and wifi from its own task
+TxScheduler txScheduler; // sends periodic frames off an esp_timer
 // LAWICELHandler lawicel;
 
 SerialConsole console;
@@ -78,11 +80,20 @@ void loadSettings()
     nvPrefs.begin(PREF_NAME, false);
 
     settings.useBinarySerialComm = nvPrefs.getBool("binarycomm", false);
+    serialGVRET.setBinaryMode(settings.useBinarySerialComm);
+    wifiGVRET.setBinaryMode(settings.useBinarySerialComm);
     settings.logLevel = nvPrefs.getUChar("loglevel", 1); // info
     settings.wifiMode = nvPrefs.getUChar("wifiMode", 1); // Wifi defaults to creating an AP
     settings.enableBT = nvPrefs.getBool("enable-bt", false);
     settings.enableLawicel = nvPrefs.getBool("enableLawicel", false);
     settings.sendingBus = nvPrefs.getInt("sendingBus", 0);
+    settings.elmCacheMode = nvPrefs.getUChar("elmcache", ELM_CACHE_OFF);
+    settings.elmCacheTtl = nvPrefs.getUShort("elmcachettl", 500);
+    settings.reduceMode = nvPrefs.getUChar("reducemode", REDUCE_OFF);
+    settings.reduceInterval = nvPrefs.getUShort("reduceint", 100);
+    settings.reduceRefresh = nvPrefs.getUShort("reducerefresh", 1000);
+    if (nvPrefs.getBytes("gateway", settings.gatewayRules, sizeof(settings.gatewayRules)) != sizeof(settings.gatewayRules))
+        memset(settings.gatewayRules, 0, sizeof(settings.gatewayRules));
 
     uint8_t defaultVal = (espChipRevision > 2) ? 0 : 1; // 0 = A0, 1 = EVTV ESP32
 #ifdef CONFIG_IDF_TARGET_ESP32S3
@@ -144,6 +155,9 @@ void loadSettings()
         settings.canSettings[i].fdSpeed = nvPrefs.getUInt(buff, 5000000);
         sprintf(buff, "can%i-fdmode", i);
         settings.canSettings[i].fdMode = nvPrefs.getBool(buff, false);
+        sprintf(buff, "can%i-filters", i);
+        if (nvPrefs.getBytes(buff, settings.canFilters[i], sizeof(settings.canFilters[i])) != sizeof(settings.canFilters[i]))
+            memset(settings.canFilters[i], 0, sizeof(settings.canFilters[i]));
     }
 
     nvPrefs.end();
@@ -154,13 +168,9 @@ void loadSettings()
 
 void setup()
 {
-#ifdef CONFIG_IDF_TARGET_ESP32S3
-    // for the ESP32S3 it will block if nothing is connected to USB and that can slow down the program
-    // if nothing is connected. But, you can't set 0 or writing rapidly to USB will lose data. It needs
-    // some sort of timeout but I'm not sure exactly how much is needed or if there is a better way
-    // to deal with this issue.
-    //  Serial.setTxTimeoutMs(2);
-#endif
+    // On the ESP32S3 writing to USB would block if nothing is connected. Frame output no longer goes through
+    // Serial.write from loop() though. TransportWriter only writes what availableForWrite() says will fit and
+    // drops (and counts) the backlog if the host stops reading, so a disconnected USB port can't stall capture.
     Serial.begin(2000000); //for production
     // Serial.begin(115200); // for testing
     // delay(2000); //just for testing. Don't use in production
@@ -183,6 +193,10 @@ void setup()
 
     canManager.setup();
 
+    transportWriter.setup();
+
+    txScheduler.setup();
+
     if (settings.enableBT)
     {
         Serial.println("Starting bluetooth");
@@ -207,6 +221,7 @@ void sendMarkTriggered(int which)
     frame.extended = true;
     frame.length = 0;
     frame.rtr = 0;
+    frame.timestamp = micros();
     canManager.displayFrame(frame, 0);
 }
 
@@ -227,38 +242,23 @@ void loop()
     // uint32_t temp32;
     bool isConnected = false;
     int serialCnt;
-    uint8_t in_byte;
+    uint8_t in_bytes[128];
 
     /*if (Serial)*/ isConnected = true;
 
     canManager.loop();
     wifiManager.loop();
 
-    size_t wifiLength = wifiGVRET.numAvailableBytes();
-    size_t serialLength = serialGVRET.numAvailableBytes();
-    size_t maxLength = (wifiLength > serialLength) ? wifiLength : serialLength;
-
-    // If the max time has passed or the buffer is almost filled then send buffered data out
-    if ((micros() - lastFlushMicros > SER_BUFF_FLUSH_INTERVAL) || (maxLength > (WIFI_BUFF_SIZE - 40)))
-    {
-        lastFlushMicros = micros();
-        if (serialLength > 0)
-        {
-            Serial.write(serialGVRET.getBufferedBytes(), serialLength);
-            serialGVRET.clearBufferedBytes();
-        }
-        if (wifiLength > 0)
-        {
-            wifiManager.sendBufferedData();
-        }
-    }
+    serialGVRET.loop();
+    wifiGVRET.loop();
 
-    serialCnt = 0;
-    while ((Serial.available() > 0) && serialCnt < 128)
+    //input waits in the driver while a long answer is going out. Reading it only to hold it would need more room
+    serialCnt = serialGVRET.isAnswerPending() ? 0 : Serial.available();
+    if (serialCnt > (int)sizeof(in_bytes)) serialCnt = sizeof(in_bytes);
+    if (serialCnt > 0)
     {
-        serialCnt++;
-        in_byte = Serial.read();
-        serialGVRET.processIncomingByte(in_byte);
+        serialCnt = Serial.read(in_bytes, serialCnt);
+        serialGVRET.processIncomingBytes(in_bytes, serialCnt);
     }
 
     elmEmulator.loop();
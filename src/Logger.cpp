@@ -156,6 +156,7 @@ boolean Logger::isDebug()
  * %% - outputs a '%' character
  * %s - prints the next parameter as string
  * %d - prints the next parameter as decimal
+ * %u - prints the next parameter as unsigned decimal
  * %f - prints the next parameter as double float
  * %x - prints the next parameter as hex value
  * %X - prints the next parameter as hex value with '0x' added before
@@ -203,6 +204,7 @@ void Logger::log(LogLevel level, const char *format, va_list args)
  * %% - outputs a '%' character
  * %s - prints the next parameter as string
  * %d - prints the next parameter as decimal
+ * %u - prints the next parameter as unsigned decimal
  * %f - prints the next parameter as double float
  * %x - prints the next parameter as hex value
  * %X - prints the next parameter as hex value with '0x' added before
@@ -242,6 +244,12 @@ void Logger::logMessage(const char *format, va_list args)
                 continue;
             }
 
+            if (*format == 'u') {
+                writeLen = sprintf((char*)&buffer[buffLen], "%u", va_arg(args, unsigned int));
+                buffLen += writeLen;
+                continue;
+            }
+
             if (*format == 'f') {
                 writeLen = sprintf((char*)&buffer[buffLen], "%.2f", va_arg(args, double));
                 buffLen += writeLen;
@@ -36,6 +36,8 @@
 #include "sys_io.h"
 #include "ELM327_Emulator.h"
 #include "can_manager.h"
+#include "tx_scheduler.h"
+#include "gvret_comm.h"
 
 extern void CANHandler();
 
@@ -84,8 +86,18 @@ void SerialConsole::printMenu()
             Logger::console("CANFDMODE%i=%i - Allow FD traffic on CAN%i (0 = Disable, 1 = Enable)", i, settings.canSettings[i].fdMode, i);
         }
         Logger::console("CANLISTENONLY%i=%i - Enable/Disable Listen Only Mode (0 = Dis, 1 = En)", i, settings.canSettings[i].listenOnly);
+        Logger::console("CAN%i bus load %i%% (peak %i%%)", i, canManager.getBusLoad(i), canManager.getBusLoadPeak(i));
+        TX_COUNTERS &tx = canManager.getTxCounters(i);
+        Logger::console("CAN%i TX queued %u sent %u failed %u dropped %u arbitration lost %u bus errors %u", i, tx.queued.load(),
+                        tx.sent.load(), tx.failed.load(), tx.dropped.load(), tx.arbLost, tx.busErrors);
         Serial.println();
         Logger::console("CANSEND%i=ID,LEN,<BYTES SEPARATED BY COMMAS> - Ex: CAN0SEND=0x200,4,1,2,3,4", i);
+        Logger::console("CAN%iFILTERn=ID,MASK,EXT,EN - Set acceptance filter n (0 - %i). Ex: CAN%iFILTER0=0x7E8,0x7F8,0,1", i, NUM_FILTERS - 1, i);
+        for (int f = 0; f < NUM_FILTERS; f++)
+        {
+            FILTER &filter = settings.canFilters[i][f];
+            if (filter.enabled) Logger::console("CAN%iFILTER%i=%X,%X,%i,1", i, f, filter.id, filter.mask, filter.extended);
+        }
         Serial.println();
     }
 
@@ -95,9 +107,89 @@ void SerialConsole::printMenu()
     Logger::console("BINSERIAL=%i - Enable/Disable Binary Sending of CANBus Frames to Serial (0=Dis, 1=En)", settings.useBinarySerialComm);
     Serial.println();
 
+    for (int i = 0; i < canManager.getNumSinks(); i++)
+    {
+        FRAME_SINK *sink = canManager.getSink(i);
+        Logger::console("SINKPOLICY%i=%i - When output %i (0=USB, 1=WiFi, 2=ELM327) is full: 0 = Drop newest, 1 = Hold off reading CAN, 2 = Drop oldest, 3 = Sample (sent %u, dropped %u)",
+                        i, sink->policy, i, sink->framesSent, sink->framesDropped);
+        if (sink->type != SINK_ELM)
+            Logger::console("SINKSAMPLE%i=%i - Send 1 in this many frames of each bus while output %i is short of room (policy 3)", i, sink->sampleRate, i);
+        if (sink->type != SINK_ELM)
+            Logger::console("SINKREDUCE%i=%i - Send output %i through the frame reduction below (0 = Dis, 1 = En)", i, sink->reduce, i);
+    }
+    Logger::console("TXPOLICY%i=%i - When the diagnostic TX queue (console, ELM327) is full: 0 = Drop frame, 1 = Wait for room", TX_PRIO_DIAG, canManager.getTxPolicy(TX_PRIO_DIAG));
+    Logger::console("TXPOLICY%i=%i - When the bulk TX queue (GVRET) is full: 0 = Drop frame, 1 = Wait for room", TX_PRIO_BULK, canManager.getTxPolicy(TX_PRIO_BULK));
+    Logger::console("REDUCEMODE=%i - Cut down repeated frames (0 = Off, 1 = Only changed payloads, 2 = Rate limit each ID) (%u held back, %u IDs tracked)",
+                    settings.reduceMode, canManager.getReducer().getFramesSuppressed(), canManager.getReducer().getTableUsed());
+    Logger::console("REDUCEINTERVAL=%i - Minimum ms between frames of one ID when rate limiting", settings.reduceInterval);
+    Logger::console("REDUCEREFRESH=%i - Resend an unchanged frame after this many ms in changed only mode (0 = never)", settings.reduceRefresh);
+    Logger::console("RX queue peak %u of %u frames, FD queue peak %u of %u, times full %u", canManager.getRxQueuePeak(), RX_QUEUE_SIZE,
+                    canManager.getRxFDQueuePeak(), RX_FD_QUEUE_SIZE, canManager.getRxQueueFull());
+    for (int i = 0; i < SysSettings.numBuses; i++)
+    {
+        if (canManager.getCaptureDropped(i)) Logger::console("CAN%i: %u frames read for the gateway while the RX queue was full, not captured", i, canManager.getCaptureDropped(i));
+    }
+    Logger::console("Frames dropped by acceptance filters: %u", canManager.getFramesFiltered());
+    for (int i = 0; i < canManager.getNumSinks(); i++)
+    {
+        FRAME_SINK *sink = canManager.getSink(i);
+        if (sink->buffer) Logger::console("Output %i: %u bytes refused for lack of room, %u queued bytes thrown away unsent", i,
+                                          sink->buffer->getOverflowCount(), sink->buffer->getDiscardedBytes());
+    }
+    Logger::console("DROPSTATS=<bus> - List frames each output lost from a bus and why (-1 = all buses)");
+    for (int i = 0; i < SysSettings.numBuses; i++)
+    {
+        BUS_HEALTH &h = canManager.getBusMonitor().getHealth(i);
+        Logger::console("CAN%i %s TEC %i REC %i: bus errors %u, TX failed %u, driver RX full %u, FIFO overruns %u, capture full %u",
+                        i, busStateName(h.state), h.tec, h.rec, h.events[EVENT_BUS_ERROR], h.events[EVENT_TX_FAILED],
+                        h.events[EVENT_RX_MISSED], h.events[EVENT_RX_OVERRUN], h.events[EVENT_CAPTURE_FULL]);
+    }
+    Logger::console("BUSEVENTS=<bus> - List error state changes and lost frames, newest last (-1 = all buses) (%i kept)",
+                    canManager.getBusMonitor().getNumHistory());
+    JITTER_STATS &jitter = canManager.getJitterStats();
+    if (jitter.active && jitter.frames > 1)
+        Logger::console("JITTERID=%X - Time between received frames with this ID (%u frames, min %uus, avg %uus, max %uus)",
+                        jitter.id, jitter.frames, jitter.minDelta, (uint32_t)(jitter.totalDelta / (jitter.frames - 1)), jitter.maxDelta);
+    else Logger::console("JITTERID=%X - Time between received frames with this ID (not enough frames yet)", jitter.id);
+    Serial.println();
+    Logger::console("TXFRAMEn=BUS,ID,LEN,<BYTES SEPARATED BY COMMAS> - Frame for periodic slot n (0 - %i)", NUM_PERIODIC - 1);
+    Logger::console("TXPERIODn=PERIOD,OFFSET,BURST - Send slot n every PERIOD us after OFFSET us, BURST frames each time (0 = stop)");
+    Logger::console("TXCOUNTERn=CTRBYTE,CTRMASK,CHKBYTE,CHKTYPE - Rolling counter bits and checksum byte (255 = none, 1 = XOR, 2 = sum)");
+    for (int p = 0; p < NUM_PERIODIC; p++)
+    {
+        PERIODIC_FRAME e = txScheduler.getEntry(p);
+        if (!e.active) continue;
+        Logger::console("TX%i CAN%i ID %x every %uus: sent %u missed %u period min %uus avg %uus max %uus", p, e.bus, e.frame.id, e.period,
+                        e.sent, e.missed, (e.sent > 1) ? e.minPeriod : 0, (e.sent > 1) ? (uint32_t)(e.totalPeriod / (e.sent - 1)) : 0, e.maxPeriod);
+    }
+    Logger::console("IDSTATS=<bus> - List count, period and last data of every ID seen on a bus (-1 = all buses, -2 = clear) (%i IDs)",
+                    canManager.getIdStats().getNumEntries());
+    Serial.println();
+
+    Logger::console("GWRULEn=SRC,DST,ID,MASK,EXT,EN,BLOCK[,NEWID,NEWIDMASK] - Forward matching frames from bus SRC to DST (n = 0 - %i, first match wins)",
+                    NUM_GATEWAY_RULES - 1);
+    Logger::console("GWDATAn=MASK,VALUE - Replace the payload bits set in MASK with VALUE. 16 hex digits each, byte 0 first");
+    for (int r = 0; r < NUM_GATEWAY_RULES; r++)
+    {
+        GATEWAY_RULE &rule = settings.gatewayRules[r];
+        if (!rule.enabled) continue;
+        Logger::console("GWRULE%i=%i,%i,%x,%x,%i,1,%i,%x,%x (%u forwarded)", r, rule.srcBus, rule.dstBus, rule.id, rule.mask, rule.extended,
+                        rule.block, rule.newId, rule.newIdMask, canManager.getGatewayStats().forwarded[r]);
+    }
+    GATEWAY_STATS &gw = canManager.getGatewayStats();
+    Logger::console("Gateway: %u blocked, %u loops stopped, %u dropped, latency min %uus avg %uus max %uus", gw.blocked, gw.loops, gw.dropped,
+                    gw.latencyCount ? gw.latencyMin : 0, gw.latencyCount ? (uint32_t)(gw.latencyTotal / gw.latencyCount) : 0, gw.latencyMax);
+    Serial.println();
+
     Logger::console("BTMODE=%i - Set mode for Bluetooth (0 = Off, 1 = On)", settings.enableBT);
     Logger::console("BTNAME=%s - Set advertised Bluetooth name", settings.btName);
     Logger::console("SENDBUS=%i - Set which CAN bus to send messages from ELM327 emulator", settings.sendingBus);
+    ELM_CACHE_STATS &cache = elmEmulator.getCache().getStats();
+    Logger::console("ELMCACHE=%i - Answer repeated OBDII requests from a cache (0 = Off, 1 = On, 2 = On and refresh stale answers in the background) (-1 = clear)",
+                    settings.elmCacheMode);
+    Logger::console("ELMCACHETTL=%i - ms an answer stays fresh for PIDs without a TTL of their own", settings.elmCacheTtl);
+    Logger::console("ELM327 cache: %u hits, %u stale hits, %u misses, %u filled from other testers, %i requests held",
+                    cache.hits, cache.staleHits, cache.misses, cache.passiveFills, elmEmulator.getCache().getNumEntries());
     Serial.println();
 
     Logger::console("LAWICEL=%i - Set whether to accept LAWICEL commands (0 = Off, 1 = On)", settings.enableLawicel);
@@ -224,6 +316,7 @@ void SerialConsole::handleConfigCmd()
             //CAN0.enable();
             canBuses[idx]->begin(settings.canSettings[idx].nomSpeed, 255);
             canBuses[idx]->watchFor();
+            canManager.applyFilters(idx);
         }
         else canBuses[idx]->disable();
         writeEEPROM = true;
@@ -290,38 +383,30 @@ void SerialConsole::handleConfigCmd()
             }
             writeEEPROM = true;
         } else Logger::console("Invalid setting! Enter a value 0 - 1");
-    } else if (cmdString == String("CAN0FILTER0")) { //someone should kick me in the face for this laziness... FIX THIS!
-        handleFilterSet(0, 0, newString);
-    } else if (cmdString == String("CAN0FILTER1")) {
-        if (handleFilterSet(0, 1, newString)) writeEEPROM = true;
-    } else if (cmdString == String("CAN0FILTER2")) {
-        if (handleFilterSet(0, 2, newString)) writeEEPROM = true;
-    } else if (cmdString == String("CAN0FILTER3")) {
-        if (handleFilterSet(0, 3, newString)) writeEEPROM = true;
-    } else if (cmdString == String("CAN0FILTER4")) {
-        if (handleFilterSet(0, 4, newString)) writeEEPROM = true;
-    } else if (cmdString == String("CAN0FILTER5")) {
-        if (handleFilterSet(0, 5, newString)) writeEEPROM = true;
-    } else if (cmdString == String("CAN0FILTER6")) {
-        if (handleFilterSet(0, 6, newString)) writeEEPROM = true;
-    } else if (cmdString == String("CAN0FILTER7")) {
-        if (handleFilterSet(0, 7, newString)) writeEEPROM = true;
-    } else if (cmdString == String("CAN1FILTER0")) {
-        if (handleFilterSet(1, 0, newString)) writeEEPROM = true;
-    } else if (cmdString == String("CAN1FILTER1")) {
-        if (handleFilterSet(1, 1, newString)) writeEEPROM = true;
-    } else if (cmdString == String("CAN1FILTER2")) {
-        if (handleFilterSet(1, 2, newString)) writeEEPROM = true;
-    } else if (cmdString == String("CAN1FILTER3")) {
-        if (handleFilterSet(1, 3, newString)) writeEEPROM = true;
-    } else if (cmdString == String("CAN1FILTER4")) {
-        if (handleFilterSet(1, 4, newString)) writeEEPROM = true;
-    } else if (cmdString == String("CAN1FILTER5")) {
-        if (handleFilterSet(1, 5, newString)) writeEEPROM = true;
-    } else if (cmdString == String("CAN1FILTER6")) {
-        if (handleFilterSet(1, 6, newString)) writeEEPROM = true;
-    } else if (cmdString == String("CAN1FILTER7")) {
-        if (handleFilterSet(1, 7, newString)) writeEEPROM = true;
+    } else if (cmdString.startsWith("CAN") && cmdString.indexOf("FILTER") == 4) { //CAN0FILTER0 - CAN4FILTER31
+        int bus = cmdString[3] - '0';
+        int filter = cmdString.substring(10).toInt();
+        if (cmdString.length() > 10 && handleFilterSet(bus, filter, newString)) writeEEPROM = true;
+    } else if (cmdString.startsWith("TXPOLICY")) {
+        int idx = cmdString[cmdString.length() - 1] - '0';
+        if (idx != TX_PRIO_DIAG && idx != TX_PRIO_BULK) Logger::console("Only TXPOLICY%i and TXPOLICY%i can be changed", TX_PRIO_DIAG, TX_PRIO_BULK);
+        else
+        {
+            if (newValue < 0) newValue = 0;
+            if (newValue > 1) newValue = 1;
+            Logger::console("Setting TX queue %i policy to %s", idx, newValue ? "wait" : "drop");
+            canManager.setTxPolicy((TX_PRIORITY)idx, (TX_POLICY)newValue);
+        }
+    } else if (cmdString.startsWith("GWRULE")) {
+        if (handleGatewaySet(0, cmdString.substring(6).toInt(), newString)) writeEEPROM = true;
+    } else if (cmdString.startsWith("GWDATA")) {
+        if (handleGatewaySet(1, cmdString.substring(6).toInt(), newString)) writeEEPROM = true;
+    } else if (cmdString.startsWith("TXFRAME")) {
+        handlePeriodicSet(0, cmdString.substring(7).toInt(), newString);
+    } else if (cmdString.startsWith("TXPERIOD")) {
+        handlePeriodicSet(1, cmdString.substring(8).toInt(), newString);
+    } else if (cmdString.startsWith("TXCOUNTER")) {
+        handlePeriodicSet(2, cmdString.substring(9).toInt(), newString);
     } else if (cmdString.startsWith("CANSEND")) {
         int idx = cmdString[cmdString.length() - 1] - '0';
         if (idx < 0) idx = 0;
@@ -334,7 +419,68 @@ void SerialConsole::handleConfigCmd()
         if (newValue > 1) newValue = 1;
         Logger::console("Setting Serial Binary Comm to %i", newValue);
         settings.useBinarySerialComm = newValue;
+        serialGVRET.setBinaryMode(newValue);
         writeEEPROM = true;
+    } else if (cmdString.startsWith("SINKPOLICY")) {
+        int idx = cmdString[cmdString.length() - 1] - '0';
+        if (idx < 0 || idx >= canManager.getNumSinks()) Logger::console("Invalid output number");
+        else
+        {
+            static const char *policyNames[NUM_SINK_POLICIES] = {"drop newest", "hold off", "drop oldest", "sample"};
+            if (newValue < 0) newValue = 0;
+            if (newValue >= NUM_SINK_POLICIES) newValue = NUM_SINK_POLICIES - 1;
+            Logger::console("Setting output %i policy to %s", idx, policyNames[newValue]);
+            canManager.setSinkPolicy(idx, (SINK_POLICY)newValue);
+        }
+    } else if (cmdString.startsWith("SINKSAMPLE")) {
+        int idx = cmdString[cmdString.length() - 1] - '0';
+        if (idx < 0 || idx >= canManager.getNumSinks()) Logger::console("Invalid output number");
+        else if (newValue >= 2 && newValue <= 255)
+        {
+            Logger::console("Output %i will send 1 in %i frames when short of room", idx, newValue);
+            canManager.setSinkSampleRate(idx, newValue);
+        }
+        else Logger::console("Invalid setting! Enter a value 2 - 255");
+    } else if (cmdString.startsWith("SINKREDUCE")) {
+        int idx = cmdString[cmdString.length() - 1] - '0';
+        if (idx < 0 || idx >= canManager.getNumSinks()) Logger::console("Invalid output number");
+        else
+        {
+            if (newValue < 0) newValue = 0;
+            if (newValue > 1) newValue = 1;
+            Logger::console("Setting output %i frame reduction to %i", idx, newValue);
+            canManager.setSinkReduce(idx, newValue);
+        }
+    } else if (cmdString == String("REDUCEMODE")) {
+        if (newValue >= REDUCE_OFF && newValue <= REDUCE_RATE) {
+            Logger::console("Setting frame reduction mode to %i", newValue);
+            settings.reduceMode = newValue;
+            canManager.applyReduceSettings();
+            writeEEPROM = true;
+        } else Logger::console("Invalid setting! Enter a value 0 - 2");
+    } else if (cmdString == String("REDUCEINTERVAL")) {
+        if (newValue >= 1 && newValue <= 60000) {
+            Logger::console("Setting frame reduction interval to %ims", newValue);
+            settings.reduceInterval = newValue;
+            canManager.applyReduceSettings();
+            writeEEPROM = true;
+        } else Logger::console("Invalid setting! Enter a value 1 - 60000");
+    } else if (cmdString == String("REDUCEREFRESH")) {
+        if (newValue >= 0 && newValue <= 60000) {
+            Logger::console("Setting frame reduction refresh to %ims", newValue);
+            settings.reduceRefresh = newValue;
+            canManager.applyReduceSettings();
+            writeEEPROM = true;
+        } else Logger::console("Invalid setting! Enter a value 0 - 60000");
+    } else if (cmdString == String("IDSTATS")) {
+        printIdStats(newValue);
+    } else if (cmdString == String("BUSEVENTS")) {
+        printBusEvents(newValue);
+    } else if (cmdString == String("DROPSTATS")) {
+        printDropStats(newValue);
+    } else if (cmdString == String("JITTERID")) {
+        Logger::console("Timing received frames with ID %X", newValue);
+        canManager.setJitterWatch(newValue);
     } else if (cmdString == String("BTMODE")) {
         if (newValue < 0) newValue = 0;
         if (newValue > 1) newValue = 1;
@@ -354,6 +500,22 @@ void SerialConsole::handleConfigCmd()
         settings.sendingBus = newValue;
         elmEmulator.setSendingBus(newValue);
         writeEEPROM = true;
+    } else if (cmdString == String("ELMCACHE")) {
+        if (newValue >= ELM_CACHE_OFF && newValue <= ELM_CACHE_REFRESH) {
+            Logger::console("Setting ELM327 cache mode to %i", newValue);
+            settings.elmCacheMode = newValue;
+            elmEmulator.getCache().clear();
+            writeEEPROM = true;
+        } else if (newValue == -1) {
+            Logger::console("Clearing ELM327 cache");
+            elmEmulator.getCache().clear();
+        } else Logger::console("Invalid setting! Enter a value -1 - 2");
+    } else if (cmdString == String("ELMCACHETTL")) {
+        if (newValue >= 10 && newValue <= 60000) {
+            Logger::console("Setting ELM327 cache TTL to %ims", newValue);
+            settings.elmCacheTtl = newValue;
+            writeEEPROM = true;
+        } else Logger::console("Invalid setting! Enter a value 10 - 60000");
     } else if (cmdString == String("LAWICEL")) {
         if (newValue < 0) newValue = 0;
         if (newValue > 1) newValue = 1;
@@ -442,12 +604,20 @@ void SerialConsole::handleConfigCmd()
             nvPrefs.putUInt(buff, settings.canSettings[i].fdSpeed);
             sprintf(buff, "can%i-fdmode", i);
             nvPrefs.putBool(buff, settings.canSettings[i].fdMode);
+            sprintf(buff, "can%i-filters", i);
+            nvPrefs.putBytes(buff, settings.canFilters[i], sizeof(settings.canFilters[i]));
         }
         
         nvPrefs.putBool("binarycomm", settings.useBinarySerialComm);
         nvPrefs.putBool("enable-bt", settings.enableBT);
         nvPrefs.putInt("sendingBus", settings.sendingBus);
+        nvPrefs.putUChar("elmcache", settings.elmCacheMode);
+        nvPrefs.putUShort("elmcachettl", settings.elmCacheTtl);
         nvPrefs.putBool("enableLawicel", settings.enableLawicel);
+        nvPrefs.putUChar("reducemode", settings.reduceMode);
+        nvPrefs.putUShort("reduceint", settings.reduceInterval);
+        nvPrefs.putUShort("reducerefresh", settings.reduceRefresh);
+        nvPrefs.putBytes("gateway", settings.gatewayRules, sizeof(settings.gatewayRules));
         nvPrefs.putUChar("loglevel", settings.logLevel);
         nvPrefs.putUChar("systype", settings.systemType);
         nvPrefs.putUChar("wifiMode", settings.wifiMode);
@@ -459,10 +629,10 @@ void SerialConsole::handleConfigCmd()
 } 
 
 //CAN0FILTER%i=%%i,%%i,%%i,%%i (ID, Mask, Extended, Enabled)", i);
-bool SerialConsole::handleFilterSet(uint8_t bus, uint8_t filter, char *values)
+bool SerialConsole::handleFilterSet(int bus, int filter, char *values)
 {
-    if (filter < 0 || filter > 7) return false;
-    if (bus < 0 || bus > 1) return false;
+    if (filter < 0 || filter >= NUM_FILTERS) return false;
+    if (bus < 0 || bus >= SysSettings.numBuses) return false;
 
     //there should be four tokens
     char *idTok = strtok(values, ",");
@@ -475,28 +645,179 @@ bool SerialConsole::handleFilterSet(uint8_t bus, uint8_t filter, char *values)
     if (!extTok) return false;
     if (!enTok) return false;
 
-    int idVal = strtol(idTok, NULL, 0);
-    int maskVal = strtol(maskTok, NULL, 0);
+    uint32_t idVal = strtoul(idTok, NULL, 0);
+    uint32_t maskVal = strtoul(maskTok, NULL, 0);
     int extVal = strtol(extTok, NULL, 0);
     int enVal = strtol(enTok, NULL, 0);
 
     Logger::console("Setting CAN%iFILTER%i to ID 0x%x Mask 0x%x Extended %i Enabled %i", bus, filter, idVal, maskVal, extVal, enVal);
 
-    if (bus == 0) {
-        //settings.CAN0Filters[filter].id = idVal;
-        //settings.CAN0Filters[filter].mask = maskVal;
-        //settings.CAN0Filters[filter].extended = extVal;
-        //settings.CAN0Filters[filter].enabled = enVal;
-        //CAN0.setRXFilter(filter, idVal, maskVal, extVal);
-    } else if (bus == 1) {
-        //settings.CAN1Filters[filter].id = idVal;
-        //settings.CAN1Filters[filter].mask = maskVal;
-        //settings.CAN1Filters[filter].extended = extVal;
-        //settings.CAN1Filters[filter].enabled = enVal;
-        //CAN1.setRXFilter(filter, idVal, maskVal, extVal);
+    return canManager.setFilter(bus, filter, idVal, maskVal, extVal != 0, enVal != 0);
+}
+
+void SerialConsole::printIdStats(int bus)
+{
+    IdStatsTable &stats = canManager.getIdStats();
+    if (bus == -2)
+    {
+        stats.requestClear(); //the RX task owns the table
+        Logger::console("ID statistics cleared");
+        return;
+    }
+    for (int i = 0; i < stats.getNumEntries(); i++)
+    {
+        const ID_STATS_ENTRY &e = stats.getEntry(i);
+        if (bus >= 0 && e.bus != bus) continue;
+        char dataStr[25];
+        int len = (e.length > 8) ? 8 : e.length;
+        for (int d = 0; d < len; d++) sprintf(&dataStr[d * 3], "%02X ", e.data[d]);
+        dataStr[len * 3] = 0;
+        if (e.count > 1)
+            Logger::console("CAN%i %x %s len %i count %u period min %uus avg %uus max %uus data %s", e.bus, e.id & 0x7FFFFFFF,
+                            (e.id & (1ul << 31)) ? "X" : "S", e.length, e.count, e.minPeriod,
+                            (uint32_t)(e.totalPeriod / (e.count - 1)), e.maxPeriod, dataStr);
+        else
+            Logger::console("CAN%i %x %s len %i count %u data %s", e.bus, e.id & 0x7FFFFFFF,
+                            (e.id & (1ul << 31)) ? "X" : "S", e.length, e.count, dataStr);
     }
+    Logger::console("%i IDs, %u frames from IDs that didn't fit in the table", stats.getNumEntries(), stats.getFramesUntracked());
+}
 
-    return true;
+const char *SerialConsole::busStateName(uint8_t state)
+{
+    switch (state)
+    {
+    case 0: return "stopped";
+    case 1: return "running";
+    case 2: return "bus off";
+    case 3: return "recovering";
+    }
+    return "state unknown";
+}
+
+//Sink drops have no bus so they show up whatever bus is asked for
+void SerialConsole::printBusEvents(int bus)
+{
+    BusMonitor &monitor = canManager.getBusMonitor();
+    int shown = 0;
+    for (int i = 0; i < monitor.getNumHistory(); i++)
+    {
+        const BUS_EVENT &e = monitor.getHistory(i);
+        if (e.type == EVENT_SINK_DROPPED)
+        {
+            Logger::console("%u: output %i dropped %i frames", e.timestamp, e.bus, e.count);
+            shown++;
+            continue;
+        }
+        if (bus >= 0 && e.bus != bus) continue;
+        Logger::console("%u: CAN%i %s x%i (TEC %i REC %i)", e.timestamp, e.bus, BusMonitor::eventName(e.type), e.count, e.tec, e.rec);
+        shown++;
+    }
+    Logger::console("%i events, %u more never made it out of the RX task", shown, monitor.getQueueFull());
+}
+
+void SerialConsole::printDropStats(int bus)
+{
+    for (int b = 0; b < SysSettings.numBuses; b++)
+    {
+        if (bus >= 0 && b != bus) continue;
+        BUS_HEALTH &h = canManager.getBusMonitor().getHealth(b);
+        Logger::console("CAN%i lost by the controller %u, held in the driver %u times", b,
+                        h.events[EVENT_RX_MISSED] + h.events[EVENT_RX_OVERRUN], h.events[EVENT_CAPTURE_FULL]);
+        for (int s = 0; s < canManager.getNumSinks(); s++)
+        {
+            FRAME_SINK *sink = canManager.getSink(s);
+            Logger::console("  output %i: no room %u, oldest dropped %u, sampled out %u", s, sink->dropped[b][DROP_FULL],
+                            sink->dropped[b][DROP_EVICTED], sink->dropped[b][DROP_SAMPLED]);
+        }
+    }
+}
+
+//what: 0 = TXFRAME, 1 = TXPERIOD, 2 = TXCOUNTER
+bool SerialConsole::handlePeriodicSet(int what, int slot, char *values)
+{
+    uint32_t vals[11];
+    int count = 0;
+    char *tok = strtok(values, ",");
+    while (tok && count < 11)
+    {
+        vals[count++] = strtoul(tok, NULL, 0);
+        tok = strtok(NULL, ",");
+    }
+
+    bool ok = false;
+    if (what == 0 && count >= 3 && vals[2] <= 8 && count == (int)(3 + vals[2]))
+    {
+        CAN_FRAME frame;
+        frame.id = vals[1];
+        frame.extended = (vals[1] > 0x7FF);
+        frame.rtr = 0;
+        frame.length = vals[2];
+        for (int i = 0; i < frame.length; i++) frame.data.uint8[i] = vals[3 + i];
+        ok = txScheduler.setFrame(slot, vals[0], frame);
+    }
+    else if (what == 1 && count >= 1)
+    {
+        ok = txScheduler.setPeriod(slot, vals[0], (count > 1) ? vals[1] : 0, (count > 2) ? vals[2] : 1);
+    }
+    else if (what == 2 && count == 4)
+    {
+        ok = txScheduler.setCounter(slot, vals[0], vals[1], vals[2], (PERIODIC_CHECKSUM)vals[3]);
+    }
+
+    if (ok) Logger::console("Periodic slot %i updated", slot);
+    else Logger::console("Invalid periodic frame setting");
+    return ok;
+}
+
+//what: 0 = GWRULE, 1 = GWDATA. The rest of the rule is kept so the two can be set in either order
+bool SerialConsole::handleGatewaySet(int what, int slot, char *values)
+{
+    if (slot < 0 || slot >= NUM_GATEWAY_RULES)
+    {
+        Logger::console("Invalid gateway rule number");
+        return false;
+    }
+    GATEWAY_RULE rule = settings.gatewayRules[slot];
+    char *toks[9];
+    int count = 0;
+    char *tok = strtok(values, ",");
+    while (tok && count < 9)
+    {
+        toks[count++] = tok;
+        tok = strtok(NULL, ",");
+    }
+
+    bool ok = false;
+    if (what == 0 && (count == 7 || count == 9))
+    {
+        rule.srcBus = strtoul(toks[0], NULL, 0);
+        rule.dstBus = strtoul(toks[1], NULL, 0);
+        rule.id = strtoul(toks[2], NULL, 0);
+        rule.mask = strtoul(toks[3], NULL, 0);
+        rule.extended = strtoul(toks[4], NULL, 0) != 0;
+        rule.enabled = strtoul(toks[5], NULL, 0) != 0;
+        rule.block = strtoul(toks[6], NULL, 0) != 0;
+        rule.newId = (count == 9) ? strtoul(toks[7], NULL, 0) : 0;
+        rule.newIdMask = (count == 9) ? strtoul(toks[8], NULL, 0) : 0;
+        ok = true;
+    }
+    else if (what == 1 && count == 2 && strlen(toks[0]) == 16 && strlen(toks[1]) == 16)
+    {
+        uint64_t mask = strtoull(toks[0], NULL, 16);
+        uint64_t value = strtoull(toks[1], NULL, 16);
+        for (int i = 0; i < 8; i++)
+        {
+            rule.dataMask[i] = mask >> (56 - i * 8);
+            rule.dataValue[i] = value >> (56 - i * 8);
+        }
+        ok = true;
+    }
+
+    if (ok) ok = canManager.setGatewayRule(slot, rule);
+    if (ok) Logger::console("Gateway rule %i updated", slot);
+    else Logger::console("Invalid gateway rule setting");
+    return ok;
 }
 
 bool SerialConsole::handleCANSend(CAN_COMMON &port, char *inputString)
@@ -524,7 +845,11 @@ bool SerialConsole::handleCANSend(CAN_COMMON &port, char *inputString)
     else frame.extended = false;
     frame.rtr = 0;
     frame.length = lenVal;
-    port.sendFrame(frame);
+    if (!canManager.sendFrame(&port, frame, TX_PRIO_DIAG))
+    {
+        Logger::console("TX queue full, frame dropped");
+        return false;
+    }
     
     Logger::console("Sending frame with id: 0x%x len: %i", frame.id, frame.length);
     return true;
@@ -53,7 +53,13 @@ private:
     void handleConsoleCmd();
     void handleShortCmd();
     void handleConfigCmd();
-    bool handleFilterSet(uint8_t bus, uint8_t filter, char *values);
+    bool handleFilterSet(int bus, int filter, char *values);
+    void printIdStats(int bus);
+    void printBusEvents(int bus);
+    void printDropStats(int bus);
+    static const char *busStateName(uint8_t state);
+    bool handlePeriodicSet(int what, int slot, char *values);
+    bool handleGatewaySet(int what, int slot, char *values);
     bool handleCANSend(CAN_COMMON &port, char *inputString);
     bool handleSWCANSend(char *inputString);
 };
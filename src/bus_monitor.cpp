@@ -0,0 +1,185 @@
+#include "bus_monitor.h"
+#include <driver/twai.h>
+
+#define ERROR_WARNING_LIMIT 96
+#define ERROR_PASSIVE_LIMIT 128
+
+BusMonitor::BusMonitor()
+{
+    memset(health, 0, sizeof(health));
+    for (int i = 0; i < NUM_BUSES; i++) health[i].state = 0xFF;
+    memset(captureFull, 0, sizeof(captureFull));
+    memset(lastCaptureFull, 0, sizeof(lastCaptureFull));
+    queueFull = 0;
+    historyCount = 0;
+    twaiBus = -1;
+    lastPoll = 0;
+    lastMissed = lastOverrun = lastBusErrors = lastTxFailed = 0;
+    lastState = TWAI_STATE_RUNNING;
+    lastLevel = 0;
+}
+
+//Counts start from whatever the driver already has so nothing from before setup() shows up as an event
+void BusMonitor::setup(int twai)
+{
+    twaiBus = twai;
+    if (twaiBus < 0) return;
+    twai_status_info_t status;
+    if (twai_get_status_info(&status) != ESP_OK)
+    {
+        twaiBus = -1;
+        return;
+    }
+    lastMissed = status.rx_missed_count;
+    lastOverrun = status.rx_overrun_count;
+    lastBusErrors = status.bus_error_count;
+    lastTxFailed = status.tx_failed_count;
+    health[twaiBus].state = status.state;
+}
+
+void BusMonitor::noteCaptureFull(int bus)
+{
+    captureFull[bus]++;
+}
+
+//Called every RX task tick but only looks every BUS_MONITOR_PERIOD ms. Anything that happened more than once in
+//between becomes one event with a count.
+void BusMonitor::poll()
+{
+    if ((millis() - lastPoll) < BUS_MONITOR_PERIOD) return;
+    lastPoll = millis();
+
+    for (int i = 0; i < NUM_BUSES; i++)
+    {
+        uint32_t full = captureFull[i];
+        if (full != lastCaptureFull[i]) addEvent(i, EVENT_CAPTURE_FULL, full - lastCaptureFull[i]);
+        lastCaptureFull[i] = full;
+    }
+
+    if (twaiBus < 0) return;
+    twai_status_info_t status;
+    if (twai_get_status_info(&status) != ESP_OK) return;
+
+    BUS_HEALTH &h = health[twaiBus];
+    h.tec = (status.tx_error_counter > 255) ? 255 : status.tx_error_counter;
+    h.rec = (status.rx_error_counter > 255) ? 255 : status.rx_error_counter;
+    h.state = status.state;
+
+    if (status.rx_missed_count != lastMissed) addEvent(twaiBus, EVENT_RX_MISSED, status.rx_missed_count - lastMissed);
+    if (status.rx_overrun_count != lastOverrun) addEvent(twaiBus, EVENT_RX_OVERRUN, status.rx_overrun_count - lastOverrun);
+    if (status.bus_error_count != lastBusErrors) addEvent(twaiBus, EVENT_BUS_ERROR, status.bus_error_count - lastBusErrors);
+    if (status.tx_failed_count != lastTxFailed) addEvent(twaiBus, EVENT_TX_FAILED, status.tx_failed_count - lastTxFailed);
+    lastMissed = status.rx_missed_count;
+    lastOverrun = status.rx_overrun_count;
+    lastBusErrors = status.bus_error_count;
+    lastTxFailed = status.tx_failed_count;
+
+    if (status.state != lastState)
+    {
+        if (status.state == TWAI_STATE_BUS_OFF) addEvent(twaiBus, EVENT_BUS_OFF, 1);
+        else if (status.state == TWAI_STATE_RECOVERING) addEvent(twaiBus, EVENT_RECOVERING, 1);
+        else if (status.state == TWAI_STATE_RUNNING) addEvent(twaiBus, EVENT_RUNNING, 1);
+        lastState = status.state;
+    }
+
+    //bus off is its own event, the error levels only mean something while the controller is taking part
+    if (status.state != TWAI_STATE_RUNNING) return;
+    uint32_t worst = (status.tx_error_counter > status.rx_error_counter) ? status.tx_error_counter : status.rx_error_counter;
+    uint8_t level = (worst >= ERROR_PASSIVE_LIMIT) ? 2 : (worst >= ERROR_WARNING_LIMIT) ? 1 : 0;
+    if (level != lastLevel)
+    {
+        if (level == 2) addEvent(twaiBus, EVENT_ERROR_PASSIVE, 1);
+        else if (level == 1 && lastLevel == 0) addEvent(twaiBus, EVENT_ERROR_WARNING, 1);
+        else if (level == 0) addEvent(twaiBus, EVENT_ERROR_ACTIVE, 1);
+        lastLevel = level;
+    }
+}
+
+void BusMonitor::addEvent(int bus, BUS_EVENT_TYPE type, uint32_t count)
+{
+    health[bus].events[type] += count;
+    BUS_EVENT *event = pending.reserve();
+    if (!event)
+    {
+        queueFull++;
+        return;
+    }
+    event->timestamp = micros();
+    event->count = (count > 0xFFFF) ? 0xFFFF : count;
+    event->bus = bus;
+    event->type = type;
+    event->tec = health[bus].tec;
+    event->rec = health[bus].rec;
+    pending.commit();
+}
+
+bool BusMonitor::nextEvent(BUS_EVENT &event)
+{
+    BUS_EVENT *next = pending.front();
+    if (!next) return false;
+    event = *next;
+    pending.pop();
+    record(event);
+    return true;
+}
+
+BUS_EVENT BusMonitor::noteSinkDropped(int sink, uint32_t count)
+{
+    BUS_EVENT event;
+    event.timestamp = micros();
+    event.count = (count > 0xFFFF) ? 0xFFFF : count;
+    event.bus = sink;
+    event.type = EVENT_SINK_DROPPED;
+    event.tec = 0;
+    event.rec = 0;
+    record(event);
+    return event;
+}
+
+void BusMonitor::record(const BUS_EVENT &event)
+{
+    history[historyCount % BUS_EVENT_HISTORY] = event;
+    historyCount++;
+}
+
+const BUS_EVENT &BusMonitor::getHistory(int i)
+{
+    uint32_t oldest = historyCount - getNumHistory();
+    return history[(oldest + i) % BUS_EVENT_HISTORY];
+}
+
+//BUS TYPE TIMESTAMP(4) COUNT(2) TEC REC, little endian
+size_t BusMonitor::encode(uint8_t *out, const BUS_EVENT &event)
+{
+    out[0] = event.bus;
+    out[1] = event.type;
+    out[2] = event.timestamp;
+    out[3] = event.timestamp >> 8;
+    out[4] = event.timestamp >> 16;
+    out[5] = event.timestamp >> 24;
+    out[6] = event.count;
+    out[7] = event.count >> 8;
+    out[8] = event.tec;
+    out[9] = event.rec;
+    return BUS_EVENT_LENGTH;
+}
+
+const char *BusMonitor::eventName(uint8_t type)
+{
+    switch (type)
+    {
+    case EVENT_RX_MISSED: return "RX queue full";
+    case EVENT_RX_OVERRUN: return "RX FIFO overrun";
+    case EVENT_BUS_ERROR: return "Bus error";
+    case EVENT_TX_FAILED: return "TX failed";
+    case EVENT_ERROR_WARNING: return "Error warning";
+    case EVENT_ERROR_PASSIVE: return "Error passive";
+    case EVENT_ERROR_ACTIVE: return "Error active";
+    case EVENT_BUS_OFF: return "Bus off";
+    case EVENT_RECOVERING: return "Recovering";
+    case EVENT_RUNNING: return "Running";
+    case EVENT_CAPTURE_FULL: return "Capture queue full";
+    case EVENT_SINK_DROPPED: return "Sink dropped";
+    }
+    return "Unknown";
+}
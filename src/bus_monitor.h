@@ -0,0 +1,88 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+#include "frame_queue.h"
+
+#define BUS_EVENT_HISTORY   64  //newest events kept for queries
+#define BUS_EVENT_QUEUE     32  //events on their way from the RX task to loop(). Must be a power of two
+#define BUS_MONITOR_PERIOD  10  //ms between looks at the controller. Repeats in between are merged into one event
+
+//What happened. Values go out in PROTO_BUS_EVENT records so don't renumber them
+enum BUS_EVENT_TYPE
+{
+    EVENT_RX_MISSED = 0,        //driver RX queue was full and frames were lost (TWAI_ALERT_RX_QUEUE_FULL)
+    EVENT_RX_OVERRUN = 1,       //controller RX FIFO overran (TWAI_ALERT_RX_FIFO_OVERRUN)
+    EVENT_BUS_ERROR = 2,        //bit, stuff, CRC, form or ACK errors (TWAI_ALERT_BUS_ERROR)
+    EVENT_TX_FAILED = 3,        //TWAI_ALERT_TX_FAILED
+    EVENT_ERROR_WARNING = 4,    //TEC or REC reached 96 (TWAI_ALERT_ABOVE_ERR_WARN)
+    EVENT_ERROR_PASSIVE = 5,    //TEC or REC reached 128 (TWAI_ALERT_ERR_PASS)
+    EVENT_ERROR_ACTIVE = 6,     //both back under 96 (TWAI_ALERT_BELOW_ERR_WARN / TWAI_ALERT_ERR_ACTIVE)
+    EVENT_BUS_OFF = 7,          //TWAI_ALERT_BUS_OFF
+    EVENT_RECOVERING = 8,       //TWAI_ALERT_RECOVERY_IN_PROGRESS
+    EVENT_RUNNING = 9,          //running again after bus off (TWAI_ALERT_BUS_RECOVERED)
+    EVENT_CAPTURE_FULL = 10,    //our RX queue was full so frames had to wait in the driver
+    EVENT_SINK_DROPPED = 11,    //an output had no room for frames. bus holds the sink number instead
+    NUM_BUS_EVENTS
+};
+
+typedef struct {
+    uint32_t timestamp;     //micros() when it was noticed
+    uint16_t count;         //how many times it happened since the last look
+    uint8_t bus;
+    uint8_t type;           //BUS_EVENT_TYPE
+    uint8_t tec;            //error counters at the time. 0 for controllers that don't report them
+    uint8_t rec;
+} BUS_EVENT;
+
+#define BUS_EVENT_LENGTH    10  //BUS_EVENT as it goes out over GVRET
+
+typedef struct {
+    uint32_t events[NUM_BUS_EVENTS]; //running totals. Sink drops are counted on the sinks instead
+    uint8_t tec;
+    uint8_t rec;
+    uint8_t state;          //twai_state_t for the built-in controller, 0xFF for the others
+} BUS_HEALTH;
+
+/*
+Follows the error state of the controllers and everything in the capture path that loses frames. The esp32_can
+driver reads the TWAI alerts itself, so rather than compete with it for them the same conditions are worked out
+from the running totals, state and error counters twai_get_status_info() gives. poll() runs in the RX task and
+hands what it finds to loop() through an SPSC queue. loop() keeps the history and puts each event into the GVRET
+stream of links that turned on STREAM_EVENTS.
+*/
+class BusMonitor
+{
+public:
+    BusMonitor();
+    void setup(int twaiBus);
+    void poll();                            //RX task only
+    void noteCaptureFull(int bus);          //RX task only
+    bool nextEvent(BUS_EVENT &event);       //loop() only. Adds it to the history too
+    BUS_EVENT noteSinkDropped(int sink, uint32_t count); //loop() only
+    BUS_HEALTH &getHealth(int bus) { return health[bus]; }
+    int getNumHistory() { return (historyCount < BUS_EVENT_HISTORY) ? historyCount : BUS_EVENT_HISTORY; }
+    const BUS_EVENT &getHistory(int i);     //0 is the oldest kept
+    uint32_t getQueueFull() { return queueFull; }
+    static size_t encode(uint8_t *out, const BUS_EVENT &event);
+    static const char *eventName(uint8_t type);
+
+private:
+    BUS_HEALTH health[NUM_BUSES];
+    FrameQueue<BUS_EVENT, BUS_EVENT_QUEUE> pending;
+    volatile uint32_t queueFull;    //events loop() never saw. They are still in the totals
+    BUS_EVENT history[BUS_EVENT_HISTORY];
+    uint32_t historyCount;
+    int twaiBus;
+    uint32_t lastPoll;
+    uint32_t lastMissed;
+    uint32_t lastOverrun;
+    uint32_t lastBusErrors;
+    uint32_t lastTxFailed;
+    uint8_t lastState;
+    uint8_t lastLevel;              //0 error active, 1 warning, 2 passive
+    uint32_t captureFull[NUM_BUSES];
+    uint32_t lastCaptureFull[NUM_BUSES];
+
+    void addEvent(int bus, BUS_EVENT_TYPE type, uint32_t count);
+    void record(const BUS_EVENT &event);
+};
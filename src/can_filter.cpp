@@ -0,0 +1,91 @@
+#include "can_filter.h"
+
+FilterMatcher::FilterMatcher()
+{
+    clear();
+    compile();
+}
+
+void FilterMatcher::clear()
+{
+    numExt = 0;
+    numStd = 0;
+    numFilters = 0;
+}
+
+//false once NUM_FILTERS have been added. Masks with bits outside the ID are trimmed so they can't stop a match
+bool FilterMatcher::add(uint32_t id, uint32_t mask, bool extended)
+{
+    if (numFilters >= NUM_FILTERS) return false;
+    if (extended)
+    {
+        mask &= 0x1FFFFFFF;
+        extFilters[numExt].mask = mask;
+        extFilters[numExt].id = id & mask;
+        numExt++;
+    }
+    else
+    {
+        stdIds[numStd] = id & 0x7FF;
+        stdMasks[numStd] = mask & 0x7FF;
+        numStd++;
+    }
+    numFilters++;
+    return true;
+}
+
+//Only called when the filters change so it can take its time
+void FilterMatcher::compile()
+{
+    for (int i = 0; i < 2048 / 32; i++) stdMap[i] = 0;
+    for (uint32_t id = 0; id < 2048; id++)
+    {
+        for (int f = 0; f < numStd; f++)
+        {
+            if ((id & stdMasks[f]) == (stdIds[f] & stdMasks[f]))
+            {
+                stdMap[id >> 5] |= 1ul << (id & 0x1F);
+                break;
+            }
+        }
+    }
+
+    //insertion sort, there are never more than NUM_FILTERS of them
+    for (int i = 1; i < numExt; i++)
+    {
+        ExtFilter f = extFilters[i];
+        int j = i - 1;
+        while (j >= 0 && (extFilters[j].mask > f.mask || (extFilters[j].mask == f.mask && extFilters[j].id > f.id)))
+        {
+            extFilters[j + 1] = extFilters[j];
+            j--;
+        }
+        extFilters[j + 1] = f;
+    }
+
+    numGroups = 0;
+    for (int i = 0; i < numExt; i++)
+    {
+        if (numGroups == 0 || extFilters[i].mask != groupMask[numGroups - 1])
+        {
+            groupStart[numGroups] = i;
+            groupMask[numGroups] = extFilters[i].mask;
+            numGroups++;
+        }
+    }
+    groupStart[numGroups] = numExt;
+}
+
+bool FilterMatcher::searchGroup(int g, uint32_t maskedId)
+{
+    int lo = groupStart[g];
+    int hi = groupStart[g + 1] - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (extFilters[mid].id == maskedId) return true;
+        if (extFilters[mid].id < maskedId) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return false;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+
+#define NUM_FILTERS 32  //acceptance filters per bus (CANxFILTER0 - CANxFILTER31)
+
+//Software side of the acceptance filters. add() each enabled filter then compile(). Standard IDs become a 2048 bit
+//map so they cost one lookup. Extended filters are sorted by mask and then by masked ID so each distinct mask is a
+//binary search. With nothing added every frame is accepted, once anything is added only matching frames are.
+//No Arduino or board headers in here so it can be checked on a PC.
+class FilterMatcher
+{
+public:
+    FilterMatcher();
+    void clear();
+    bool add(uint32_t id, uint32_t mask, bool extended);
+    void compile();
+
+    bool isOpen() { return numFilters == 0; }
+    bool matches(uint32_t id, bool extended)
+    {
+        if (numFilters == 0) return true;
+        if (!extended) return (stdMap[(id & 0x7FF) >> 5] >> (id & 0x1F)) & 1;
+        for (int g = 0; g < numGroups; g++)
+        {
+            if (searchGroup(g, id & groupMask[g])) return true;
+        }
+        return false;
+    }
+
+private:
+    struct ExtFilter {
+        uint32_t mask;
+        uint32_t id; //already masked
+    };
+
+    uint32_t stdMap[2048 / 32];
+    ExtFilter extFilters[NUM_FILTERS];
+    uint32_t stdIds[NUM_FILTERS];
+    uint32_t stdMasks[NUM_FILTERS];
+    uint8_t groupStart[NUM_FILTERS + 1]; //extFilters[groupStart[g] .. groupStart[g + 1]) all share groupMask[g]
+    uint32_t groupMask[NUM_FILTERS];
+    int numExt;
+    int numStd;
+    int numGroups;
+    int numFilters;
+
+    bool searchGroup(int g, uint32_t maskedId);
+};
@@ -5,6 +5,13 @@
 #include "SerialConsole.h"
 #include "gvret_comm.h"
 #include "ELM327_Emulator.h"
+#include "tx_scheduler.h"
+#include "frame_encoder.h"
+#include "frame_bits.h"
+#include <driver/twai.h>
+
+static_assert(NUM_BUSES <= ID_STATS_BUSES, "IdStatsTable needs an index for every bus");
+static_assert(NUM_BUSES <= GATEWAY_BUSES, "GatewayRoutes needs room for every bus");
 
 
 //twai alerts copied here for ease of access. Look up alerts right here:
@@ -33,6 +40,45 @@
 CANManager::CANManager()
 {
     sendToConsole = true;
+    numSinks = 0;
+    jitter.active = false;
+    jitter.id = 0;
+    jitter.frames = 0;
+    rxTaskHandle = nullptr;
+    rxWakeTaskHandle = nullptr;
+    rxQueueFull = 0;
+    isoTpSeen = 0;
+    framesFiltered = 0;
+    txTaskHandle = nullptr;
+    txPolicy[TX_PRIO_DIAG] = TX_DROP;
+    txPolicy[TX_PRIO_GATEWAY] = TX_DROP;
+    txPolicy[TX_PRIO_PERIODIC] = TX_DROP;
+    txPolicy[TX_PRIO_BULK] = TX_BLOCK; //replay should slow the host down rather than lose frames
+    for (int i = 0; i < NUM_BUSES; i++)
+    {
+        txCounters[i].queued = 0;
+        txCounters[i].sent = 0;
+        txCounters[i].failed = 0;
+        txCounters[i].dropped = 0;
+        txCounters[i].arbLost = 0;
+        txCounters[i].busErrors = 0;
+    }
+    twaiBus = -1;
+    for (int i = 0; i < NUM_BUSES; i++) driverStamps[i] = false;
+    inFlightHead = inFlightTail = 0;
+    dropStatsTimer = 0;
+    gatewayRoutes = nullptr;
+    rxPasses = 0;
+    memset(gatewayStats.forwarded, 0, sizeof(gatewayStats.forwarded));
+    gatewayStats.blocked = 0;
+    gatewayStats.loops = 0;
+    gatewayStats.dropped = 0;
+    gatewayStats.latencyMin = 0xFFFFFFFF;
+    gatewayStats.latencyMax = 0;
+    gatewayStats.latencyTotal = 0;
+    gatewayStats.latencyCount = 0;
+    statsGeneration = 0;
+    for (int i = 0; i < NUM_BUSES; i++) captureDropped[i] = 0;
 }
 
 void CANManager::setup()
@@ -75,6 +121,7 @@ void CANManager::setup()
                 canBuses[i]->setListenOnlyMode(false);
             }
             canBuses[i]->watchFor();
+            applyFilters(i);
         } 
         else
         {
@@ -84,111 +131,870 @@ void CANManager::setup()
 
     for (int j = 0; j < NUM_BUSES; j++)
     {
-        busLoad[j].bitsPerQuarter = settings.canSettings[j].nomSpeed / 4;
         busLoad[j].bitsSoFar = 0;
         busLoad[j].busloadPercentage = 0;
-        if (busLoad[j].bitsPerQuarter == 0) busLoad[j].bitsPerQuarter = 125000;
+        busLoad[j].busloadPeak = 0;
     }
 
     busLoadTimer = millis();
+    applyReduceSettings();
+    isotp.setSender(CANManager::isoTpSend, this);
+    applyGateway(); //once the buses are up since it redoes their filters
+
+    //TX status comes from the TWAI driver's own counters rather than its alerts
+    twai_status_info_t status;
+    for (int i = 0; i < NUM_BUSES; i++) if (canBuses[i] == &CAN0) twaiBus = i;
+    //TWAI and MCP2517FD (the only FD capable driver) stamp frames in their own receive path, ahead of the RX task
+    for (int i = 0; i < NUM_BUSES; i++) driverStamps[i] = canBuses[i] && (canBuses[i] == &CAN0 || canBuses[i]->supportsFDMode());
+    if (twaiBus >= 0 && twai_get_status_info(&status) == ESP_OK)
+    {
+        lastTxFailed = status.tx_failed_count;
+        lastArbLost = status.arb_lost_count;
+        lastBusErrors = status.bus_error_count;
+    }
+    else twaiBus = -1;
+    busMonitor.setup(twaiBus);
+
+    //Same core as loop() but a higher priority so it gets in ahead of wifi, OTA and the comm parsers every tick.
+    if (!rxTaskHandle) xTaskCreatePinnedToCore(CANManager::rxTaskEntry, "CAN_RX", 4096, this, 10, &rxTaskHandle, xPortGetCoreID());
+    //TWAI raises RX_DATA for every frame it receives. A small task waits on it and wakes the RX task
+    if (twaiBus >= 0 && !rxWakeTaskHandle && twai_reconfigure_alerts(TWAI_ALERT_RX_DATA, nullptr) == ESP_OK)
+        xTaskCreatePinnedToCore(CANManager::rxWakeTaskEntry, "CAN_RXWAKE", 2048, this, 10, &rxWakeTaskHandle, xPortGetCoreID());
+    //above the RX task. It only runs when woken by a new frame or once a tick to check on the controllers
+    if (!txTaskHandle) xTaskCreatePinnedToCore(CANManager::txTaskEntry, "CAN_TX", 4096, this, 11, &txTaskHandle, xPortGetCoreID());
+
+    //USB and wifi can both be active at once. A stalled USB host shouldn't hold up wifi so serial drops when full
+    //while wifi keeps the old behavior of making the frames wait in the driver queue.
+    if (numSinks == 0)
+    {
+        addSink(SINK_SERIAL, &serialGVRET, SINK_DROP);
+        addSink(SINK_WIFI, &wifiGVRET, SINK_BLOCK);
+        addSink(SINK_ELM, nullptr, SINK_DROP);
+    }
+}
+
+int CANManager::addSink(SINK_TYPE type, CommBuffer *buffer, SINK_POLICY policy)
+{
+    if (numSinks >= MAX_SINKS) return -1;
+    sinks[numSinks].type = type;
+    sinks[numSinks].buffer = buffer;
+    sinks[numSinks].policy = policy;
+    sinks[numSinks].reduce = (type == SINK_WIFI); //wifi is the link that runs out of room first
+    sinks[numSinks].framesSent = 0;
+    sinks[numSinks].framesDropped = 0;
+    sinks[numSinks].droppedReported = 0;
+    memset(sinks[numSinks].dropped, 0, sizeof(sinks[numSinks].dropped));
+    sinks[numSinks].sampleRate = 10;
+    memset(sinks[numSinks].sampleCount, 0, sizeof(sinks[numSinks].sampleCount));
+    return numSinks++;
+}
+
+void CANManager::setSinkPolicy(int sink, SINK_POLICY policy)
+{
+    if (sink < 0 || sink >= numSinks) return;
+    sinks[sink].policy = policy;
+}
+
+void CANManager::setSinkSampleRate(int sink, uint8_t rate)
+{
+    if (sink < 0 || sink >= numSinks || rate < 2) return;
+    sinks[sink].sampleRate = rate;
+}
+
+void CANManager::setSinkReduce(int sink, bool reduce)
+{
+    if (sink < 0 || sink >= numSinks) return;
+    if (sinks[sink].type == SINK_ELM) return; //the emulator has to see every reply
+    sinks[sink].reduce = reduce;
+}
+
+void CANManager::applyReduceSettings()
+{
+    reducer.setMode((REDUCE_MODE)settings.reduceMode, settings.reduceInterval, settings.reduceRefresh);
+}
+
+FRAME_SINK *CANManager::getSink(int sink)
+{
+    if (sink < 0 || sink >= numSinks) return nullptr;
+    return &sinks[sink];
 }
 
 void CANManager::addBits(int offset, CAN_FRAME &frame)
 {
     if (offset < 0) return;
     if (offset >= NUM_BUSES) return;
-    busLoad[offset].bitsSoFar += 41 + (frame.length * 9);
-    if (frame.extended) busLoad[offset].bitsSoFar += 18;
+    busLoad[offset].bitsSoFar += FrameBits::classic(frame.id, frame.extended, frame.rtr, frame.length, frame.data.uint8);
 }
 
+//Bits sent at the FD data rate are scaled to how many nominal bits they take the time of
 void CANManager::addBits(int offset, CAN_FRAME_FD &frame)
 {
     if (offset < 0) return;
     if (offset >= NUM_BUSES) return;
-    busLoad[offset].bitsSoFar += 41 + (frame.length * 9);
-    if (frame.extended) busLoad[offset].bitsSoFar += 18;
+    if (!frame.fdMode)
+    {
+        busLoad[offset].bitsSoFar += FrameBits::classic(frame.id, frame.extended, frame.rrs, frame.length, frame.data.uint8);
+        return;
+    }
+    uint32_t nomSpeed = settings.canSettings[offset].nomSpeed;
+    uint32_t fdSpeed = settings.canSettings[offset].fdSpeed;
+    bool brs = (fdSpeed > nomSpeed) && (nomSpeed > 0);
+    uint32_t nominalBits, dataBits;
+    FrameBits::fd(frame.id, frame.extended, brs, frame.length, frame.data.uint8, nominalBits, dataBits);
+    if (dataBits) nominalBits += ((uint64_t)dataBits * nomSpeed) / fdSpeed;
+    busLoad[offset].bitsSoFar += nominalBits;
 }
 
-void CANManager::sendFrame(CAN_COMMON *bus, CAN_FRAME &frame)
+//Stores one filter slot in settings and rebuilds the bus's filters. Saving to NVS is up to the caller
+bool CANManager::setFilter(int bus, int filter, uint32_t id, uint32_t mask, bool extended, bool enabled)
 {
-    int whichBus = 0;
-    for (int i = 0; i < NUM_BUSES; i++) if (canBuses[i] == bus) whichBus = i;
-    bus->sendFrame(frame);
-    addBits(whichBus, frame);
+    if (bus < 0 || bus >= SysSettings.numBuses) return false;
+    if (filter < 0 || filter >= NUM_FILTERS) return false;
+    FILTER &f = settings.canFilters[bus][filter];
+    f.id = id;
+    f.mask = mask;
+    f.extended = extended;
+    f.enabled = enabled;
+    applyFilters(bus);
+    return true;
+}
+
+/*
+Rebuilds the software matcher for a bus from settings and tries to hand the same filters to the controller so it
+can throw unwanted traffic away before it costs anything. The controller only gets them if every enabled filter fits
+in its mailboxes, otherwise it is opened back up with watchFor(). Some drivers can't clear a mailbox once it's set
+so the hardware may still let extra frames through. That's fine, the software matcher in loop() has the final say.
+A bus the gateway forwards from is never filtered in hardware since the gateway has to see all of its traffic.
+*/
+void CANManager::applyFilters(int bus)
+{
+    if (bus < 0 || bus >= NUM_BUSES) return;
+    FilterMatcher &matcher = filters[bus];
+    GatewayRoutes *routes = gatewayRoutes.load();
+    bool inHardware = (canBuses[bus] != nullptr) && settings.canSettings[bus].enabled && !(routes && routes->hasRules(bus));
+    int mailbox = 0;
+
+    matcher.clear();
+    for (int i = 0; i < NUM_FILTERS; i++)
+    {
+        FILTER &f = settings.canFilters[bus][i];
+        if (!f.enabled) continue;
+        matcher.add(f.id, f.mask, f.extended);
+        if (inHardware && canBuses[bus]->setRXFilter(mailbox++, f.id, f.mask, f.extended) < 0) inHardware = false;
+    }
+    matcher.compile();
+
+    if (matcher.isOpen() || !inHardware)
+    {
+        if (canBuses[bus] && settings.canSettings[bus].enabled) canBuses[bus]->watchFor();
+    }
+}
+
+bool CANManager::setGatewayRule(int slot, const GATEWAY_RULE &rule)
+{
+    if (slot < 0 || slot >= NUM_GATEWAY_RULES) return false;
+    if (rule.enabled)
+    {
+        if (rule.srcBus >= SysSettings.numBuses) return false;
+        if (!rule.block && (rule.dstBus >= SysSettings.numBuses || rule.dstBus == rule.srcBus)) return false;
+    }
+    settings.gatewayRules[slot] = rule;
+    applyGateway();
+    return true;
 }
 
-void CANManager::sendFrame(CAN_COMMON *bus, CAN_FRAME_FD &frame)
+/*
+Builds new routes from settings and swaps them in whole. The RX task picks up the pointer once per pass, so once
+it has finished the pass it was in when they were swapped nothing can still be using the old routes. loop() runs at
+a lower priority on the same core so that takes a tick at most.
+*/
+void CANManager::applyGateway()
+{
+    GatewayRoutes *routes = nullptr;
+    for (int r = 0; r < NUM_GATEWAY_RULES; r++)
+    {
+        if (!settings.gatewayRules[r].enabled) continue;
+        routes = new GatewayRoutes();
+        routes->compile(settings.gatewayRules, NUM_GATEWAY_RULES);
+        break;
+    }
+
+    GatewayRoutes *old = gatewayRoutes.exchange(routes);
+    if (old)
+    {
+        uint32_t pass = rxPasses;
+        while (rxTaskHandle && rxPasses == pass) vTaskDelay(1);
+        delete old;
+    }
+    for (int i = 0; i < SysSettings.numBuses; i++) applyFilters(i);
+}
+
+/*
+Runs in the RX task for every classic frame as it comes off the controller, before it is queued for loop() and
+even when the queue has no room for it, so forwarding never waits on the sinks. The first rule that matches decides. The forwarded copy goes through the
+gateway TX queue, which never blocks, and its receive timestamp goes along so the TX task can time the trip.
+*/
+void CANManager::gatewayFrame(GatewayRoutes &routes, int bus, CAN_FRAME &frame)
+{
+    int r = routes.route(bus, frame.id, frame.extended);
+    if (r < 0) return;
+    const GATEWAY_RULE &rule = routes.getRule(r);
+    if (rule.block)
+    {
+        gatewayStats.blocked++;
+        return;
+    }
+    if (loopGuard.isLoop(bus, frame.id, frame.extended, frame.data.uint8, frame.length, micros()))
+    {
+        gatewayStats.loops++;
+        return;
+    }
+
+    CAN_FRAME out = frame;
+    GatewayRoutes::rewrite(rule, out.id, out.extended, out.data.uint8, out.length);
+    if (!sendFrame(rule.dstBus, out, TX_PRIO_GATEWAY))
+    {
+        gatewayStats.dropped++;
+        return;
+    }
+    gatewayStats.forwarded[r]++;
+    loopGuard.sent(rule.dstBus, out.id, out.extended, out.data.uint8, out.length, micros());
+}
+
+bool CANManager::isoTpSend(void *context, int bus, uint32_t id, bool extended, const uint8_t *data)
+{
+    CAN_FRAME frame;
+    frame.id = id;
+    frame.extended = extended;
+    frame.rtr = 0;
+    frame.length = 8;
+    memcpy(frame.data.uint8, data, 8);
+    return ((CANManager *)context)->sendFrame(bus, frame, TX_PRIO_DIAG);
+}
+
+bool CANManager::sendFrame(CAN_COMMON *bus, CAN_FRAME &frame, TX_PRIORITY priority)
+{
+    for (int i = 0; i < NUM_BUSES; i++) if (canBuses[i] && canBuses[i] == bus) return sendFrame(i, frame, priority);
+    return false;
+}
+
+/*
+Queues a frame for the TX task. Returns false if the frame was dropped because the queue for this bus and priority
+stayed full. Whether it then made it onto the bus is reported later through the TX counters and, for hosts that
+asked for it, a PROTO_TX_STATUS record.
+*/
+bool CANManager::sendFrame(int bus, CAN_FRAME &frame, TX_PRIORITY priority)
+{
+    if (bus < 0 || bus >= NUM_BUSES || !canBuses[bus]) return false;
+    FrameQueue<CAN_FRAME, TX_QUEUE_SIZE> &queue = txQueues[bus][priority];
+    CAN_FRAME *entry = queue.reserve();
+    if (!entry && txPolicy[priority] == TX_BLOCK && priority != TX_PRIO_PERIODIC && priority != TX_PRIO_GATEWAY)
+    {
+        uint32_t start = millis();
+        while (!(entry = queue.reserve()) && (millis() - start) < TX_BLOCK_TIMEOUT)
+        {
+            if (txTaskHandle) xTaskNotifyGive(txTaskHandle);
+            vTaskDelay(1);
+        }
+    }
+    if (!entry)
+    {
+        txCounters[bus].dropped++;
+        return false;
+    }
+    *entry = frame;
+    queue.commit();
+    txCounters[bus].queued++;
+    if (txTaskHandle) xTaskNotifyGive(txTaskHandle);
+    return true;
+}
+
+void CANManager::setTxPolicy(TX_PRIORITY priority, TX_POLICY policy)
+{
+    if (priority >= NUM_TX_PRIOS) return;
+    if (priority == TX_PRIO_PERIODIC || priority == TX_PRIO_GATEWAY) return; //the esp_timer and RX tasks can't sit and wait
+    txPolicy[priority] = policy;
+}
+
+//FD frames are rare enough that they still go straight to the controller
+bool CANManager::sendFrame(CAN_COMMON *bus, CAN_FRAME_FD &frame)
 {
     int whichBus = 0;
     for (int i = 0; i < NUM_BUSES; i++) if (canBuses[i] == bus) whichBus = i;
-    bus->sendFrameFD(frame);
+    if (!bus->sendFrameFD(frame)) return false;
     addBits(whichBus, frame);
+    return true;
 }
 
 
+bool CANManager::isSinkActive(FRAME_SINK &sink, CAN_FRAME &frame, int whichBus)
+{
+    switch (sink.type)
+    {
+    case SINK_SERIAL:
+        return sendToConsole;
+    case SINK_WIFI:
+        return SysSettings.isWifiActive;
+    case SINK_ELM: //replies to its requests come through its ISO-TP sessions instead
+        if (whichBus != settings.sendingBus) return false;
+        return elmEmulator.getMonitorMode();
+    }
+    return false;
+}
+
+//the ELM327 emulator has no idea what to do with FD frames
+bool CANManager::isSinkActive(FRAME_SINK &sink, CAN_FRAME_FD &frame, int whichBus)
+{
+    switch (sink.type)
+    {
+    case SINK_SERIAL:
+        return sendToConsole;
+    case SINK_WIFI:
+        return SysSettings.isWifiActive;
+    default:
+        return false;
+    }
+}
+
+static void sendToELM(CAN_FRAME &frame)
+{
+    elmEmulator.processCANReply(frame);
+}
+
+static void sendToELM(CAN_FRAME_FD &frame)
+{
+}
+
+//start timing a new ID. Stats from the last one are thrown away
+void CANManager::setJitterWatch(uint32_t id)
+{
+    jitter.active = false;
+    jitter.id = id;
+    jitter.frames = 0;
+    jitter.minDelta = 0xFFFFFFFF;
+    jitter.maxDelta = 0;
+    jitter.totalDelta = 0;
+    jitter.active = true;
+}
+
+void CANManager::updateJitter(uint32_t id, uint32_t timestamp)
+{
+    if (!jitter.active || id != jitter.id) return;
+    if (jitter.frames > 0)
+    {
+        uint32_t delta = timestamp - jitter.lastTimestamp;
+        if (delta < jitter.minDelta) jitter.minDelta = delta;
+        if (delta > jitter.maxDelta) jitter.maxDelta = delta;
+        jitter.totalDelta += delta;
+    }
+    jitter.lastTimestamp = timestamp;
+    jitter.frames++;
+}
+
+//Each active sink gets the frame in its own format. Stateless formats are encoded at most once per frame no matter
+//how many sinks want them. The compressed stream keeps per session state so it is encoded for each sink that uses it.
+//Sinks with reduction turned on skip whatever the FrameReducer holds back.
+template <class FrameType>
+void CANManager::fanOutFrame(FrameType &frame, int whichBus)
+{
+    uint8_t encoded[FORMAT_COMPRESSED][FrameEncoder::MAX_TEXT_LENGTH];
+    size_t encodedLength[FORMAT_COMPRESSED] = {0};
+    uint8_t perSink[FrameEncoder::MAX_TEXT_LENGTH];
+    int reducerSays = -1; //only asked once a sink wants it, then the answer holds for every reducing sink
+    bool reducedSent = false;
+
+    for (int s = 0; s < numSinks; s++)
+    {
+        FRAME_SINK &sink = sinks[s];
+        if (!isSinkActive(sink, frame, whichBus)) continue;
+        if (sink.reduce && reducer.getMode() != REDUCE_OFF)
+        {
+            if (reducerSays < 0) reducerSays = reducer.pass(whichBus, frame.id, frame.extended, frame.data.uint8, frame.length, frame.timestamp);
+            if (!reducerSays) continue;
+        }
+        //every bus keeps its own count so a quiet bus isn't sampled out by a busy one
+        if (sink.policy == SINK_SAMPLE && sink.buffer && sink.buffer->numFreeBytes() < SINK_SAMPLE_LEVEL)
+        {
+            if (++sink.sampleCount[whichBus] < sink.sampleRate)
+            {
+                countDrop(sink, whichBus, DROP_SAMPLED);
+                continue;
+            }
+            sink.sampleCount[whichBus] = 0;
+        }
+        if (sink.type == SINK_ELM)
+        {
+            sendToELM(frame);
+            sink.framesSent++;
+            if (sink.reduce) reducedSent = true;
+            continue;
+        }
+
+        uint8_t *bytes;
+        size_t length;
+        FRAME_FORMAT format = sink.buffer->getFrameFormat();
+        if (format < FORMAT_COMPRESSED)
+        {
+            if (encodedLength[format] == 0) encodedLength[format] = sink.buffer->encodeFrame(encoded[format], frame, whichBus, frame.timestamp);
+            bytes = encoded[format];
+            length = encodedLength[format];
+        }
+        else
+        {
+            bytes = perSink;
+            length = sink.buffer->encodeFrame(perSink, frame, whichBus, frame.timestamp);
+        }
+
+        if (sink.buffer->sendBytesToBuffer(bytes, length))
+        {
+            sink.framesSent++;
+            if (sink.reduce) reducedSent = true;
+        }
+        else
+        {
+            if (format == FORMAT_COMPRESSED) sink.buffer->frameRefused();
+            countDrop(sink, whichBus, (sink.policy == SINK_DROP_OLDEST) ? DROP_EVICTED : DROP_FULL);
+        }
+    }
+    //only a frame a reducing sink actually has counts as the last one sent, or a refused one would hold the next back
+    if (reducedSent && reducerSays == 1) reducer.sent();
+}
+
+void CANManager::countDrop(FRAME_SINK &sink, int whichBus, DROP_REASON reason)
+{
+    sink.framesDropped++;
+    sink.dropped[whichBus][reason]++;
+}
+
 void CANManager::displayFrame(CAN_FRAME &frame, int whichBus)
 {
-        if (SysSettings.isWifiActive) wifiGVRET.sendFrameToBuffer(frame, whichBus);
-        else if (sendToConsole) serialGVRET.sendFrameToBuffer(frame, whichBus);
+    fanOutFrame(frame, whichBus);
 }
 
 void CANManager::displayFrame(CAN_FRAME_FD &frame, int whichBus)
 {
-    if (SysSettings.isWifiActive) wifiGVRET.sendFrameToBuffer(frame, whichBus);
-        else serialGVRET.sendFrameToBuffer(frame, whichBus);
+    fanOutFrame(frame, whichBus);
 }
 
-void CANManager::loop()
+//true if any active sink that wants backpressure couldn't take another worst case frame. SINK_DROP_OLDEST sinks
+//only count while fewer than evictLevel frames are waiting. Past that the oldest frames go out to everyone else
+//and the full sink loses them, so it picks up with the newest frames once it has room again.
+bool CANManager::blockingSinkFull(uint32_t waiting, uint32_t evictLevel)
 {
-    CAN_FRAME incoming;
-    CAN_FRAME_FD inFD;
-    
-    size_t wifiLength = wifiGVRET.numAvailableBytes();
-    size_t serialLength = serialGVRET.numAvailableBytes();
-    size_t maxLength = (wifiLength > serialLength) ? wifiLength : serialLength;
+    for (int s = 0; s < numSinks; s++)
+    {
+        if (!sinks[s].buffer) continue;
+        if (sinks[s].policy != SINK_BLOCK && (sinks[s].policy != SINK_DROP_OLDEST || waiting >= evictLevel)) continue;
+        if (sinks[s].type == SINK_SERIAL && !sendToConsole) continue;
+        if (sinks[s].type == SINK_WIFI && !SysSettings.isWifiActive) continue;
+        if (sinks[s].buffer->numFreeBytes() < FrameEncoder::MAX_TEXT_LENGTH) return true;
+    }
+    return false;
+}
+
+//Every bus gets its own load worked out over the time since the last update, not an assumed 250ms, since the RX
+//task only checks once per tick. Smoothed the same way as before and the highest unsmoothed value is kept as the peak.
+void CANManager::updateBusLoad()
+{
+    uint32_t now = millis();
+    uint32_t elapsed = now - busLoadTimer;
+    if (elapsed < 250) return;
+    busLoadTimer = now;
 
-    if (millis() > (busLoadTimer + 250)) {
-        busLoadTimer = millis();
-        busLoad[0].busloadPercentage = ((busLoad[0].busloadPercentage * 3) + (((busLoad[0].bitsSoFar * 1000) / busLoad[0].bitsPerQuarter) / 10)) / 4;
+    for (int i = 0; i < NUM_BUSES; i++)
+    {
+        uint32_t bits = busLoad[i].bitsSoFar.exchange(0);
+        uint32_t speed = settings.canSettings[i].nomSpeed;
+        if (speed == 0) speed = 125000;
+        uint32_t percent = ((uint64_t)bits * 100000ull) / ((uint64_t)speed * elapsed);
+        if (percent > 100) percent = 100;
+        busLoad[i].busloadPercentage = ((busLoad[i].busloadPercentage * 3) + percent) / 4;
         //Force busload percentage to be at least 1% if any traffic exists at all. This forces the LED to light up for any traffic.
-        if (busLoad[0].busloadPercentage == 0 && busLoad[0].bitsSoFar > 0) busLoad[0].busloadPercentage = 1;
-        busLoad[0].bitsPerQuarter = settings.canSettings[0].nomSpeed / 4;
-        busLoad[0].bitsSoFar = 0;
-        if(busLoad[0].busloadPercentage > busLoad[1].busloadPercentage){
-            //updateBusloadLED(busLoad[0].busloadPercentage);
-        } else{
-            //updateBusloadLED(busLoad[1].busloadPercentage);
-        }
+        if (busLoad[i].busloadPercentage == 0 && bits > 0) busLoad[i].busloadPercentage = 1;
+        if (percent > busLoad[i].busloadPeak) busLoad[i].busloadPeak = percent;
+    }
+    if(busLoad[0].busloadPercentage > busLoad[1].busloadPercentage){
+        //updateBusloadLED(busLoad[0].busloadPercentage);
+    } else{
+        //updateBusloadLED(busLoad[1].busloadPercentage);
     }
+}
 
-    for (int i = 0; i < SysSettings.numBuses; i++)
+void CANManager::rxTaskEntry(void *param)
+{
+    ((CANManager *)param)->rxTask();
+}
+
+void CANManager::notifyRx()
+{
+    if (rxTaskHandle) xTaskNotifyGive(rxTaskHandle);
+}
+
+void CANManager::rxWakeTaskEntry(void *param)
+{
+    ((CANManager *)param)->rxWakeTask();
+}
+
+void CANManager::rxWakeTask()
+{
+    uint32_t alerts;
+    for (;;)
+    {
+        if (twai_read_alerts(&alerts, portMAX_DELAY) != ESP_OK) vTaskDelay(pdMS_TO_TICKS(100)); //driver not running
+        else if (alerts & TWAI_ALERT_RX_DATA) notifyRx();
+    }
+}
+
+/*
+Pulls frames out of the controllers as soon as they show up, no matter what loop() is busy with, stamps the ones whose
+driver keeps no receive time and counts them on the way into rxQueue / rxFDQueue. idStats is kept here so its counts and periods don't depend on
+when loop() gets to a frame or whether a blocking sink is holding it up. The task sleeps until notifyRx() says a
+driver has frames (TWAI through rxWakeTask) or a tick has passed, then empties every driver queue it finds. The tick
+covers drivers with no notification and frames that weren't in the driver's queue yet when the wake came.
+When a queue is full the frames are left in the driver and the next wake tries again. That is also how SINK_BLOCK
+backpressure ends up reaching the bus. Buses with gateway rules are the exception, see gatewayFrame().
+*/
+void CANManager::rxTask()
+{
+    CAN_FRAME uncaptured;
+    for (;;)
     {
-        if (!canBuses[i]) continue;
-        if (!settings.canSettings[i].enabled) continue;
-        while ( (canBuses[i]->available() > 0) && (maxLength < (WIFI_BUFF_SIZE - 80)))
+        updateBusLoad();
+        busMonitor.poll();
+        GatewayRoutes *routes = gatewayRoutes.load();
+        uint32_t generation = routes ? routes->getGeneration() : 0;
+        if (generation != statsGeneration) //new rules, the slots may mean something else now
         {
-            if (settings.canSettings[i].fdMode == 0)
+            memset(gatewayStats.forwarded, 0, sizeof(gatewayStats.forwarded));
+            statsGeneration = generation;
+        }
+        for (int i = 0; i < SysSettings.numBuses; i++)
+        {
+            if (!canBuses[i]) continue;
+            if (!settings.canSettings[i].enabled) continue;
+            while (canBuses[i]->available() > 0)
             {
-                canBuses[i]->read(incoming);
-                addBits(i, incoming);
-                displayFrame(incoming, i);
+                if (settings.canSettings[i].fdMode == 0)
+                {
+                    RX_FRAME *rx = rxQueue.reserve();
+                    bool gatewayed = routes && routes->hasRules(i);
+                    if (!rx && !gatewayed)
+                    {
+                        rxQueueFull++;
+                        busMonitor.noteCaptureFull(i);
+                        break;
+                    }
+                    //a bus the gateway forwards from can't wait for room in the capture, so without any its frames
+                    //are still read and forwarded and only the capture loses them
+                    CAN_FRAME &frame = rx ? rx->frame : uncaptured;
+                    canBuses[i]->read(frame);
+                    //the driver's own receive time where it keeps one, otherwise as close as this task gets to it.
+                    //Either way 0 is a time like any other
+                    if (!driverStamps[i]) frame.timestamp = micros();
+                    addBits(i, frame);
+                    idStats.update(i, frame.id, frame.extended, frame.data.uint8, frame.length, frame.timestamp);
+                    if (gatewayed) gatewayFrame(*routes, i, frame);
+                    if (!rx)
+                    {
+                        captureDropped[i]++;
+                        continue;
+                    }
+                    rx->bus = i;
+                    rxQueue.commit();
+                }
+                else
+                {
+                    RX_FRAME_FD *rx = rxFDQueue.reserve();
+                    if (!rx)
+                    {
+                        rxQueueFull++;
+                        busMonitor.noteCaptureFull(i);
+                        break;
+                    }
+                    canBuses[i]->readFD(rx->frame);
+                    if (!driverStamps[i]) rx->frame.timestamp = micros();
+                    rx->bus = i;
+                    addBits(i, rx->frame);
+                    idStats.update(i, rx->frame.id, rx->frame.extended, rx->frame.data.uint8, rx->frame.length, rx->frame.timestamp);
+                    rxFDQueue.commit();
+                }
             }
-            else
+        }
+        rxPasses++;
+        ulTaskNotifyTake(pdTRUE, 1);
+    }
+}
+
+void CANManager::txTaskEntry(void *param)
+{
+    ((CANManager *)param)->txTask();
+}
+
+/*
+Feeds every bus's controller from its TX queues, highest priority first, until the controller won't take any more.
+Then it waits to be told about new frames, but never more than a tick so a full controller is tried again soon.
+Starting from the top priority each time means a diagnostic request only ever waits behind what the controller
+already holds, not behind the rest of a replay.
+*/
+void CANManager::txTask()
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, 1);
+        for (int bus = 0; bus < NUM_BUSES; bus++)
+        {
+            if (!canBuses[bus]) continue;
+            bool controllerFull = false;
+            for (int p = 0; p < NUM_TX_PRIOS && !controllerFull; p++)
             {
-                canBuses[i]->readFD(inFD);
-                addBits(i, inFD);
-                displayFrame(inFD, i);
+                CAN_FRAME *frame;
+                bool report = (p != TX_PRIO_GATEWAY); //hosts only hear about frames they or the device asked for
+                while ((frame = txQueues[bus][p].front()))
+                {
+                    //the built-in controller can only be followed while there is room to remember what's in it
+                    if (bus == twaiBus && (inFlightHead - inFlightTail) >= TX_TRACK_SIZE) { controllerFull = true; break; }
+                    if (!settings.canSettings[bus].enabled)
+                    {
+                        txFinished(bus, *frame, TX_DROPPED, report);
+                        txQueues[bus][p].pop();
+                        continue;
+                    }
+                    if (!canBuses[bus]->sendFrame(*frame)) { controllerFull = true; break; }
+                    addBits(bus, *frame);
+                    if (p == TX_PRIO_GATEWAY) gatewayLatency(micros() - frame->timestamp);
+                    if (p == TX_PRIO_PERIODIC) txScheduler.frameSent(frame->timestamp, esp_timer_get_time()); //timestamp is the slot
+                    if (bus == twaiBus)
+                    {
+                        TX_RESULT &track = inFlight[inFlightHead % TX_TRACK_SIZE];
+                        track.id = frame->id | (frame->extended ? (1ul << 31) : 0);
+                        track.bus = bus;
+                        track.status = report; //only used as a flag until it finishes
+                        inFlightHead++;
+                    }
+                    else txFinished(bus, *frame, TX_DONE, report);
+                    txQueues[bus][p].pop();
+                }
             }
-            
-            if ( ((incoming.id > 0x7DF) && (incoming.id < 0x7F0)) || elmEmulator.getMonitorMode())
+        }
+        pollTwaiStatus();
+    }
+}
+
+//time from a forwarded frame being received to its copy being handed to the destination controller. TX task only
+void CANManager::gatewayLatency(uint32_t latency)
+{
+    if (latency < gatewayStats.latencyMin) gatewayStats.latencyMin = latency;
+    if (latency > gatewayStats.latencyMax) gatewayStats.latencyMax = latency;
+    gatewayStats.latencyTotal.fetch_add(latency, std::memory_order_relaxed);
+    gatewayStats.latencyCount++;
+}
+
+void CANManager::txFinished(int bus, CAN_FRAME &frame, TX_STATUS status, bool report)
+{
+    if (status == TX_DONE) txCounters[bus].sent++;
+    else if (status == TX_FAILED) txCounters[bus].failed++;
+    else txCounters[bus].dropped++;
+    if (!report) return;
+    TX_RESULT *result = txResults.reserve();
+    if (!result) return; //nobody is reading them fast enough. The counters still have it
+    result->id = frame.id | (frame.extended ? (1ul << 31) : 0);
+    result->bus = bus;
+    result->status = status;
+    txResults.commit();
+}
+
+/*
+The TWAI driver doesn't say which frame finished, only how many are still waiting and running totals of failures.
+Frames leave the controller in the order they went in so whatever is no longer waiting has finished, oldest first.
+Any new failures are put down to the oldest of those.
+*/
+void CANManager::pollTwaiStatus()
+{
+    if (twaiBus < 0 || inFlightHead == inFlightTail) return;
+    twai_status_info_t status;
+    if (twai_get_status_info(&status) != ESP_OK) return;
+
+    TX_COUNTERS &counters = txCounters[twaiBus];
+    counters.arbLost += status.arb_lost_count - lastArbLost;
+    counters.busErrors += status.bus_error_count - lastBusErrors;
+    lastArbLost = status.arb_lost_count;
+    lastBusErrors = status.bus_error_count;
+    uint32_t newFailures = status.tx_failed_count - lastTxFailed;
+    lastTxFailed = status.tx_failed_count;
+
+    uint32_t waiting = inFlightHead - inFlightTail;
+    uint32_t finished = (status.msgs_to_tx < waiting) ? waiting - status.msgs_to_tx : 0;
+    while (finished--)
+    {
+        TX_RESULT &track = inFlight[inFlightTail % TX_TRACK_SIZE];
+        CAN_FRAME frame;
+        frame.id = track.id & 0x7FFFFFFF;
+        frame.extended = (track.id >> 31) & 1;
+        txFinished(track.bus, frame, newFailures ? TX_FAILED : TX_DONE, track.status);
+        if (newFailures) newFailures--;
+        inFlightTail++;
+    }
+}
+
+//Completions go to every GVRET link that turned on STREAM_TX_STATUS with PROTO_SET_STREAM_MODE
+void CANManager::sendTxResults()
+{
+    TX_RESULT *result;
+    while ((result = txResults.front()))
+    {
+        uint8_t record[8];
+        record[0] = 0xF1;
+        record[1] = PROTO_TX_STATUS;
+        record[2] = result->bus;
+        record[3] = result->status;
+        record[4] = result->id;
+        record[5] = result->id >> 8;
+        record[6] = result->id >> 16;
+        record[7] = result->id >> 24;
+        for (int s = 0; s < numSinks; s++)
+        {
+            FRAME_SINK &sink = sinks[s];
+            if (!sink.buffer || !(sink.buffer->getStreamMode() & STREAM_TX_STATUS)) continue;
+            if (sink.type == SINK_SERIAL && !sendToConsole) continue;
+            if (sink.type == SINK_WIFI && !SysSettings.isWifiActive) continue;
+            sink.buffer->sendBytesToBuffer(record, sizeof(record));
+        }
+        txResults.pop();
+    }
+}
+
+//Events go to every GVRET link that turned on STREAM_EVENTS. Sink drops are checked here since loop() is what
+//drops them, at most one event per sink per pass
+void CANManager::sendBusEvents()
+{
+    BUS_EVENT event;
+    uint8_t record[2 + BUS_EVENT_LENGTH];
+    record[0] = 0xF1;
+    record[1] = PROTO_BUS_EVENT;
+
+    for (int s = 0; s < numSinks; s++)
+    {
+        FRAME_SINK &sink = sinks[s];
+        if (sink.framesDropped == sink.droppedReported) continue;
+        event = busMonitor.noteSinkDropped(s, sink.framesDropped - sink.droppedReported);
+        sink.droppedReported = sink.framesDropped;
+        BusMonitor::encode(&record[2], event);
+        sendToEventSinks(record, sizeof(record));
+    }
+    while (busMonitor.nextEvent(event))
+    {
+        BusMonitor::encode(&record[2], event);
+        sendToEventSinks(record, sizeof(record));
+    }
+}
+
+//A link that is out of room just misses the event. It is still in the history
+void CANManager::sendToEventSinks(uint8_t *record, size_t length)
+{
+    for (int s = 0; s < numSinks; s++)
+    {
+        FRAME_SINK &sink = sinks[s];
+        if (!sink.buffer || !(sink.buffer->getStreamMode() & STREAM_EVENTS)) continue;
+        if (sink.type == SINK_SERIAL && !sendToConsole) continue;
+        if (sink.type == SINK_WIFI && !SysSettings.isWifiActive) continue;
+        sink.buffer->sendBytesToBuffer(record, length);
+    }
+}
+
+//Running totals so the host can tell how many frames are missing between two records and why. See PROTO_DROP_STATS
+size_t CANManager::encodeDropStats(uint8_t *out)
+{
+    size_t pos = 0;
+    uint32_t now = micros();
+    out[pos++] = 0xF1;
+    out[pos++] = PROTO_DROP_STATS;
+    for (int i = 0; i < 4; i++) out[pos++] = now >> (i * 8);
+    out[pos++] = SysSettings.numBuses;
+    out[pos++] = numSinks;
+    for (int b = 0; b < SysSettings.numBuses; b++)
+    {
+        BUS_HEALTH &h = busMonitor.getHealth(b);
+        uint32_t lost = h.events[EVENT_RX_MISSED] + h.events[EVENT_RX_OVERRUN] + captureDropped[b];
+        for (int i = 0; i < 4; i++) out[pos++] = lost >> (i * 8);
+        for (int i = 0; i < 4; i++) out[pos++] = h.events[EVENT_CAPTURE_FULL] >> (i * 8);
+    }
+    for (int s = 0; s < numSinks; s++)
+    {
+        out[pos++] = s;
+        out[pos++] = sinks[s].policy;
+        out[pos++] = sinks[s].sampleRate;
+        for (int b = 0; b < SysSettings.numBuses; b++)
+        {
+            for (int r = 0; r < NUM_DROP_REASONS; r++)
             {
-                //canManager.displayFrame(incoming, i);
-                if (i == settings.sendingBus)  elmEmulator.processCANReply(incoming);
+                for (int i = 0; i < 4; i++) out[pos++] = sinks[s].dropped[b][r] >> (i * 8);
             }
-            
-            wifiLength = wifiGVRET.numAvailableBytes();
-            serialLength = serialGVRET.numAvailableBytes();
-            maxLength = (wifiLength > serialLength) ? wifiLength:serialLength;
         }
     }
+    return pos;
+}
+
+//A link without room for the whole record skips it. The totals carry over into the next one
+void CANManager::sendDropStats()
+{
+    uint8_t record[DROP_STATS_MAX_LENGTH];
+    size_t length = 0;
+    dropStatsTimer = millis();
+    for (int s = 0; s < numSinks; s++)
+    {
+        FRAME_SINK &sink = sinks[s];
+        if (!sink.buffer || !(sink.buffer->getStreamMode() & STREAM_DROP_STATS)) continue;
+        if (sink.type == SINK_SERIAL && !sendToConsole) continue;
+        if (sink.type == SINK_WIFI && !SysSettings.isWifiActive) continue;
+        if (length == 0) length = encodeDropStats(record);
+        sink.buffer->sendBytesToBuffer(record, length);
+    }
+}
+
+//Only hands queued frames to the sinks now. The RX task has already taken them off the controllers and counted them
+//in idStats. Every frame is offered to the ISO-TP sessions as soon as it is queued, ahead of the sinks, so a full
+//blocking sink can't hold up a diagnostic conversation. Then the ones the acceptance filters don't want are thrown
+//away here before anything is formatted.
+void CANManager::loop()
+{
+    RX_FRAME *rx;
+    RX_FRAME_FD *rxFD;
+
+    sendTxResults();
+    sendBusEvents();
+    if ((millis() - dropStatsTimer) >= DROP_STATS_PERIOD) sendDropStats();
+    isotp.tick(micros());
+
+    while ((rx = rxQueue.peek(isoTpSeen)))
+    {
+        isotp.handleFrame(rx->bus, rx->frame.id, rx->frame.extended, rx->frame.data.uint8, rx->frame.length, micros());
+        isoTpSeen++;
+    }
+
+    while (!blockingSinkFull(rxQueue.count(), RX_EVICT_LEVEL) && (rx = rxQueue.front()))
+    {
+        if (isoTpSeen) isoTpSeen--;
+        else isotp.handleFrame(rx->bus, rx->frame.id, rx->frame.extended, rx->frame.data.uint8, rx->frame.length, micros());
+        if (!filters[rx->bus].matches(rx->frame.id, rx->frame.extended))
+        {
+            framesFiltered++;
+            rxQueue.pop();
+            continue;
+        }
+        updateJitter(rx->frame.id, rx->frame.timestamp);
+        displayFrame(rx->frame, rx->bus);
+        rxQueue.pop();
+    }
+    while (!blockingSinkFull(rxFDQueue.count(), RX_EVICT_LEVEL * RX_FD_QUEUE_SIZE / RX_QUEUE_SIZE) && (rxFD = rxFDQueue.front()))
+    {
+        if (!filters[rxFD->bus].matches(rxFD->frame.id, rxFD->frame.extended))
+        {
+            framesFiltered++;
+            rxFDQueue.pop();
+            continue;
+        }
+        updateJitter(rxFD->frame.id, rxFD->frame.timestamp);
+        displayFrame(rxFD->frame, rxFD->bus);
+        rxFDQueue.pop();
+    }
 }
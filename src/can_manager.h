@@ -1,12 +1,137 @@
 #pragma once
 #include "config.h"
+#include "commbuffer.h"
+#include "frame_queue.h"
+#include "frame_reducer.h"
+#include "id_stats.h"
+#include "bus_monitor.h"
+#include "gateway.h"
+#include "isotp.h"
 
 typedef struct {
-    uint32_t bitsPerQuarter;
-    uint32_t bitsSoFar;
-    uint8_t busloadPercentage;
+    std::atomic<uint32_t> bitsSoFar; //RX task adds received frames, whoever sends adds transmitted ones. Stuff bits included
+    uint8_t busloadPercentage;      //smoothed
+    uint8_t busloadPeak;            //highest single reading since boot
 } BUSLOAD;
 
+#define MAX_SINKS   4
+
+//Frames wait here between the RX task and loop(). Must be powers of two
+#define RX_QUEUE_SIZE       256
+#define RX_FD_QUEUE_SIZE    32
+
+typedef struct {
+    CAN_FRAME frame;
+    uint8_t bus;
+} RX_FRAME;
+
+typedef struct {
+    CAN_FRAME_FD frame;
+    uint8_t bus;
+} RX_FRAME_FD;
+
+//Frames waiting for a controller, per bus and priority. Must be a power of two
+#define TX_QUEUE_SIZE       32
+#define TX_RESULT_QUEUE     64  //completions waiting to be echoed to GVRET hosts
+#define TX_TRACK_SIZE       32  //frames handed to the built-in TWAI controller that haven't finished yet
+#define TX_BLOCK_TIMEOUT    100 //ms a TX_BLOCK sender waits before the frame is dropped anyway
+
+//Lower numbers go out first. Each class must only ever be fed from one task since the queues are SPSC
+enum TX_PRIORITY
+{
+    TX_PRIO_DIAG,       //console and ELM327 requests. loop() only
+    TX_PRIO_GATEWAY,    //frames forwarded between buses. RX task only
+    TX_PRIO_PERIODIC,   //TxScheduler. esp_timer task only
+    TX_PRIO_BULK,       //GVRET replay. loop() only
+    NUM_TX_PRIOS
+};
+
+//what to do when a TX queue is full
+enum TX_POLICY
+{
+    TX_DROP,            //refuse the frame and count it
+    TX_BLOCK            //wait up to TX_BLOCK_TIMEOUT ms for room. Never used for TX_PRIO_PERIODIC or TX_PRIO_GATEWAY
+};
+
+enum TX_STATUS
+{
+    TX_DONE = 0,        //on the bus. Buses without TWAI status count a frame as done once the controller takes it
+    TX_FAILED = 1,      //the controller gave up on it
+    TX_DROPPED = 2      //never got to the controller
+};
+
+typedef struct {
+    uint32_t id;        //bit 31 set for extended
+    uint8_t bus;
+    uint8_t status;     //TX_STATUS. While in flight, whether hosts are told when it finishes
+} TX_RESULT;
+
+//queued and dropped are counted by whichever task sends, sent / failed / dropped by the TX task, so those are atomic
+typedef struct {
+    std::atomic<uint32_t> queued;
+    std::atomic<uint32_t> sent;
+    std::atomic<uint32_t> failed;
+    std::atomic<uint32_t> dropped;
+    uint32_t arbLost;   //built-in TWAI only, retried automatically. TX task only
+    uint32_t busErrors; //same
+} TX_COUNTERS;
+
+enum SINK_TYPE
+{
+    SINK_SERIAL,    //serialGVRET over USB
+    SINK_WIFI,      //wifiGVRET over the telnet port
+    SINK_ELM        //ELM327 emulator replies and monitor mode. Formats and flushes its own output
+};
+
+//what to do when a sink doesn't have room for a frame
+enum SINK_POLICY
+{
+    SINK_DROP,          //drop the newest frame for this sink only and count it
+    SINK_BLOCK,         //stop reading the CAN buses until the sink has room again. Frames wait in the driver queue
+    SINK_DROP_OLDEST,   //hold off like SINK_BLOCK until the RX queue is RX_EVICT_LEVEL full, then drop the oldest waiting frames
+    SINK_SAMPLE,        //once the sink is short of room send only every sampleRate'th frame of each bus
+    NUM_SINK_POLICIES
+};
+
+//where a sink lost a frame
+enum DROP_REASON
+{
+    DROP_FULL,          //no room for it
+    DROP_EVICTED,       //oldest frame thrown away while a SINK_DROP_OLDEST sink held off
+    DROP_SAMPLED,       //left out by SINK_SAMPLE
+    NUM_DROP_REASONS
+};
+
+#define RX_EVICT_LEVEL      (RX_QUEUE_SIZE * 3 / 4)    //scaled for the FD queue
+#define SINK_SAMPLE_LEVEL   (WIFI_BUFF_SIZE / 4)       //free bytes under which SINK_SAMPLE starts sampling
+#define DROP_STATS_PERIOD   1000                       //ms between PROTO_DROP_STATS records
+#define DROP_STATS_MAX_LENGTH (10 + NUM_BUSES * 8 + MAX_SINKS * (3 + NUM_BUSES * NUM_DROP_REASONS * 4))
+
+typedef struct {
+    SINK_TYPE type;
+    CommBuffer *buffer;
+    SINK_POLICY policy;
+    bool reduce;            //goes through the FrameReducer when a reduction mode is set
+    uint32_t framesSent;
+    uint32_t framesDropped;     //every reason together
+    uint32_t droppedReported;   //framesDropped as of the last EVENT_SINK_DROPPED
+    uint32_t dropped[NUM_BUSES][NUM_DROP_REASONS];
+    uint8_t sampleRate;         //SINK_SAMPLE sends 1 in this many
+    uint8_t sampleCount[NUM_BUSES];
+} FRAME_SINK;
+
+//inter-arrival times of one ID, worked out from the receive timestamps. Compare against a known periodic
+//source to see how much timing error the capture path adds
+typedef struct {
+    uint32_t id;
+    bool active;
+    uint32_t frames;
+    uint32_t lastTimestamp;
+    uint32_t minDelta;
+    uint32_t maxDelta;
+    uint64_t totalDelta;
+} JITTER_STATS;
+
 class CAN_COMMON;
 class CAN_FRAME;
 class CAN_FRAME_FD;
@@ -17,16 +142,106 @@ public:
     CANManager();
     void addBits(int offset, CAN_FRAME &frame);
     void addBits(int offset, CAN_FRAME_FD &frame);    
-    void sendFrame(CAN_COMMON *bus, CAN_FRAME &frame);
-    void sendFrame(CAN_COMMON *bus, CAN_FRAME_FD &frame);
+    bool sendFrame(CAN_COMMON *bus, CAN_FRAME &frame, TX_PRIORITY priority = TX_PRIO_BULK);
+    bool sendFrame(int bus, CAN_FRAME &frame, TX_PRIORITY priority = TX_PRIO_BULK);
+    bool sendFrame(CAN_COMMON *bus, CAN_FRAME_FD &frame);
     void displayFrame(CAN_FRAME &frame, int whichBus);
     void displayFrame(CAN_FRAME_FD &frame, int whichBus);
     void loop();
     void setup();
+    void notifyRx();    //a driver has frames waiting. Called from a task, not an ISR
     void setSendToConsole(bool state) { sendToConsole = state; }
+    int addSink(SINK_TYPE type, CommBuffer *buffer, SINK_POLICY policy);
+    void setSinkPolicy(int sink, SINK_POLICY policy);
+    void setSinkSampleRate(int sink, uint8_t rate);
+    size_t encodeDropStats(uint8_t *out);
+    int getNumSinks() { return numSinks; }
+    FRAME_SINK *getSink(int sink);
+    void setJitterWatch(uint32_t id);
+    JITTER_STATS &getJitterStats() { return jitter; }
+    uint32_t getRxQueuePeak() { return rxQueue.getHighWater(); }
+    uint32_t getRxFDQueuePeak() { return rxFDQueue.getHighWater(); }
+    uint32_t getRxQueueFull() { return rxQueueFull; }
+    uint32_t getCaptureDropped(int bus) { return captureDropped[bus]; }
+    bool setFilter(int bus, int filter, uint32_t id, uint32_t mask, bool extended, bool enabled);
+    void applyFilters(int bus);
+    uint32_t getFramesFiltered() { return framesFiltered; }
+    void setSinkReduce(int sink, bool reduce);
+    void applyReduceSettings();
+    FrameReducer &getReducer() { return reducer; }
+    IdStatsTable &getIdStats() { return idStats; }
+    uint8_t getBusLoad(int bus) { return busLoad[bus].busloadPercentage; }
+    uint8_t getBusLoadPeak(int bus) { return busLoad[bus].busloadPeak; }
+    void setTxPolicy(TX_PRIORITY priority, TX_POLICY policy);
+    TX_POLICY getTxPolicy(TX_PRIORITY priority) { return txPolicy[priority]; }
+    TX_COUNTERS &getTxCounters(int bus) { return txCounters[bus]; }
+    bool setGatewayRule(int slot, const GATEWAY_RULE &rule);
+    void applyGateway();
+    GATEWAY_STATS &getGatewayStats() { return gatewayStats; }
+    IsoTpEngine &getIsoTp() { return isotp; }
+    BusMonitor &getBusMonitor() { return busMonitor; }
 
 private:
+    FRAME_SINK sinks[MAX_SINKS];
+    int numSinks;
+
     BUSLOAD busLoad[NUM_BUSES];
     uint32_t busLoadTimer;
     bool sendToConsole;
+    JITTER_STATS jitter;
+    TaskHandle_t rxTaskHandle;
+    TaskHandle_t rxWakeTaskHandle;
+    FrameQueue<RX_FRAME, RX_QUEUE_SIZE> rxQueue;
+    FrameQueue<RX_FRAME_FD, RX_FD_QUEUE_SIZE> rxFDQueue;
+    volatile uint32_t rxQueueFull; //times the RX task found the queue full and left frames with the driver
+    volatile uint32_t captureDropped[NUM_BUSES]; //read off a bus with gateway rules while the RX queue was full, never captured
+    FilterMatcher filters[NUM_BUSES];
+    uint32_t framesFiltered;
+    FrameReducer reducer;
+    IdStatsTable idStats;
+    TaskHandle_t txTaskHandle;
+    FrameQueue<CAN_FRAME, TX_QUEUE_SIZE> txQueues[NUM_BUSES][NUM_TX_PRIOS];
+    FrameQueue<TX_RESULT, TX_RESULT_QUEUE> txResults;
+    TX_POLICY txPolicy[NUM_TX_PRIOS];
+    TX_COUNTERS txCounters[NUM_BUSES];
+    int twaiBus;            //which bus is the built-in TWAI controller, -1 if none or its status can't be read
+    bool driverStamps[NUM_BUSES]; //the driver fills in timestamp when the frame arrives, the RX task leaves it alone
+    TX_RESULT inFlight[TX_TRACK_SIZE];
+    uint32_t inFlightHead;
+    uint32_t inFlightTail;
+    uint32_t lastTxFailed;
+    uint32_t lastArbLost;
+    uint32_t lastBusErrors;
+    BusMonitor busMonitor;
+    uint32_t dropStatsTimer;
+    std::atomic<GatewayRoutes *> gatewayRoutes; //swapped whole by loop(), read by the RX task. nullptr = no rules
+    std::atomic<uint32_t> rxPasses;             //RX task passes, so loop() knows when an old GatewayRoutes is unused
+    GatewayLoopGuard loopGuard;
+    GATEWAY_STATS gatewayStats;
+    uint32_t statsGeneration;   //RX task only. GatewayRoutes the forwarded counts belong to, 0 = none
+    IsoTpEngine isotp;      //loop() only. Sends through TX_PRIO_DIAG
+    uint32_t isoTpSeen;     //frames at the front of rxQueue isotp has already had
+
+    bool isSinkActive(FRAME_SINK &sink, CAN_FRAME &frame, int whichBus);
+    bool isSinkActive(FRAME_SINK &sink, CAN_FRAME_FD &frame, int whichBus);
+    bool blockingSinkFull(uint32_t waiting, uint32_t evictLevel);
+    void countDrop(FRAME_SINK &sink, int whichBus, DROP_REASON reason);
+    void sendDropStats();
+    template <class FrameType> void fanOutFrame(FrameType &frame, int whichBus);
+    void updateJitter(uint32_t id, uint32_t timestamp);
+    void updateBusLoad();
+    static void rxTaskEntry(void *param);
+    void rxTask();
+    static void rxWakeTaskEntry(void *param);
+    void rxWakeTask();
+    static void txTaskEntry(void *param);
+    void txTask();
+    void txFinished(int bus, CAN_FRAME &frame, TX_STATUS status, bool report = true);
+    void gatewayFrame(GatewayRoutes &routes, int bus, CAN_FRAME &frame);
+    void gatewayLatency(uint32_t latency);
+    static bool isoTpSend(void *context, int bus, uint32_t id, bool extended, const uint8_t *data);
+    void pollTwaiStatus();
+    void sendTxResults();
+    void sendBusEvents();
+    void sendToEventSinks(uint8_t *record, size_t length);
 };
@@ -1,37 +1,121 @@
 #include "commbuffer.h"
 #include "Logger.h"
 #include "gvret_comm.h"
+#include "frame_encoder.h"
+
+static_assert((WIFI_BUFF_SIZE & (WIFI_BUFF_SIZE - 1)) == 0, "WIFI_BUFF_SIZE must be a power of two");
 
 CommBuffer::CommBuffer()
 {
-    transmitBufferLength = 0;
+    transmitHead = 0;
+    transmitTail = 0;
+    overflowBytes = 0;
+    discardedBytes = 0;
+    binaryMode = false;
+    streamMode = 0;
+    answerPending = false;
+    discardSeen = 0;
+    resyncNeeded = false;
+    resyncSent = false;
+}
+
+//Starts a new compressed stream session (or ends it if mode is 0). The host has to forget its dictionary at the same time
+void CommBuffer::setStreamMode(uint8_t mode)
+{
+    streamMode = mode & (STREAM_COMPRESSED | STREAM_XOR | STREAM_TX_STATUS | STREAM_EVENTS | STREAM_DROP_STATS);
+    streamEncoder.reset(streamMode & STREAM_XOR);
+    discardSeen = discardedBytes;
+    resyncNeeded = false;
+    resyncSent = false;
 }
 
 size_t CommBuffer::numAvailableBytes()
 {
-    return transmitBufferLength;
+    return transmitHead.load(std::memory_order_acquire) - transmitTail.load(std::memory_order_acquire);
 }
 
-void CommBuffer::clearBufferedBytes()
+//none at all while a long answer is going out, so frame sinks treat the link as full until it is done
+size_t CommBuffer::numFreeBytes()
+{
+    if (answerPending) return 0;
+    return WIFI_BUFF_SIZE - numAvailableBytes();
+}
+
+//how many bytes can be read starting at getBufferedBytes() before hitting the end of the buffer
+size_t CommBuffer::numContiguousBytes()
 {
-    transmitBufferLength = 0;
+    uint32_t tail = transmitTail.load(std::memory_order_relaxed);
+    size_t avail = transmitHead.load(std::memory_order_acquire) - tail;
+    size_t toEnd = WIFI_BUFF_SIZE - (tail & (WIFI_BUFF_SIZE - 1));
+    return (avail < toEnd) ? avail : toEnd;
 }
 
 uint8_t* CommBuffer::getBufferedBytes()
 {
-    return transmitBuffer;
+    return &transmitBuffer[transmitTail.load(std::memory_order_relaxed) & (WIFI_BUFF_SIZE - 1)];
+}
+
+void CommBuffer::consumeBytes(size_t length)
+{
+    size_t avail = numAvailableBytes();
+    if (length > avail) length = avail;
+    transmitTail.store(transmitTail.load(std::memory_order_relaxed) + length, std::memory_order_release);
+}
+
+//consumer side, for a link nobody is reading. The bytes are counted rather than sent
+void CommBuffer::discardBytes(size_t length)
+{
+    size_t avail = numAvailableBytes();
+    if (length > avail) length = avail;
+    consumeBytes(length);
+    discardedBytes += length;
+}
+
+//anything half way through an answer goes too
+void CommBuffer::clearBufferedBytes()
+{
+    transmitTail.store(transmitHead.load(std::memory_order_acquire), std::memory_order_release);
+    answerPending = false;
+    resyncNeeded = true;
 }
 
-//a bit faster version that blasts through the copy more efficiently.
-void CommBuffer::sendBytesToBuffer(uint8_t *bytes, size_t length)
+//a bit faster version that blasts through the copy more efficiently. All or nothing so a frame is never split
+//by running out of room partway through.
+bool CommBuffer::sendBytesToBuffer(uint8_t *bytes, size_t length)
 {
-    memcpy(&transmitBuffer[transmitBufferLength], bytes, length);
-    transmitBufferLength += length;
+    if (answerPending || !queueBytes(bytes, length))
+    {
+        overflowBytes += length;
+        return false;
+    }
+    return true;
 }
 
-void CommBuffer::sendByteToBuffer(uint8_t byt)
+//the copy itself. Only the pieces of a pending answer come straight here, and they are retried rather than lost
+bool CommBuffer::queueBytes(const uint8_t *bytes, size_t length)
 {
-    transmitBuffer[transmitBufferLength++] = byt;
+    uint32_t head = transmitHead.load(std::memory_order_relaxed);
+    if (length > (WIFI_BUFF_SIZE - (head - transmitTail.load(std::memory_order_acquire)))) return false;
+    size_t pos = head & (WIFI_BUFF_SIZE - 1);
+    size_t firstPart = WIFI_BUFF_SIZE - pos;
+    if (firstPart > length) firstPart = length;
+    memcpy(&transmitBuffer[pos], bytes, firstPart);
+    if (firstPart < length) memcpy(transmitBuffer, bytes + firstPart, length - firstPart);
+    transmitHead.store(head + length, std::memory_order_release);
+    return true;
+}
+
+bool CommBuffer::sendByteToBuffer(uint8_t byt)
+{
+    uint32_t head = transmitHead.load(std::memory_order_relaxed);
+    if (answerPending || (head - transmitTail.load(std::memory_order_acquire)) >= WIFI_BUFF_SIZE)
+    {
+        overflowBytes++;
+        return false;
+    }
+    transmitBuffer[head & (WIFI_BUFF_SIZE - 1)] = byt;
+    transmitHead.store(head + 1, std::memory_order_release);
+    return true;
 }
 
 void CommBuffer::sendString(String str)
@@ -41,100 +125,74 @@ void CommBuffer::sendString(String str)
     sendCharString(buff);
 }
 
+//all or nothing like a frame so a console line is never cut short
 void CommBuffer::sendCharString(char *str)
 {
-    char *p = str;
-    int i = 0;
-    while (*p)
+    size_t length = strlen(str);
+    if (sendBytesToBuffer((uint8_t *)str, length)) Logger::debug("Queued %i bytes", (int)length);
+}
+
+FRAME_FORMAT CommBuffer::getFrameFormat()
+{
+    if (!binaryMode) return FORMAT_TEXT;
+    if (streamMode & STREAM_COMPRESSED) return FORMAT_COMPRESSED;
+    return FORMAT_GVRET;
+}
+
+size_t CommBuffer::encodeFrame(uint8_t *out, CAN_FRAME &frame, int whichBus, uint32_t timestamp)
+{
+    switch (getFrameFormat())
     {
-        sendByteToBuffer(*p++);
-        i++;
-    }
-    Logger::debug("Queued %i bytes", i);
-}
-
-void CommBuffer::sendFrameToBuffer(CAN_FRAME &frame, int whichBus)
-{
-    uint8_t temp;
-    size_t writtenBytes;
-    if (settings.useBinarySerialComm) {
-        if (frame.extended) frame.id |= 1 << 31;
-        transmitBuffer[transmitBufferLength++] = 0xF1;
-        transmitBuffer[transmitBufferLength++] = 0; //0 = canbus frame sending
-        uint32_t now = micros();
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(now & 0xFF);
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(now >> 8);
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(now >> 16);
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(now >> 24);
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(frame.id & 0xFF);
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(frame.id >> 8);
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(frame.id >> 16);
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(frame.id >> 24);
-        transmitBuffer[transmitBufferLength++] = frame.length + (uint8_t)(whichBus << 4);
-        for (int c = 0; c < frame.length; c++) {
-            transmitBuffer[transmitBufferLength++] = frame.data.uint8[c];
-        }
-        //temp = checksumCalc(buff, 11 + frame.length);
-        temp = 0;
-        transmitBuffer[transmitBufferLength++] = temp;
-        //Serial.write(buff, 12 + frame.length);
-    } else {
-        writtenBytes = sprintf((char *)&transmitBuffer[transmitBufferLength], "%d - %x", micros(), frame.id);
-        transmitBufferLength += writtenBytes;
-        if (frame.extended) sprintf((char *)&transmitBuffer[transmitBufferLength], " X ");
-        else sprintf((char *)&transmitBuffer[transmitBufferLength], " S ");
-        transmitBufferLength += 3;
-        writtenBytes = sprintf((char *)&transmitBuffer[transmitBufferLength], "%i %i", whichBus, frame.length);
-        transmitBufferLength += writtenBytes;
-        for (int c = 0; c < frame.length; c++) {
-            writtenBytes = sprintf((char *)&transmitBuffer[transmitBufferLength], " %x", frame.data.uint8[c]);
-            transmitBufferLength += writtenBytes;
+    case FORMAT_TEXT:
+        return FrameEncoder::encodeText(out, frame, whichBus, timestamp);
+    case FORMAT_COMPRESSED:
+    {
+        //records the consumer threw away took slot definitions and timestamp steps with them
+        uint32_t discarded = discardedBytes;
+        if (discarded != discardSeen)
+        {
+            discardSeen = discarded;
+            resyncNeeded = true;
         }
-        sprintf((char *)&transmitBuffer[transmitBufferLength], "\r\n");
-        transmitBufferLength += 2;
+        resyncSent = resyncNeeded;
+        if (!resyncNeeded) return streamEncoder.encode(out, frame, whichBus, timestamp);
+        resyncNeeded = false;
+        streamEncoder.reset(streamMode & STREAM_XOR);
+        out[0] = 0xF1;
+        out[1] = PROTO_SET_STREAM_MODE;
+        out[2] = streamMode;
+        return 3 + streamEncoder.encode(&out[3], frame, whichBus, timestamp);
+    }
+    default:
+        return FrameEncoder::encodeBinary(out, frame, whichBus, timestamp);
     }
 }
 
-void CommBuffer::sendFrameToBuffer(CAN_FRAME_FD &frame, int whichBus)
-{
-    uint8_t temp;
-    size_t writtenBytes;
-    if (settings.useBinarySerialComm) {
-        if (frame.extended) frame.id |= 1 << 31;
-        transmitBuffer[transmitBufferLength++] = 0xF1;
-        transmitBuffer[transmitBufferLength++] = PROTO_BUILD_FD_FRAME;
-        uint32_t now = micros();
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(now & 0xFF);
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(now >> 8);
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(now >> 16);
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(now >> 24);
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(frame.id & 0xFF);
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(frame.id >> 8);
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(frame.id >> 16);
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(frame.id >> 24);
-        transmitBuffer[transmitBufferLength++] = frame.length;
-        transmitBuffer[transmitBufferLength++] = (uint8_t)(whichBus);
-        for (int c = 0; c < frame.length; c++) {
-            transmitBuffer[transmitBufferLength++] = frame.data.uint8[c];
-        }
-        //temp = checksumCalc(buff, 11 + frame.length);
-        temp = 0;
-        transmitBuffer[transmitBufferLength++] = temp;
-        //Serial.write(buff, 12 + frame.length);
-    } else {
-        writtenBytes = sprintf((char *)&transmitBuffer[transmitBufferLength], "%d - %x", micros(), frame.id);
-        transmitBufferLength += writtenBytes;
-        if (frame.extended) sprintf((char *)&transmitBuffer[transmitBufferLength], " X ");
-        else sprintf((char *)&transmitBuffer[transmitBufferLength], " S ");
-        transmitBufferLength += 3;
-        writtenBytes = sprintf((char *)&transmitBuffer[transmitBufferLength], "%i %i", whichBus, frame.length);
-        transmitBufferLength += writtenBytes;
-        for (int c = 0; c < frame.length; c++) {
-            writtenBytes = sprintf((char *)&transmitBuffer[transmitBufferLength], " %x", frame.data.uint8[c]);
-            transmitBufferLength += writtenBytes;
-        }
-        sprintf((char *)&transmitBuffer[transmitBufferLength], "\r\n");
-        transmitBufferLength += 2;
-    }
+//The frame encodeFrame() just did couldn't be queued. The compressed stream goes back to what the host has seen
+void CommBuffer::frameRefused()
+{
+    if (getFrameFormat() != FORMAT_COMPRESSED) return;
+    if (resyncSent) resyncNeeded = true;
+    else streamEncoder.undo();
+}
+
+//there is no compressed form of FD frames so those always go out as normal GVRET records
+size_t CommBuffer::encodeFrame(uint8_t *out, CAN_FRAME_FD &frame, int whichBus, uint32_t timestamp)
+{
+    if (!binaryMode) return FrameEncoder::encodeText(out, frame, whichBus, timestamp);
+    return FrameEncoder::encodeBinary(out, frame, whichBus, timestamp);
 }
 
+bool CommBuffer::sendFrameToBuffer(CAN_FRAME &frame, int whichBus)
+{
+    uint8_t buff[FrameEncoder::MAX_TEXT_LENGTH];
+    if (sendBytesToBuffer(buff, encodeFrame(buff, frame, whichBus, frame.timestamp))) return true;
+    frameRefused();
+    return false;
+}
+
+bool CommBuffer::sendFrameToBuffer(CAN_FRAME_FD &frame, int whichBus)
+{
+    uint8_t buff[FrameEncoder::MAX_TEXT_LENGTH];
+    return sendBytesToBuffer(buff, encodeFrame(buff, frame, whichBus, frame.timestamp));
+}
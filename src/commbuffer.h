@@ -1,23 +1,66 @@
 #pragma once
 #include <Arduino.h>
+#include <atomic>
 #include "config.h"
 #include "esp32_can.h"
+#include "frame_encoder.h"
 
+//How frames queued into a CommBuffer are put on the wire
+enum FRAME_FORMAT
+{
+    FORMAT_GVRET,       //plain GVRET binary records
+    FORMAT_TEXT,        //human readable lines for a terminal
+    FORMAT_COMPRESSED,  //compressed GVRET stream. Stateful so it is encoded per buffer
+    NUM_FRAME_FORMATS
+};
+
+//Single producer / single consumer ring buffer. Whatever formats frames and command replies is the producer and only
+//ever moves transmitHead. The transport that drains the buffer is the consumer and only ever moves transmitTail.
+//Both indices free run and are masked on access so WIFI_BUFF_SIZE must be a power of two.
+//The consumer should loop on getBufferedBytes() / numContiguousBytes() / consumeBytes() since the buffered data
+//can wrap around the end of transmitBuffer.
 class CommBuffer
 {
 public:
     CommBuffer();
     size_t numAvailableBytes();
+    size_t numFreeBytes();
+    size_t numContiguousBytes();
     uint8_t* getBufferedBytes();
+    void consumeBytes(size_t length);
+    void discardBytes(size_t length);
     void clearBufferedBytes();
-    void sendFrameToBuffer(CAN_FRAME &frame, int whichBus);
-    void sendFrameToBuffer(CAN_FRAME_FD &frame, int whichBus);
-    void sendBytesToBuffer(uint8_t *bytes, size_t length);
-    void sendByteToBuffer(uint8_t byt);
+    uint32_t getOverflowCount() { return overflowBytes; }
+    uint32_t getDiscardedBytes() { return discardedBytes; }
+    bool isAnswerPending() { return answerPending; }
+    void setBinaryMode(bool binary) { binaryMode = binary; }
+    bool isBinaryMode() { return binaryMode; }
+    FRAME_FORMAT getFrameFormat();
+    size_t encodeFrame(uint8_t *out, CAN_FRAME &frame, int whichBus, uint32_t timestamp);
+    size_t encodeFrame(uint8_t *out, CAN_FRAME_FD &frame, int whichBus, uint32_t timestamp);
+    void frameRefused();
+    void setStreamMode(uint8_t mode);
+    uint8_t getStreamMode() { return streamMode; }
+    bool sendFrameToBuffer(CAN_FRAME &frame, int whichBus);
+    bool sendFrameToBuffer(CAN_FRAME_FD &frame, int whichBus);
+    bool sendBytesToBuffer(uint8_t *bytes, size_t length);
+    bool sendByteToBuffer(uint8_t byt);
     void sendString(String str);
     void sendCharString(char *str);
 
 protected:
     byte transmitBuffer[WIFI_BUFF_SIZE];
-    int transmitBufferLength; //not creating a ring buffer. The buffer should be large enough to never overflow
-};
\ No newline at end of file
+    std::atomic<uint32_t> transmitHead; //producer side. Next byte to be written
+    std::atomic<uint32_t> transmitTail; //consumer side. Next byte to be sent
+    uint32_t overflowBytes; //bytes thrown away because the consumer wasn't keeping up
+    std::atomic<uint32_t> discardedBytes; //bytes that were queued but the consumer threw away unsent
+    bool binaryMode; //GVRET binary or text lines. Each link can be in a different mode
+    uint8_t streamMode; //PROTO_SET_STREAM_MODE flags. 0 = plain GVRET records
+    CompressedStreamEncoder streamEncoder;
+    uint32_t discardSeen;   //discardedBytes as of the last compressed record
+    bool resyncNeeded;      //the host has lost records. Reset the encoder and echo the stream mode before the next one
+    bool resyncSent;        //the last compressed record carried that echo
+    bool answerPending; //an answer too long to queue at once is going out in pieces. Nothing else may go in between
+
+    bool queueBytes(const uint8_t *bytes, size_t length);
+};
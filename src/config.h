@@ -35,6 +35,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <esp32_can.h>
 // #include <esp32_mcp2517fd.h>
 #include <Preferences.h>
+#include "can_filter.h"
+#include "gateway.h"
 
 //size to use for buffering writes to USB. On the ESP32 we're actually talking TTL serial to a TTL<->USB chip
 #define SER_BUFF_SIZE       1024
@@ -98,6 +100,8 @@ struct CANFDSettings {
 
 struct EEPROMSettings {
     CANFDSettings canSettings[NUM_BUSES];
+    FILTER canFilters[NUM_BUSES][NUM_FILTERS]; //stored in NVS as one blob per bus, "can%i-filters"
+    GATEWAY_RULE gatewayRules[NUM_GATEWAY_RULES]; //stored in NVS as one blob, "gateway"
 
     boolean useBinarySerialComm; //use a binary protocol on the serial link or human readable format?
 
@@ -107,9 +111,15 @@ struct EEPROMSettings {
     boolean enableBT; //are we enabling bluetooth too?
     char btName[32];
     int sendingBus;
+    uint8_t elmCacheMode;       //ELM_CACHE_MODE for the ELM327 emulator's OBDII answers
+    uint16_t elmCacheTtl;       //ms an answer stays fresh for PIDs without a TTL of their own
 
     boolean enableLawicel;
 
+    uint8_t reduceMode;         //REDUCE_MODE for sinks that have reduction turned on
+    uint16_t reduceInterval;    //ms between frames of one ID in REDUCE_RATE mode
+    uint16_t reduceRefresh;     //ms before an unchanged frame is resent in REDUCE_CHANGES mode. 0 = never
+
     //if we're using WiFi then output to serial is disabled (it's far too slow to keep up)  
     uint8_t wifiMode; //0 = don't use wifi, 1 = connect to an AP, 2 = Create an AP
     char SSID[32];     //null terminated string for the SSID
@@ -143,6 +153,8 @@ class SerialConsole;
 class CANManager;
 class LAWICELHandler;
 class ELM327Emu;
+class WiFiManager;
+class TxScheduler;
 
 extern EEPROMSettings settings;
 extern SystemSettings SysSettings;
@@ -153,6 +165,8 @@ extern SerialConsole console;
 extern CANManager canManager;
 extern LAWICELHandler lawicel;
 extern ELM327Emu elmEmulator;
+extern WiFiManager wifiManager;
+extern TxScheduler txScheduler;
 extern char deviceName[20];
 extern char otaHost[40];
 extern char otaFilename[100];
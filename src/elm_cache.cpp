@@ -0,0 +1,187 @@
+#include "elm_cache.h"
+#include <string.h>
+#include "elm_commands.h"
+
+#define TTL_FAST    100     //ms. Engine speed, road speed, load, throttle and so on
+#define TTL_SLOW    2000    //temperatures, pressures that barely move and fuel level
+#define TTL_FIXED   60000   //supported PID maps and vehicle information never change
+
+ElmCache::ElmCache()
+{
+    clear();
+}
+
+void ElmCache::clear()
+{
+    memset(entries, 0, sizeof(entries));
+    memset(&stats, 0, sizeof(stats));
+    useCounter = 0;
+    pending = nullptr;
+    pendingTime = 0;
+    pendingFirst = false;
+}
+
+int ElmCache::getNumEntries()
+{
+    int count = 0;
+    for (int i = 0; i < ELM_CACHE_ENTRIES; i++) if (entries[i].requestLength) count++;
+    return count;
+}
+
+uint32_t ElmCache::getTtl(const uint8_t *request, uint8_t length, uint32_t defaultTtl)
+{
+    if (length < 2) return defaultTtl;
+    if (request[0] == 0x09) return TTL_FIXED;
+    if (request[0] != 0x01 || length != 2) return defaultTtl;
+
+    switch (request[1])
+    {
+    case 0x00: case 0x20: case 0x40: case 0x60: case 0x80: case 0xA0: case 0xC0:
+        return TTL_FIXED;
+    case 0x04: case 0x0B: case 0x0C: case 0x0D: case 0x0E: case 0x10: case 0x11:
+    case 0x43: case 0x45: case 0x47: case 0x49: case 0x4A: case 0x4C: case 0x5E:
+        return TTL_FAST;
+    case 0x05: case 0x0F: case 0x2F: case 0x33: case 0x46: case 0x5C:
+        return TTL_SLOW;
+    }
+    return defaultTtl;
+}
+
+//Reads that give the same answer however often they are asked. Mode 02 and 22 requests carry two bytes after the mode
+bool ElmCache::isCacheable(const uint8_t *request, uint8_t length)
+{
+    if (length < 2) return false;
+    switch (request[0])
+    {
+    case 0x01: case 0x09:
+        return length == 2;
+    case 0x02: case 0x22:
+        return length == 3;
+    }
+    return false;
+}
+
+//Positive answers echo the mode + 0x40 and the PID. Negative ones are 7F, the mode and a reason
+bool ElmCache::isAnswerTo(const uint8_t *request, uint8_t requestLength, const uint8_t *data, uint16_t length)
+{
+    if (requestLength == 0 || length == 0) return false;
+    if (data[0] == 0x7F) return (length >= 2 && data[1] == request[0]);
+    if (data[0] != request[0] + 0x40 || length < requestLength) return false;
+    return !memcmp(&data[1], &request[1], requestLength - 1);
+}
+
+ELM_CACHE_ENTRY *ElmCache::find(uint32_t header, const uint8_t *request, uint8_t length)
+{
+    if (!isCacheable(request, length)) return nullptr;
+    for (int i = 0; i < ELM_CACHE_ENTRIES; i++)
+    {
+        ELM_CACHE_ENTRY &e = entries[i];
+        if (e.requestLength == length && e.header == header && !memcmp(e.request, request, length)) return &e;
+    }
+    return nullptr;
+}
+
+ELM_CACHE_ENTRY *ElmCache::findOrAdd(uint32_t header, const uint8_t *request, uint8_t length)
+{
+    ELM_CACHE_ENTRY *e = find(header, request, length);
+    if (e || !isCacheable(request, length)) return e;
+
+    e = &entries[0];
+    for (int i = 0; i < ELM_CACHE_ENTRIES; i++)
+    {
+        if (entries[i].requestLength == 0)
+        {
+            e = &entries[i];
+            break;
+        }
+        if (entries[i].lastUsed < e->lastUsed) e = &entries[i];
+    }
+    if (e == pending) pending = nullptr;
+    memset(e, 0, sizeof(ELM_CACHE_ENTRY));
+    e->header = header;
+    memcpy(e->request, request, length);
+    e->requestLength = length;
+    e->lastUsed = ++useCounter;
+    return e;
+}
+
+ELM_CACHE_RESULT ElmCache::lookup(uint32_t header, const uint8_t *request, uint8_t length, uint8_t mode, uint32_t defaultTtl,
+                                  uint32_t now, const ELM_CACHE_ENTRY **entry)
+{
+    *entry = nullptr;
+    if (!isCacheable(request, length)) return ELM_CACHE_MISS; //not counted, it was never going to be cached
+    ELM_CACHE_ENTRY *e = find(header, request, length);
+    *entry = e;
+    if (!e || e->numResponses == 0)
+    {
+        stats.misses++;
+        return ELM_CACHE_MISS;
+    }
+
+    uint32_t age = now - e->filled;
+    uint32_t ttl = getTtl(request, length, defaultTtl);
+    if (age < ttl)
+    {
+        e->lastUsed = ++useCounter;
+        stats.hits++;
+        return ELM_CACHE_FRESH;
+    }
+    if (mode == ELM_CACHE_REFRESH && age < ttl * ELM_CACHE_STALE_FACTOR)
+    {
+        e->lastUsed = ++useCounter;
+        stats.staleHits++;
+        return ELM_CACHE_STALE;
+    }
+    stats.misses++;
+    return ELM_CACHE_MISS;
+}
+
+void ElmCache::beginRequest(uint32_t header, const uint8_t *request, uint8_t length, uint32_t now)
+{
+    pending = findOrAdd(header, request, length);
+    pendingTime = now;
+    pendingFirst = true;
+}
+
+void ElmCache::store(ELM_CACHE_ENTRY &entry, uint32_t rxId, const uint8_t *data, uint8_t length, uint32_t now)
+{
+    int slot = 0;
+    while (slot < entry.numResponses && entry.responses[slot].rxId != rxId) slot++;
+    if (slot >= ELM_CACHE_RESPONSES) return;
+    if (slot == entry.numResponses) entry.numResponses++;
+    ELM_CACHED_RESPONSE &r = entry.responses[slot];
+    r.rxId = rxId;
+    r.length = length;
+    memcpy(r.data, data, length);
+    entry.filled = now;
+}
+
+void ElmCache::addResponse(uint32_t rxId, const uint8_t *data, uint16_t length, uint32_t now)
+{
+    if (length < 2 || length > 7 || data[0] < 0x40 || data[0] == 0x7F) return;
+
+    ELM_CACHE_ENTRY *ours = nullptr;
+    if (pending && (now - pendingTime) < ELM_CACHE_COLLECT && isAnswerTo(pending->request, pending->requestLength, data, length))
+    {
+        ours = pending;
+        if (pendingFirst) ours->numResponses = 0;
+        pendingFirst = false;
+        store(*ours, rxId, data, length, now);
+    }
+
+    //the same answer also fills the entry for asking that ECU directly, whoever asked
+    uint32_t header = ElmCommands::requestId(rxId, 0);
+    if (header == 0) return;
+    uint8_t request[3];
+    uint8_t requestLength = (data[0] == 0x62 || data[0] == 0x42) ? 3 : 2; //16 bit identifiers, PID and frame number
+    if (length < requestLength) return;
+    request[0] = data[0] - 0x40;
+    memcpy(&request[1], &data[1], requestLength - 1);
+    ELM_CACHE_ENTRY *direct = (ours && ours->header == header) ? ours : findOrAdd(header, request, requestLength);
+    if (direct == ours) return;
+    if (direct)
+    {
+        store(*direct, rxId, data, length, now);
+        if (!ours) stats.passiveFills++;
+    }
+}
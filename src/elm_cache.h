@@ -0,0 +1,84 @@
+#pragma once
+#include <stdint.h>
+
+#define ELM_CACHE_ENTRIES       32      //requests remembered. The least recently used one goes
+#define ELM_CACHE_RESPONSES     4       //ECUs remembered per request, enough for a 7DF broadcast on most cars
+#define ELM_CACHE_STALE_FACTOR  4       //a stale answer can still be served this many TTLs after it came in
+#define ELM_CACHE_COLLECT       500     //ms after our own request that answers are still taken as answers to it
+
+enum ELM_CACHE_MODE
+{
+    ELM_CACHE_OFF,
+    ELM_CACHE_ON,           //fresh answers come from the cache, anything older goes to the ECU
+    ELM_CACHE_REFRESH       //stale answers are served too and the ECU is asked again in the background
+};
+
+enum ELM_CACHE_RESULT
+{
+    ELM_CACHE_MISS,
+    ELM_CACHE_FRESH,
+    ELM_CACHE_STALE
+};
+
+typedef struct {
+    uint32_t rxId;
+    uint8_t length;
+    uint8_t data[7];
+} ELM_CACHED_RESPONSE;
+
+typedef struct {
+    uint32_t header;        //address the request went to, ATSH
+    uint8_t request[3];     //mode and PID
+    uint8_t requestLength;  //0 = free
+    uint32_t filled;        //ms
+    uint32_t lastUsed;
+    uint8_t numResponses;
+    ELM_CACHED_RESPONSE responses[ELM_CACHE_RESPONSES];
+} ELM_CACHE_ENTRY;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t staleHits;     //served while being refreshed in the background
+    uint32_t misses;
+    uint32_t passiveFills;  //answers to somebody else's requests that were kept
+} ELM_CACHE_STATS;
+
+/*
+Answers to OBDII requests kept for a while so gauges polled over and over don't each cost a round trip to the ECU.
+Keyed by the request header and the mode / PID bytes, holding one answer per ECU that replied. Only the read-only
+services are cached, modes 01, 02, 09 and 22. Anything else changes the ECU's state or depends on it (sessions,
+security access seeds, tester present, routines) and always goes to the bus. Only positive single frame answers are
+kept, which covers mode 01 and most mode 22 values. Each PID gets its own TTL: engine speed and
+the like a tenth of a second, temperatures and levels a few seconds, the supported PID maps and mode 09 for a minute.
+Everything else gets the default TTL.
+Answers to our own requests are collected for ELM_CACHE_COLLECT ms after beginRequest(). Answers from 7E8 - 7EF or
+18DAF1xx to anybody else's requests fill the entry for the matching physical request header, 7E0 - 7E7 or 18DAxxF1.
+No Arduino or board headers in here so it can be checked on a PC.
+*/
+class ElmCache
+{
+public:
+    ElmCache();
+    void clear();
+    ELM_CACHE_RESULT lookup(uint32_t header, const uint8_t *request, uint8_t length, uint8_t mode, uint32_t defaultTtl,
+                            uint32_t now, const ELM_CACHE_ENTRY **entry);
+    void beginRequest(uint32_t header, const uint8_t *request, uint8_t length, uint32_t now);
+    void addResponse(uint32_t rxId, const uint8_t *data, uint16_t length, uint32_t now);
+    ELM_CACHE_STATS &getStats() { return stats; }
+    int getNumEntries();
+    static uint32_t getTtl(const uint8_t *request, uint8_t length, uint32_t defaultTtl);
+    static bool isCacheable(const uint8_t *request, uint8_t length);
+    static bool isAnswerTo(const uint8_t *request, uint8_t requestLength, const uint8_t *data, uint16_t length);
+
+private:
+    ELM_CACHE_ENTRY entries[ELM_CACHE_ENTRIES];
+    ELM_CACHE_STATS stats;
+    uint32_t useCounter;
+    ELM_CACHE_ENTRY *pending;   //entry our last request is filling, nullptr if none
+    uint32_t pendingTime;
+    bool pendingFirst;          //no answer in yet, the old ones go when the first arrives
+
+    ELM_CACHE_ENTRY *find(uint32_t header, const uint8_t *request, uint8_t length);
+    ELM_CACHE_ENTRY *findOrAdd(uint32_t header, const uint8_t *request, uint8_t length);
+    static void store(ELM_CACHE_ENTRY &entry, uint32_t rxId, const uint8_t *data, uint8_t length, uint32_t now);
+};
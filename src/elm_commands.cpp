@@ -0,0 +1,283 @@
+#include "elm_commands.h"
+#include <string.h>
+#include "utility.h"
+#include "elm_timing.h"
+
+typedef void (*ElmHandler)(char *args, ELM_STATE &state, ElmReply &reply);
+
+typedef struct {
+    const char *name;   //without the leading "at"
+    bool prefix;        //arguments follow the name
+    ElmHandler handler; //nullptr if the command only answers
+    const char *reply;  //added after the handler, nullptr for no reply
+} ELM_AT_COMMAND;
+
+static void atReset(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    reply.add(ElmCommands::lineEnding(state));
+}
+
+//set header address (address we send queries to). Three digits for 11 bit IDs, six for the low 24 bits of a 29 bit
+//ID under the ATCP priority or all eight
+static void atSetHeader(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    size_t digits = strlen(args);
+    uint32_t value = Utility::parseHexString(args, digits);
+    if (digits == 3) state.ecuAddress = value & 0x7FF;
+    else if (digits == 6) state.ecuAddress = ((uint32_t)(state.canPriority & 0x1F) << 24) | value;
+    else if (digits == 8) state.ecuAddress = value & 0x1FFFFFFF;
+    else
+    {
+        reply.add("?");
+        return;
+    }
+    reply.add("OK");
+}
+
+static void atCanPriority(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    state.canPriority = Utility::parseHexString(args, strlen(args)) & 0x1F;
+}
+
+//Only the CAN protocols can be done here. 0 / automatic picks 11 bit 500k, the others are left as they were
+static void atSetProtocol(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    size_t length = strlen(args);
+    if (length == 0) return;
+    char protocol = args[length - 1];
+    if (protocol == '0') state.protocol = 6;
+    if (protocol >= '6' && protocol <= '9') state.protocol = protocol - '0';
+}
+
+static void atDescribeProtocol(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    static const char *names[] = {"can11/500", "can29/500", "can11/250", "can29/250"};
+    reply.add(names[state.protocol - 6]);
+}
+
+static void atProtocolNumber(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    reply.add((char)('0' + state.protocol));
+}
+
+//ATCRA hhh or hhhhhhhh takes answers from that ID only, X for any digit. No ID goes back to every ECU
+static void atReceiveAddress(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    size_t digits = strlen(args);
+    if (digits != 0 && digits != 3 && digits != 8)
+    {
+        reply.add("?");
+        return;
+    }
+    state.rxFilter = 0;
+    state.rxMask = 0;
+    for (size_t i = 0; i < digits; i++)
+    {
+        state.rxFilter <<= 4;
+        state.rxMask <<= 4;
+        if (args[i] == 'x') continue;
+        state.rxFilter |= Utility::parseHexCharacter(args[i]);
+        state.rxMask |= 0xF;
+    }
+    reply.add("OK");
+}
+
+static void atCanFilter(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    state.rxFilter = Utility::parseHexString(args, strlen(args));
+}
+
+static void atCanMask(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    state.rxMask = Utility::parseHexString(args, strlen(args));
+}
+
+static void atEcho(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    if (args[0] == '1') state.echo = true;
+    if (args[0] == '0') state.echo = false;
+}
+
+static void atHeaders(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    state.header = (args[0] == '1');
+}
+
+static void atLineFeeds(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    state.lineFeed = (args[0] == '1');
+}
+
+static void atDlcOff(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    state.dlc = false;
+}
+
+static void atDlcOn(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    state.dlc = true;
+}
+
+static void atAdaptiveTiming(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    if (args[0] >= '0' && args[0] <= '2') state.adaptiveTiming = args[0] - '0';
+}
+
+//00 goes back to the default like it does on a real ELM327
+static void atSetTimeout(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    state.stTimeout = Utility::parseHexString(args, strlen(args));
+    if (state.stTimeout == 0) state.stTimeout = ELM_ST_DEFAULT;
+}
+
+static void atMonitorAll(char *args, ELM_STATE &state, ElmReply &reply)
+{
+    state.monitorMode = true;
+}
+
+static const ELM_AT_COMMAND atCommands[] = {
+    {"z",    false, atReset,      "ELM327 v1.3a"},
+    {"sh",   true,  atSetHeader,  nullptr},
+    {"e",    true,  atEcho,       nullptr},
+    {"h",    true,  atHeaders,    "OK"},
+    {"l",    true,  atLineFeeds,  "OK"},
+    {"@1",   false, nullptr,      "OBDLink MX"},
+    {"i",    false, nullptr,      "ELM327 v1.5"},
+    {"at",   true,  atAdaptiveTiming, "OK"},
+    {"st",   true,  atSetTimeout, "OK"},
+    {"sp",   true,  atSetProtocol, "OK"},
+    {"tp",   true,  atSetProtocol, "OK"},           //try protocol, nothing to try with only CAN
+    {"dp",   false, atDescribeProtocol, nullptr},
+    {"dpn",  false, atProtocolNumber, nullptr},     //same as passed to sp
+    {"cp",   true,  atCanPriority, "OK"},
+    {"cra",  true,  atReceiveAddress, nullptr},
+    {"cf",   true,  atCanFilter,  "OK"},
+    {"cm",   true,  atCanMask,    "OK"},
+    {"d0",   true,  atDlcOff,     "OK"},
+    {"d1",   true,  atDlcOn,      "OK"},
+    {"d",    false, nullptr,      "OK"},            //set to defaults
+    {"ma",   true,  atMonitorAll, nullptr},
+    {"m",    true,  nullptr,      "OK"},            //memory on/off
+    //TODO: the system should actually have this value so it wouldn't hurt to look it up and report the real value.
+    {"rv",   false, nullptr,      "14.2V"},
+};
+
+void ElmCommands::reset(ELM_STATE &state)
+{
+    state.lineFeed = true;
+    state.header = false;
+    state.echo = false;
+    state.monitorMode = false;
+    state.dlc = false;
+    state.ecuAddress = 0x7E0;
+    state.adaptiveTiming = 1;
+    state.stTimeout = ELM_ST_DEFAULT;
+    state.protocol = 6;
+    state.canPriority = ELM_CAN_PRIORITY;
+    state.rxFilter = 0;
+    state.rxMask = 0;
+}
+
+//Without ATCRA / ATCF / ATCM anything in the OBDII answer range gets through: 7E8 - 7EF or 18DAF1xx
+void ElmCommands::getReceiveFilter(const ELM_STATE &state, uint32_t &id, uint32_t &mask)
+{
+    bool extended = isExtended(state);
+    if (state.rxMask)
+    {
+        mask = state.rxMask & (extended ? 0x1FFFFFFF : 0x7FF);
+        id = state.rxFilter & mask;
+    }
+    else if (extended)
+    {
+        id = 0x18DAF100;
+        mask = 0x1FFFFF00;
+    }
+    else
+    {
+        id = 0x7E8;
+        mask = 0x7F8;
+    }
+}
+
+//Headers for one ECU, 7E0 - 7E7 or 18DAxxF1. Anything else is sent as a functional request
+bool ElmCommands::isPhysical(uint32_t header, bool extended)
+{
+    if (extended) return (header & 0x1FFF00FF) == 0x18DA00F1;
+    return header >= 0x7E0 && header <= 0x7E7;
+}
+
+//the ID a physically addressed ECU answers on
+uint32_t ElmCommands::responseId(uint32_t header, bool extended)
+{
+    if (extended) return 0x18DAF100 | ((header >> 8) & 0xFF);
+    return header + 8;
+}
+
+//where the flow control for an answer goes. The ECU's own request ID where there's a standard one, otherwise the
+//current header like the ELM327 does
+uint32_t ElmCommands::requestId(uint32_t rxId, uint32_t header)
+{
+    if (rxId >= 0x7E8 && rxId <= 0x7EF) return rxId - 8;
+    if ((rxId & 0x1FFFFF00) == 0x18DAF100) return 0x18DA00F1 | ((rxId & 0xFF) << 8);
+    return header;
+}
+
+bool ElmCommands::dispatch(char *cmd, ELM_STATE &state, ElmReply &reply)
+{
+    if (strncmp(cmd, "at", 2)) return false;
+    char *name = cmd + 2;
+
+    for (size_t i = 0; i < sizeof(atCommands) / sizeof(atCommands[0]); i++)
+    {
+        const ELM_AT_COMMAND &command = atCommands[i];
+        size_t nameLength = strlen(command.name);
+        if (command.prefix ? strncmp(name, command.name, nameLength) : strcmp(name, command.name)) continue;
+        if (command.handler) command.handler(name + nameLength, state, reply);
+        if (command.reply) reply.add(command.reply);
+        return true;
+    }
+    reply.add("OK"); //respond to anything not specifically handled by just saying OK and pretending
+    return true;
+}
+
+void ElmReply::clear()
+{
+    length = 0;
+    truncated = false;
+    text[0] = 0;
+}
+
+void ElmReply::add(const char *str)
+{
+    while (*str) add(*str++);
+}
+
+void ElmReply::add(char chr)
+{
+    if (length >= ELM_REPLY_SIZE)
+    {
+        truncated = true;
+        return;
+    }
+    text[length++] = chr;
+    text[length] = 0;
+}
+
+//upper case like the ELM327 itself, always exactly digits long
+void ElmReply::addHex(uint32_t value, int digits)
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+    for (int i = digits - 1; i >= 0; i--) add(hexDigits[(value >> (4 * i)) & 0xF]);
+}
+
+void ElmReply::addDecimal(uint32_t value)
+{
+    char digits[10];
+    int count = 0;
+    do
+    {
+        digits[count++] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+    while (count) add(digits[--count]);
+}
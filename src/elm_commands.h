@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define ELM_REPLY_SIZE  128 //longest reply built in one go. Longer ones (big ISO-TP answers) are sent in pieces
+#define ELM_CAN_PRIORITY 0x18 //ATCP default, top bits of a 29 bit header given as six digits
+
+//Everything the AT commands can change
+typedef struct {
+    bool lineFeed;      //should we use line feeds?
+    bool header;        //should we produce a header?
+    bool echo;          //should we echo back anything sent to us?
+    bool monitorMode;   //should we output all frames?
+    bool dlc;           //output DLC?
+    uint32_t ecuAddress;    //ATSH, 11 or 29 bits depending on the protocol
+    uint8_t protocol;       //ATSP, 6 - 9 = ISO 15765-4 CAN 11/500, 29/500, 11/250, 29/250
+    uint8_t canPriority;    //ATCP
+    uint32_t rxFilter;      //ATCRA / ATCF / ATCM. A mask of 0 takes every ECU answer for the protocol
+    uint32_t rxMask;
+    uint8_t adaptiveTiming; //ATAT 0 - 2
+    uint8_t stTimeout;      //ATST, longest wait for an answer in 4.096ms units
+} ELM_STATE;
+
+//Fixed size text buffer replies are built in before going to the TX buffer in one piece. Anything that doesn't fit
+//is cut off and counted rather than allocated for
+class ElmReply
+{
+public:
+    ElmReply() { clear(); }
+    void clear();
+    void add(const char *str);
+    void add(char chr);
+    void addHex(uint32_t value, int digits);
+    void addDecimal(uint32_t value);
+    const char *getText() { return text; }
+    size_t getLength() { return length; }
+    size_t getFree() { return ELM_REPLY_SIZE - length; }
+    bool isTruncated() { return truncated; }
+
+private:
+    char text[ELM_REPLY_SIZE + 1];
+    size_t length;
+    bool truncated;
+};
+
+//AT command table. Each entry is either matched exactly or as a prefix with the arguments following, first match
+//wins so longer names sharing a prefix come first. Unknown AT commands get "OK" like a real ELM327 pretends to.
+//No Arduino or board headers in here so it can be checked on a PC.
+class ElmCommands
+{
+public:
+    static void reset(ELM_STATE &state);
+    //false if cmd isn't an AT command, which makes it an OBDII request for the caller to send
+    static bool dispatch(char *cmd, ELM_STATE &state, ElmReply &reply);
+    static const char *lineEnding(const ELM_STATE &state) { return state.lineFeed ? "\r\n" : "\r"; }
+    static bool isExtended(const ELM_STATE &state) { return state.protocol == 7 || state.protocol == 9; }
+    static void getReceiveFilter(const ELM_STATE &state, uint32_t &id, uint32_t &mask);
+    static bool isPhysical(uint32_t header, bool extended);
+    static uint32_t responseId(uint32_t header, bool extended);
+    static uint32_t requestId(uint32_t rxId, uint32_t header);
+};
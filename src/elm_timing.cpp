@@ -0,0 +1,78 @@
+#include "elm_timing.h"
+#include <string.h>
+
+#define ADAPTIVE1_MARGIN    10000   //us on top of twice the learned time
+#define ADAPTIVE2_MARGIN    2000    //us on top of one and a half times
+
+ElmTiming::ElmTiming()
+{
+    clear();
+}
+
+void ElmTiming::clear()
+{
+    memset(entries, 0, sizeof(entries));
+    useCounter = 0;
+}
+
+ElmTiming::Entry *ElmTiming::find(uint32_t address, const uint8_t *request, uint8_t length)
+{
+    if (length == 0 || length > 3) return nullptr;
+    for (int i = 0; i < ELM_TIMING_ENTRIES; i++)
+    {
+        Entry &e = entries[i];
+        if (e.length == length && e.address == address && !memcmp(e.request, request, length)) return &e;
+    }
+    return nullptr;
+}
+
+uint32_t ElmTiming::getLatency(uint32_t address, const uint8_t *request, uint8_t length)
+{
+    Entry *e = find(address, request, length);
+    return e ? e->latency : 0;
+}
+
+uint32_t ElmTiming::getTimeout(uint32_t address, const uint8_t *request, uint8_t length, uint8_t adaptive, uint8_t stTimeout)
+{
+    uint32_t maxTimeout = (stTimeout ? stTimeout : ELM_ST_DEFAULT) * (uint32_t)ELM_ST_UNIT;
+    if (adaptive == 0) return maxTimeout;
+    Entry *e = find(address, request, length);
+    if (!e) return maxTimeout;
+
+    uint32_t timeout;
+    if (adaptive == 1) timeout = e->latency * 2 + ADAPTIVE1_MARGIN;
+    else timeout = e->latency + e->latency / 2 + ADAPTIVE2_MARGIN;
+    if (timeout < ELM_ADAPTIVE_MIN) timeout = ELM_ADAPTIVE_MIN;
+    if (timeout > maxTimeout) timeout = maxTimeout;
+    return timeout;
+}
+
+void ElmTiming::noteLatency(uint32_t address, const uint8_t *request, uint8_t length, uint32_t latency)
+{
+    if (length == 0 || length > 3) return;
+    useCounter++;
+    Entry *e = find(address, request, length);
+    if (e)
+    {
+        if (latency > e->latency) e->latency = latency;
+        else e->latency -= (e->latency - latency) / 8;
+        e->lastUsed = useCounter;
+        return;
+    }
+
+    e = &entries[0];
+    for (int i = 0; i < ELM_TIMING_ENTRIES; i++)
+    {
+        if (entries[i].length == 0)
+        {
+            e = &entries[i];
+            break;
+        }
+        if (entries[i].lastUsed < e->lastUsed) e = &entries[i];
+    }
+    e->address = address;
+    memcpy(e->request, request, length);
+    e->length = length;
+    e->latency = latency;
+    e->lastUsed = useCounter;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+
+#define ELM_TIMING_ENTRIES  16      //requests whose response time is remembered. The least recently used one goes
+#define ELM_ST_DEFAULT      0x32    //ATST default, about 200ms
+#define ELM_ST_UNIT         4096    //us per ATST count
+#define ELM_ADAPTIVE_MIN    4000    //us. Never wait less than this however quick the ECU has been
+
+/*
+Learns how long each ECU takes to answer each request, like the adaptive timing of a real ELM327. A request is the
+address it went to and its mode / PID bytes, so a broadcast to 7DF is learned apart from the same PID sent to 7E0.
+A slower answer than expected is taken straight away, quicker ones only pull the estimate down an eighth at a time
+so one lucky answer doesn't make the next wait too short.
+ATAT0 always waits the whole ATST time. ATAT1 waits twice the learned time plus a margin, ATAT2 half as long again
+plus a smaller margin. Requests that haven't been answered yet wait the whole ATST time.
+No Arduino or board headers in here so it can be checked on a PC.
+*/
+class ElmTiming
+{
+public:
+    ElmTiming();
+    void clear();
+    uint32_t getTimeout(uint32_t address, const uint8_t *request, uint8_t length, uint8_t adaptive, uint8_t stTimeout);
+    void noteLatency(uint32_t address, const uint8_t *request, uint8_t length, uint32_t latency);
+    uint32_t getLatency(uint32_t address, const uint8_t *request, uint8_t length); //0 if not learned yet
+
+private:
+    struct Entry {
+        uint32_t address;
+        uint8_t request[3];
+        uint8_t length;     //0 = free
+        uint32_t latency;   //us
+        uint32_t lastUsed;
+    };
+    Entry entries[ELM_TIMING_ENTRIES];
+    uint32_t useCounter;
+
+    Entry *find(uint32_t address, const uint8_t *request, uint8_t length);
+};
@@ -0,0 +1,199 @@
+#include "frame_bits.h"
+
+#define CRC15_POLY      0x4599
+#define TRAILER_BITS    13  //CRC delimiter, ACK slot, ACK delimiter, 7 EOF, 3 intermission
+
+//Stuffing state between bytes is the last bit on the wire and how many of it in a row (1 - 4, five never survives
+//since it gets a stuff bit straight away). Packed as lastBit * 4 + (run - 1)
+#define STUFF_STATES    8
+
+//Frame laid out MSB first before stuffing
+class BitWriter
+{
+public:
+    uint8_t buff[72]; //enough for an extended FD frame with 64 bytes of data
+    int bits;
+
+    BitWriter() : bits(0) {}
+    void put(uint32_t value, int count)
+    {
+        for (int i = count - 1; i >= 0; i--)
+        {
+            if ((bits & 7) == 0) buff[bits >> 3] = 0;
+            if ((value >> i) & 1) buff[bits >> 3] |= 0x80 >> (bits & 7);
+            bits++;
+        }
+    }
+    int get(int bit) { return (buff[bit >> 3] >> (7 - (bit & 7))) & 1; }
+};
+
+static int stuffStep(int &state, int bit)
+{
+    int last = state >> 2;
+    int run = (state & 3) + 1;
+    if (bit == last) run++;
+    else
+    {
+        last = bit;
+        run = 1;
+    }
+    if (run == 5)
+    {
+        state = (!bit) << 2; //the stuff bit starts a run of its own
+        return 1;
+    }
+    state = (last << 2) | (run - 1);
+    return 0;
+}
+
+//Both tables are filled in before setup() runs so the RX task and senders never race to build them
+static struct FrameBitTables
+{
+    uint8_t stuff[STUFF_STATES][256]; //stuff bits in the low nibble, state after the byte in the high nibble
+    uint16_t crc15[256];
+
+    FrameBitTables()
+    {
+        for (int s = 0; s < STUFF_STATES; s++)
+        {
+            for (int b = 0; b < 256; b++)
+            {
+                int state = s;
+                int count = 0;
+                for (int i = 7; i >= 0; i--) count += stuffStep(state, (b >> i) & 1);
+                stuff[s][b] = (state << 4) | count;
+            }
+        }
+        for (int b = 0; b < 256; b++)
+        {
+            uint16_t crc = b << 7;
+            for (int i = 0; i < 8; i++)
+            {
+                crc <<= 1;
+                if (crc & 0x8000) crc ^= CRC15_POLY;
+            }
+            crc15[b] = crc & 0x7FFF;
+        }
+    }
+} tables;
+
+//stuff bits needed for bits [from, to) of the frame, carrying state from and to the neighbouring parts
+static uint32_t countStuff(BitWriter &frame, int from, int to, int &state)
+{
+    uint32_t count = 0;
+    int bit = from;
+    while ((bit & 7) && bit < to) count += stuffStep(state, frame.get(bit++));
+    while (bit + 8 <= to)
+    {
+        uint8_t entry = tables.stuff[state][frame.buff[bit >> 3]];
+        count += entry & 0xF;
+        state = entry >> 4;
+        bit += 8;
+    }
+    while (bit < to) count += stuffStep(state, frame.get(bit++));
+    return count;
+}
+
+static uint16_t crc15(BitWriter &frame)
+{
+    uint16_t crc = 0;
+    int bit = 0;
+    for (; bit + 8 <= frame.bits; bit += 8)
+        crc = ((crc << 8) ^ tables.crc15[((crc >> 7) ^ frame.buff[bit >> 3]) & 0xFF]) & 0x7FFF;
+    for (; bit < frame.bits; bit++)
+    {
+        int next = frame.get(bit) ^ ((crc >> 14) & 1);
+        crc = (crc << 1) & 0x7FFF;
+        if (next) crc ^= CRC15_POLY;
+    }
+    return crc;
+}
+
+static void putId(BitWriter &frame, uint32_t id, bool extended, int rtrOrRrs)
+{
+    frame.put(0, 1); //SOF
+    if (extended)
+    {
+        frame.put(id >> 18, 11);
+        frame.put(1, 1); //SRR
+        frame.put(1, 1); //IDE
+        frame.put(id, 18);
+        frame.put(rtrOrRrs, 1);
+    }
+    else
+    {
+        frame.put(id, 11);
+        frame.put(rtrOrRrs, 1);
+        frame.put(0, 1); //IDE
+    }
+}
+
+uint32_t FrameBits::classic(uint32_t id, bool extended, bool rtr, uint8_t length, const uint8_t *data)
+{
+    BitWriter frame;
+    if (length > 8) length = 8;
+
+    putId(frame, id, extended, rtr);
+    frame.put(0, extended ? 2 : 1); //r1 r0 / r0
+    frame.put(length, 4);
+    if (!rtr) for (int i = 0; i < length; i++) frame.put(data[i], 8);
+    frame.put(crc15(frame), 15);
+
+    int state = 1 << 2; //idle bus is recessive
+    return frame.bits + countStuff(frame, 0, frame.bits, state) + TRAILER_BITS;
+}
+
+uint8_t FrameBits::fdPaddedLength(uint8_t length)
+{
+    if (length <= 8) return length;
+    if (length <= 24) return (length + 3) & ~3;
+    if (length <= 32) return 32;
+    if (length <= 48) return 48;
+    return 64;
+}
+
+static uint8_t fdDLC(uint8_t length)
+{
+    if (length <= 8) return length;
+    if (length <= 24) return 9 + (length - 12) / 4;
+    if (length <= 32) return 13;
+    if (length <= 48) return 14;
+    return 15;
+}
+
+void FrameBits::fd(uint32_t id, bool extended, bool brs, uint8_t length, const uint8_t *data,
+                   uint32_t &nominalBits, uint32_t &dataBits)
+{
+    BitWriter frame;
+    if (length > 64) length = 64;
+    uint8_t padded = fdPaddedLength(length);
+
+    putId(frame, id, extended, 0); //RRS
+    frame.put(1, 1); //FDF
+    frame.put(0, 1); //res
+    frame.put(brs, 1);
+    int arbitrationEnd = frame.bits; //bit rate switches at the BRS sample point
+    frame.put(0, 1); //ESI
+    frame.put(fdDLC(padded), 4);
+    for (int i = 0; i < padded; i++) frame.put((i < length) ? data[i] : 0xCC, 8);
+
+    int state = 1 << 2;
+    uint32_t arbitration = arbitrationEnd + countStuff(frame, 0, arbitrationEnd, state);
+    uint32_t dataPhase = (frame.bits - arbitrationEnd) + countStuff(frame, arbitrationEnd, frame.bits, state);
+
+    //CRC field is 4 bits of stuff count then CRC17 or CRC21 with a fixed stuff bit before every 4 bits, plus
+    //the CRC delimiter which still goes at the data rate
+    uint32_t crcBits = 4 + ((padded > 16) ? 21 : 17);
+    dataPhase += crcBits + ((crcBits + 3) / 4) + 1;
+
+    if (brs)
+    {
+        nominalBits = arbitration + TRAILER_BITS - 1;
+        dataBits = dataPhase;
+    }
+    else
+    {
+        nominalBits = arbitration + dataPhase + TRAILER_BITS - 1;
+        dataBits = 0;
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+
+//Exact length on the wire of a CAN or CAN FD frame, stuff bits included. The frame is laid out bit for bit from
+//SOF to the end of the CRC and the stuff bits are counted a byte at a time with a lookup table. Classic frames need
+//their CRC worked out too since it is stuffed. CAN FD uses fixed stuff bits in the CRC field so it doesn't.
+//Everything after the CRC (delimiters, ACK, EOF and 3 bits of intermission) is a fixed 13 bits.
+//No Arduino or board headers in here so it can be checked on a PC.
+class FrameBits
+{
+public:
+    //bits of a classic frame, all at the nominal rate
+    static uint32_t classic(uint32_t id, bool extended, bool rtr, uint8_t length, const uint8_t *data);
+    //bits of an FD frame. With brs the ESI bit through the CRC delimiter go at the data rate and are returned in
+    //dataBits, everything else is in nominalBits. Without brs the whole frame is nominal
+    static void fd(uint32_t id, bool extended, bool brs, uint8_t length, const uint8_t *data,
+                   uint32_t &nominalBits, uint32_t &dataBits);
+    //FD payload sizes jump from 8 to 12, 16, 20, 24, 32, 48 and 64. Anything in between is padded out
+    static uint8_t fdPaddedLength(uint8_t length);
+};
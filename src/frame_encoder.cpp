@@ -0,0 +1,254 @@
+#include "frame_encoder.h"
+#include <string.h>
+#include "gvret_protocol.h"
+
+static const uint8_t hexDigits[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+
+static const uint32_t powersOfTen[10] = {1000000000ul, 100000000ul, 10000000ul, 1000000ul, 100000ul,
+                                         10000ul, 1000ul, 100ul, 10ul, 1ul};
+
+//What differs between the CAN and CAN FD GVRET records. Everything else is shared by encodeBinaryFrame
+template <class FrameType> struct GVRETLayout;
+
+template <> struct GVRETLayout<CAN_FRAME>
+{
+    static const uint8_t command = PROTO_BUILD_CAN_FRAME;
+    static const size_t headerLength = 11;
+    //classic frames pack the bus number into the top nibble of the length byte
+    static inline void writeLengthAndBus(uint8_t *out, const CAN_FRAME &frame, int whichBus)
+    {
+        out[10] = frame.length + (uint8_t)(whichBus << 4);
+    }
+    //always copy all 8 bytes. A fixed size copy is a couple of word stores instead of a call into memcpy and the
+    //checksum byte overwrites whatever lands past the real payload. Output buffers are sized for FD so this is safe.
+    static inline size_t payloadCopyLength(const CAN_FRAME &frame) { return 8; }
+};
+
+template <> struct GVRETLayout<CAN_FRAME_FD>
+{
+    static const uint8_t command = PROTO_BUILD_FD_FRAME;
+    static const size_t headerLength = 12;
+    static inline void writeLengthAndBus(uint8_t *out, const CAN_FRAME_FD &frame, int whichBus)
+    {
+        out[10] = frame.length;
+        out[11] = (uint8_t)whichBus;
+    }
+    static inline size_t payloadCopyLength(const CAN_FRAME_FD &frame) { return frame.length; }
+};
+
+//The ESP32 is little endian as is the GVRET protocol so the 32 bit fields are stored straight across.
+//Extended frames are flagged with bit 31 of the ID on the wire only, the caller's frame isn't touched.
+template <class FrameType>
+static inline size_t encodeBinaryFrame(uint8_t *out, const FrameType &frame, int whichBus, uint32_t timestamp)
+{
+    typedef GVRETLayout<FrameType> Layout;
+    uint32_t wireID = frame.id;
+    if (frame.extended) wireID |= 1ul << 31;
+
+    out[0] = 0xF1;
+    out[1] = Layout::command;
+    memcpy(&out[2], &timestamp, 4);
+    memcpy(&out[6], &wireID, 4);
+    Layout::writeLengthAndBus(out, frame, whichBus);
+    memcpy(&out[Layout::headerLength], frame.data.uint8, Layout::payloadCopyLength(frame));
+    out[Layout::headerLength + frame.length] = 0; //checksum is not computed. SavvyCAN ignores it
+    return Layout::headerLength + frame.length + 1;
+}
+
+size_t FrameEncoder::encodeBinary(uint8_t *out, const CAN_FRAME &frame, int whichBus, uint32_t timestamp)
+{
+    return encodeBinaryFrame(out, frame, whichBus, timestamp);
+}
+
+size_t FrameEncoder::encodeBinary(uint8_t *out, const CAN_FRAME_FD &frame, int whichBus, uint32_t timestamp)
+{
+    return encodeBinaryFrame(out, frame, whichBus, timestamp);
+}
+
+//Output is byte for byte what the old sprintf("%d - %x", ...) / " %x" chain produced. Note that the timestamp
+//was printed with %d so it goes negative once micros() passes 2^31. That is kept so existing log parsers don't change.
+template <class FrameType>
+static size_t encodeTextFrame(uint8_t *out, const FrameType &frame, int whichBus, uint32_t timestamp)
+{
+    uint8_t *p = out;
+    p += FrameEncoder::writeSignedDecimal(p, (int32_t)timestamp);
+    *p++ = ' ';
+    *p++ = '-';
+    *p++ = ' ';
+    p += FrameEncoder::writeHex(p, frame.id);
+    *p++ = ' ';
+    *p++ = frame.extended ? 'X' : 'S';
+    *p++ = ' ';
+    p += FrameEncoder::writeSignedDecimal(p, whichBus);
+    *p++ = ' ';
+    p += FrameEncoder::writeDecimal(p, frame.length);
+    for (int c = 0; c < frame.length; c++)
+    {
+        uint8_t byt = frame.data.uint8[c];
+        *p++ = ' ';
+        if (byt > 0xF) *p++ = hexDigits[byt >> 4];
+        *p++ = hexDigits[byt & 0xF];
+    }
+    *p++ = '\r';
+    *p++ = '\n';
+    return p - out;
+}
+
+size_t FrameEncoder::encodeText(uint8_t *out, const CAN_FRAME &frame, int whichBus, uint32_t timestamp)
+{
+    return encodeTextFrame(out, frame, whichBus, timestamp);
+}
+
+size_t FrameEncoder::encodeText(uint8_t *out, const CAN_FRAME_FD &frame, int whichBus, uint32_t timestamp)
+{
+    return encodeTextFrame(out, frame, whichBus, timestamp);
+}
+
+//Division free conversion. Each digit is found by counting how many times its power of ten can be subtracted
+//which is at most 9 subtractions per digit and much cheaper than a software divide on the Xtensa core.
+size_t FrameEncoder::writeDecimal(uint8_t *out, uint32_t value)
+{
+    uint8_t *p = out;
+    int idx = 0;
+    if (value == 0)
+    {
+        *p = '0';
+        return 1;
+    }
+    while (powersOfTen[idx] > value) idx++; //skip leading zeros
+    for (; idx < 10; idx++)
+    {
+        uint32_t pow = powersOfTen[idx];
+        uint8_t digit = '0';
+        while (value >= pow)
+        {
+            value -= pow;
+            digit++;
+        }
+        *p++ = digit;
+    }
+    return p - out;
+}
+
+size_t FrameEncoder::writeSignedDecimal(uint8_t *out, int32_t value)
+{
+    if (value >= 0) return writeDecimal(out, (uint32_t)value);
+    *out = '-';
+    return 1 + writeDecimal(out + 1, 0u - (uint32_t)value);
+}
+
+//lower case hex with no leading zeros, same as %x
+size_t FrameEncoder::writeHex(uint8_t *out, uint32_t value)
+{
+    int nibbles = (32 - __builtin_clz(value | 1) + 3) >> 2;
+    for (int i = nibbles - 1; i >= 0; i--)
+    {
+        out[i] = hexDigits[value & 0xF];
+        value >>= 4;
+    }
+    return nibbles;
+}
+
+CompressedStreamEncoder::CompressedStreamEncoder()
+{
+    reset(false);
+}
+
+void CompressedStreamEncoder::reset(bool useXor)
+{
+    for (int i = 0; i < NUM_SLOTS; i++) slots[i].valid = false;
+    lastTimestamp = 0;
+    haveTimestamp = false;
+    allowXor = useXor;
+    undoSlotNum = 0;
+    undoSlot = slots[0];
+    undoTimestamp = 0;
+    undoHaveTimestamp = false;
+}
+
+//the record the last encode() made never went out. Only good once, straight after that encode()
+void CompressedStreamEncoder::undo()
+{
+    slots[undoSlotNum] = undoSlot;
+    lastTimestamp = undoTimestamp;
+    haveTimestamp = undoHaveTimestamp;
+}
+
+size_t CompressedStreamEncoder::encode(uint8_t *out, const CAN_FRAME &frame, int whichBus, uint32_t timestamp)
+{
+    uint8_t *p = out;
+    uint32_t wireID = frame.id;
+    if (frame.extended) wireID |= 1ul << 31;
+    uint8_t length = (frame.length > 8) ? 8 : frame.length;
+
+    uint32_t hash = wireID ^ (wireID >> 7) ^ (wireID >> 14) ^ ((uint32_t)whichBus * 31);
+    uint8_t slotNum = hash % NUM_SLOTS;
+    Slot &slot = slots[slotNum];
+    undoSlotNum = slotNum;
+    undoSlot = slot;
+    undoTimestamp = lastTimestamp;
+    undoHaveTimestamp = haveTimestamp;
+    bool define = !slot.valid || slot.id != wireID || slot.bus != whichBus || slot.length != length;
+
+    //work out the XOR form up front so we only use it when it is actually shorter
+    uint8_t xorMask = 0;
+    uint8_t xorBytes[8];
+    int numChanged = 0;
+    if (allowXor && !define)
+    {
+        for (int c = 0; c < length; c++)
+        {
+            uint8_t diff = frame.data.uint8[c] ^ slot.data[c];
+            if (diff)
+            {
+                xorMask |= 1 << c;
+                xorBytes[numChanged++] = diff;
+            }
+        }
+    }
+    bool useXor = allowXor && !define && ((1 + numChanged) < length);
+
+    *p++ = 0xF1;
+    *p++ = PROTO_COMPRESSED_FRAME;
+    *p++ = slotNum | (define ? 0x40 : 0) | (useXor ? 0x80 : 0);
+
+    uint32_t delta = timestamp;
+    if (haveTimestamp)
+    {
+        int32_t signedDelta = (int32_t)(timestamp - lastTimestamp);
+        delta = ((uint32_t)signedDelta << 1) ^ (uint32_t)(signedDelta >> 31);
+    }
+    lastTimestamp = timestamp;
+    haveTimestamp = true;
+    while (delta > 0x7F)
+    {
+        *p++ = (uint8_t)(delta | 0x80);
+        delta >>= 7;
+    }
+    *p++ = (uint8_t)delta;
+
+    if (define)
+    {
+        memcpy(p, &wireID, 4);
+        p += 4;
+        *p++ = length + (uint8_t)(whichBus << 4);
+        slot.id = wireID;
+        slot.bus = whichBus;
+        slot.length = length;
+        slot.valid = true;
+    }
+
+    if (useXor)
+    {
+        *p++ = xorMask;
+        memcpy(p, xorBytes, numChanged);
+        p += numChanged;
+    }
+    else
+    {
+        memcpy(p, frame.data.uint8, length);
+        p += length;
+    }
+    memcpy(slot.data, frame.data.uint8, 8);
+    return p - out;
+}
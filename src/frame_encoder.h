@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <can_common.h>
+
+//Turns frames into the bytes that go out over the comm links. Everything here writes into a caller supplied
+//buffer and returns how many bytes were written so the result can be queued with a single copy.
+//Only depends on can_common and the GVRET command numbers, never on Arduino or board code, so keep it that way.
+class FrameEncoder
+{
+public:
+    //GVRET binary record is an 11 (CAN) or 12 (CAN FD) byte header, the payload, then a checksum byte
+    static const size_t MAX_BINARY_LENGTH = 12 + 64 + 1;
+    //longest possible text line is an FD frame: "-2147483648 - 1fffffff X 15 64" then 64 * " ff" then CRLF
+    static const size_t MAX_TEXT_LENGTH = 232;
+
+    static size_t encodeBinary(uint8_t *out, const CAN_FRAME &frame, int whichBus, uint32_t timestamp);
+    static size_t encodeBinary(uint8_t *out, const CAN_FRAME_FD &frame, int whichBus, uint32_t timestamp);
+    static size_t encodeText(uint8_t *out, const CAN_FRAME &frame, int whichBus, uint32_t timestamp);
+    static size_t encodeText(uint8_t *out, const CAN_FRAME_FD &frame, int whichBus, uint32_t timestamp);
+    static size_t writeDecimal(uint8_t *out, uint32_t value);
+    static size_t writeSignedDecimal(uint8_t *out, int32_t value);
+    static size_t writeHex(uint8_t *out, uint32_t value);
+};
+
+/*
+Compressed GVRET stream (see PROTO_SET_STREAM_MODE). Each classic CAN frame becomes one record:
+
+    F1 18 H TS [ID(4) LB] PAYLOAD
+
+H      bits 0-5: dictionary slot (0 - 62)
+       bit 6: slot definition follows TS. ID is 4 bytes little endian with bit 31 = extended, LB is length + (bus << 4).
+              The slot keeps this ID/bus/length until it is defined again
+       bit 7: PAYLOAD is XOR coded. A mask byte says which payload bytes changed since the last frame in this slot
+              and is followed by (new ^ old) for each set bit, lowest bit first. Bytes not in the mask are unchanged
+TS     the first record after a reset carries the full 32 bit timestamp as an unsigned LEB128 varint. After that it
+       is the signed difference in microseconds from the previous record, zigzag coded ((d << 1) ^ (d >> 31)) into
+       an unsigned LEB128 varint, so frames that come out slightly out of order don't look like a jump of 2^32
+PAYLOAD slot length raw bytes unless bit 7 is set
+
+Slots are chosen by hashing bus and ID so a slot can be redefined at any time. The host must just follow definitions.
+Dictionary, previous payloads and the timestamp base are all reset whenever the mode is set. CAN FD frames are
+always sent as normal PROTO_BUILD_FD_FRAME records.
+A record that is encoded but then can't be queued is taken back with undo() so the state stays what the host has
+seen. If records the host was going to get are thrown away after they were queued the device resets the encoder
+and sends the PROTO_SET_STREAM_MODE echo again ahead of the next record, see CommBuffer.
+*/
+class CompressedStreamEncoder
+{
+public:
+    static const int NUM_SLOTS = 63;
+    static const size_t MAX_LENGTH = 2 + 1 + 5 + 5 + 9;
+
+    CompressedStreamEncoder();
+    void reset(bool useXor);
+    size_t encode(uint8_t *out, const CAN_FRAME &frame, int whichBus, uint32_t timestamp);
+    void undo();
+
+private:
+    struct Slot {
+        uint32_t id; //bit 31 set for extended
+        uint8_t bus;
+        uint8_t length;
+        bool valid;
+        uint8_t data[8];
+    };
+    Slot slots[NUM_SLOTS];
+    uint32_t lastTimestamp;
+    bool haveTimestamp;     //false until the first record after a reset
+    bool allowXor;
+    //what the last encode() changed, for undo()
+    Slot undoSlot;
+    uint8_t undoSlotNum;
+    uint32_t undoTimestamp;
+    bool undoHaveTimestamp;
+};
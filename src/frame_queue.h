@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+//Single producer / single consumer queue of fixed size entries. Same free running index scheme as CommBuffer so
+//SIZE must be a power of two. The producer fills the entry from reserve() in place and then calls commit(). The
+//consumer works on front() in place and then calls pop(). Entries are never copied in or out.
+template <class T, uint32_t SIZE>
+class FrameQueue
+{
+    static_assert((SIZE & (SIZE - 1)) == 0, "FrameQueue SIZE must be a power of two");
+
+public:
+    FrameQueue() : head(0), tail(0), highWater(0) {}
+
+    //producer side. nullptr when the queue is full
+    T *reserve()
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if ((h - tail.load(std::memory_order_acquire)) >= SIZE) return nullptr;
+        return &entries[h & (SIZE - 1)];
+    }
+
+    void commit()
+    {
+        uint32_t h = head.load(std::memory_order_relaxed) + 1;
+        head.store(h, std::memory_order_release);
+        uint32_t used = h - tail.load(std::memory_order_relaxed);
+        if (used > highWater) highWater = used;
+    }
+
+    //consumer side. nullptr when the queue is empty
+    T *front()
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t) return nullptr;
+        return &entries[t & (SIZE - 1)];
+    }
+
+    //consumer side. The entry i places behind front() without taking anything off. nullptr past the last one
+    T *peek(uint32_t i)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if ((head.load(std::memory_order_acquire) - t) <= i) return nullptr;
+        return &entries[(t + i) & (SIZE - 1)];
+    }
+
+    void pop()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    uint32_t count() { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+    uint32_t capacity() { return SIZE; }
+    uint32_t getHighWater() { return highWater; }
+
+private:
+    T entries[SIZE];
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    uint32_t highWater; //most entries ever waiting at once. Only the producer writes it
+};
@@ -0,0 +1,103 @@
+#include "frame_reducer.h"
+
+FrameReducer::FrameReducer()
+{
+    mode = REDUCE_OFF;
+    interval = 0;
+    refresh = 0;
+    reset();
+}
+
+//forgets everything so the next frame of every ID goes out
+void FrameReducer::setMode(REDUCE_MODE newMode, uint32_t intervalMs, uint32_t refreshMs)
+{
+    mode = newMode;
+    interval = intervalMs * 1000;
+    refresh = refreshMs * 1000;
+    reset();
+}
+
+void FrameReducer::reset()
+{
+    for (int i = 0; i < REDUCER_TABLE_SIZE; i++) table[i].bus = 0xFF;
+    used = 0;
+    framesSuppressed = 0;
+    passed = nullptr;
+}
+
+//FNV-1a
+uint32_t FrameReducer::hashPayload(const uint8_t *data, uint8_t length)
+{
+    uint32_t hash = 2166136261ul;
+    for (int i = 0; i < length; i++)
+    {
+        hash ^= data[i];
+        hash *= 16777619ul;
+    }
+    return hash;
+}
+
+//slot for this bus and key, a fresh one if it's new, or nullptr when the table is full
+FrameReducer::Entry *FrameReducer::find(int bus, uint32_t key)
+{
+    uint32_t slot = ((key ^ (key >> 11)) * 2654435761ul + bus) & (REDUCER_TABLE_SIZE - 1);
+    for (int probe = 0; probe < REDUCER_TABLE_SIZE; probe++)
+    {
+        Entry &e = table[slot];
+        if (e.bus == 0xFF)
+        {
+            //keep a few slots spare so probe runs stay short
+            if (used >= REDUCER_TABLE_SIZE - (REDUCER_TABLE_SIZE / 8)) return nullptr;
+            e.bus = bus;
+            e.key = key;
+            e.everSent = false;
+            used++;
+            return &e;
+        }
+        if (e.key == key && e.bus == bus) return &e;
+        slot = (slot + 1) & (REDUCER_TABLE_SIZE - 1);
+    }
+    return nullptr;
+}
+
+//true if this frame should be sent on
+bool FrameReducer::pass(int bus, uint32_t id, bool extended, const uint8_t *data, uint8_t length, uint32_t timestamp)
+{
+    passed = nullptr;
+    if (mode == REDUCE_OFF) return true;
+
+    uint32_t key = id | (extended ? (1ul << 31) : 0);
+    Entry *e = find(bus, key);
+    if (!e) return true;
+
+    uint32_t hash = hashPayload(data, length);
+    bool send;
+    if (!e->everSent) send = true;
+    else if (mode == REDUCE_CHANGES)
+    {
+        send = (hash != e->hash) || (length != e->length) || (refresh && (timestamp - e->lastSent) >= refresh);
+    }
+    else send = (timestamp - e->lastSent) >= interval;
+
+    if (!send)
+    {
+        framesSuppressed++;
+        return false;
+    }
+    passed = e;
+    passedTimestamp = timestamp;
+    passedHash = hash;
+    passedLength = length;
+    return true;
+}
+
+//the frame pass() last let through went to at least one sink
+void FrameReducer::sent()
+{
+    if (!passed) return;
+    passed->lastSent = passedTimestamp;
+    passed->hash = passedHash;
+    passed->length = passedLength;
+    passed->everSent = true;
+    passed = nullptr;
+}
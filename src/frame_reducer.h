@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+
+#define REDUCER_TABLE_SIZE  512 //(bus, ID) pairs remembered. Must be a power of two
+
+enum REDUCE_MODE
+{
+    REDUCE_OFF,         //every frame goes out
+    REDUCE_CHANGES,     //only frames whose payload differs from the last one sent for that bus and ID, plus a refresh
+    REDUCE_RATE         //at most one frame per bus and ID every interval
+};
+
+//Cuts down the cyclic traffic sent to a sink. Remembers when each (bus, ID) was last sent and a hash of that payload
+//in a linear probed table. If the table fills up, IDs it has no room for are always let through so nothing is ever
+//hidden for lack of space. Times are the frame receive timestamps in microseconds.
+//pass() only decides. The frame it let through is remembered once sent() says a sink took it, so a frame no sink
+//had room for doesn't hold back the ones after it.
+//No Arduino or board headers in here so it can be checked on a PC.
+class FrameReducer
+{
+public:
+    FrameReducer();
+    void setMode(REDUCE_MODE mode, uint32_t intervalMs, uint32_t refreshMs);
+    REDUCE_MODE getMode() { return mode; }
+    void reset();
+    bool pass(int bus, uint32_t id, bool extended, const uint8_t *data, uint8_t length, uint32_t timestamp);
+    void sent();
+    uint32_t getFramesSuppressed() { return framesSuppressed; }
+    uint32_t getTableUsed() { return used; }
+
+private:
+    struct Entry {
+        uint32_t key;       //ID with bit 31 set for extended
+        uint32_t lastSent;  //timestamp of the last frame sent
+        uint32_t hash;      //payload hash of the last frame sent
+        uint8_t bus;        //0xFF = empty slot
+        uint8_t length;
+        bool everSent;      //false until sent(), the fields above mean nothing till then
+    };
+
+    Entry table[REDUCER_TABLE_SIZE];
+    REDUCE_MODE mode;
+    uint32_t interval;  //microseconds
+    uint32_t refresh;   //microseconds, 0 = never
+    uint32_t used;
+    uint32_t framesSuppressed;
+    Entry *passed;      //what the last pass() let through, for sent(). nullptr if nothing to remember
+    uint32_t passedTimestamp;
+    uint32_t passedHash;
+    uint8_t passedLength;
+
+    Entry *find(int bus, uint32_t key);
+    static uint32_t hashPayload(const uint8_t *data, uint8_t length);
+};
@@ -0,0 +1,111 @@
+#include "gateway.h"
+#include <string.h>
+
+static uint32_t routesMade = 0;
+
+GatewayRoutes::GatewayRoutes()
+{
+    generation = ++routesMade;
+    if (generation == 0) generation = ++routesMade;
+    memset(rules, 0, sizeof(rules));
+    for (int b = 0; b < GATEWAY_BUSES; b++)
+    {
+        stdIndex[b] = nullptr;
+        numExt[b] = 0;
+        numRules[b] = 0;
+    }
+}
+
+GatewayRoutes::~GatewayRoutes()
+{
+    for (int b = 0; b < GATEWAY_BUSES; b++) delete[] stdIndex[b];
+}
+
+//Only called once per set of rules. Rules going nowhere useful (disabled, bad bus numbers, back to the bus they came
+//from) are left out. Lower slots win when rules overlap
+void GatewayRoutes::compile(const GATEWAY_RULE *newRules, int count)
+{
+    if (count > NUM_GATEWAY_RULES) count = NUM_GATEWAY_RULES;
+    memcpy(rules, newRules, count * sizeof(GATEWAY_RULE));
+
+    for (int r = 0; r < count; r++)
+    {
+        GATEWAY_RULE &rule = rules[r];
+        if (!rule.enabled || rule.srcBus >= GATEWAY_BUSES) continue;
+        if (!rule.block && (rule.dstBus >= GATEWAY_BUSES || rule.dstBus == rule.srcBus)) continue;
+        numRules[rule.srcBus]++;
+        if (rule.extended)
+        {
+            rule.mask &= 0x1FFFFFFF;
+            extRules[rule.srcBus][numExt[rule.srcBus]++] = r;
+            continue;
+        }
+
+        rule.mask &= 0x7FF;
+        uint8_t *&index = stdIndex[rule.srcBus];
+        if (!index)
+        {
+            index = new uint8_t[2048];
+            memset(index, GATEWAY_NO_RULE, 2048);
+        }
+        for (uint32_t id = 0; id < 2048; id++)
+        {
+            if (index[id] == GATEWAY_NO_RULE && (id & rule.mask) == (rule.id & rule.mask)) index[id] = r;
+        }
+    }
+}
+
+void GatewayRoutes::rewrite(const GATEWAY_RULE &rule, uint32_t &id, bool extended, uint8_t *data, uint8_t length)
+{
+    if (rule.newIdMask)
+    {
+        id = (id & ~rule.newIdMask) | (rule.newId & rule.newIdMask);
+        id &= extended ? 0x1FFFFFFF : 0x7FF;
+    }
+    if (length > 8) length = 8;
+    for (int i = 0; i < length; i++) data[i] = (data[i] & ~rule.dataMask[i]) | (rule.dataValue[i] & rule.dataMask[i]);
+}
+
+GatewayLoopGuard::GatewayLoopGuard()
+{
+    memset(slots, 0, sizeof(slots));
+}
+
+//FNV-1a over everything that makes two frames the same frame on the same bus
+uint32_t GatewayLoopGuard::hashFrame(int bus, uint32_t id, bool extended, const uint8_t *data, uint8_t length)
+{
+    uint32_t hash = 2166136261ul;
+    uint8_t head[6] = {(uint8_t)bus, (uint8_t)id, (uint8_t)(id >> 8), (uint8_t)(id >> 16), (uint8_t)((id >> 24) | (extended ? 0x80 : 0)), length};
+    for (int i = 0; i < 6; i++)
+    {
+        hash ^= head[i];
+        hash *= 16777619ul;
+    }
+    if (length > 8) length = 8;
+    for (int i = 0; i < length; i++)
+    {
+        hash ^= data[i];
+        hash *= 16777619ul;
+    }
+    return hash;
+}
+
+void GatewayLoopGuard::sent(int bus, uint32_t id, bool extended, const uint8_t *data, uint8_t length, uint32_t now)
+{
+    uint32_t hash = hashFrame(bus, id, extended, data, length);
+    Slot &slot = slots[hash & (GATEWAY_LOOP_SLOTS - 1)];
+    slot.hash = hash;
+    slot.time = now;
+    slot.bus = bus;
+    slot.used = true;
+}
+
+bool GatewayLoopGuard::isLoop(int bus, uint32_t id, bool extended, const uint8_t *data, uint8_t length, uint32_t now)
+{
+    uint32_t hash = hashFrame(bus, id, extended, data, length);
+    Slot &slot = slots[hash & (GATEWAY_LOOP_SLOTS - 1)];
+    if (!slot.used || slot.hash != hash || slot.bus != bus) return false;
+    if ((now - slot.time) > GATEWAY_LOOP_WINDOW) return false;
+    slot.used = false; //caught it, the next copy starts fresh
+    return true;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+#define NUM_GATEWAY_RULES   32      //GWRULE0 - GWRULE31, all buses together
+#define GATEWAY_BUSES       8       //most buses a GatewayRoutes can route between
+#define GATEWAY_NO_RULE     0xFF
+#define GATEWAY_LOOP_SLOTS  64      //recently forwarded frames remembered for loop detection. Power of two
+#define GATEWAY_LOOP_WINDOW 2000    //us. A forwarded frame showing up again on the bus it was sent to within this is a loop
+
+//One forwarding rule. Frames from srcBus whose ID matches id under mask go to dstBus, or nowhere if block is set.
+//Set bits of newIdMask take the ID bits from newId and set bits of dataMask take the payload bits from dataValue.
+struct GATEWAY_RULE {  //should be 38 bytes
+    uint32_t id;
+    uint32_t mask;
+    uint32_t newId;
+    uint32_t newIdMask;     //0 = ID passes through unchanged
+    uint8_t dataMask[8];
+    uint8_t dataValue[8];
+    uint8_t srcBus;
+    uint8_t dstBus;
+    bool extended;
+    bool enabled;
+    bool block;
+    uint8_t reserved;
+} __attribute__((__packed__));
+
+//Every field has one writer. The counts are the RX task's, forwarded zeroed by it too when the rules change. The
+//latency fields are the TX task's. latencyTotal is atomic so nobody reading it gets half of an update
+typedef struct {
+    uint32_t forwarded[NUM_GATEWAY_RULES];
+    uint32_t blocked;       //matched a block rule
+    uint32_t loops;         //not forwarded because they were our own frames coming back
+    uint32_t dropped;       //destination TX queue was full
+    uint32_t latencyMin;    //us from receive timestamp to the frame being handed to the destination controller
+    uint32_t latencyMax;
+    std::atomic<uint64_t> latencyTotal;
+    uint32_t latencyCount;
+} GATEWAY_STATS;
+
+//Compiled form of the rules. Built once whenever the rules change and then only read, so the RX task can use it
+//while a new one is built. Standard IDs get a 2048 entry table per source bus holding the first matching rule, so
+//routing a standard frame is one lookup. Extended rules are checked in slot order, only those for the source bus.
+//No Arduino or board headers in here so it can be checked on a PC.
+class GatewayRoutes
+{
+public:
+    GatewayRoutes();
+    ~GatewayRoutes();
+    void compile(const GATEWAY_RULE *rules, int count);
+    bool hasRules(int bus) { return numRules[bus] > 0; }
+    uint32_t getGeneration() { return generation; } //different for every GatewayRoutes made, never 0
+    const GATEWAY_RULE &getRule(int rule) { return rules[rule]; }
+
+    //rule number or -1 if no rule wants the frame
+    int route(int bus, uint32_t id, bool extended)
+    {
+        if (!extended)
+        {
+            if (!stdIndex[bus]) return -1;
+            uint8_t r = stdIndex[bus][id & 0x7FF];
+            return (r == GATEWAY_NO_RULE) ? -1 : r;
+        }
+        for (int i = 0; i < numExt[bus]; i++)
+        {
+            const GATEWAY_RULE &rule = rules[extRules[bus][i]];
+            if ((id & rule.mask) == (rule.id & rule.mask)) return extRules[bus][i];
+        }
+        return -1;
+    }
+
+    static void rewrite(const GATEWAY_RULE &rule, uint32_t &id, bool extended, uint8_t *data, uint8_t length);
+
+private:
+    GATEWAY_RULE rules[NUM_GATEWAY_RULES];
+    uint8_t *stdIndex[GATEWAY_BUSES];   //only allocated for buses with standard rules
+    uint8_t extRules[GATEWAY_BUSES][NUM_GATEWAY_RULES];
+    uint8_t numExt[GATEWAY_BUSES];
+    uint8_t numRules[GATEWAY_BUSES];
+    uint32_t generation;
+};
+
+//Remembers what the gateway just put on each bus. Our own transmissions aren't received back, so the same frame
+//turning up on that bus straight afterwards means something outside (another bridge or a wiring loop) carried it
+//back and forwarding it again would go round forever. Direct mapped on a hash of ID and payload. A collision just
+//forgets the older frame, which can only let one more copy through before the loop is caught.
+class GatewayLoopGuard
+{
+public:
+    GatewayLoopGuard();
+    void sent(int bus, uint32_t id, bool extended, const uint8_t *data, uint8_t length, uint32_t now);
+    bool isLoop(int bus, uint32_t id, bool extended, const uint8_t *data, uint8_t length, uint32_t now);
+
+private:
+    struct Slot {
+        uint32_t hash;
+        uint32_t time;
+        uint8_t bus;
+        bool used;
+    };
+    Slot slots[GATEWAY_LOOP_SLOTS];
+
+    static uint32_t hashFrame(int bus, uint32_t id, bool extended, const uint8_t *data, uint8_t length);
+};
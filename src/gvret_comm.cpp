@@ -6,11 +6,80 @@ Implements handling of the GVRET comm protocol, both sending and receiving
 #include "SerialConsole.h"
 #include "config.h"
 #include "can_manager.h"
+#include "tx_scheduler.h"
 
 GVRET_Comm_Handler::GVRET_Comm_Handler()
 {
     step = 0;
     state = IDLE;
+    answer = ANSWER_NONE;
+    heldLength = 0;
+}
+
+/*
+Block version of processIncomingByte. Whenever the parser is idle and a whole PROTO_BUILD_CAN_FRAME record is sitting
+in the buffer it is decoded in one go straight from the buffer. That's nearly all of the traffic when a capture is
+being replayed to the bus. Anything else, and any record split across two reads, goes through the byte state machine
+so the results are exactly the same as feeding the bytes in one at a time.
+*/
+void GVRET_Comm_Handler::processIncomingBytes(const uint8_t *data, size_t length)
+{
+    size_t pos = 0;
+    while (pos < length)
+    {
+        if (answer != ANSWER_NONE) //the rest waits until the answer is all out
+        {
+            holdInput(&data[pos], length - pos);
+            return;
+        }
+        if (state == IDLE && data[pos] == 0xF1 && (length - pos) >= 9 && data[pos + 1] == PROTO_BUILD_CAN_FRAME)
+        {
+            const uint8_t *rec = &data[pos + 2];
+            uint8_t dataLength = rec[5] & 0xF;
+            if (dataLength > 8) dataLength = 8;
+            size_t recordLength = 2 + 6 + dataLength + 1; //F1, command, id/bus/len, data, checksum
+            if ((length - pos) >= recordLength)
+            {
+                uint32_t id = rec[0] | (rec[1] << 8) | (rec[2] << 16) | ((uint32_t)rec[3] << 24);
+                build_out_frame.extended = (id & (1ul << 31)) ? true : false;
+                build_out_frame.id = id & 0x7FFFFFFF;
+                out_bus = rec[4] & 3;
+                build_out_frame.length = dataLength;
+                memcpy(build_out_frame.data.uint8, &rec[6], dataLength);
+                build_out_frame.rtr = 0;
+                canManager.sendFrame(out_bus, build_out_frame);
+                pos += recordLength;
+                continue;
+            }
+        }
+        //same again for a whole PROTO_BUILD_CAN_BATCH. No need to copy it into batchBuff first
+        if (state == IDLE && data[pos] == 0xF1 && (length - pos) >= 4 && data[pos + 1] == PROTO_BUILD_CAN_BATCH
+            && data[pos + 2] <= MAX_BATCH_FRAMES)
+        {
+            int count = data[pos + 2];
+            size_t recordsLength = getBatchLength(&data[pos + 3], length - pos - 3, count);
+            if (recordsLength || count == 0)
+            {
+                size_t checkPos = pos + 3 + recordsLength;
+                if (checkPos < length)
+                {
+                    uint8_t checksum = checksumCalc((uint8_t *)&data[pos], checkPos - pos);
+                    sendBatch(&data[pos + 3], count, (checksum == data[checkPos]) ? BATCH_OK : BATCH_BAD_CHECKSUM);
+                    pos = checkPos + 1;
+                    continue;
+                }
+            }
+        }
+        processIncomingByte(data[pos++]);
+    }
+}
+
+//Callers stop reading while an answer is pending so no more than one read's worth should ever turn up here
+void GVRET_Comm_Handler::holdInput(const uint8_t *data, size_t length)
+{
+    if (length > sizeof(heldInput) - heldLength) length = sizeof(heldInput) - heldLength;
+    memcpy(&heldInput[heldLength], data, length);
+    heldLength += length;
 }
 
 void GVRET_Comm_Handler::processIncomingByte(uint8_t in_byte)
@@ -20,6 +89,7 @@ void GVRET_Comm_Handler::processIncomingByte(uint8_t in_byte)
 
     uint8_t temp8;
     uint16_t temp16;
+    uint8_t reply[17]; //longest fixed reply. Replies are built whole and queued in one go so a full buffer never splits one
 
     switch (state) {
     case IDLE:
@@ -29,7 +99,8 @@ void GVRET_Comm_Handler::processIncomingByte(uint8_t in_byte)
         }
         else if(in_byte == 0xE7)
         {
-            settings.useBinarySerialComm = true;
+            setBinaryMode(true);
+            if (this == &serialGVRET) settings.useBinarySerialComm = true;
             //setPromiscuousMode(); //going into binary comm will set promisc. mode too.
         } 
         else
@@ -48,50 +119,37 @@ void GVRET_Comm_Handler::processIncomingByte(uint8_t in_byte)
         case PROTO_TIME_SYNC:
             state = TIME_SYNC;
             step = 0;
-            transmitBuffer[transmitBufferLength++] = 0xF1;
-            transmitBuffer[transmitBufferLength++] = 1; //time sync
-            transmitBuffer[transmitBufferLength++] = (uint8_t) (now & 0xFF);
-            transmitBuffer[transmitBufferLength++] = (uint8_t) (now >> 8);
-            transmitBuffer[transmitBufferLength++] = (uint8_t) (now >> 16);
-            transmitBuffer[transmitBufferLength++] = (uint8_t) (now >> 24);
+            reply[0] = 0xF1;
+            reply[1] = 1; //time sync
+            reply[2] = (uint8_t) (now & 0xFF);
+            reply[3] = (uint8_t) (now >> 8);
+            reply[4] = (uint8_t) (now >> 16);
+            reply[5] = (uint8_t) (now >> 24);
+            sendBytesToBuffer(reply, 6);
             break;
         case PROTO_DIG_INPUTS:
             //immediately return the data for digital inputs
             temp8 = 0; //getDigital(0) + (getDigital(1) << 1) + (getDigital(2) << 2) + (getDigital(3) << 3) + (getDigital(4) << 4) + (getDigital(5) << 5);
-            transmitBuffer[transmitBufferLength++] = 0xF1;
-            transmitBuffer[transmitBufferLength++] = 2; //digital inputs
-            transmitBuffer[transmitBufferLength++] = temp8;
-            temp8 = checksumCalc(buff, 2);
-            transmitBuffer[transmitBufferLength++]  = temp8;
+            reply[0] = 0xF1;
+            reply[1] = 2; //digital inputs
+            reply[2] = temp8;
+            reply[3] = checksumCalc(buff, 2);
+            sendBytesToBuffer(reply, 4);
             state = IDLE;
             break;
         case PROTO_ANA_INPUTS:
             //immediately return data on analog inputs
-            temp16 = 0;// getAnalog(0);  // Analogue input 1
-            transmitBuffer[transmitBufferLength++] = 0xF1;
-            transmitBuffer[transmitBufferLength++] = 3;
-            transmitBuffer[transmitBufferLength++] = temp16 & 0xFF;
-            transmitBuffer[transmitBufferLength++] = uint8_t(temp16 >> 8);
-            temp16 = 0;//getAnalog(1);  // Analogue input 2
-            transmitBuffer[transmitBufferLength++] = temp16 & 0xFF;
-            transmitBuffer[transmitBufferLength++] = uint8_t(temp16 >> 8);
-            temp16 = 0;//getAnalog(2);  // Analogue input 3
-            transmitBuffer[transmitBufferLength++] = temp16 & 0xFF;
-            transmitBuffer[transmitBufferLength++] = uint8_t(temp16 >> 8);
-            temp16 = 0;//getAnalog(3);  // Analogue input 4
-            transmitBuffer[transmitBufferLength++] = temp16 & 0xFF;
-            transmitBuffer[transmitBufferLength++] = uint8_t(temp16 >> 8);
-            temp16 = 0;//getAnalog(4);  // Analogue input 5
-            transmitBuffer[transmitBufferLength++] = temp16 & 0xFF;
-            transmitBuffer[transmitBufferLength++] = uint8_t(temp16 >> 8);
-            temp16 = 0;//getAnalog(5);  // Analogue input 6
-            transmitBuffer[transmitBufferLength++] = temp16 & 0xFF;
-            transmitBuffer[transmitBufferLength++] = uint8_t(temp16 >> 8);
-            temp16 = 0;//getAnalog(6);  // Vehicle Volts
-            transmitBuffer[transmitBufferLength++] = temp16 & 0xFF;
-            transmitBuffer[transmitBufferLength++] = uint8_t(temp16 >> 8);
-            temp8 = checksumCalc(buff, 9);
-            transmitBuffer[transmitBufferLength++] = temp8;
+            //seven inputs: analogue 1 - 6 then vehicle volts. None of them are read on this hardware yet
+            reply[0] = 0xF1;
+            reply[1] = 3;
+            for (int a = 0; a < 7; a++)
+            {
+                temp16 = 0;// getAnalog(a);
+                reply[2 + a * 2] = temp16 & 0xFF;
+                reply[3 + a * 2] = uint8_t(temp16 >> 8);
+            }
+            reply[16] = checksumCalc(buff, 9);
+            sendBytesToBuffer(reply, 17);
             state = IDLE;
             break;
         case PROTO_SET_DIG_OUT:
@@ -105,30 +163,30 @@ void GVRET_Comm_Handler::processIncomingByte(uint8_t in_byte)
             break;
         case PROTO_GET_CANBUS_PARAMS:
             //immediately return data on canbus params
-            transmitBuffer[transmitBufferLength++] = 0xF1;
-            transmitBuffer[transmitBufferLength++] = 6;
-            transmitBuffer[transmitBufferLength++] = settings.canSettings[0].enabled + ((unsigned char) settings.canSettings[0].listenOnly << 4);
-            transmitBuffer[transmitBufferLength++] = settings.canSettings[0].nomSpeed;
-            transmitBuffer[transmitBufferLength++] = settings.canSettings[0].nomSpeed >> 8;
-            transmitBuffer[transmitBufferLength++] = settings.canSettings[0].nomSpeed >> 16;
-            transmitBuffer[transmitBufferLength++] = settings.canSettings[0].nomSpeed >> 24;
-            transmitBuffer[transmitBufferLength++] = settings.canSettings[1].enabled + ((unsigned char) settings.canSettings[1].listenOnly << 4);
-            transmitBuffer[transmitBufferLength++] = settings.canSettings[1].nomSpeed;
-            transmitBuffer[transmitBufferLength++] = settings.canSettings[1].nomSpeed >> 8;
-            transmitBuffer[transmitBufferLength++] = settings.canSettings[1].nomSpeed >> 16;
-            transmitBuffer[transmitBufferLength++] = settings.canSettings[1].nomSpeed >> 24;
+            reply[0] = 0xF1;
+            reply[1] = 6;
+            for (int b = 0; b < 2; b++)
+            {
+                reply[2 + b * 5] = settings.canSettings[b].enabled + ((unsigned char) settings.canSettings[b].listenOnly << 4);
+                reply[3 + b * 5] = settings.canSettings[b].nomSpeed;
+                reply[4 + b * 5] = settings.canSettings[b].nomSpeed >> 8;
+                reply[5 + b * 5] = settings.canSettings[b].nomSpeed >> 16;
+                reply[6 + b * 5] = settings.canSettings[b].nomSpeed >> 24;
+            }
+            sendBytesToBuffer(reply, 12);
             state = IDLE;
             break;
         case PROTO_GET_DEV_INFO:
             //immediately return device information
-            transmitBuffer[transmitBufferLength++] = 0xF1;
-            transmitBuffer[transmitBufferLength++] = 7;
-            transmitBuffer[transmitBufferLength++] = CFG_BUILD_NUM & 0xFF;
-            transmitBuffer[transmitBufferLength++] = (CFG_BUILD_NUM >> 8);
-            transmitBuffer[transmitBufferLength++] = 0x20;
-            transmitBuffer[transmitBufferLength++] = 0;
-            transmitBuffer[transmitBufferLength++] = 0;
-            transmitBuffer[transmitBufferLength++] = 0; //was single wire mode. Should be rethought for this board.
+            reply[0] = 0xF1;
+            reply[1] = 7;
+            reply[2] = CFG_BUILD_NUM & 0xFF;
+            reply[3] = (CFG_BUILD_NUM >> 8);
+            reply[4] = 0x20;
+            reply[5] = 0;
+            reply[6] = 0;
+            reply[7] = 0; //was single wire mode. Should be rethought for this board.
+            sendBytesToBuffer(reply, 8);
             state = IDLE;
             break;
         case PROTO_SET_SW_MODE:
@@ -137,10 +195,11 @@ void GVRET_Comm_Handler::processIncomingByte(uint8_t in_byte)
             step = 0;
             break;
         case PROTO_KEEPALIVE:
-            transmitBuffer[transmitBufferLength++] = 0xF1;
-            transmitBuffer[transmitBufferLength++] = 0x09;
-            transmitBuffer[transmitBufferLength++] = 0xDE;
-            transmitBuffer[transmitBufferLength++] = 0xAD;
+            reply[0] = 0xF1;
+            reply[1] = 0x09;
+            reply[2] = 0xDE;
+            reply[3] = 0xAD;
+            sendBytesToBuffer(reply, 4);
             state = IDLE;
             break;
         case PROTO_SET_SYSTYPE:
@@ -154,15 +213,17 @@ void GVRET_Comm_Handler::processIncomingByte(uint8_t in_byte)
             step = 0;
             break;
         case PROTO_GET_NUMBUSES:
-            transmitBuffer[transmitBufferLength++] = 0xF1;
-            transmitBuffer[transmitBufferLength++] = 12;
-            transmitBuffer[transmitBufferLength++] = SysSettings.numBuses;
+            reply[0] = 0xF1;
+            reply[1] = 12;
+            reply[2] = SysSettings.numBuses;
+            sendBytesToBuffer(reply, 3);
             state = IDLE;
             break;
         case PROTO_GET_EXT_BUSES:
-            transmitBuffer[transmitBufferLength++]  = 0xF1;
-            transmitBuffer[transmitBufferLength++]  = 13;
-            for (int u = 2; u < 17; u++) transmitBuffer[transmitBufferLength++] = 0;
+            reply[0] = 0xF1;
+            reply[1] = 13;
+            for (int u = 2; u < 17; u++) reply[u] = 0;
+            sendBytesToBuffer(reply, 17);
             step = 0;
             state = IDLE;
             break;
@@ -171,6 +232,66 @@ void GVRET_Comm_Handler::processIncomingByte(uint8_t in_byte)
             step = 0;
             buff[0] = 0xF1;
             break;
+        case PROTO_SET_STREAM_MODE:
+            state = SET_STREAM_MODE;
+            break;
+        case PROTO_BUILD_CAN_BATCH:
+            state = BUILD_CAN_BATCH;
+            batchChecksum = 0xF1 ^ PROTO_BUILD_CAN_BATCH;
+            step = 0;
+            break;
+        case PROTO_SET_PERIODIC:
+            state = SET_PERIODIC;
+            periodicBuff[0] = 0xF1;
+            periodicBuff[1] = PROTO_SET_PERIODIC;
+            step = 0;
+            break;
+        case PROTO_GET_PERIODIC:
+            startAnswer(ANSWER_PERIODIC);
+            state = IDLE;
+            break;
+        case PROTO_GET_BUS_LOAD:
+            reply[0] = 0xF1;
+            reply[1] = PROTO_GET_BUS_LOAD;
+            reply[2] = SysSettings.numBuses;
+            for (int b = 0; b < SysSettings.numBuses; b++)
+            {
+                reply[3 + b * 2] = canManager.getBusLoad(b);
+                reply[4 + b * 2] = canManager.getBusLoadPeak(b);
+            }
+            sendBytesToBuffer(reply, 3 + SysSettings.numBuses * 2);
+            state = IDLE;
+            break;
+        case PROTO_SET_GATEWAY:
+            state = SET_GATEWAY;
+            gatewayBuff[0] = 0xF1;
+            gatewayBuff[1] = PROTO_SET_GATEWAY;
+            step = 0;
+            break;
+        case PROTO_GET_GATEWAY_STATS:
+            startAnswer(ANSWER_GATEWAY);
+            state = IDLE;
+            break;
+        case PROTO_DROP_STATS:
+        {
+            uint8_t record[DROP_STATS_MAX_LENGTH];
+            sendBytesToBuffer(record, canManager.encodeDropStats(record));
+            state = IDLE;
+            break;
+        }
+        case PROTO_GET_BUS_EVENTS:
+            startAnswer(ANSWER_BUS_EVENTS);
+            state = IDLE;
+            break;
+        case PROTO_GET_ID_STATS:
+            state = GET_ID_STATS;
+            break;
+        case PROTO_SET_FILTER:
+            state = SET_FILTER;
+            buff[0] = 0xF1;
+            buff[1] = PROTO_SET_FILTER;
+            step = 0;
+            break;
         }
         break;
     case BUILD_CAN_FRAME:
@@ -215,7 +336,7 @@ void GVRET_Comm_Handler::processIncomingByte(uint8_t in_byte)
                 //this would be the checksum byte. Compute and compare.
                 //temp8 = checksumCalc(buff, step);
                 build_out_frame.rtr = 0;
-                if (out_bus < NUM_BUSES) canManager.sendFrame(canBuses[out_bus], build_out_frame);
+                canManager.sendFrame(out_bus, build_out_frame);
             }
             break;
         }
@@ -292,6 +413,7 @@ void GVRET_Comm_Handler::processIncomingByte(uint8_t in_byte)
                     if (settings.canSettings[0].listenOnly) canBuses[0]->setListenOnlyMode(true);
                     else canBuses[0]->setListenOnlyMode(false);
                     canBuses[0]->watchFor();
+                    canManager.applyFilters(0);
                 }
                 else canBuses[0]->disable();
                 break;
@@ -344,6 +466,7 @@ void GVRET_Comm_Handler::processIncomingByte(uint8_t in_byte)
                     if (settings.canSettings[1].listenOnly) canBuses[1]->setListenOnlyMode(true);
                     else canBuses[1]->setListenOnlyMode(false);
                     canBuses[1]->watchFor();
+                    canManager.applyFilters(1);
                 }
                 else canBuses[1]->disable();
 
@@ -418,6 +541,7 @@ void GVRET_Comm_Handler::processIncomingByte(uint8_t in_byte)
                     //{
 
                     //if(isConnected) {
+                    build_out_frame.timestamp = micros();
                     canManager.displayFrame(build_out_frame, 0);
                     //}
                     //}
@@ -426,6 +550,75 @@ void GVRET_Comm_Handler::processIncomingByte(uint8_t in_byte)
             }
             step++;
             break;
+        case BUILD_CAN_BATCH:
+            if (step == 0)
+            {
+                batchCount = in_byte;
+                batchLength = 0;
+                batchRecords = 0;
+                batchRecordPos = 0;
+            }
+            else if (batchRecords < batchCount)
+            {
+                //oversized batches are still walked record by record so the rest of it isn't taken as commands
+                if (batchLength < MAX_BATCH_BYTES) batchBuff[batchLength] = in_byte;
+                batchLength++;
+                if (batchRecordPos == 5) batchRecordSize = 6 + ((in_byte & 0xF) > 8 ? 8 : (in_byte & 0xF));
+                batchRecordPos++;
+                if (batchRecordPos > 5 && batchRecordPos == batchRecordSize)
+                {
+                    batchRecords++;
+                    batchRecordPos = 0;
+                }
+            }
+            else
+            {
+                if (batchCount > MAX_BATCH_FRAMES) sendBatch(batchBuff, batchCount, BATCH_TOO_LARGE);
+                else sendBatch(batchBuff, batchCount, (in_byte == batchChecksum) ? BATCH_OK : BATCH_BAD_CHECKSUM);
+                state = IDLE;
+            }
+            batchChecksum ^= in_byte;
+            step++;
+            break;
+        case SET_FILTER:
+            buff[2 + step] = in_byte;
+            if (step == 11) //checksum
+            {
+                setFilter(buff);
+                state = IDLE;
+            }
+            step++;
+            break;
+        case SET_PERIODIC:
+            periodicBuff[2 + step] = in_byte;
+            if (step == PERIODIC_RECORD_LENGTH - 3)
+            {
+                setPeriodic(periodicBuff);
+                state = IDLE;
+            }
+            step++;
+            break;
+        case SET_GATEWAY:
+            gatewayBuff[2 + step] = in_byte;
+            if (step == GATEWAY_RECORD_LENGTH - 3)
+            {
+                setGatewayRule(gatewayBuff);
+                state = IDLE;
+            }
+            step++;
+            break;
+        case GET_ID_STATS:
+            startAnswer(ANSWER_ID_STATS, in_byte);
+            state = IDLE;
+            break;
+        case SET_STREAM_MODE:
+            setStreamMode(in_byte);
+            reply[0] = 0xF1;
+            reply[1] = PROTO_SET_STREAM_MODE;
+            reply[2] = getStreamMode();
+            if (!sendBytesToBuffer(reply, 3)) resyncNeeded = true; //the host has to hear about the reset somehow
+            state = IDLE;
+            break;
         case SETUP_EXT_BUSES: //setup enable/listenonly/speed for SWCAN, Enable/Speed for LIN1, LIN2
             switch(step)
             {
@@ -476,6 +669,333 @@ void GVRET_Comm_Handler::processIncomingByte(uint8_t in_byte)
     }
 }
 
+//Size of count batch records starting at records, or 0 if they don't all fit in length bytes
+size_t GVRET_Comm_Handler::getBatchLength(const uint8_t *records, size_t length, int count)
+{
+    size_t pos = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (pos + 6 > length) return 0;
+        uint8_t dataLength = records[pos + 5] & 0xF;
+        if (dataLength > 8) dataLength = 8;
+        pos += 6 + dataLength;
+    }
+    if (pos > length) return 0;
+    return pos;
+}
+
+//Queues a checked batch onto the controllers back to back and tells the host how far it got. Stops at the first
+//frame that won't go so the host can pick up from there in order.
+void GVRET_Comm_Handler::sendBatch(const uint8_t *records, int count, GVRET_BATCH_STATUS status)
+{
+    int sent = 0;
+    if (status == BATCH_OK)
+    {
+        size_t pos = 0;
+        for (; sent < count; sent++)
+        {
+            const uint8_t *rec = &records[pos];
+            int bus = rec[0] & 3;
+            uint32_t id = rec[1] | (rec[2] << 8) | (rec[3] << 16) | ((uint32_t)rec[4] << 24);
+            uint8_t dataLength = rec[5] & 0xF;
+            if (dataLength > 8) dataLength = 8;
+            build_out_frame.extended = (id & (1ul << 31)) ? true : false;
+            build_out_frame.id = id & 0x7FFFFFFF;
+            build_out_frame.length = dataLength;
+            memcpy(build_out_frame.data.uint8, &rec[6], dataLength);
+            build_out_frame.rtr = 0;
+            if (!canManager.sendFrame(bus, build_out_frame)) break;
+            pos += 6 + dataLength;
+        }
+    }
+    uint8_t reply[4] = {0xF1, PROTO_BUILD_CAN_BATCH, (uint8_t)status, (uint8_t)sent};
+    sendBytesToBuffer(reply, sizeof(reply));
+}
+
+//record is a whole PROTO_SET_FILTER record from F1 to the checksum
+void GVRET_Comm_Handler::setFilter(const uint8_t *record)
+{
+    int bus = record[2];
+    int slot = record[3];
+    uint32_t id = record[4] | (record[5] << 8) | (record[6] << 16) | ((uint32_t)record[7] << 24);
+    uint32_t mask = record[8] | (record[9] << 8) | (record[10] << 16) | ((uint32_t)record[11] << 24);
+    uint8_t flags = record[12];
+    GVRET_FILTER_STATUS status = FILTER_OK;
+
+    if (checksumCalc((uint8_t *)record, 13) != record[13]) status = FILTER_BAD_CHECKSUM;
+    else if (!canManager.setFilter(bus, slot, id, mask, flags & 1, flags & 2)) status = FILTER_BAD_SLOT;
+    else
+    {
+        char key[16];
+        sprintf(key, "can%i-filters", bus);
+        nvPrefs.begin(PREF_NAME, false);
+        nvPrefs.putBytes(key, settings.canFilters[bus], sizeof(settings.canFilters[bus]));
+        nvPrefs.end();
+    }
+
+    uint8_t reply[5] = {0xF1, PROTO_SET_FILTER, (uint8_t)bus, (uint8_t)slot, (uint8_t)status};
+    sendBytesToBuffer(reply, sizeof(reply));
+}
+
+static size_t putUInt32(uint8_t *out, uint32_t value)
+{
+    out[0] = value;
+    out[1] = value >> 8;
+    out[2] = value >> 16;
+    out[3] = value >> 24;
+    return 4;
+}
+
+void GVRET_Comm_Handler::setPeriodic(const uint8_t *record)
+{
+    int slot = record[2];
+    int bus = record[3];
+    uint32_t id = record[4] | (record[5] << 8) | (record[6] << 16) | ((uint32_t)record[7] << 24);
+    uint32_t period = record[8] | (record[9] << 8) | (record[10] << 16) | ((uint32_t)record[11] << 24);
+    uint32_t offset = record[12] | (record[13] << 8) | (record[14] << 16) | ((uint32_t)record[15] << 24);
+    uint8_t status = 0;
+
+    if (checksumCalc((uint8_t *)record, PERIODIC_RECORD_LENGTH - 1) != record[PERIODIC_RECORD_LENGTH - 1]) status = 1;
+    else
+    {
+        CAN_FRAME frame;
+        frame.extended = (id & (1ul << 31)) ? true : false;
+        frame.id = id & 0x7FFFFFFF;
+        frame.rtr = 0;
+        frame.length = record[21];
+        if (frame.length <= 8) memcpy(frame.data.uint8, &record[22], 8);
+        if (!txScheduler.setFrame(slot, bus, frame)
+            || !txScheduler.setCounter(slot, record[17], record[18], record[19], (PERIODIC_CHECKSUM)record[20])
+            || !txScheduler.setPeriod(slot, period, offset, record[16])) status = 2;
+    }
+
+    uint8_t reply[4] = {0xF1, PROTO_SET_PERIODIC, (uint8_t)slot, (uint8_t)status};
+    sendBytesToBuffer(reply, sizeof(reply));
+}
+
+/*
+Answers of more than a few records go out a record at a time from loop(), as many as there is room for on each
+pass, rather than holding loop() up until the transport writer makes room. The link takes nothing else until the
+answer is done (see answerPending) so no frame can land in the middle of one, and further commands wait their turn
+in heldInput. Which records go in is settled when the answer starts so the count in its header always matches.
+*/
+void GVRET_Comm_Handler::startAnswer(GVRET_ANSWER type, int bus)
+{
+    IdStatsTable &stats = canManager.getIdStats();
+    memset(answerItems, 0, sizeof(answerItems));
+    answerCount = 0;
+    switch (type)
+    {
+    case ANSWER_PERIODIC:
+        answerEnd = NUM_PERIODIC;
+        for (int i = 0; i < NUM_PERIODIC; i++) if (txScheduler.getEntry(i).active) markAnswerItem(i);
+        break;
+    case ANSWER_ID_STATS:
+        if (bus == 0xFE) stats.requestClear(); //answered with zero records
+        answerEnd = stats.getNumEntries();
+        for (int i = 0; i < answerEnd; i++) if (bus == 0xFF || stats.getEntry(i).bus == bus) markAnswerItem(i);
+        break;
+    case ANSWER_BUS_EVENTS: //a health record per bus, the number of events, then the events
+        answerEnd = SysSettings.numBuses + 1 + canManager.getBusMonitor().getNumHistory();
+        for (int i = 0; i < answerEnd; i++) markAnswerItem(i);
+        break;
+    case ANSWER_GATEWAY:
+        answerEnd = NUM_GATEWAY_RULES;
+        for (int r = 0; r < NUM_GATEWAY_RULES; r++) if (settings.gatewayRules[r].enabled) markAnswerItem(r);
+        break;
+    default:
+        return;
+    }
+    answer = type;
+    answerStep = -1;
+    answerLength = 0;
+    answerProgress = millis();
+    answerPending = true;
+    loop();
+}
+
+void GVRET_Comm_Handler::markAnswerItem(int item)
+{
+    answerItems[item / 32] |= 1ul << (item % 32);
+    answerCount++;
+}
+
+void GVRET_Comm_Handler::finishAnswer()
+{
+    answer = ANSWER_NONE;
+    answerPending = false;
+}
+
+//Queues as much of a pending answer as there is room for, then any commands that came in behind it. Called every
+//pass of the main loop()
+void GVRET_Comm_Handler::loop()
+{
+    if (answer == ANSWER_NONE) return;
+    if (!answerPending) //the buffer was cleared under it. Whoever asked isn't there any more
+    {
+        answer = ANSWER_NONE;
+        heldLength = 0;
+        return;
+    }
+    for (;;)
+    {
+        if (!answerLength && !(answerLength = buildAnswerRecord(answerRecord))) break;
+        if (!queueBytes(answerRecord, answerLength))
+        {
+            //nothing moving for this long means nobody is reading the other end anyway
+            if ((millis() - answerProgress) > ANSWER_TIMEOUT) break;
+            return;
+        }
+        answerLength = 0;
+        answerProgress = millis();
+    }
+    finishAnswer();
+
+    if (heldLength)
+    {
+        uint8_t input[sizeof(heldInput)];
+        size_t length = heldLength;
+        memcpy(input, heldInput, length);
+        heldLength = 0;
+        processIncomingBytes(input, length);
+    }
+}
+
+//The header first, then a record for every item marked when the answer started. 0 once it is all done
+size_t GVRET_Comm_Handler::buildAnswerRecord(uint8_t *record)
+{
+    IdStatsTable &stats = canManager.getIdStats();
+    BusMonitor &monitor = canManager.getBusMonitor();
+    size_t pos = 0;
+
+    if (answerStep < 0)
+    {
+        answerStep = 0;
+        record[pos++] = 0xF1;
+        switch (answer)
+        {
+        case ANSWER_PERIODIC:
+            record[pos++] = PROTO_GET_PERIODIC;
+            record[pos++] = answerCount;
+            break;
+        case ANSWER_ID_STATS:
+            record[pos++] = PROTO_GET_ID_STATS;
+            record[pos++] = answerCount;
+            record[pos++] = answerCount >> 8;
+            pos += putUInt32(&record[pos], stats.getFramesUntracked());
+            break;
+        case ANSWER_BUS_EVENTS:
+            record[pos++] = PROTO_GET_BUS_EVENTS;
+            record[pos++] = SysSettings.numBuses;
+            record[pos++] = NUM_BUS_EVENTS;
+            break;
+        case ANSWER_GATEWAY:
+        {
+            GATEWAY_STATS &gw = canManager.getGatewayStats();
+            record[pos++] = PROTO_GET_GATEWAY_STATS;
+            pos += putUInt32(&record[pos], gw.blocked);
+            pos += putUInt32(&record[pos], gw.loops);
+            pos += putUInt32(&record[pos], gw.dropped);
+            pos += putUInt32(&record[pos], gw.latencyCount ? gw.latencyMin : 0);
+            pos += putUInt32(&record[pos], gw.latencyCount ? (uint32_t)(gw.latencyTotal / gw.latencyCount) : 0);
+            pos += putUInt32(&record[pos], gw.latencyMax);
+            record[pos++] = answerCount;
+            break;
+        }
+        default:
+            break;
+        }
+        return pos;
+    }
+
+    while (answerStep < answerEnd && !(answerItems[answerStep / 32] & (1ul << (answerStep % 32)))) answerStep++;
+    if (answerStep >= answerEnd) return 0;
+    int item = answerStep++;
+
+    switch (answer)
+    {
+    case ANSWER_PERIODIC:
+    {
+        PERIODIC_FRAME e = txScheduler.getEntry(item);
+        record[pos++] = item;
+        pos += putUInt32(&record[pos], e.sent);
+        pos += putUInt32(&record[pos], e.missed);
+        pos += putUInt32(&record[pos], (e.sent > 1) ? e.minPeriod : 0);
+        pos += putUInt32(&record[pos], (e.sent > 1) ? (uint32_t)(e.totalPeriod / (e.sent - 1)) : 0);
+        pos += putUInt32(&record[pos], e.maxPeriod);
+        break;
+    }
+    case ANSWER_ID_STATS:
+    {
+        const ID_STATS_ENTRY &e = stats.getEntry(item);
+        record[pos++] = e.bus;
+        pos += putUInt32(&record[pos], e.id);
+        record[pos++] = e.length;
+        pos += putUInt32(&record[pos], e.count);
+        pos += putUInt32(&record[pos], (e.count > 1) ? e.minPeriod : 0);
+        pos += putUInt32(&record[pos], (e.count > 1) ? (uint32_t)(e.totalPeriod / (e.count - 1)) : 0);
+        pos += putUInt32(&record[pos], e.maxPeriod);
+        pos += putUInt32(&record[pos], e.lastTimestamp);
+        memset(&record[pos], 0, 8);
+        memcpy(&record[pos], e.data, (e.length > 8) ? 8 : e.length);
+        pos += 8;
+        break;
+    }
+    case ANSWER_BUS_EVENTS:
+        if (item < SysSettings.numBuses)
+        {
+            BUS_HEALTH &h = monitor.getHealth(item);
+            record[pos++] = h.state;
+            record[pos++] = h.tec;
+            record[pos++] = h.rec;
+            for (int t = 0; t < NUM_BUS_EVENTS; t++) pos += putUInt32(&record[pos], h.events[t]);
+        }
+        else if (item == SysSettings.numBuses) record[pos++] = answerEnd - SysSettings.numBuses - 1;
+        else pos = BusMonitor::encode(record, monitor.getHistory(item - SysSettings.numBuses - 1));
+        break;
+    case ANSWER_GATEWAY:
+        record[pos++] = item;
+        pos += putUInt32(&record[pos], canManager.getGatewayStats().forwarded[item]);
+        break;
+    default:
+        break;
+    }
+    return pos;
+}
+
+//record is a whole PROTO_SET_GATEWAY record from F1 to the checksum. Saved straight away like PROTO_SET_FILTER
+void GVRET_Comm_Handler::setGatewayRule(const uint8_t *record)
+{
+    int slot = record[2];
+    GATEWAY_RULE rule;
+    uint8_t status = 0;
+
+    rule.srcBus = record[3];
+    rule.dstBus = record[4];
+    rule.extended = record[5] & 1;
+    rule.enabled = (record[5] & 2) != 0;
+    rule.block = (record[5] & 4) != 0;
+    rule.reserved = 0;
+    rule.id = record[6] | (record[7] << 8) | (record[8] << 16) | ((uint32_t)record[9] << 24);
+    rule.mask = record[10] | (record[11] << 8) | (record[12] << 16) | ((uint32_t)record[13] << 24);
+    rule.newId = record[14] | (record[15] << 8) | (record[16] << 16) | ((uint32_t)record[17] << 24);
+    rule.newIdMask = record[18] | (record[19] << 8) | (record[20] << 16) | ((uint32_t)record[21] << 24);
+    memcpy(rule.dataMask, &record[22], 8);
+    memcpy(rule.dataValue, &record[30], 8);
+
+    if (checksumCalc((uint8_t *)record, GATEWAY_RECORD_LENGTH - 1) != record[GATEWAY_RECORD_LENGTH - 1]) status = 1;
+    else if (!canManager.setGatewayRule(slot, rule)) status = 2;
+    else
+    {
+        nvPrefs.begin(PREF_NAME, false);
+        nvPrefs.putBytes("gateway", settings.gatewayRules, sizeof(settings.gatewayRules));
+        nvPrefs.end();
+    }
+
+    uint8_t reply[4] = {0xF1, PROTO_SET_GATEWAY, (uint8_t)slot, (uint8_t)status};
+    sendBytesToBuffer(reply, sizeof(reply));
+}
+
 //Get the value of XOR'ing all the bytes together. This creates a reasonable checksum that can be used
 //to make sure nothing too stupid has happened on the comm.
 uint8_t GVRET_Comm_Handler::checksumCalc(uint8_t *buffer, int length)
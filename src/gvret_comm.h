@@ -3,6 +3,12 @@
 #include "config.h"
 #include "esp32_can.h"
 #include "commbuffer.h"
+#include "gvret_protocol.h"
+#include "bus_monitor.h"
+#include "id_stats.h"
+
+#define ANSWER_TIMEOUT      250                         //ms with no room made before a long answer is given up on
+#define ANSWER_RECORD_SIZE  (3 + 4 * NUM_BUS_EVENTS)    //biggest single record of a long answer (bus health)
 
 enum STATE {
     IDLE,
@@ -18,29 +24,22 @@ enum STATE {
     SET_SINGLEWIRE_MODE,
     SET_SYSTYPE,
     ECHO_CAN_FRAME,
-    SETUP_EXT_BUSES
+    SETUP_EXT_BUSES,
+    SET_STREAM_MODE,
+    BUILD_CAN_BATCH,
+    SET_FILTER,
+    GET_ID_STATS,
+    SET_PERIODIC,
+    SET_GATEWAY
 };
 
-enum GVRET_PROTOCOL
-{
-    PROTO_BUILD_CAN_FRAME = 0,
-    PROTO_TIME_SYNC = 1,
-    PROTO_DIG_INPUTS = 2,
-    PROTO_ANA_INPUTS = 3,
-    PROTO_SET_DIG_OUT = 4,
-    PROTO_SETUP_CANBUS = 5,
-    PROTO_GET_CANBUS_PARAMS = 6,
-    PROTO_GET_DEV_INFO = 7,
-    PROTO_SET_SW_MODE = 8,
-    PROTO_KEEPALIVE = 9,
-    PROTO_SET_SYSTYPE = 10,
-    PROTO_ECHO_CAN_FRAME = 11,
-    PROTO_GET_NUMBUSES = 12,
-    PROTO_GET_EXT_BUSES = 13,
-    PROTO_SET_EXT_BUSES = 14,
-    PROTO_BUILD_FD_FRAME = 20,
-    PROTO_SETUP_FD = 21,
-    PROTO_GET_FD = 22,
+//Answers too long to queue at once. They go out from loop() a record at a time
+enum GVRET_ANSWER {
+    ANSWER_NONE,
+    ANSWER_PERIODIC,
+    ANSWER_ID_STATS,
+    ANSWER_BUS_EVENTS,
+    ANSWER_GATEWAY
 };
 
 class GVRET_Comm_Handler: public CommBuffer
@@ -48,7 +47,9 @@ class GVRET_Comm_Handler: public CommBuffer
 public:
     GVRET_Comm_Handler();
     void processIncomingByte(uint8_t in_byte);
-    
+    void processIncomingBytes(const uint8_t *data, size_t length);
+    void loop();
+
 private:
     CAN_FRAME build_out_frame;
     CAN_FRAME_FD build_out_fd_frame;
@@ -57,6 +58,35 @@ private:
     int step;
     STATE state;
     uint32_t build_int;
+    uint8_t batchBuff[MAX_BATCH_BYTES]; //PROTO_BUILD_CAN_BATCH records are held here until the checksum arrives
+    size_t batchLength;
+    uint8_t batchCount;
+    uint8_t batchRecords;
+    uint8_t batchRecordPos;
+    uint8_t batchRecordSize;
+    uint8_t batchChecksum;
+    uint8_t periodicBuff[PERIODIC_RECORD_LENGTH];
+    uint8_t gatewayBuff[GATEWAY_RECORD_LENGTH];
+    GVRET_ANSWER answer; //long answer going out, if any
+    int answerStep; //next item of it. -1 = header
+    int answerEnd;
+    int answerCount;
+    uint32_t answerItems[ID_STATS_ENTRIES / 32]; //which items go in, fixed when the answer starts
+    uint8_t answerRecord[ANSWER_RECORD_SIZE]; //record that didn't fit last pass
+    size_t answerLength;
+    uint32_t answerProgress; //millis() when the last record went in
+    uint8_t heldInput[256]; //commands that came in behind the answer
+    size_t heldLength;
 
     uint8_t checksumCalc(uint8_t *buffer, int length);
+    size_t getBatchLength(const uint8_t *records, size_t length, int count);
+    void sendBatch(const uint8_t *records, int count, GVRET_BATCH_STATUS status);
+    void setFilter(const uint8_t *record);
+    void setPeriodic(const uint8_t *record);
+    void setGatewayRule(const uint8_t *record);
+    void startAnswer(GVRET_ANSWER type, int bus = 0xFF);
+    void markAnswerItem(int item);
+    void finishAnswer();
+    size_t buildAnswerRecord(uint8_t *record);
+    void holdInput(const uint8_t *data, size_t length);
 };
\ No newline at end of file
@@ -0,0 +1,184 @@
+#pragma once
+
+#define MAX_BATCH_FRAMES    32  //most frames a PROTO_BUILD_CAN_BATCH record may carry
+#define MAX_BATCH_BYTES     (MAX_BATCH_FRAMES * 14)
+
+//GVRET command numbers. Kept free of any Arduino or board headers so the frame encoders that need them can be
+//built and exercised on a PC.
+enum GVRET_PROTOCOL
+{
+    PROTO_BUILD_CAN_FRAME = 0,
+    PROTO_TIME_SYNC = 1,
+    PROTO_DIG_INPUTS = 2,
+    PROTO_ANA_INPUTS = 3,
+    PROTO_SET_DIG_OUT = 4,
+    PROTO_SETUP_CANBUS = 5,
+    PROTO_GET_CANBUS_PARAMS = 6,
+    PROTO_GET_DEV_INFO = 7,
+    PROTO_SET_SW_MODE = 8,
+    PROTO_KEEPALIVE = 9,
+    PROTO_SET_SYSTYPE = 10,
+    PROTO_ECHO_CAN_FRAME = 11,
+    PROTO_GET_NUMBUSES = 12,
+    PROTO_GET_EXT_BUSES = 13,
+    PROTO_SET_EXT_BUSES = 14,
+    PROTO_BUILD_FD_FRAME = 20,
+    PROTO_SETUP_FD = 21,
+    PROTO_GET_FD = 22,
+    PROTO_SET_STREAM_MODE = 23, //F1 17 <mode> - STREAM_ flags below. Echoes the mode back, and again unasked after lost records
+    PROTO_COMPRESSED_FRAME = 24, //device to host only. Format is documented with CompressedStreamEncoder
+    PROTO_BUILD_CAN_BATCH = 25, //several frames to send in one record. See below
+    PROTO_SET_FILTER = 26, //set one acceptance filter slot. See below
+    PROTO_GET_ID_STATS = 27, //per ID counts and periods gathered on the device. See below
+    PROTO_GET_BUS_LOAD = 28, //F1 1C -> F1 1C NUMBUSES { LOAD PEAK } * NUMBUSES. Percentages, stuff bits included
+    PROTO_SET_PERIODIC = 29, //set up or stop a periodic frame. See below
+    PROTO_GET_PERIODIC = 30, //achieved timing of the periodic frames. See below
+    PROTO_TX_STATUS = 31, //device to host only. F1 1F BUS STATUS ID(4) when a frame the host sent is done with
+    PROTO_BUS_EVENT = 32, //device to host only. Controller error or lost frames. See below
+    PROTO_GET_BUS_EVENTS = 33, //error counters, totals and recent events. See below
+    PROTO_DROP_STATS = 34, //where frames were lost on the way to the host. See below
+    PROTO_SET_GATEWAY = 35, //set one of the on-device forwarding rules. See below
+    PROTO_GET_GATEWAY_STATS = 36, //what the gateway forwarded and how long it took. See below
+};
+
+//PROTO_SET_STREAM_MODE flags
+#define STREAM_COMPRESSED   1
+#define STREAM_XOR          2
+#define STREAM_TX_STATUS    4   //send a PROTO_TX_STATUS record for every frame sent (TX_STATUS: 0 = sent, 1 = failed, 2 = dropped)
+#define STREAM_EVENTS       8   //send a PROTO_BUS_EVENT record whenever a bus or the capture path has trouble
+#define STREAM_DROP_STATS   16  //send a PROTO_DROP_STATS record every second
+
+/*
+PROTO_BUILD_CAN_BATCH sends up to MAX_BATCH_FRAMES classic frames with one checksum:
+
+    F1 19 COUNT { BUS ID(4) LEN DATA(LEN) } * COUNT CHK
+
+ID is little endian with bit 31 = extended, same as PROTO_BUILD_CAN_FRAME. LEN is 0 - 8. CHK is the XOR of every byte
+from F1 up to the last data byte. Nothing is sent unless CHK matches, then the frames are queued for the controllers in order.
+The device answers every batch with
+
+    F1 19 STATUS SENT
+
+where SENT is how many frames were queued. Anything short of COUNT means the tx queues filled up, so
+the host should resend from that frame on.
+*/
+enum GVRET_BATCH_STATUS
+{
+    BATCH_OK = 0,
+    BATCH_BAD_CHECKSUM = 1,
+    BATCH_TOO_LARGE = 2
+};
+
+/*
+PROTO_SET_FILTER sets one of the NUM_FILTERS acceptance filters of a bus and saves it:
+
+    F1 1A BUS SLOT ID(4) MASK(4) FLAGS CHK
+
+ID and MASK are little endian. FLAGS bit 0 = extended, bit 1 = enabled. CHK is the XOR of every byte from F1 on.
+Once any filter on a bus is enabled only frames matching one of them are forwarded from that bus. The device answers
+
+    F1 1A BUS SLOT STATUS
+*/
+enum GVRET_FILTER_STATUS
+{
+    FILTER_OK = 0,
+    FILTER_BAD_CHECKSUM = 1,
+    FILTER_BAD_SLOT = 2
+};
+
+/*
+PROTO_GET_ID_STATS asks for everything the device has counted since boot or the last clear:
+
+    F1 1B BUS
+
+BUS 0xFF means every bus and BUS 0xFE clears the table and answers with zero records. The answer is
+
+    F1 1B NUM(2) UNTRACKED(4) { BUS ID(4) LEN COUNT(4) MIN(4) AVG(4) MAX(4) LAST(4) DATA(8) } * NUM
+
+All values little endian. ID has bit 31 set for extended. MIN, AVG and MAX are the periods between frames in
+microseconds and are 0 until an ID has been seen twice. LAST is the receive timestamp of the newest frame. DATA is
+its payload padded with zeros, only the first 8 bytes for FD frames. UNTRACKED counts frames of IDs the table had no
+room for. Every frame a controller receives is counted, including the ones the software filters then drop. Only
+what a controller's hardware filters reject never shows up.
+
+This and the other long answers (periodic, bus event and gateway stats) go out over several passes of the main loop.
+Nothing else is sent on that link until the answer is complete, including frames, and further commands are handled
+after it.
+*/
+#define ID_STATS_RECORD_LENGTH  34
+
+/*
+PROTO_SET_PERIODIC loads one of the device's periodic transmit slots and starts or stops it:
+
+    F1 1D SLOT BUS ID(4) PERIOD(4) OFFSET(4) BURST CTRBYTE CTRMASK CHKBYTE CHKTYPE LEN DATA(8) CHK
+
+ID is little endian with bit 31 = extended. PERIOD and OFFSET are microseconds, PERIOD 0 stops the slot. BURST frames
+go back to back each period. CTRBYTE / CHKBYTE are payload byte numbers or 0xFF for none. The counter counts up
+within the CTRMASK bits of its byte. CHKTYPE 1 = XOR, 2 = sum of the other payload bytes. DATA is always 8 bytes,
+only LEN of them are sent. CHK is the XOR of every byte from F1 on. The device answers
+
+    F1 1D SLOT STATUS
+
+with STATUS 0 for OK, 1 for a bad checksum and 2 for values the scheduler won't take. PROTO_GET_PERIODIC (F1 1E)
+answers
+
+    F1 1E NUM { SLOT SENT(4) MISSED(4) MIN(4) AVG(4) MAX(4) } * NUM
+
+for every running slot. MIN, AVG and MAX are the achieved periods in microseconds, measured from when each burst
+went to the controller. SENT counts those bursts.
+*/
+#define PERIODIC_RECORD_LENGTH  31  //F1 through CHK
+
+/*
+PROTO_BUS_EVENT records go out in between frames to links with STREAM_EVENTS set:
+
+    F1 20 BUS TYPE TIMESTAMP(4) COUNT(2) TEC REC
+
+TYPE is a BUS_EVENT_TYPE from bus_monitor.h. TIMESTAMP is in microseconds like frame timestamps. COUNT is how many
+times it happened since the previous look at the controller, about every 10ms. TEC and REC are the error counters at
+the time, 0 for controllers that don't report them. For TYPE 11 (a sink dropped frames) BUS is the sink number.
+PROTO_GET_BUS_EVENTS (F1 21) answers
+
+    F1 21 NUMBUSES NUMTYPES { STATE TEC REC TOTAL(4) * NUMTYPES } * NUMBUSES NUM { event as above from BUS on } * NUM
+
+STATE is 0 stopped, 1 running, 2 bus off, 3 recovering or 0xFF if the controller doesn't say. TOTAL is a running
+count of each event type on that bus. The events are the newest NUM kept on the device, oldest first.
+*/
+
+/*
+PROTO_DROP_STATS goes out every second to links with STREAM_DROP_STATS set and answers F1 22:
+
+    F1 22 TIMESTAMP(4) NUMBUSES NUMSINKS { LOST(4) HELD(4) } * NUMBUSES
+          { SINK POLICY RATE { FULL(4) EVICTED(4) SAMPLED(4) } * NUMBUSES } * NUMSINKS
+
+Every count is a running total since boot so the difference between two records tells the host how many frames are
+missing from that stretch of the capture and why. LOST is frames the controller lost (driver queue or FIFO full,
+built-in controller only) plus frames read off a bus with gateway rules while the device's own RX queue had no room
+to capture them. HELD is how many times frames had to wait in the driver because that queue was full. Per sink and bus, FULL is frames refused for lack of room, EVICTED is the oldest frames thrown away while a
+drop-oldest sink (POLICY 2) was full and SAMPLED is frames left out while a sampling sink (POLICY 3) was short of room.
+A sampling sink sends 1 in RATE frames of each bus while it is short of room, so FULL + EVICTED are the only frames
+that leave gaps a sample can't account for.
+*/
+
+/*
+PROTO_SET_GATEWAY sets one of the NUM_GATEWAY_RULES forwarding rules and saves it:
+
+    F1 23 SLOT SRC DST FLAGS ID(4) MASK(4) NEWID(4) NEWIDMASK(4) DATAMASK(8) DATAVALUE(8) CHK
+
+Classic frames from bus SRC whose ID matches ID under MASK are sent on bus DST as soon as they are received. FLAGS
+bit 0 = extended, bit 1 = enabled, bit 2 = block (matching frames are not forwarded anywhere). Lower slots win when
+rules overlap. ID bits set in NEWIDMASK are taken from NEWID and payload bits set in DATAMASK from DATAVALUE, byte 0
+first. All numbers little endian. CHK is the XOR of every byte from F1 on. The device answers
+
+    F1 23 SLOT STATUS
+
+with STATUS 0 for OK, 1 for a bad checksum and 2 for a rule that can't work (no such bus or DST = SRC).
+PROTO_GET_GATEWAY_STATS (F1 24) answers
+
+    F1 24 BLOCKED(4) LOOPS(4) DROPPED(4) MIN(4) AVG(4) MAX(4) NUM { SLOT FORWARDED(4) } * NUM
+
+for every enabled rule. LOOPS counts frames not forwarded because they were the gateway's own frames coming back.
+DROPPED counts frames the destination couldn't queue. MIN, AVG and MAX are microseconds from a frame being received
+to its copy being handed to the destination controller.
+*/
+#define GATEWAY_RECORD_LENGTH   39  //F1 through CHK
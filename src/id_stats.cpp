@@ -0,0 +1,88 @@
+#include "id_stats.h"
+#include <string.h>
+
+#define MAX_PROBE   16
+
+IdStatsTable::IdStatsTable()
+{
+    for (int i = 0; i < ID_STATS_BUSES; i++) stdIndex[i] = nullptr;
+    clear();
+}
+
+void IdStatsTable::clear()
+{
+    for (int i = 0; i < ID_STATS_BUSES; i++)
+    {
+        if (stdIndex[i]) memset(stdIndex[i], 0, 2048 * sizeof(uint16_t));
+    }
+    memset(extSlots, 0, sizeof(extSlots));
+    numEntries = 0;
+    framesUntracked = 0;
+    clearRequested = false;
+}
+
+//takes the next free entry and points slot at it. nullptr once the pool is used up
+ID_STATS_ENTRY *IdStatsTable::newEntry(int bus, uint32_t key, uint16_t &slot)
+{
+    int n = numEntries.load(std::memory_order_relaxed);
+    if (n >= ID_STATS_ENTRIES) return nullptr;
+    ID_STATS_ENTRY *e = &entries[n];
+    e->id = key;
+    e->bus = bus;
+    e->count = 0;
+    e->minPeriod = 0xFFFFFFFF;
+    e->maxPeriod = 0;
+    e->totalPeriod = 0;
+    slot = n + 1;
+    numEntries.store(n + 1, std::memory_order_release); //readers only see it once it is set up
+    return e;
+}
+
+ID_STATS_ENTRY *IdStatsTable::findExtended(int bus, uint32_t key)
+{
+    uint32_t slot = ((key * 2654435761ul) ^ bus) & (ID_STATS_EXT_SLOTS - 1);
+    for (int probe = 0; probe < MAX_PROBE; probe++)
+    {
+        uint16_t index = extSlots[slot];
+        if (index == 0) return newEntry(bus, key, extSlots[slot]);
+        ID_STATS_ENTRY *e = &entries[index - 1];
+        if (e->id == key && e->bus == bus) return e;
+        slot = (slot + 1) & (ID_STATS_EXT_SLOTS - 1);
+    }
+    return nullptr;
+}
+
+void IdStatsTable::update(int bus, uint32_t id, bool extended, const uint8_t *data, uint8_t length, uint32_t timestamp)
+{
+    if (bus < 0 || bus >= ID_STATS_BUSES) return;
+    if (clearRequested) clear();
+    ID_STATS_ENTRY *e;
+    if (!extended)
+    {
+        if (!stdIndex[bus])
+        {
+            stdIndex[bus] = new uint16_t[2048]();
+        }
+        uint16_t &index = stdIndex[bus][id & 0x7FF];
+        e = index ? &entries[index - 1] : newEntry(bus, id & 0x7FF, index);
+    }
+    else e = findExtended(bus, id | (1ul << 31));
+
+    if (!e)
+    {
+        framesUntracked++;
+        return;
+    }
+
+    if (e->count > 0)
+    {
+        uint32_t period = timestamp - e->lastTimestamp;
+        if (period < e->minPeriod) e->minPeriod = period;
+        if (period > e->maxPeriod) e->maxPeriod = period;
+        e->totalPeriod += period;
+    }
+    e->count++;
+    e->lastTimestamp = timestamp;
+    e->length = length;
+    memcpy(e->data, data, (length > 8) ? 8 : length);
+}
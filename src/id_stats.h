@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+#define ID_STATS_BUSES      5       //same as NUM_BUSES. Kept here so this file doesn't need config.h
+#define ID_STATS_ENTRIES    512     //(bus, ID) pairs tracked across all buses
+#define ID_STATS_EXT_SLOTS  1024    //hash slots for 29 bit IDs. Must be a power of two
+
+typedef struct {
+    uint32_t id;            //bit 31 set for extended
+    uint8_t bus;
+    uint8_t length;         //DLC of the last frame. Only the first 8 bytes of FD payloads are kept
+    uint8_t data[8];
+    uint32_t count;
+    uint32_t lastTimestamp; //microseconds
+    uint32_t minPeriod;
+    uint32_t maxPeriod;
+    uint64_t totalPeriod;   //average period is totalPeriod / (count - 1)
+} ID_STATS_ENTRY;
+
+//Per (bus, ID) counts, periods and last payload for every frame the controllers hand over. That is not the whole bus
+//once acceptance filters are set since the controllers drop what their hardware filters reject. Standard IDs are
+//looked up directly in a 2048 entry index for their bus which is only allocated once that bus sees a standard frame.
+//Extended IDs go through a linear probed hash with a bounded probe length. Both point into one shared pool of
+//entries so memory doesn't depend on how many buses the board has. Frames for IDs that don't fit any more are only
+//counted.
+//update() belongs to the RX task. Anyone may read: an entry is complete before getNumEntries() counts it, though
+//one read while its ID is being received can mix values from two frames. Other tasks clear through requestClear(),
+//which the next update() carries out. No Arduino or board headers in here so it can be checked on a PC.
+class IdStatsTable
+{
+public:
+    IdStatsTable();
+    void clear();
+    void requestClear() { clearRequested = true; }
+    void update(int bus, uint32_t id, bool extended, const uint8_t *data, uint8_t length, uint32_t timestamp);
+    int getNumEntries() { return clearRequested ? 0 : numEntries.load(std::memory_order_acquire); }
+    const ID_STATS_ENTRY &getEntry(int i) { return entries[i]; }
+    uint32_t getFramesUntracked() { return clearRequested ? 0 : framesUntracked; }
+
+private:
+    ID_STATS_ENTRY entries[ID_STATS_ENTRIES];
+    uint16_t *stdIndex[ID_STATS_BUSES]; //entry number + 1, 0 = not seen yet
+    uint16_t extSlots[ID_STATS_EXT_SLOTS]; //same
+    std::atomic<int> numEntries;
+    uint32_t framesUntracked;
+    std::atomic<bool> clearRequested;
+
+    ID_STATS_ENTRY *newEntry(int bus, uint32_t key, uint16_t &slot);
+    ID_STATS_ENTRY *findExtended(int bus, uint32_t key);
+};
@@ -0,0 +1,397 @@
+#include "isotp.h"
+#include <string.h>
+
+#define PCI_SINGLE      0
+#define PCI_FIRST       1
+#define PCI_CONSECUTIVE 2
+#define PCI_FLOW        3
+
+#define FLOW_CTS        0
+#define FLOW_WAIT       1
+#define FLOW_OVERFLOW   2
+
+IsoTpEngine::IsoTpEngine()
+{
+    memset(sessions, 0, sizeof(sessions));
+    memset(listeners, 0, sizeof(listeners));
+    for (int i = 0; i < ISOTP_SESSIONS; i++) sessions[i].buffer = -1;
+    for (int i = 0; i < ISOTP_BUFFERS; i++) poolUsed[i] = false;
+    sender = nullptr;
+    senderContext = nullptr;
+}
+
+void IsoTpEngine::setSender(IsoTpSendFn send, void *context)
+{
+    sender = send;
+    senderContext = context;
+}
+
+//-1 if every session is taken. Opening the same (bus, tx ID, rx ID) again hands back the session that's already open
+int IsoTpEngine::open(int bus, uint32_t txId, uint32_t rxId, bool extended, IsoTpReceiveFn onReceive, void *context)
+{
+    int free = -1;
+    for (int i = 0; i < ISOTP_SESSIONS; i++)
+    {
+        ISOTP_SESSION &s = sessions[i];
+        if (!s.open)
+        {
+            if (free < 0) free = i;
+            continue;
+        }
+        if (s.bus == bus && s.txId == txId && s.rxId == rxId && s.extended == extended)
+        {
+            s.onReceive = onReceive;
+            s.context = context;
+            return i;
+        }
+    }
+    if (free < 0) return -1;
+
+    ISOTP_SESSION &s = sessions[free];
+    memset(&s, 0, sizeof(s));
+    s.open = true;
+    s.bus = bus;
+    s.txId = txId;
+    s.rxId = rxId;
+    s.extended = extended;
+    s.onReceive = onReceive;
+    s.context = context;
+    s.buffer = -1;
+    s.state = ISOTP_IDLE;
+    return free;
+}
+
+void IsoTpEngine::close(int session)
+{
+    if (session < 0 || session >= ISOTP_SESSIONS) return;
+    ISOTP_SESSION &s = sessions[session];
+    if (s.buffer >= 0) poolUsed[s.buffer] = false;
+    s.buffer = -1;
+    s.open = false;
+    s.state = ISOTP_IDLE;
+}
+
+//Whether the session's next first frame is an answer to us and gets flow control. send() sets it, the owner clears
+//it once it stops waiting
+void IsoTpEngine::expectAnswer(int session, bool expecting)
+{
+    if (session < 0 || session >= ISOTP_SESSIONS) return;
+    sessions[session].expecting = expecting;
+}
+
+//Same for the sessions the listener opens from now on, for the answers to a functional request
+void IsoTpEngine::expectAnswers(int listener, bool expecting)
+{
+    if (listener < 0 || listener >= ISOTP_LISTENERS) return;
+    listeners[listener].expecting = expecting;
+}
+
+void IsoTpEngine::setFlowControl(int session, uint8_t blockSize, uint8_t stMin)
+{
+    if (session < 0 || session >= ISOTP_SESSIONS) return;
+    sessions[session].blockSize = blockSize;
+    sessions[session].stMin = stMin;
+}
+
+//-1 if every listener is taken
+int IsoTpEngine::listen(int bus, uint32_t id, uint32_t mask, bool extended, IsoTpAcceptFn accept, void *context)
+{
+    for (int i = 0; i < ISOTP_LISTENERS; i++)
+    {
+        ISOTP_LISTENER &l = listeners[i];
+        if (l.used) continue;
+        l.used = true;
+        l.bus = bus;
+        l.extended = extended;
+        l.mask = mask;
+        l.id = id & mask;
+        l.accept = accept;
+        l.context = context;
+        l.expecting = false;
+        return i;
+    }
+    return -1;
+}
+
+void IsoTpEngine::unlisten(int listener)
+{
+    if (listener < 0 || listener >= ISOTP_LISTENERS) return;
+    listeners[listener].used = false;
+}
+
+int IsoTpEngine::findSession(int bus, uint32_t id, bool extended)
+{
+    for (int i = 0; i < ISOTP_SESSIONS; i++)
+    {
+        ISOTP_SESSION &s = sessions[i];
+        if (s.open && s.bus == bus && s.rxId == id && s.extended == extended) return i;
+    }
+    return -1;
+}
+
+int IsoTpEngine::getBuffersInUse()
+{
+    int count = 0;
+    for (int i = 0; i < ISOTP_BUFFERS; i++) if (poolUsed[i]) count++;
+    return count;
+}
+
+//0x00 - 0x7F are milliseconds, 0xF1 - 0xF9 are 100 - 900us. Anything else is reserved and has to be read as 127ms
+uint32_t IsoTpEngine::stMinToUs(uint8_t stMin)
+{
+    if (stMin <= 0x7F) return stMin * 1000ul;
+    if (stMin >= 0xF1 && stMin <= 0xF9) return (stMin - 0xF0) * 100ul;
+    return 127000ul;
+}
+
+int8_t IsoTpEngine::takeBuffer()
+{
+    for (int i = 0; i < ISOTP_BUFFERS; i++)
+    {
+        if (!poolUsed[i])
+        {
+            poolUsed[i] = true;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void IsoTpEngine::finish(ISOTP_SESSION &s, bool failed)
+{
+    if (s.buffer >= 0) poolUsed[s.buffer] = false;
+    s.buffer = -1;
+    s.state = ISOTP_IDLE;
+    s.fcPending = false;
+    if (failed) s.errors++;
+}
+
+bool IsoTpEngine::sendFrame(ISOTP_SESSION &s, const uint8_t *data, uint8_t length)
+{
+    if (!sender) return false;
+    uint8_t frame[8];
+    memcpy(frame, data, length);
+    memset(&frame[length], ISOTP_PADDING, 8 - length);
+    return sender(senderContext, s.bus, s.txId, s.extended, frame);
+}
+
+bool IsoTpEngine::sendFlowControl(ISOTP_SESSION &s, uint8_t status)
+{
+    uint8_t fc[3] = {(uint8_t)((PCI_FLOW << 4) | status), s.blockSize, s.stMin};
+    return sendFrame(s, fc, 3);
+}
+
+//A flow control that can't be queued now is owed until tick() gets it out. The sender would otherwise sit waiting
+//for it until its N_Bs timeout
+void IsoTpEngine::flowControl(ISOTP_SESSION &s, uint8_t status)
+{
+    s.fcStatus = status;
+    s.fcPending = !sendFlowControl(s, status);
+}
+
+//False if the session is still busy with another message, the length is out of range, the pool is empty or the
+//first frame couldn't be queued
+bool IsoTpEngine::send(int session, const uint8_t *data, uint16_t length, uint32_t now)
+{
+    if (session < 0 || session >= ISOTP_SESSIONS) return false;
+    ISOTP_SESSION &s = sessions[session];
+    if (!s.open || s.state != ISOTP_IDLE) return false;
+    if (length == 0 || length > ISOTP_MAX_PAYLOAD) return false;
+
+    uint8_t frame[8];
+    if (length <= 7)
+    {
+        frame[0] = (PCI_SINGLE << 4) | length;
+        memcpy(&frame[1], data, length);
+        if (!sendFrame(s, frame, length + 1)) return false;
+        s.sent++;
+        s.expecting = true;
+        return true;
+    }
+
+    s.buffer = takeBuffer();
+    if (s.buffer < 0) return false;
+    memcpy(pool[s.buffer], data, length);
+    frame[0] = (PCI_FIRST << 4) | (length >> 8);
+    frame[1] = length & 0xFF;
+    memcpy(&frame[2], data, 6);
+    if (!sendFrame(s, frame, 8))
+    {
+        finish(s, false);
+        return false;
+    }
+    s.length = length;
+    s.pos = 6;
+    s.seq = 1;
+    s.waits = 0;
+    s.lastTime = now;
+    s.state = ISOTP_TX_WAIT_FC;
+    s.expecting = true;
+    return true;
+}
+
+//Functionally addressed requests can only ever be single frames and the answers come back on each ECU's own session
+bool IsoTpEngine::sendFunctional(int bus, uint32_t id, bool extended, const uint8_t *data, uint8_t length)
+{
+    if (!sender || length == 0 || length > 7) return false;
+    uint8_t frame[8];
+    frame[0] = (PCI_SINGLE << 4) | length;
+    memcpy(&frame[1], data, length);
+    memset(&frame[length + 1], ISOTP_PADDING, 7 - length);
+    return sender(senderContext, bus, id, extended, frame);
+}
+
+//Sends whatever consecutive frames STmin allows right now. Stops early if the TX queue is full, tick() carries on
+void IsoTpEngine::sendConsecutive(ISOTP_SESSION &s, uint32_t now)
+{
+    while (s.state == ISOTP_TX_SENDING && (now - s.lastTime) >= s.stMinUs)
+    {
+        uint8_t frame[8];
+        uint16_t chunk = s.length - s.pos;
+        if (chunk > 7) chunk = 7;
+        frame[0] = (PCI_CONSECUTIVE << 4) | s.seq;
+        memcpy(&frame[1], &pool[s.buffer][s.pos], chunk);
+        if (!sendFrame(s, frame, chunk + 1)) return;
+        s.pos += chunk;
+        s.seq = (s.seq + 1) & 0xF;
+        s.lastTime = now;
+        if (s.pos >= s.length)
+        {
+            s.sent++;
+            finish(s, false);
+        }
+        else if (s.blockLeft && --s.blockLeft == 0)
+        {
+            s.state = ISOTP_TX_WAIT_FC;
+        }
+        if (s.stMinUs) return; //a tick is as fine grained as the timing gets
+    }
+}
+
+//True if the frame belonged to a session. The caller can still pass it on to anything else that wants to see it
+bool IsoTpEngine::handleFrame(int bus, uint32_t id, bool extended, const uint8_t *data, uint8_t length, uint32_t now)
+{
+    if (length == 0) return false;
+    int session = findSession(bus, id, extended);
+    //only the start of a message can open a session, the rest of one nobody took is no use to anyone
+    for (int i = 0; session < 0 && i < ISOTP_LISTENERS && (data[0] >> 4) <= PCI_FIRST; i++)
+    {
+        ISOTP_LISTENER &l = listeners[i];
+        if (!l.used || l.bus != bus || l.extended != extended || (id & l.mask) != l.id) continue;
+        if (l.accept(l.context, bus, id, extended) >= 0) session = findSession(bus, id, extended);
+        if (session >= 0 && l.expecting) sessions[session].expecting = true;
+    }
+    if (session < 0) return false;
+    ISOTP_SESSION &s = sessions[session];
+
+    switch (data[0] >> 4)
+    {
+    case PCI_SINGLE:
+    {
+        uint8_t size = data[0] & 0xF;
+        if (size == 0 || size > length - 1) break;
+        if (s.state == ISOTP_RX) finish(s, true); //a new message ends the one that was coming in
+        if (s.state != ISOTP_IDLE) break;         //we're sending, it's not for us to take this now
+        s.received++;
+        if (s.onReceive) s.onReceive(s.context, session, &data[1], size);
+        break;
+    }
+    case PCI_FIRST:
+    {
+        uint16_t size = ((data[0] & 0xF) << 8) | data[1];
+        if (size < 8 || length < 8) break;
+        if (s.state == ISOTP_RX) finish(s, true);
+        if (s.state != ISOTP_IDLE) break;
+        s.fcPending = false; //an overflow still owed is for a message the sender has given up on
+        s.passive = !s.expecting;
+        s.buffer = takeBuffer();
+        if (s.buffer < 0)
+        {
+            s.errors++;
+            if (!s.passive) flowControl(s, FLOW_OVERFLOW);
+            break;
+        }
+        memcpy(pool[s.buffer], &data[2], 6);
+        s.length = size;
+        s.pos = 6;
+        s.seq = 1;
+        s.blockLeft = s.blockSize;
+        s.lastTime = now;
+        s.state = ISOTP_RX;
+        if (!s.passive) flowControl(s, FLOW_CTS);
+        break;
+    }
+    case PCI_CONSECUTIVE:
+    {
+        if (s.state != ISOTP_RX) break;
+        if ((data[0] & 0xF) != s.seq)
+        {
+            finish(s, true);
+            break;
+        }
+        uint16_t chunk = s.length - s.pos;
+        if (chunk > 7) chunk = 7;
+        if (chunk > length - 1) chunk = length - 1;
+        memcpy(&pool[s.buffer][s.pos], &data[1], chunk);
+        s.pos += chunk;
+        s.seq = (s.seq + 1) & 0xF;
+        s.lastTime = now;
+        if (s.pos >= s.length)
+        {
+            s.received++;
+            if (s.onReceive) s.onReceive(s.context, session, pool[s.buffer], s.length);
+            finish(s, false);
+        }
+        else if (!s.passive && s.blockSize && --s.blockLeft == 0)
+        {
+            s.blockLeft = s.blockSize;
+            flowControl(s, FLOW_CTS);
+        }
+        break;
+    }
+    case PCI_FLOW:
+        if (s.state != ISOTP_TX_WAIT_FC || length < 3) break;
+        switch (data[0] & 0xF)
+        {
+        case FLOW_CTS:
+            s.blockLeft = data[1];
+            s.stMinUs = stMinToUs(data[2]);
+            s.waits = 0;
+            s.state = ISOTP_TX_SENDING;
+            s.lastTime = now - s.stMinUs; //first frame of the block can go straight away
+            sendConsecutive(s, now);
+            break;
+        case FLOW_WAIT:
+            s.lastTime = now;
+            if (++s.waits > ISOTP_MAX_WAITS) finish(s, true);
+            break;
+        default:
+            finish(s, true);
+            break;
+        }
+        break;
+    }
+    return true;
+}
+
+void IsoTpEngine::tick(uint32_t now)
+{
+    for (int i = 0; i < ISOTP_SESSIONS; i++)
+    {
+        ISOTP_SESSION &s = sessions[i];
+        if (!s.open) continue;
+        if (s.fcPending) s.fcPending = !sendFlowControl(s, s.fcStatus);
+        switch (s.state)
+        {
+        case ISOTP_TX_WAIT_FC:
+        case ISOTP_RX:
+            if ((now - s.lastTime) > ISOTP_TIMEOUT) finish(s, true);
+            break;
+        case ISOTP_TX_SENDING:
+            sendConsecutive(s, now);
+            break;
+        default:
+            break;
+        }
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <stdint.h>
+
+#define ISOTP_MAX_PAYLOAD   4095    //largest message a classic CAN first frame can announce
+#define ISOTP_SESSIONS      12      //open sessions at once. ELM327 emulation uses up to 8 for the ECUs answering it
+#define ISOTP_LISTENERS     4       //ID filters that open sessions for senders nobody has a session with yet
+#define ISOTP_BUFFERS       4       //multi-frame messages in flight at once, all sessions together
+#define ISOTP_PADDING       0xAA    //fills out every frame to 8 bytes
+#define ISOTP_TIMEOUT       1000000 //us to wait for a flow control or the next consecutive frame (N_Bs / N_Cr)
+#define ISOTP_MAX_WAITS     10      //flow control WAIT frames put up with before giving up
+
+//Sends one 8 byte frame. False if it couldn't be queued, the engine tries again on a later tick
+typedef bool (*IsoTpSendFn)(void *context, int bus, uint32_t id, bool extended, const uint8_t *data);
+//A whole message arrived. data is only good until this returns
+typedef void (*IsoTpReceiveFn)(void *context, int session, const uint8_t *data, uint16_t length);
+//A single or first frame from an ID without a session passed a listener's filter. Returns the session opened for it
+//or -1 to let the frame go
+typedef int (*IsoTpAcceptFn)(void *context, int bus, uint32_t id, bool extended);
+
+enum ISOTP_STATE
+{
+    ISOTP_IDLE,
+    ISOTP_TX_WAIT_FC,   //first frame or a whole block sent, waiting for the receiver to say go on
+    ISOTP_TX_SENDING,   //sending consecutive frames as fast as STmin allows
+    ISOTP_RX            //first frame received, collecting consecutive frames
+};
+
+typedef struct {
+    bool open;
+    uint8_t bus;
+    bool extended;
+    uint32_t txId;
+    uint32_t rxId;
+    IsoTpReceiveFn onReceive;
+    void *context;
+    bool expecting;         //a request of ours is waiting for its answer. Flow control is only ever sent then
+    bool passive;           //the message coming in is someone else's. Their receiver does the flow control
+    uint8_t blockSize;      //what we ask for as a receiver. 0 = everything in one block
+    uint8_t stMin;          //same, raw STmin byte
+    ISOTP_STATE state;
+    int8_t buffer;          //pool buffer while a multi-frame message is in flight, -1 otherwise
+    uint16_t length;
+    uint16_t pos;
+    uint8_t seq;
+    uint8_t blockLeft;      //consecutive frames left in this block. 0 = no limit when sending
+    uint8_t waits;
+    bool fcPending;         //the sender refused a flow control we owe, tick() tries it again
+    uint8_t fcStatus;       //which one
+    uint32_t stMinUs;       //separation the receiver asked us for
+    uint32_t lastTime;
+    uint32_t sent;          //messages, not frames
+    uint32_t received;
+    uint32_t errors;        //timeouts, sequence errors and overflows
+} ISOTP_SESSION;
+
+typedef struct {
+    bool used;
+    uint8_t bus;
+    bool extended;
+    uint32_t id;
+    uint32_t mask;
+    IsoTpAcceptFn accept;
+    void *context;
+    bool expecting;         //sessions it opens start out expecting an answer
+} ISOTP_LISTENER;
+
+/*
+ISO 15765-2 transport over classic CAN with normal addressing. Each session is one (bus, tx ID, rx ID) pair and can
+send and receive messages of up to 4095 bytes. Single frames go straight out. Longer messages are cut into a first
+frame and consecutive frames, paced by the block size and STmin the receiver sends back. A session only answers a
+first frame with flow control, its own block size and STmin and a new one after every block, while it is expecting
+an answer: from send() until the owner calls expectAnswer(session, false). Any other first frame is some other
+tester's conversation and is only listened in on, so nothing ever goes on the bus for it. Buffers for
+multi-frame messages come from a fixed pool. A message that finds the pool empty is refused with an overflow flow
+control when receiving (dropped quietly when only listening in) or send() returns false when sending.
+Listeners are for talking to ECUs that aren't known in advance, like everything answering a functional request.
+They only ever see frames no session took.
+Everything is driven from one task: handleFrame() for every received classic frame and tick() often enough to keep
+up with STmin. Times are microseconds from whatever clock the caller uses.
+No Arduino or board headers in here so it can be checked on a PC.
+*/
+class IsoTpEngine
+{
+public:
+    IsoTpEngine();
+    void setSender(IsoTpSendFn send, void *context);
+    int open(int bus, uint32_t txId, uint32_t rxId, bool extended, IsoTpReceiveFn onReceive, void *context);
+    void close(int session);
+    void setFlowControl(int session, uint8_t blockSize, uint8_t stMin);
+    int listen(int bus, uint32_t id, uint32_t mask, bool extended, IsoTpAcceptFn accept, void *context);
+    void unlisten(int listener);
+    void expectAnswer(int session, bool expecting);
+    void expectAnswers(int listener, bool expecting);
+    bool send(int session, const uint8_t *data, uint16_t length, uint32_t now);
+    bool sendFunctional(int bus, uint32_t id, bool extended, const uint8_t *data, uint8_t length);
+    bool handleFrame(int bus, uint32_t id, bool extended, const uint8_t *data, uint8_t length, uint32_t now);
+    void tick(uint32_t now);
+    bool isBusy(int session) { return sessions[session].state != ISOTP_IDLE; }
+    const ISOTP_SESSION &getSession(int session) { return sessions[session]; }
+    int getBuffersInUse();
+
+private:
+    ISOTP_SESSION sessions[ISOTP_SESSIONS];
+    ISOTP_LISTENER listeners[ISOTP_LISTENERS];
+    uint8_t pool[ISOTP_BUFFERS][ISOTP_MAX_PAYLOAD];
+    bool poolUsed[ISOTP_BUFFERS];
+    IsoTpSendFn sender;
+    void *senderContext;
+
+    bool sendFrame(ISOTP_SESSION &s, const uint8_t *data, uint8_t length);
+    bool sendFlowControl(ISOTP_SESSION &s, uint8_t status);
+    void flowControl(ISOTP_SESSION &s, uint8_t status);
+    void sendConsecutive(ISOTP_SESSION &s, uint32_t now);
+    int8_t takeBuffer();
+    void finish(ISOTP_SESSION &s, bool failed);
+    int findSession(int bus, uint32_t id, bool extended);
+    static uint32_t stMinToUs(uint8_t stMin);
+};
@@ -0,0 +1,75 @@
+#include "transport_writer.h"
+#include "gvret_comm.h"
+#include "wifi_manager.h"
+
+//If the USB host hasn't taken a single byte in this long assume nobody is listening and drop the backlog
+#define SER_STALL_TIMEOUT   50000
+
+TransportWriter::TransportWriter()
+{
+    taskHandle = nullptr;
+    lastSerialFlush = 0;
+    lastWifiFlush = 0;
+    serialStallStart = 0;
+}
+
+void TransportWriter::setup()
+{
+    //loop() runs on ARDUINO_RUNNING_CORE. Put the writer on the other one so flushes never steal time from CAN RX
+    BaseType_t otherCore = (xPortGetCoreID() == 0) ? 1 : 0;
+    xTaskCreatePinnedToCore(TransportWriter::taskEntry, "GVRET_TX", 4096, this, 5, &taskHandle, otherCore);
+}
+
+void TransportWriter::taskEntry(void *param)
+{
+    ((TransportWriter *)param)->run();
+}
+
+void TransportWriter::run()
+{
+    for (;;)
+    {
+        bool busy = false;
+        size_t serialLength = serialGVRET.numAvailableBytes();
+        size_t wifiLength = wifiGVRET.numAvailableBytes();
+
+        //same rules the loop used to apply. Flush on the interval or when a buffer is getting close to full
+        if (serialLength > 0 && ((micros() - lastSerialFlush > SER_BUFF_FLUSH_INTERVAL) || (serialLength > (WIFI_BUFF_SIZE / 2))))
+        {
+            busy = flushSerial();
+        }
+        if (wifiLength > 0 && ((micros() - lastWifiFlush > SER_BUFF_FLUSH_INTERVAL) || (wifiLength > (WIFI_BUFF_SIZE / 2))))
+        {
+            lastWifiFlush = micros();
+            wifiManager.sendBufferedData();
+            busy = true;
+        }
+        if (!busy) vTaskDelay(1);
+    }
+}
+
+//Returns true if anything was written. Never waits on the port.
+bool TransportWriter::flushSerial()
+{
+    size_t spanLength = serialGVRET.numContiguousBytes();
+    int room = Serial.availableForWrite();
+
+    if (room <= 0)
+    {
+        if (serialStallStart == 0) serialStallStart = micros() | 1;
+        else if ((micros() - serialStallStart) > SER_STALL_TIMEOUT)
+        {
+            serialGVRET.discardBytes(serialGVRET.numAvailableBytes());
+            lastSerialFlush = micros();
+        }
+        return false;
+    }
+
+    serialStallStart = 0;
+    if (spanLength > (size_t)room) spanLength = room;
+    size_t written = Serial.write(serialGVRET.getBufferedBytes(), spanLength);
+    serialGVRET.consumeBytes(written);
+    //only restart the interval once everything queued so far is out
+    if (serialGVRET.numAvailableBytes() == 0) lastSerialFlush = micros();
+    return written > 0;
+}
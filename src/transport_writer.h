@@ -0,0 +1,24 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+
+//Drains serialGVRET and wifiGVRET from a FreeRTOS task on the other core. The GVRET buffers are SPSC rings so
+//CAN RX keeps filling the free part of the ring while this task writes out the part that is already full.
+//Nothing in here is allowed to block the capture loop. USB writes only take what the port has room for and
+//if the host stops reading altogether the serial backlog is thrown away and counted by serialGVRET instead.
+class TransportWriter
+{
+public:
+    TransportWriter();
+    void setup();
+
+private:
+    TaskHandle_t taskHandle;
+    uint32_t lastSerialFlush;
+    uint32_t lastWifiFlush;
+    uint32_t serialStallStart;
+
+    static void taskEntry(void *param);
+    void run();
+    bool flushSerial();
+};
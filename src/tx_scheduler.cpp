@@ -0,0 +1,238 @@
+#include "tx_scheduler.h"
+#include "can_manager.h"
+
+//esp_timer usually runs the callback a little late. Anything due within this many microseconds goes out in the same
+//pass instead of arming the timer again for almost no time
+#define SCHEDULE_SLACK  20
+
+TxScheduler::TxScheduler()
+{
+    timer = nullptr;
+    lock = portMUX_INITIALIZER_UNLOCKED;
+    armSeq = 0;
+    for (int i = 0; i < NUM_PERIODIC; i++)
+    {
+        entries[i].active = false;
+        entries[i].period = 0;
+        entries[i].offset = 0;
+        entries[i].burst = 1;
+        entries[i].counterByte = 0xFF;
+        entries[i].checksumByte = 0xFF;
+        entries[i].checksumType = CHECKSUM_NONE;
+        entries[i].frame.length = 0;
+        entries[i].frame.extended = false;
+        entries[i].frame.rtr = 0;
+        entries[i].frame.id = 0;
+        entries[i].bus = 0;
+    }
+}
+
+void TxScheduler::setup()
+{
+    esp_timer_create_args_t args = {};
+    args.callback = TxScheduler::timerEntry;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "periodic_tx";
+    esp_timer_create(&args, &timer);
+}
+
+//Only changes what goes out. Timing and whether it's running are left alone
+bool TxScheduler::setFrame(int slot, int bus, CAN_FRAME &frame)
+{
+    if (slot < 0 || slot >= NUM_PERIODIC) return false;
+    if (bus < 0 || bus >= SysSettings.numBuses) return false;
+    if (frame.length > 8) return false;
+    portENTER_CRITICAL(&lock);
+    entries[slot].frame = frame;
+    entries[slot].bus = bus;
+    portEXIT_CRITICAL(&lock);
+    return true;
+}
+
+//Starts the slot (or restarts it with new timing). Period 0 stops it
+bool TxScheduler::setPeriod(int slot, uint32_t period, uint32_t offset, uint8_t burst)
+{
+    if (slot < 0 || slot >= NUM_PERIODIC) return false;
+    if (period == 0)
+    {
+        stop(slot);
+        return true;
+    }
+    if (period < 100 || burst == 0) return false;
+
+    portENTER_CRITICAL(&lock);
+    PERIODIC_FRAME &e = entries[slot];
+    e.period = period;
+    e.offset = offset;
+    e.burst = burst;
+    e.counter = 0;
+    e.sent = 0;
+    e.missed = 0;
+    e.minPeriod = 0xFFFFFFFF;
+    e.maxPeriod = 0;
+    e.totalPeriod = 0;
+    e.nextDue = esp_timer_get_time() + offset;
+    e.active = true;
+    portEXIT_CRITICAL(&lock);
+    rearm();
+    return true;
+}
+
+bool TxScheduler::setCounter(int slot, uint8_t counterByte, uint8_t counterMask, uint8_t checksumByte, PERIODIC_CHECKSUM checksumType)
+{
+    if (slot < 0 || slot >= NUM_PERIODIC) return false;
+    if (counterByte != 0xFF && (counterByte > 7 || counterMask == 0)) return false;
+    if (checksumByte != 0xFF && checksumByte > 7) return false;
+    if (checksumType > CHECKSUM_SUM) return false;
+    portENTER_CRITICAL(&lock);
+    entries[slot].counterByte = counterByte;
+    entries[slot].counterMask = counterMask;
+    entries[slot].checksumByte = checksumByte;
+    entries[slot].checksumType = (checksumByte == 0xFF) ? CHECKSUM_NONE : checksumType;
+    portEXIT_CRITICAL(&lock);
+    return true;
+}
+
+void TxScheduler::stop(int slot)
+{
+    if (slot < 0 || slot >= NUM_PERIODIC) return;
+    portENTER_CRITICAL(&lock);
+    entries[slot].active = false;
+    portEXIT_CRITICAL(&lock);
+    //the timer is left armed. It will find nothing due and arm itself for whatever is left
+}
+
+PERIODIC_FRAME TxScheduler::getEntry(int slot)
+{
+    portENTER_CRITICAL(&lock);
+    PERIODIC_FRAME e = entries[slot];
+    portEXIT_CRITICAL(&lock);
+    return e;
+}
+
+void TxScheduler::timerEntry(void *param)
+{
+    ((TxScheduler *)param)->run();
+}
+
+//Puts the rolling counter and then the checksum into the frame about to be sent. Call with the lock held
+void TxScheduler::prepareFrame(PERIODIC_FRAME &e)
+{
+    uint8_t *data = e.frame.data.uint8;
+    if (e.counterByte < 8)
+    {
+        int shift = __builtin_ctz(e.counterMask);
+        data[e.counterByte] = (data[e.counterByte] & ~e.counterMask) | ((e.counter << shift) & e.counterMask);
+        e.counter++;
+    }
+    if (e.checksumByte < 8 && e.checksumType != CHECKSUM_NONE)
+    {
+        uint8_t check = 0;
+        for (int i = 0; i < e.frame.length; i++)
+        {
+            if (i == e.checksumByte) continue;
+            if (e.checksumType == CHECKSUM_XOR) check ^= data[i];
+            else check += data[i];
+        }
+        data[e.checksumByte] = check;
+    }
+}
+
+//Arms the timer for the earliest deadline. Call without the lock: only the deadline is worked out under it, the
+//esp_timer calls take esp_timer's own lock and can take a while. Whoever worked out a deadline last may not be the
+//one who armed the timer last, so if anyone else worked one out in the meantime it is all done again.
+void TxScheduler::rearm()
+{
+    if (!timer) return;
+    for (;;)
+    {
+        portENTER_CRITICAL(&lock);
+        int64_t earliest = INT64_MAX;
+        for (int i = 0; i < NUM_PERIODIC; i++)
+        {
+            if (entries[i].active && entries[i].nextDue < earliest) earliest = entries[i].nextDue;
+        }
+        uint32_t seq = ++armSeq;
+        portEXIT_CRITICAL(&lock);
+
+        esp_timer_stop(timer);
+        if (earliest != INT64_MAX)
+        {
+            int64_t wait = earliest - esp_timer_get_time();
+            if (wait < 1) wait = 1;
+            esp_timer_start_once(timer, wait);
+        }
+
+        portENTER_CRITICAL(&lock);
+        bool last = (seq == armSeq);
+        portEXIT_CRITICAL(&lock);
+        if (last) return;
+    }
+}
+
+/*
+Runs in the esp_timer task. Frames are copied out under the lock and queued outside of it since that may take a
+moment. The first frame of each burst carries its slot in timestamp so the TX task can report back through
+frameSent() when it really went to the controller. Achieved periods are measured from then, not from here.
+*/
+void TxScheduler::run()
+{
+    CAN_FRAME frame;
+    int bus;
+
+    for (int slot = 0; slot < NUM_PERIODIC; slot++)
+    {
+        int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&lock);
+        PERIODIC_FRAME &e = entries[slot];
+        bool due = e.active && (e.nextDue <= now + SCHEDULE_SLACK);
+        int burst = e.burst;
+        portEXIT_CRITICAL(&lock);
+        if (!due) continue;
+
+        bool ok = true;
+        for (int b = 0; b < burst && ok; b++)
+        {
+            portENTER_CRITICAL(&lock);
+            prepareFrame(e);
+            frame = e.frame;
+            bus = e.bus;
+            portEXIT_CRITICAL(&lock);
+            frame.timestamp = (b == 0) ? slot : PERIODIC_NOT_TIMED;
+            ok = canManager.sendFrame(bus, frame, TX_PRIO_PERIODIC);
+        }
+
+        now = esp_timer_get_time();
+        portENTER_CRITICAL(&lock);
+        if (!ok) e.missed++;
+        e.nextDue += e.period;
+        if (e.nextDue <= now)
+        {
+            uint32_t behind = (now - e.nextDue) / e.period + 1;
+            e.missed += behind;
+            e.nextDue += (int64_t)behind * e.period;
+        }
+        portEXIT_CRITICAL(&lock);
+    }
+
+    rearm();
+}
+
+//The TX task has just handed the first frame of a burst to the controller. sentAt is esp_timer_get_time() from then
+void TxScheduler::frameSent(uint32_t slot, int64_t sentAt)
+{
+    if (slot >= NUM_PERIODIC) return;
+    portENTER_CRITICAL(&lock);
+    PERIODIC_FRAME &e = entries[slot];
+    if (e.sent > 0)
+    {
+        uint32_t period = sentAt - e.lastSent;
+        if (period < e.minPeriod) e.minPeriod = period;
+        if (period > e.maxPeriod) e.maxPeriod = period;
+        e.totalPeriod += period;
+    }
+    e.lastSent = sentAt;
+    e.sent++;
+    portEXIT_CRITICAL(&lock);
+}
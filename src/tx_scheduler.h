@@ -0,0 +1,66 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "config.h"
+
+#define NUM_PERIODIC    16  //periodic frames the scheduler can run at once, all buses together
+#define PERIODIC_NOT_TIMED  0xFFFFFFFF  //timestamp of the frames of a burst after the first. See frameSent()
+
+enum PERIODIC_CHECKSUM
+{
+    CHECKSUM_NONE,
+    CHECKSUM_XOR,   //XOR of every other payload byte
+    CHECKSUM_SUM    //sum of every other payload byte, low 8 bits
+};
+
+typedef struct {
+    CAN_FRAME frame;
+    uint8_t bus;
+    bool active;
+    uint32_t period;        //microseconds
+    uint32_t offset;        //microseconds after start() / setPeriod() before the first one goes
+    uint8_t burst;          //frames sent back to back each period
+    uint8_t counterByte;    //0xFF = no rolling counter
+    uint8_t counterMask;    //bits of counterByte the counter lives in
+    uint8_t counter;
+    uint8_t checksumByte;   //0xFF = no checksum
+    PERIODIC_CHECKSUM checksumType;
+    int64_t nextDue;
+    int64_t lastSent;
+    uint32_t sent;          //bursts the TX task has handed to the controller
+    uint32_t missed;        //periods skipped because the bus wouldn't take the frame or we fell a whole period behind
+    uint32_t minPeriod;     //achieved periods between sends, microseconds
+    uint32_t maxPeriod;
+    uint64_t totalPeriod;
+} PERIODIC_FRAME;
+
+/*
+Sends frames on a fixed schedule without the host or loop() being involved. One esp_timer is armed for the exact
+microsecond the next frame is due. When it fires, everything that is due goes out and the timer is armed again for
+the earliest remaining due time. Deadlines advance by the period every time so errors never add up. If a frame
+couldn't go for a whole period, that period is counted as missed and the schedule picks up at the next one.
+With NUM_PERIODIC entries a scan for the earliest deadline is cheaper than keeping a timing wheel sorted.
+*/
+class TxScheduler
+{
+public:
+    TxScheduler();
+    void setup();
+    bool setFrame(int slot, int bus, CAN_FRAME &frame);
+    bool setPeriod(int slot, uint32_t period, uint32_t offset, uint8_t burst);
+    bool setCounter(int slot, uint8_t counterByte, uint8_t counterMask, uint8_t checksumByte, PERIODIC_CHECKSUM checksumType);
+    void stop(int slot);
+    PERIODIC_FRAME getEntry(int slot);
+    void frameSent(uint32_t slot, int64_t sentAt);
+
+private:
+    PERIODIC_FRAME entries[NUM_PERIODIC];
+    esp_timer_handle_t timer;
+    portMUX_TYPE lock;
+    uint32_t armSeq; //bumped under the lock every time rearm() works out a deadline
+
+    static void timerEntry(void *param);
+    void run();
+    void rearm();
+    void prepareFrame(PERIODIC_FRAME &entry);
+};
@@ -40,6 +40,8 @@
 #include <WiFi.h>
 #include "ELM327_Emulator.h"
 
+#define CLIENT_LOCK_WAIT    pdMS_TO_TICKS(2)    //longest loop() waits for the writer task to let go of clientLock
+
 // WARNING: This function is called from a separate FreeRTOS task (thread)!
 void WiFiEvent(WiFiEvent_t event)
 {
@@ -151,6 +153,7 @@ static IPAddress broadcastAddr(255, 255, 255, 255);
 WiFiManager::WiFiManager()
 {
     lastBroadcast = 0;
+    clientLock = xSemaphoreCreateMutex();
 }
 
 void WiFiManager::setup()
@@ -271,7 +274,9 @@ void WiFiManager::loop()
     if (settings.enableBT != 0)
         return; // No wifi if BT is on
 
-    if (wifiServer.hasClient())
+    //the writer task holds clientLock while it writes, which can take a while on a slow link. loop() never waits
+    //long for it. A client that can't be accepted or stopped now is dealt with on a later pass
+    if (wifiServer.hasClient() && xSemaphoreTake(clientLock, CLIENT_LOCK_WAIT) == pdTRUE)
     {
         for (i = 0; i < MAX_CLIENTS; i++)
         {
@@ -284,6 +289,8 @@ void WiFiManager::loop()
                     Serial.println("Couldn't accept client connection!");
                 else
                 {
+                    wifiGVRET.setStreamMode(0); // a new client knows nothing about the old compressed session
+                    wifiGVRET.clearBufferedBytes(); // or about whatever was queued for the old one. Safe, the writer is locked out
                     Serial.print("New client: ");
                     Serial.print(i);
                     Serial.print(' ');
@@ -296,6 +303,7 @@ void WiFiManager::loop()
             // no free/disconnected spot so reject
             wifiServer.accept().stop();
         }
+        xSemaphoreGive(clientLock);
     }
 
     if (wifiOBDII.hasClient())
@@ -330,24 +338,25 @@ void WiFiManager::loop()
     {
         if (SysSettings.clientNodes[i] && SysSettings.clientNodes[i].connected())
         {
-            if (SysSettings.clientNodes[i].available())
+            if (!wifiGVRET.isAnswerPending() && SysSettings.clientNodes[i].available())
             {
-                // get data from the telnet client and push it to input processing
-                while (SysSettings.clientNodes[i].available())
+                // get data from the telnet client and push it to input processing. Stop if it starts a long answer
+                uint8_t inBytes[256];
+                int numRead;
+                while (!wifiGVRET.isAnswerPending() && (numRead = SysSettings.clientNodes[i].read(inBytes, sizeof(inBytes))) > 0)
                 {
-                    uint8_t inByt;
-                    inByt = SysSettings.clientNodes[i].read();
                     SysSettings.isWifiActive = true;
-                    // Serial.write(inByt); //echo to serial - just for debugging. Don't leave this on!
-                    wifiGVRET.processIncomingByte(inByt);
+                    // Serial.write(inBytes, numRead); //echo to serial - just for debugging. Don't leave this on!
+                    wifiGVRET.processIncomingBytes(inBytes, numRead);
                 }
             }
         }
         else
         {
-            if (SysSettings.clientNodes[i])
+            if (SysSettings.clientNodes[i] && xSemaphoreTake(clientLock, CLIENT_LOCK_WAIT) == pdTRUE)
             {
                 SysSettings.clientNodes[i].stop();
+                xSemaphoreGive(clientLock);
             }
         }
 
@@ -381,17 +390,30 @@ void WiFiManager::loop()
 void WiFiManager::sendBufferedData()
 {
     if (settings.enableBT != 0)
-        return; // No wifi if BT is on
-    for (int i = 0; i < MAX_CLIENTS; i++)
     {
-        size_t wifiLength = wifiGVRET.numAvailableBytes();
+        wifiGVRET.discardBytes(wifiGVRET.numAvailableBytes()); // No wifi if BT is on. Only the producer may clear the buffer
+        return;
+    }
+    xSemaphoreTake(clientLock, portMAX_DELAY);
+    //only read once the lock is held. loop() may have cleared the buffer for a new client while this task waited
+    size_t wifiLength = wifiGVRET.numAvailableBytes();
+    while (wifiLength > 0)
+    {
+        size_t spanLength = wifiGVRET.numContiguousBytes();
+        if (spanLength == 0) break;
+        if (spanLength > wifiLength) spanLength = wifiLength;
         uint8_t *buff = wifiGVRET.getBufferedBytes();
-        if (SysSettings.clientNodes[i] && SysSettings.clientNodes[i].connected())
+        for (int i = 0; i < MAX_CLIENTS; i++)
         {
-            SysSettings.clientNodes[i].write(buff, wifiLength);
+            if (SysSettings.clientNodes[i] && SysSettings.clientNodes[i].connected())
+            {
+                SysSettings.clientNodes[i].write(buff, spanLength);
+            }
         }
+        wifiGVRET.consumeBytes(spanLength);
+        wifiLength -= spanLength;
     }
-    wifiGVRET.clearBufferedBytes();
+    xSemaphoreGive(clientLock);
 }
 
 // Utility to extract header value from headers
@@ -19,4 +19,5 @@ private:
     WiFiClient wifiClient;
     WiFiUDP wifiUDPServer;
     uint32_t lastBroadcast;
+    SemaphoreHandle_t clientLock; //clientNodes are written to from the TransportWriter task
 };
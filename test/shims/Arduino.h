@@ -0,0 +1,149 @@
+#pragma once
+//Just enough of the Arduino-ESP32 core and FreeRTOS for the firmware sources in the native build to compile and
+//run on a PC. Time comes from a clock the tests can stop and step (see Shim:: below). FreeRTOS tasks are threads.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <atomic>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH    1
+#define LOW     0
+#define INPUT   0
+#define OUTPUT  1
+#define NUM_ANALOG_INPUTS   6
+
+#define HEX 16
+#define DEC 10
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return 0; }
+inline uint16_t analogRead(uint8_t) { return 0; }
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+inline void yield() {}
+
+//Test control of the clock behind millis(), micros() and esp_timer_get_time(). The clock runs in real time until a
+//test stops it, after which it only moves through advanceTime() or vTaskDelay() (a tick per call)
+namespace Shim
+{
+    void stopClock(uint64_t startUs = 0);
+    void runClock();
+    void advanceTime(uint64_t us);
+    uint64_t now();
+    void stopTasks();   //tasks park the next time they delay or wait so a test can finish without them running on
+}
+
+class String
+{
+public:
+    String() {}
+    String(const char *str) : s(str ? str : "") {}
+    String(const std::string &str) : s(str) {}
+    String(char c) : s(1, c) {}
+    String(int value, int base = DEC);
+    String(unsigned int value, int base = DEC);
+    String(long value, int base = DEC);
+    String(unsigned long value, int base = DEC);
+
+    unsigned int length() const { return s.length(); }
+    const char *c_str() const { return s.c_str(); }
+    void toCharArray(char *buf, unsigned int bufsize) const;
+    bool concat(const String &str) { s += str.s; return true; }
+    String &operator+=(const String &str) { s += str.s; return *this; }
+    String &operator+=(const char *str) { s += str; return *this; }
+    String &operator+=(char c) { s += c; return *this; }
+    friend String operator+(const String &a, const String &b) { return String(a.s + b.s); }
+    bool operator==(const String &other) const { return s == other.s; }
+    bool operator==(const char *other) const { return s == other; }
+    bool equals(const String &other) const { return s == other.s; }
+    char operator[](unsigned int index) const { return index < s.length() ? s[index] : 0; }
+    bool startsWith(const String &prefix) const { return s.compare(0, prefix.s.length(), prefix.s) == 0; }
+    int indexOf(const String &str) const;
+    void toUpperCase();
+    void toLowerCase();
+    String substring(unsigned int from) const { return String(from < s.length() ? s.substr(from) : std::string()); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        return String(from < s.length() && to > from ? s.substr(from, to - from) : std::string());
+    }
+    long toInt() const { return strtol(s.c_str(), nullptr, 10); }
+
+private:
+    std::string s;
+};
+
+//Serial writes go to stdout only when a test asks for them, otherwise they'd bury the test output
+class HardwareSerial
+{
+public:
+    void begin(uint32_t) {}
+    int available() { return 0; }
+    int read() { return -1; }
+    int availableForWrite() { return 4096; }
+    void flush() {}
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t size);
+    size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+    size_t print(const char *str) { return write(str); }
+    size_t print(const String &str) { return write(str.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(int value, int base = DEC) { return print((long)value, base); }
+    size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+    size_t print(double value, int digits = 2);
+    template <class T> size_t println(T value) { return print(value) + println(); }
+    template <class T> size_t println(T value, int base) { return print(value, base) + println(); }
+    size_t println() { return write("\r\n"); }
+    size_t printf(const char *format, ...);
+    operator bool() { return true; }
+
+    bool echo = false;
+};
+
+extern HardwareSerial Serial;
+
+//FreeRTOS, enough for the tasks and locks the firmware uses
+typedef void *TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdTRUE          1
+#define pdFALSE         0
+#define pdPASS          1
+#define portMAX_DELAY   0xFFFFFFFF
+#define portTICK_PERIOD_MS  1
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+
+typedef struct {
+    volatile uint32_t owner;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+void portENTER_CRITICAL(portMUX_TYPE *mux);
+void portEXIT_CRITICAL(portMUX_TYPE *mux);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+void xTaskNotifyGive(TaskHandle_t task);
+inline BaseType_t xPortGetCoreID() { return 1; }
+
+typedef int esp_err_t;
+#define ESP_OK      0
+#define ESP_FAIL    -1
@@ -0,0 +1,15 @@
+#pragma once
+//Bluetooth link with nothing on the other end
+#include <Arduino.h>
+
+class BluetoothSerial
+{
+public:
+    bool begin(String name) { return true; }
+    bool begin(const char *name) { return true; }
+    int available() { return 0; }
+    int read() { return -1; }
+    size_t write(uint8_t c) { return 1; }
+    size_t write(const uint8_t *buf, size_t size) { return size; }
+    bool hasClient() { return false; }
+};
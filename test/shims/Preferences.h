@@ -0,0 +1,27 @@
+#pragma once
+//NVS stand-in. Nothing is kept, every get returns its default
+#include <Arduino.h>
+
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false) { return true; }
+    void end() {}
+    bool clear() { return true; }
+    size_t putBool(const char *key, bool value) { return 1; }
+    size_t putUChar(const char *key, uint8_t value) { return 1; }
+    size_t putUShort(const char *key, uint16_t value) { return 2; }
+    size_t putInt(const char *key, int32_t value) { return 4; }
+    size_t putUInt(const char *key, uint32_t value) { return 4; }
+    size_t putString(const char *key, const char *value) { return strlen(value); }
+    size_t putString(const char *key, String value) { return value.length(); }
+    size_t putBytes(const char *key, const void *value, size_t length) { return length; }
+    bool getBool(const char *key, bool defaultValue = false) { return defaultValue; }
+    uint8_t getUChar(const char *key, uint8_t defaultValue = 0) { return defaultValue; }
+    uint16_t getUShort(const char *key, uint16_t defaultValue = 0) { return defaultValue; }
+    int32_t getInt(const char *key, int32_t defaultValue = 0) { return defaultValue; }
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0) { return defaultValue; }
+    size_t getString(const char *key, char *value, size_t maxLength) { return 0; }
+    size_t getBytes(const char *key, void *buf, size_t maxLength) { return 0; }
+    size_t getBytesLength(const char *key) { return 0; }
+};
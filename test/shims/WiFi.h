@@ -0,0 +1,37 @@
+#pragma once
+//A WiFiClient that is just two byte strings. Tests put the host's bytes in input and read what was sent from output
+#include <Arduino.h>
+#include <string>
+
+class WiFiClient
+{
+public:
+    WiFiClient() : isConnected(false), readPos(0) {}
+    uint8_t connected() { return isConnected; }
+    operator bool() { return isConnected; }
+    int available() { return input.length() - readPos; }
+    int read() { return (readPos < input.length()) ? (uint8_t)input[readPos++] : -1; }
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t size)
+    {
+        output.append((const char *)buf, size);
+        return size;
+    }
+    int availableForWrite() { return 4096; }
+    void flush() {}
+    void stop() { isConnected = false; }
+
+    //test side
+    void feed(const char *text)
+    {
+        input.append(text);
+        isConnected = true;
+    }
+
+    bool isConnected;
+    std::string input;
+    std::string output;
+
+private:
+    size_t readPos;
+};
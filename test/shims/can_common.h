@@ -0,0 +1,151 @@
+#pragma once
+//Stand-in for the esp32_can library's can_common.h. The frame classes have the same fields as the real ones.
+//CAN_COMMON is a mock controller: tests inject frames for it to receive and look at what was sent to it.
+#include <Arduino.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+typedef union {
+    uint64_t uint64;
+    uint32_t uint32[2];
+    uint16_t uint16[4];
+    uint8_t uint8[8];
+    uint8_t bytes[8];
+    uint8_t byte[8];
+} BytesUnion;
+
+typedef union {
+    uint64_t uint64[8];
+    uint32_t uint32[16];
+    uint16_t uint16[32];
+    uint8_t uint8[64];
+    uint8_t bytes[64];
+    uint8_t byte[64];
+} BytesUnion_FD;
+
+class CAN_FRAME
+{
+public:
+    CAN_FRAME() : id(0), fid(0), timestamp(0), rtr(0), priority(15), extended(false), length(0) { data.uint64 = 0; }
+
+    BytesUnion data;
+    uint32_t id;
+    uint32_t fid;
+    uint32_t timestamp;
+    uint8_t rtr;
+    uint8_t priority;
+    uint8_t extended;
+    uint8_t length;
+};
+
+class CAN_FRAME_FD
+{
+public:
+    CAN_FRAME_FD() : id(0), fid(0), timestamp(0), rrs(0), priority(15), extended(false), fdMode(0), length(0)
+    {
+        memset(data.uint8, 0, sizeof(data.uint8));
+    }
+
+    BytesUnion_FD data;
+    uint32_t id;
+    uint32_t fid;
+    uint32_t timestamp;
+    uint8_t rrs;
+    uint8_t priority;
+    uint8_t extended;
+    uint8_t fdMode;
+    uint8_t length;
+};
+
+class CAN_COMMON
+{
+public:
+    //stampsFrames: timestamp is set to micros() as the frame is received, like the TWAI driver does
+    CAN_COMMON(bool stampsFrames = false) : enabled(false), listenOnly(false), speed(0), overruns(0), txRoom(1000000),
+                   rxLimit(0xFFFFFFFF), filtersSet(0), stampsFrames(stampsFrames) {}
+    virtual ~CAN_COMMON() {}
+
+    virtual uint32_t begin(uint32_t baud = 500000, uint8_t pin = 255) { speed = baud; enabled = true; return baud; }
+    virtual uint32_t beginFD(uint32_t nominalSpeed, uint32_t fdSpeed) { speed = nominalSpeed; enabled = true; return nominalSpeed; }
+    virtual void enable() { enabled = true; }
+    virtual void disable() { enabled = false; }
+    virtual void setListenOnlyMode(bool state) { listenOnly = state; }
+    virtual bool supportsFDMode() { return false; }
+    virtual void setDebuggingMode(bool state) {}
+    virtual int watchFor() { filtersSet = 0; return 0; }
+    virtual int setRXFilter(uint8_t mailbox, uint32_t id, uint32_t mask, bool extended) { filtersSet++; return mailbox; }
+
+    virtual uint16_t available()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return (rxFrames.size() > 0xFFFF) ? 0xFFFF : rxFrames.size(); //a test can queue more than a real driver
+    }
+    virtual uint32_t read(CAN_FRAME &frame)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (rxFrames.empty()) return 0;
+        frame = rxFrames.front();
+        rxFrames.pop_front();
+        return 1;
+    }
+    virtual uint32_t readFD(CAN_FRAME_FD &frame) { return 0; }
+    virtual bool sendFrame(CAN_FRAME &frame)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (txRoom == 0) return false;
+        txRoom--;
+        sent.push_back(frame);
+        return true;
+    }
+    virtual bool sendFrameFD(CAN_FRAME_FD &frame) { return false; }
+
+    //test side
+    //false and counted as an overrun once the driver queue holds rxLimit frames
+    bool inject(const CAN_FRAME &frame)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (rxFrames.size() >= rxLimit)
+        {
+            overruns++;
+            return false;
+        }
+        rxFrames.push_back(frame);
+        if (stampsFrames) rxFrames.back().timestamp = micros();
+        return true;
+    }
+    void setRxLimit(uint32_t frames)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        rxLimit = frames;
+    }
+    std::vector<CAN_FRAME> takeSent()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::vector<CAN_FRAME> out;
+        out.swap(sent);
+        return out;
+    }
+    void setTxRoom(uint32_t frames)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        txRoom = frames;
+    }
+
+    bool enabled;
+    bool listenOnly;
+    uint32_t speed;
+    std::atomic<uint32_t> overruns;
+
+private:
+    std::mutex lock;
+    std::deque<CAN_FRAME> rxFrames;
+    std::vector<CAN_FRAME> sent;
+    uint32_t txRoom;    //frames the controller takes before sendFrame() says it is full
+    uint32_t rxLimit;   //depth of the driver's receive queue
+    int filtersSet;
+    bool stampsFrames;
+};
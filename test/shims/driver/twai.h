@@ -0,0 +1,30 @@
+#pragma once
+//No TWAI controller on a PC. Status and alerts fail so the firmware treats every bus as one without TWAI status
+#include <Arduino.h>
+
+typedef enum {
+    TWAI_STATE_STOPPED,
+    TWAI_STATE_RUNNING,
+    TWAI_STATE_BUS_OFF,
+    TWAI_STATE_RECOVERING
+} twai_state_t;
+
+typedef struct {
+    twai_state_t state;
+    uint32_t msgs_to_tx;
+    uint32_t msgs_to_rx;
+    uint32_t tx_error_counter;
+    uint32_t rx_error_counter;
+    uint32_t tx_failed_count;
+    uint32_t rx_missed_count;
+    uint32_t rx_overrun_count;
+    uint32_t arb_lost_count;
+    uint32_t bus_error_count;
+} twai_status_info_t;
+
+inline esp_err_t twai_get_status_info(twai_status_info_t *status) { return ESP_FAIL; }
+
+#define TWAI_ALERT_RX_DATA  0x00000004
+
+inline esp_err_t twai_reconfigure_alerts(uint32_t alerts, uint32_t *current) { return ESP_FAIL; }
+inline esp_err_t twai_read_alerts(uint32_t *alerts, TickType_t ticks) { return ESP_FAIL; }
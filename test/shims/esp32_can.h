@@ -0,0 +1,6 @@
+#pragma once
+//Stand-in for the esp32_can library. CAN0 is the built-in controller, CAN1 the external one
+#include "can_common.h"
+
+extern CAN_COMMON CAN0;
+extern CAN_COMMON CAN1;
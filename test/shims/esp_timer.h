@@ -0,0 +1,32 @@
+#pragma once
+//esp_timer on the shim clock. Nothing fires on its own: a test moves the clock and calls Shim::runTimers(), which
+//also returns how late each callback ran so timing code can be exercised with whatever lateness the test chooses
+#include <Arduino.h>
+
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum {
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+typedef struct esp_timer *esp_timer_handle_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+int64_t esp_timer_get_time();
+
+namespace Shim
+{
+    int64_t nextTimer();    //when the earliest armed timer is due, INT64_MAX if none is armed
+    int runTimers();        //runs every timer that is due by now(). Returns how many ran
+}
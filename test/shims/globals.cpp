@@ -0,0 +1,24 @@
+//The globals ESP32RET.cpp defines, for the native build which leaves out ESP32RET.cpp, setup() and loop().
+//Tests set up settings, SysSettings and canBuses themselves, see test_support.h
+#include "config.h"
+#include "ELM327_Emulator.h"
+#include "SerialConsole.h"
+#include "gvret_comm.h"
+#include "can_manager.h"
+#include "tx_scheduler.h"
+
+EEPROMSettings settings;
+SystemSettings SysSettings;
+Preferences nvPrefs;
+char deviceName[20];
+char otaHost[40];
+char otaFilename[100];
+
+ELM327Emu elmEmulator;
+GVRET_Comm_Handler serialGVRET;
+GVRET_Comm_Handler wifiGVRET;
+CANManager canManager;
+TxScheduler txScheduler;
+SerialConsole console;
+
+CAN_COMMON *canBuses[NUM_BUSES];
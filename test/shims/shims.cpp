@@ -0,0 +1,263 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <esp32_can.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+HardwareSerial Serial;
+CAN_COMMON CAN0(true); //the TWAI driver stamps frames itself, the external controller here doesn't
+CAN_COMMON CAN1;
+
+static std::atomic<bool> clockStopped(false);
+static std::atomic<uint64_t> stoppedTime(0);
+static const std::chrono::steady_clock::time_point clockStart = std::chrono::steady_clock::now();
+
+uint64_t Shim::now()
+{
+    if (clockStopped) return stoppedTime;
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - clockStart).count();
+}
+
+void Shim::stopClock(uint64_t startUs)
+{
+    stoppedTime = startUs;
+    clockStopped = true;
+}
+
+void Shim::runClock()
+{
+    clockStopped = false;
+}
+
+void Shim::advanceTime(uint64_t us)
+{
+    if (clockStopped) stoppedTime += us;
+    else std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+uint32_t millis() { return Shim::now() / 1000; }
+uint32_t micros() { return Shim::now(); }
+int64_t esp_timer_get_time() { return Shim::now(); }
+void delay(uint32_t ms) { Shim::advanceTime((uint64_t)ms * 1000); }
+void delayMicroseconds(uint32_t us) { Shim::advanceTime(us); }
+
+String::String(int value, int base) : String((long)value, base) {}
+String::String(unsigned int value, int base) : String((unsigned long)value, base) {}
+
+String::String(long value, int base)
+{
+    char buf[24];
+    if (base == HEX) snprintf(buf, sizeof(buf), "%lx", value);
+    else snprintf(buf, sizeof(buf), "%ld", value);
+    s = buf;
+}
+
+String::String(unsigned long value, int base)
+{
+    char buf[24];
+    if (base == HEX) snprintf(buf, sizeof(buf), "%lx", value);
+    else snprintf(buf, sizeof(buf), "%lu", value);
+    s = buf;
+}
+
+void String::toCharArray(char *buf, unsigned int bufsize) const
+{
+    if (bufsize == 0) return;
+    size_t length = s.length() < bufsize - 1 ? s.length() : bufsize - 1;
+    memcpy(buf, s.c_str(), length);
+    buf[length] = 0;
+}
+
+int String::indexOf(const String &str) const
+{
+    size_t pos = s.find(str.s);
+    return (pos == std::string::npos) ? -1 : (int)pos;
+}
+
+void String::toUpperCase()
+{
+    for (auto &c : s) c = toupper(c);
+}
+
+void String::toLowerCase()
+{
+    for (auto &c : s) c = tolower(c);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t size)
+{
+    if (echo) fwrite(buf, 1, size, stdout);
+    return size;
+}
+
+size_t HardwareSerial::print(long value, int base)
+{
+    return print(String(value, base));
+}
+
+size_t HardwareSerial::print(unsigned long value, int base)
+{
+    return print(String(value, base));
+}
+
+size_t HardwareSerial::print(double value, int digits)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", digits, value);
+    return print(buf);
+}
+
+size_t HardwareSerial::printf(const char *format, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    return print(buf);
+}
+
+//critical sections are spinlocks like on the ESP32. They only keep threads apart, nothing is masked
+void portENTER_CRITICAL(portMUX_TYPE *mux)
+{
+    while (__atomic_exchange_n(&mux->owner, 1, __ATOMIC_ACQUIRE)) std::this_thread::yield();
+}
+
+void portEXIT_CRITICAL(portMUX_TYPE *mux)
+{
+    __atomic_store_n(&mux->owner, 0, __ATOMIC_RELEASE);
+}
+
+struct ShimTask {
+    TaskFunction_t function;
+    void *param;
+    std::mutex lock;
+    std::condition_variable wake;
+    uint32_t notifications;
+};
+
+static thread_local ShimTask *currentTask = nullptr;
+static std::atomic<bool> tasksStopped(false);
+//never destroyed, a condition variable with threads parked on it would hold up exit() forever
+static std::mutex &parkLock = *new std::mutex;
+static std::condition_variable &parked = *new std::condition_variable;
+
+//a stopped task never comes back, it just waits here until the test program exits
+static void parkIfStopped()
+{
+    if (!currentTask || !tasksStopped) return;
+    std::unique_lock<std::mutex> guard(parkLock);
+    for (;;) parked.wait(guard);
+}
+
+void Shim::stopTasks()
+{
+    tasksStopped = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20)); //anything mid pass gets to its next delay
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    ShimTask *task = new ShimTask();
+    task->function = function;
+    task->param = param;
+    task->notifications = 0;
+    if (handle) *handle = task;
+    std::thread([task]() {
+        currentTask = task;
+        task->function(task->param);
+    }).detach();
+    return pdPASS;
+}
+
+//a tick is a millisecond. With the clock stopped a delay moves it along instead of sleeping
+void vTaskDelay(TickType_t ticks)
+{
+    parkIfStopped();
+    if (clockStopped && !currentTask) stoppedTime += (uint64_t)ticks * 1000;
+    else std::this_thread::sleep_for(std::chrono::milliseconds(ticks ? ticks : 1));
+    parkIfStopped();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks)
+{
+    parkIfStopped();
+    ShimTask *task = currentTask;
+    if (!task) return 0;
+    std::unique_lock<std::mutex> guard(task->lock);
+    if (!task->notifications) task->wake.wait_for(guard, std::chrono::milliseconds(ticks));
+    uint32_t count = task->notifications;
+    if (clearOnExit) task->notifications = 0;
+    else if (count) task->notifications--;
+    return count;
+}
+
+void xTaskNotifyGive(TaskHandle_t handle)
+{
+    ShimTask *task = (ShimTask *)handle;
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notifications++;
+    task->wake.notify_one();
+}
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    bool armed;
+    int64_t due;
+};
+
+static std::vector<esp_timer *> timers;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+    esp_timer *timer = new esp_timer();
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    timer->armed = false;
+    timer->due = 0;
+    timers.push_back(timer);
+    *handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs)
+{
+    if (timer->armed) return ESP_FAIL; //same as the real one, it has to be stopped first
+    timer->armed = true;
+    timer->due = Shim::now() + timeoutUs;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->armed) return ESP_FAIL;
+    timer->armed = false;
+    return ESP_OK;
+}
+
+int64_t Shim::nextTimer()
+{
+    int64_t next = INT64_MAX;
+    for (esp_timer *timer : timers) if (timer->armed && timer->due < next) next = timer->due;
+    return next;
+}
+
+int Shim::runTimers()
+{
+    int count = 0;
+    int64_t now = Shim::now();
+    for (size_t i = 0; i < timers.size(); i++)
+    {
+        esp_timer *timer = timers[i];
+        if (!timer->armed || timer->due > now) continue;
+        timer->armed = false;
+        timer->callback(timer->arg);
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,36 @@
+#pragma once
+//Settings the way loadSettings() leaves them for a two bus board, with the mock controllers as the buses
+#include "config.h"
+#include "commbuffer.h"
+
+inline void setupTestSettings(int numBuses = 2)
+{
+    memset(&settings, 0, sizeof(settings));
+    for (int i = 0; i < NUM_BUSES; i++)
+    {
+        canBuses[i] = nullptr;
+        settings.canSettings[i].nomSpeed = 500000;
+        settings.canSettings[i].fdSpeed = 5000000;
+    }
+    canBuses[0] = &CAN0;
+    if (numBuses > 1) canBuses[1] = &CAN1;
+    for (int i = 0; i < numBuses; i++) settings.canSettings[i].enabled = true;
+    settings.logLevel = 4;
+    SysSettings.numBuses = numBuses;
+    SysSettings.isWifiActive = false;
+}
+
+//takes everything queued in a CommBuffer the way TransportWriter does, wrapping around the end of the ring
+inline size_t drainBuffer(CommBuffer &buffer, uint8_t *out, size_t maxLength)
+{
+    size_t length = 0;
+    while (buffer.numAvailableBytes() && length < maxLength)
+    {
+        size_t chunk = buffer.numContiguousBytes();
+        if (chunk > maxLength - length) chunk = maxLength - length;
+        memcpy(&out[length], buffer.getBufferedBytes(), chunk);
+        buffer.consumeBytes(chunk);
+        length += chunk;
+    }
+    return length;
+}
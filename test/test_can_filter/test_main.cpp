@@ -0,0 +1,183 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "can_filter.h"
+
+//FilterMatcher's bitmap and grouped binary searches against simply trying every filter in turn
+
+void setUp() {}
+void tearDown() {}
+
+typedef struct {
+    uint32_t id;
+    uint32_t mask;
+    bool extended;
+} TEST_FILTER;
+
+static bool anyMatches(const TEST_FILTER *filters, int count, uint32_t id, bool extended)
+{
+    if (count == 0) return true;
+    uint32_t idBits = extended ? 0x1FFFFFFF : 0x7FF;
+    for (int f = 0; f < count; f++)
+    {
+        uint32_t mask = filters[f].mask & idBits;
+        if (filters[f].extended == extended && (id & mask) == (filters[f].id & mask)) return true;
+    }
+    return false;
+}
+
+static void load(FilterMatcher &matcher, const TEST_FILTER *filters, int count)
+{
+    matcher.clear();
+    for (int f = 0; f < count; f++) TEST_ASSERT_TRUE(matcher.add(filters[f].id, filters[f].mask, filters[f].extended));
+    matcher.compile();
+}
+
+//nothing added lets everything through, clearing goes back to that
+static void test_open()
+{
+    FilterMatcher matcher;
+    TEST_ASSERT_TRUE(matcher.isOpen());
+    TEST_ASSERT_TRUE(matcher.matches(0x123, false));
+    TEST_ASSERT_TRUE(matcher.matches(0x18DAF110, true));
+
+    matcher.add(0x123, 0x7FF, false);
+    matcher.compile();
+    TEST_ASSERT_FALSE(matcher.isOpen());
+    TEST_ASSERT_FALSE(matcher.matches(0x124, false));
+    matcher.clear();
+    matcher.compile();
+    TEST_ASSERT_TRUE(matcher.isOpen());
+    TEST_ASSERT_TRUE(matcher.matches(0x124, false));
+}
+
+//A frame gets through if any one filter takes it, whatever the others say. Several extended filters share a mask,
+//so one group is searched, and others are narrower or wider versions of the same range
+static void test_overlapping_masks()
+{
+    const TEST_FILTER filters[] = {
+        {0x100, 0x700, false},  //0x100 - 0x1FF
+        {0x123, 0x7FF, false},  //inside the one above
+        {0x120, 0x7F0, false},  //so is this
+        {0x7E8, 0x7F8, false},
+        {0x18DAF100, 0x1FFFFF00, true},
+        {0x18DAF110, 0x1FFFFFFF, true},  //inside the one above
+        {0x18DA00F1, 0x1FFF00FF, true},
+        {0x18DB33F1, 0x1FFFFFFF, true},
+        {0x18DB44F1, 0x1FFFFFFF, true},  //same mask as the one above, a different ID
+        {0x0CF00400, 0x00FFFF00, true},  //J1939 PGN F004 from any source, any priority
+    };
+    const int count = sizeof(filters) / sizeof(filters[0]);
+    FilterMatcher matcher;
+    load(matcher, filters, count);
+
+    TEST_ASSERT_TRUE(matcher.matches(0x123, false));
+    TEST_ASSERT_TRUE(matcher.matches(0x12F, false));
+    TEST_ASSERT_TRUE(matcher.matches(0x1FF, false));
+    TEST_ASSERT_TRUE(matcher.matches(0x7EF, false));
+    TEST_ASSERT_FALSE(matcher.matches(0x200, false));
+    TEST_ASSERT_FALSE(matcher.matches(0x7E7, false));
+
+    TEST_ASSERT_TRUE(matcher.matches(0x18DAF110, true));
+    TEST_ASSERT_TRUE(matcher.matches(0x18DAF1FF, true));
+    TEST_ASSERT_TRUE(matcher.matches(0x18DA10F1, true));
+    TEST_ASSERT_TRUE(matcher.matches(0x18DB33F1, true));
+    TEST_ASSERT_TRUE(matcher.matches(0x18DB44F1, true));
+    TEST_ASSERT_FALSE(matcher.matches(0x18DB55F1, true));
+    TEST_ASSERT_TRUE(matcher.matches(0x18F00417, true));
+    TEST_ASSERT_TRUE(matcher.matches(0x0CF00400, true));
+    TEST_ASSERT_FALSE(matcher.matches(0x0CF00500, true));
+    TEST_ASSERT_FALSE(matcher.matches(0x18DAF000, true));
+
+    for (uint32_t id = 0; id < 0x800; id++) TEST_ASSERT_EQUAL(anyMatches(filters, count, id, false), matcher.matches(id, false));
+}
+
+//Standard filters never take extended frames nor the other way round, even with the same number. A set of filters
+//that are all one kind shuts the other kind out entirely. Mask bits above the ID don't stop a match
+static void test_standard_and_extended()
+{
+    const TEST_FILTER standard[] = {{0x123, 0xFFFFFFFF, false}};
+    FilterMatcher matcher;
+    load(matcher, standard, 1);
+    TEST_ASSERT_TRUE(matcher.matches(0x123, false));
+    TEST_ASSERT_FALSE(matcher.matches(0x123, true));
+    TEST_ASSERT_FALSE(matcher.matches(0x18DAF110, true));
+
+    const TEST_FILTER extended[] = {{0x123, 0xFFFFFFFF, true}, {0x18DA0000, 0x1FFF0000, true}};
+    load(matcher, extended, 2);
+    TEST_ASSERT_TRUE(matcher.matches(0x123, true));
+    TEST_ASSERT_FALSE(matcher.matches(0x123, false));
+    TEST_ASSERT_TRUE(matcher.matches(0x18DA1234, true));
+    TEST_ASSERT_FALSE(matcher.matches(0x234, false)); //the low bits of the extended range as a standard ID
+    TEST_ASSERT_FALSE(matcher.matches(0x18DB1234, true));
+
+    //an extended filter covering everything doesn't open up standard frames
+    const TEST_FILTER everything[] = {{0, 0, true}};
+    load(matcher, everything, 1);
+    TEST_ASSERT_TRUE(matcher.matches(0x1FFFFFFF, true));
+    TEST_ASSERT_TRUE(matcher.matches(0, true));
+    TEST_ASSERT_FALSE(matcher.matches(0, false));
+}
+
+//All NUM_FILTERS filters can be used and every one of them matches. One more is refused and changes nothing
+static void test_filter_limit()
+{
+    TEST_FILTER filters[NUM_FILTERS];
+    for (int f = 0; f < NUM_FILTERS; f++)
+    {
+        filters[f].extended = f & 1;
+        filters[f].id = filters[f].extended ? 0x10000000 + f * 0x1001 : 0x400 + f;
+        filters[f].mask = filters[f].extended ? 0x1FFFFFFF : 0x7FF;
+    }
+    FilterMatcher matcher;
+    load(matcher, filters, NUM_FILTERS);
+    TEST_ASSERT_FALSE(matcher.add(0x555, 0x7FF, false));
+    matcher.compile();
+    TEST_ASSERT_FALSE(matcher.matches(0x555, false));
+    for (int f = 0; f < NUM_FILTERS; f++) TEST_ASSERT_TRUE(matcher.matches(filters[f].id, filters[f].extended));
+    TEST_ASSERT_FALSE(matcher.matches(0x400 + NUM_FILTERS, false));
+    TEST_ASSERT_FALSE(matcher.matches(0x10000000 + 2 * 0x1001, true));
+
+    //clearing frees every slot again
+    matcher.clear();
+    for (int f = 0; f < NUM_FILTERS; f++) TEST_ASSERT_TRUE(matcher.add(f, 0x7FF, false));
+    TEST_ASSERT_FALSE(matcher.add(NUM_FILTERS, 0x7FF, false));
+}
+
+//Random sets of up to NUM_FILTERS filters with masks drawn from a few shapes so that groups and overlaps happen
+static void test_matches_every_filter_tried()
+{
+    const uint32_t masks[] = {0x1FFFFFFF, 0x1FFFFF00, 0x1FFF00FF, 0x00FFFF00, 0x1FFFFFF8, 0, 0x7FF, 0x7F0, 0x700};
+    FilterMatcher matcher;
+    TEST_FILTER filters[NUM_FILTERS];
+    srand(4);
+    for (int round = 0; round < 200; round++)
+    {
+        int count = 1 + rand() % NUM_FILTERS;
+        for (int f = 0; f < count; f++)
+        {
+            filters[f].extended = rand() & 1;
+            //IDs close together so masks overlap rather than never meeting
+            filters[f].id = filters[f].extended ? 0x18DA0000 + (rand() & 0xFFFF) : 0x700 + (rand() & 0xFF);
+            filters[f].mask = masks[rand() % (sizeof(masks) / sizeof(masks[0]))];
+        }
+        load(matcher, filters, count);
+        for (uint32_t id = 0; id < 0x800; id++) TEST_ASSERT_EQUAL(anyMatches(filters, count, id, false), matcher.matches(id, false));
+        for (int i = 0; i < 2000; i++)
+        {
+            uint32_t id = (i & 1) ? filters[rand() % count].id ^ (rand() & 0x1FF) : (0x18DA0000 + (rand() & 0xFFFF));
+            id &= 0x1FFFFFFF;
+            TEST_ASSERT_EQUAL(anyMatches(filters, count, id, true), matcher.matches(id, true));
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_open);
+    RUN_TEST(test_overlapping_masks);
+    RUN_TEST(test_standard_and_extended);
+    RUN_TEST(test_filter_limit);
+    RUN_TEST(test_matches_every_filter_tried);
+    return UNITY_END();
+}
@@ -0,0 +1,451 @@
+#include <unity.h>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include "test_support.h"
+#include "can_manager.h"
+#include "gvret_comm.h"
+#include "../../tools/gvret_decode/gvret_stream_decoder.h"
+
+//canManager with its RX and TX tasks running against the mock controllers, the way setup() leaves it on a board.
+//The tasks are started once for the whole suite so every test leaves the buses idle and the queues empty.
+
+void setUp()
+{
+    serialGVRET.clearBufferedBytes();
+}
+
+void tearDown()
+{
+    Shim::runClock();
+}
+
+//until the RX task has emptied the mock controller and handed the frame on
+static void waitForRxTask()
+{
+    while (CAN0.available() || CAN1.available()) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+}
+
+static std::vector<DecodedFrame> decodeSerial(GvretStreamDecoder &decoder)
+{
+    std::vector<DecodedFrame> decoded;
+    uint8_t out[WIFI_BUFF_SIZE];
+    size_t length = drainBuffer(serialGVRET, out, sizeof(out));
+    decoder.feed(out, length, [&decoded](const DecodedFrame &frame) { decoded.push_back(frame); });
+    return decoded;
+}
+
+//The RX task counts every frame into the ID stats on its own, so they stay right while loop() is held up behind a
+//full blocking sink or busy with anything else
+static void test_id_stats_without_loop()
+{
+    IdStatsTable &stats = canManager.getIdStats();
+    stats.requestClear();
+    for (int i = 0; i < 20; i++)
+    {
+        CAN_FRAME frame;
+        frame.id = 0x200 + (i % 4);
+        frame.length = 1;
+        frame.data.uint8[0] = i;
+        (i & 1 ? CAN1 : CAN0).inject(frame);
+    }
+    waitForRxTask();
+
+    TEST_ASSERT_EQUAL(4, stats.getNumEntries());
+    uint32_t total = 0;
+    for (int i = 0; i < stats.getNumEntries(); i++) total += stats.getEntry(i).count;
+    TEST_ASSERT_EQUAL(20, total);
+
+    canManager.loop(); //leave the queues empty for the next test
+    stats.requestClear();
+}
+
+//Periodic traffic with a known amount of jitter goes in on a running clock while loop() only gets to the frames in
+//batches, long after they arrived. CAN0 stamps frames in the driver, so the host must see exactly the time inject()
+//ran at and JITTER_STATS the generated deltas to within that. CAN1 leaves junk or 0 in timestamp and is stamped by
+//the RX task. That may be up to a tick late, or more for the odd frame the host scheduler holds the task up on.
+static void test_jitter_matches_generated()
+{
+    const int frames = 150;
+    const uint32_t tickBound = 3000;    //a tick, plus the host waking the RX task late
+    const uint32_t hiccupBound = 20000; //the host scheduler can hold any thread up for a timeslice or two
+    std::vector<uint32_t> before[2], after[2];
+    std::atomic<bool> done(false);
+    canManager.setJitterWatch(0x321);
+    GvretStreamDecoder decoder;
+    std::vector<DecodedFrame> decoded;
+
+    std::thread traffic([&]() {
+        std::mt19937 rng(10);
+        auto next = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++)
+        {
+            next += std::chrono::microseconds(10000 - 400 + rng() % 800); //10 ms +- 0.4 ms
+            std::this_thread::sleep_until(next);
+            for (int bus = 0; bus < 2; bus++)
+            {
+                CAN_FRAME frame;
+                frame.id = 0x321 + bus;
+                frame.length = 2;
+                frame.data.uint8[0] = i;
+                frame.timestamp = (i % 3 == 0) ? 0 : 0xDEAD0000 + i;
+                before[bus].push_back(micros());
+                (bus ? CAN1 : CAN0).inject(frame);
+                after[bus].push_back(micros());
+            }
+        }
+        done = true;
+    });
+    std::mt19937 rng(11);
+    while (!done)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(rng() % 30000)); //loop() busy elsewhere
+        canManager.loop();
+        std::vector<DecodedFrame> batch = decodeSerial(decoder);
+        decoded.insert(decoded.end(), batch.begin(), batch.end());
+    }
+    traffic.join();
+    waitForRxTask();
+    canManager.loop();
+    std::vector<DecodedFrame> batch = decodeSerial(decoder);
+    decoded.insert(decoded.end(), batch.begin(), batch.end());
+
+    TEST_ASSERT_EQUAL(2 * frames, decoded.size());
+    std::vector<uint32_t> stamps[2];
+    uint32_t worst[2] = {0, 0};
+    int late = 0;
+    for (const DecodedFrame &frame : decoded)
+    {
+        int bus = frame.id - 0x321;
+        int i = stamps[bus].size();
+        TEST_ASSERT_EQUAL(bus, frame.bus);
+        TEST_ASSERT_EQUAL(i, frame.data[0]);
+        uint32_t stamp = frame.timestamp;
+        //no earlier than the frame went in, and no later than the driver (CAN0) or RX task (CAN1) could have stamped it
+        TEST_ASSERT_TRUE(stamp - before[bus][i] <= 0x7FFFFFFF);
+        uint32_t error = stamp - before[bus][i];
+        if (bus == 0) TEST_ASSERT_TRUE(after[bus][i] - stamp <= 0x7FFFFFFF);
+        else
+        {
+            TEST_ASSERT_TRUE(error <= hiccupBound);
+            if (error > tickBound) late++;
+        }
+        if (error > worst[bus]) worst[bus] = error;
+        stamps[bus].push_back(stamp);
+    }
+    char message[100];
+    snprintf(message, sizeof(message), "worst receive stamp error: driver %u us, RX task %u us", worst[0], worst[1]);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(late <= frames / 20);
+
+    uint32_t minDelta = 0xFFFFFFFF, maxDelta = 0;
+    uint64_t totalDelta = 0;
+    for (int i = 1; i < frames; i++)
+    {
+        uint32_t delta = stamps[0][i] - stamps[0][i - 1];
+        //the generated delta lies between these two
+        TEST_ASSERT_TRUE(delta >= before[0][i] - after[0][i - 1] && delta <= after[0][i] - before[0][i - 1]);
+        if (delta < minDelta) minDelta = delta;
+        if (delta > maxDelta) maxDelta = delta;
+        totalDelta += delta;
+    }
+    JITTER_STATS &jitter = canManager.getJitterStats();
+    TEST_ASSERT_EQUAL(frames, jitter.frames);
+    TEST_ASSERT_EQUAL_UINT32(minDelta, jitter.minDelta);
+    TEST_ASSERT_EQUAL_UINT32(maxDelta, jitter.maxDelta);
+    TEST_ASSERT_EQUAL_UINT64(totalDelta, jitter.totalDelta);
+}
+
+//Mean time from a frame reaching the driver to the RX task stamping it, with the driver calling notifyRx() or not.
+//CAN1 leaves the stamping to the RX task
+static uint32_t rxTaskLatency(bool notify)
+{
+    const int frames = 100;
+    std::mt19937 rng(12);
+    GvretStreamDecoder decoder;
+    std::vector<uint32_t> sentAt;
+    std::vector<DecodedFrame> decoded;
+    for (int i = 0; i < frames; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(rng() % 1000)); //anywhere in a tick
+        CAN_FRAME frame;
+        frame.id = 0x330;
+        frame.length = 1;
+        frame.data.uint8[0] = i;
+        sentAt.push_back(micros());
+        CAN1.inject(frame);
+        if (notify) canManager.notifyRx();
+        if (i % 20 == 19)
+        {
+            waitForRxTask();
+            canManager.loop();
+            std::vector<DecodedFrame> batch = decodeSerial(decoder);
+            decoded.insert(decoded.end(), batch.begin(), batch.end());
+        }
+    }
+    TEST_ASSERT_EQUAL(frames, decoded.size());
+    uint64_t total = 0;
+    for (int i = 0; i < frames; i++) total += (uint32_t)decoded[i].timestamp - sentAt[i];
+    return total / frames;
+}
+
+//A driver that gives a notification has its frames picked up straight away instead of at the next tick
+static void test_rx_notification()
+{
+    uint32_t polled = rxTaskLatency(false);
+    uint32_t notified = rxTaskLatency(true);
+    char message[80];
+    snprintf(message, sizeof(message), "mean RX task latency: tick %u us, notified %u us", polled, notified);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(notified < 250);
+    TEST_ASSERT_TRUE(notified < polled / 2);
+}
+
+//what the TransportWriter does, minus the link
+static void discardSerial()
+{
+    size_t length;
+    while ((length = serialGVRET.numContiguousBytes())) serialGVRET.consumeBytes(length);
+}
+
+//Offers frames at a steady rate in 1 ms steps, like a busy bus, until told to stop
+class TrafficGenerator
+{
+public:
+    TrafficGenerator(CAN_COMMON &bus, uint32_t framesPerSecond, uint64_t &offered)
+        : running(true), thread([this, &bus, framesPerSecond, &offered]() {
+        CAN_FRAME frame;
+        frame.length = 8;
+        auto start = std::chrono::steady_clock::now();
+        for (int ms = 1; running; ms++)
+        {
+            std::this_thread::sleep_until(start + std::chrono::milliseconds(ms));
+            for (; offered < (uint64_t)framesPerSecond * ms / 1000; offered++)
+            {
+                frame.id = 0x100 + (offered & 0x3FF);
+                bus.inject(frame);
+            }
+        }
+    }) {}
+    ~TrafficGenerator()
+    {
+        running = false;
+        thread.join();
+    }
+
+private:
+    std::atomic<bool> running;
+    std::thread thread;
+};
+
+//Share of the frames offered over 300 ms at a given rate that overran a 64 frame driver queue while loop() spends
+//5 ms of every pass on something else, as it does flushing wifi. Frames go through the RX task and loop() as now,
+//or are polled off the controller in loop() as they were before the RX task
+static double overrunShare(bool rxTask, uint32_t rate)
+{
+    CAN_COMMON &bus = rxTask ? CAN0 : CAN1;
+    settings.canSettings[1].enabled = rxTask; //keeps the RX task off CAN1 for the polled run
+    bus.setRxLimit(64);
+    uint32_t overruns = bus.overruns;
+    uint64_t offered = 0;
+    {
+        TrafficGenerator traffic(bus, rate, offered);
+        auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+        while (std::chrono::steady_clock::now() < end)
+        {
+            if (rxTask) //the writer empties the 2k serial buffer as often as loop() fills it
+            {
+                uint32_t sent;
+                do {
+                    sent = canManager.getSink(0)->framesSent;
+                    canManager.loop();
+                    discardSerial();
+                } while (canManager.getSink(0)->framesSent != sent);
+            }
+            else
+            {
+                CAN_FRAME frame;
+                while (bus.available() > 0 && bus.read(frame))
+                {
+                    frame.timestamp = micros();
+                    canManager.addBits(1, frame);
+                    canManager.displayFrame(frame, 1);
+                    discardSerial();
+                }
+            }
+            discardSerial();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+    CAN_FRAME leftover;
+    if (!rxTask) while (bus.read(leftover)) {}
+    while (bus.available())
+    {
+        canManager.loop();
+        discardSerial();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    waitForRxTask();
+    canManager.loop();
+    discardSerial();
+    bus.setRxLimit(0xFFFFFFFF);
+    settings.canSettings[1].enabled = true;
+    return (double)(bus.overruns - overruns) / offered;
+}
+
+//Host numbers, and the host's scheduler adds hiccups of its own, so only the big differences are checked. The RX
+//task gets a core of its own here where it shares one with loop() on the ESP32, but it needs little of it: it
+//empties the driver every tick into a 256 frame queue
+static void test_frames_per_second()
+{
+    static const uint32_t rates[] = {4000, 8000, 16000, 32000};
+    double polled[4], withTask[4];
+    canManager.setSinkPolicy(0, SINK_BLOCK); //the serial writer keeps up, so only the driver queue can overflow
+    for (int i = 0; i < 4; i++)
+    {
+        polled[i] = overrunShare(false, rates[i]);
+        withTask[i] = overrunShare(true, rates[i]);
+        char message[120];
+        snprintf(message, sizeof(message), "%u frames/s offered: overruns polled from loop() %.2f%%, with RX task %.2f%%",
+                 (unsigned)rates[i], polled[i] * 100, withTask[i] * 100);
+        TEST_MESSAGE(message);
+    }
+    canManager.setSinkPolicy(0, SINK_DROP);
+
+    //64 frames can't cover a 5 ms stall past 12800 frames/s, the RX queue can until about 50000
+    TEST_ASSERT_TRUE(polled[3] > 0.2);
+    TEST_ASSERT_TRUE(withTask[3] < polled[3] / 4);
+}
+
+//A diagnostic conversation carries on while a blocking sink is full and loop() can't hand frames on to the sinks
+static void test_isotp_ahead_of_full_sink()
+{
+    static uint8_t filler[WIFI_BUFF_SIZE];
+    IsoTpEngine &isotp = canManager.getIsoTp();
+    int session = isotp.open(0, 0x7E0, 0x7E8, false, nullptr, nullptr);
+    const uint8_t request[] = {0x22, 0xF1, 0x90};
+    TEST_ASSERT_TRUE(isotp.send(session, request, sizeof(request), micros()));
+    canManager.setSinkPolicy(0, SINK_BLOCK);
+    TEST_ASSERT_TRUE(serialGVRET.sendBytesToBuffer(filler, WIFI_BUFF_SIZE - 10));
+
+    CAN_FRAME first;
+    first.id = 0x7E8;
+    first.length = 8;
+    const uint8_t firstData[8] = {0x10, 20, 0x62, 0xF1, 0x90, 1, 2, 3};
+    memcpy(first.data.uint8, firstData, 8);
+    CAN0.inject(first);
+    waitForRxTask();
+    canManager.loop();
+    TEST_ASSERT_EQUAL(WIFI_BUFF_SIZE - 10, serialGVRET.numAvailableBytes()); //the frame is still waiting for the sink
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    std::vector<CAN_FRAME> sent = CAN0.takeSent();
+    TEST_ASSERT_EQUAL(2, sent.size()); //the request and the flow control
+    TEST_ASSERT_EQUAL_HEX32(0x7E0, sent[1].id);
+    TEST_ASSERT_EQUAL_HEX8(0x30, sent[1].data.uint8[0]);
+
+    serialGVRET.clearBufferedBytes();
+    canManager.loop();
+    canManager.setSinkPolicy(0, SINK_DROP);
+    isotp.close(session);
+}
+
+//The gateway keeps forwarding while loop() is held up and the RX queue is full. The frames the capture has no room
+//for are counted as lost to it. Changing the rules starts the forwarded counts again
+static void test_gateway_with_capture_full()
+{
+    const int frames = RX_QUEUE_SIZE + 100;
+    GATEWAY_RULE rule;
+    memset(&rule, 0, sizeof(rule));
+    rule.id = 0x100;
+    rule.mask = 0x700;
+    rule.srcBus = 0;
+    rule.dstBus = 1;
+    rule.enabled = true;
+    TEST_ASSERT_TRUE(canManager.setGatewayRule(0, rule));
+    uint32_t dropped = canManager.getCaptureDropped(0);
+    uint32_t held = canManager.getRxQueueFull();
+
+    size_t forwarded = 0;
+    for (int i = 0; i < frames; i++)
+    {
+        CAN_FRAME frame;
+        frame.id = 0x100 + (i & 0xFF);
+        frame.length = 2;
+        frame.data.uint8[0] = i;
+        frame.data.uint8[1] = i >> 8;
+        CAN0.inject(frame);
+        if (i % 16 == 15 || i == frames - 1) //within what the gateway TX queue holds
+        {
+            waitForRxTask();
+            forwarded += CAN1.takeSent().size();
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    forwarded += CAN1.takeSent().size();
+    TEST_ASSERT_EQUAL(frames, forwarded);
+    TEST_ASSERT_EQUAL(frames, canManager.getGatewayStats().forwarded[0]);
+    TEST_ASSERT_EQUAL(frames - RX_QUEUE_SIZE, canManager.getCaptureDropped(0) - dropped);
+    TEST_ASSERT_EQUAL(held, canManager.getRxQueueFull()); //nothing had to wait in the driver
+
+    rule.enabled = false;
+    TEST_ASSERT_TRUE(canManager.setGatewayRule(0, rule));
+    waitForRxTask();
+    TEST_ASSERT_EQUAL(0, canManager.getGatewayStats().forwarded[0]);
+    canManager.loop(); //lets the captured ones go, the serial sink drops what it has no room for
+    discardSerial();
+}
+
+//Two senders on their own priorities and the TX task all count into the same TX_COUNTERS. None of it may be lost.
+//The controller takes nothing for the first half so the senders mostly race each other on dropped
+static void test_tx_counters_from_several_tasks()
+{
+    const uint32_t frames = 1000000;
+    TX_COUNTERS &counters = canManager.getTxCounters(0);
+    uint32_t queuedBefore = counters.queued, droppedBefore = counters.dropped, sentBefore = counters.sent;
+    canManager.setTxPolicy(TX_PRIO_BULK, TX_DROP);
+    CAN0.setTxRoom(0);
+
+    auto sender = [frames](TX_PRIORITY priority) {
+        CAN_FRAME frame;
+        frame.id = 0x600 + priority;
+        frame.length = 0;
+        for (uint32_t i = 0; i < frames; i++)
+        {
+            if (i == frames / 2 && priority == TX_PRIO_DIAG) CAN0.setTxRoom(1000000);
+            canManager.sendFrame(0, frame, priority);
+        }
+    };
+    std::thread diag(sender, TX_PRIO_DIAG);
+    std::thread bulk(sender, TX_PRIO_BULK);
+    diag.join();
+    bulk.join();
+    while (counters.sent - sentBefore != counters.queued - queuedBefore) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    canManager.setTxPolicy(TX_PRIO_BULK, TX_BLOCK);
+    CAN0.takeSent();
+
+    TEST_ASSERT_EQUAL(2 * frames, (counters.queued - queuedBefore) + (counters.dropped - droppedBefore));
+    TEST_ASSERT_EQUAL(counters.queued - queuedBefore, counters.sent - sentBefore);
+}
+
+int main(int argc, char **argv)
+{
+    setupTestSettings();
+    serialGVRET.setBinaryMode(true);
+    canManager.setup();
+    canManager.setSendToConsole(true);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_id_stats_without_loop);
+    RUN_TEST(test_jitter_matches_generated);
+    RUN_TEST(test_rx_notification);
+    RUN_TEST(test_frames_per_second);
+    RUN_TEST(test_isotp_ahead_of_full_sink);
+    RUN_TEST(test_gateway_with_capture_full);
+    RUN_TEST(test_tx_counters_from_several_tasks);
+    int failures = UNITY_END();
+    Shim::stopTasks();
+    return failures;
+}
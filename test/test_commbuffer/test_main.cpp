@@ -0,0 +1,76 @@
+#include <unity.h>
+#include "commbuffer.h"
+#include "gvret_protocol.h"
+#include "test_support.h"
+
+void setUp() {}
+void tearDown() {}
+
+static void test_wraps_around()
+{
+    CommBuffer buffer;
+    uint8_t in[300];
+    uint8_t out[WIFI_BUFF_SIZE];
+    size_t length;
+    for (int i = 0; i < 300; i++) in[i] = i;
+
+    //walk the head around the end of the ring a few times
+    for (int pass = 0; pass < 20; pass++)
+    {
+        TEST_ASSERT_TRUE(buffer.sendBytesToBuffer(in, sizeof(in)));
+        length = drainBuffer(buffer, out, sizeof(out));
+        TEST_ASSERT_EQUAL(sizeof(in), length);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(in, out, length);
+    }
+}
+
+static void test_all_or_nothing()
+{
+    CommBuffer buffer;
+    static uint8_t big[WIFI_BUFF_SIZE];
+    TEST_ASSERT_TRUE(buffer.sendBytesToBuffer(big, WIFI_BUFF_SIZE - 10));
+    TEST_ASSERT_FALSE(buffer.sendBytesToBuffer(big, 11));
+    TEST_ASSERT_EQUAL(WIFI_BUFF_SIZE - 10, buffer.numAvailableBytes());
+    TEST_ASSERT_EQUAL(11, buffer.getOverflowCount());
+    TEST_ASSERT_TRUE(buffer.sendBytesToBuffer(big, 10));
+    TEST_ASSERT_EQUAL(0, buffer.numFreeBytes());
+    TEST_ASSERT_FALSE(buffer.sendByteToBuffer(1));
+    buffer.discardBytes(100);
+    TEST_ASSERT_EQUAL(100, buffer.getDiscardedBytes());
+    TEST_ASSERT_EQUAL(100, buffer.numFreeBytes());
+    buffer.clearBufferedBytes();
+    TEST_ASSERT_EQUAL(WIFI_BUFF_SIZE, buffer.numFreeBytes());
+    TEST_ASSERT_EQUAL(100, buffer.getDiscardedBytes());
+}
+
+static void test_frame_formats()
+{
+    CommBuffer buffer;
+    CAN_FRAME frame;
+    frame.id = 0x100;
+    frame.length = 1;
+    frame.timestamp = 5;
+
+    TEST_ASSERT_EQUAL(FORMAT_TEXT, buffer.getFrameFormat());
+    buffer.setBinaryMode(true);
+    TEST_ASSERT_EQUAL(FORMAT_GVRET, buffer.getFrameFormat());
+    buffer.setStreamMode(STREAM_COMPRESSED | 0x80);
+    TEST_ASSERT_EQUAL(STREAM_COMPRESSED, buffer.getStreamMode());
+    TEST_ASSERT_EQUAL(FORMAT_COMPRESSED, buffer.getFrameFormat());
+
+    buffer.sendFrameToBuffer(frame, 0);
+    uint8_t out[64];
+    size_t length = drainBuffer(buffer, out, sizeof(out));
+    TEST_ASSERT_EQUAL(2 + 1 + 1 + 5 + 1, length);
+    TEST_ASSERT_EQUAL_HEX8(0xF1, out[0]);
+    TEST_ASSERT_EQUAL_HEX8(PROTO_COMPRESSED_FRAME, out[1]);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_wraps_around);
+    RUN_TEST(test_all_or_nothing);
+    RUN_TEST(test_frame_formats);
+    return UNITY_END();
+}
@@ -0,0 +1,317 @@
+#include <unity.h>
+#include <stdlib.h>
+#include <new>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "test_support.h"
+#include "ELM327_Emulator.h"
+#include "can_manager.h"
+
+//The ELM327 emulator driven over a wifi client the way a dashboard app polls it, with canManager's tasks running
+//against the mock controllers. Every heap allocation on the test's own thread is counted, malloc and operator new
+//alike, so anything the command path allocates shows up. The counting wraps glibc's own allocator so this one needs
+//a Linux host.
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static thread_local bool counting = false;
+static uint32_t allocations = 0;
+
+extern "C" void *malloc(size_t size)
+{
+    if (counting) allocations++;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    if (counting) allocations++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    if (counting) allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+void *operator new(size_t size)
+{
+    if (counting) allocations++;
+    void *ptr = __libc_malloc(size ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { __libc_free(ptr); }
+void operator delete[](void *ptr) noexcept { __libc_free(ptr); }
+void operator delete(void *ptr, size_t size) noexcept { __libc_free(ptr); }
+void operator delete[](void *ptr, size_t size) noexcept { __libc_free(ptr); }
+
+static WiFiClient client;
+
+//What a polling app sends over and over: settings, the protocol, battery voltage and engine PIDs. The PIDs go to
+//the bus and each following line stops the wait for its answer
+static const char *poll = "ATE0\rATL0\rATH1\rATSH7E0\rATDP\rATDPN\rATRV\rATST32\r010C\r010D\rATI\r22F190\rATCRA7E8\rAT@1\r";
+
+//runs the emulator on a batch of input. The client's buffers are sized first so only the emulator can allocate
+static uint32_t allocationsFor(const char *input)
+{
+    client.feed(input);
+    client.output.clear();
+    client.output.reserve(64 * 1024);
+    allocations = 0;
+    counting = true;
+    elmEmulator.loop();
+    counting = false;
+    return allocations;
+}
+
+void setUp() {}
+
+void tearDown()
+{
+    Shim::runClock();
+}
+
+//until the RX task has emptied the mock controller and handed the frames on
+static void waitForRxTask()
+{
+    while (CAN0.available()) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+}
+
+static void injectFrame(uint32_t id, const uint8_t *data, bool extended = false)
+{
+    CAN_FRAME frame;
+    frame.id = id;
+    frame.extended = extended;
+    frame.rtr = 0;
+    frame.length = 8;
+    memcpy(frame.data.uint8, data, 8);
+    CAN0.inject(frame);
+}
+
+//the way replies used to be built, to be sure the counting sees it
+static void test_counter_sees_string_replies()
+{
+    String ending("\r\n");
+    allocations = 0;
+    counting = true;
+    String reply = String("7E8 10 14 49 02 01 31 47 31 ") + String(0x1AF8, HEX) + ending;
+    counting = false;
+    TEST_ASSERT_GREATER_THAN(0, allocations);
+}
+
+static void test_commands_without_allocating()
+{
+    allocationsFor(poll); //first time through sets up the ISO-TP listener and sessions
+    TEST_ASSERT_TRUE(client.output.find("ELM327 v1.5") != std::string::npos);
+
+    for (int round = 0; round < 50; round++) TEST_ASSERT_EQUAL(0, allocationsFor(poll));
+    TEST_ASSERT_TRUE(client.output.find("14.2V") != std::string::npos);
+    TEST_ASSERT_TRUE(client.output.find("can11/500") != std::string::npos);
+}
+
+static void test_cache_without_allocating()
+{
+    settings.elmCacheMode = ELM_CACHE_REFRESH;
+    allocationsFor(poll);
+    for (int round = 0; round < 50; round++) TEST_ASSERT_EQUAL(0, allocationsFor(poll));
+    settings.elmCacheMode = ELM_CACHE_OFF;
+}
+
+//Once our own request is over the sessions only listen. Another tester's conversation with the ECU still fills the
+//cache but neither its single frame answers nor its multi-frame ones get anything from us on the bus
+static void test_passive_fill_sends_nothing()
+{
+    const uint8_t otherRequest[8] = {0x02, 0x01, 0x0D, 0, 0, 0, 0, 0};
+    const uint8_t speed[8] = {0x03, 0x41, 0x0D, 0x32, 0, 0, 0, 0};
+    const uint8_t vinRequest[8] = {0x03, 0x22, 0xF1, 0x90, 0, 0, 0, 0};
+    const uint8_t vinFirst[8] = {0x10, 20, 0x62, 0xF1, 0x90, 1, 2, 3};
+    const uint8_t vinNext[2][8] = {{0x21, 4, 5, 6, 7, 8, 9, 10}, {0x22, 11, 12, 13, 14, 15, 16, 17}};
+    settings.elmCacheMode = ELM_CACHE_ON;
+    Shim::stopClock(5000000);
+    client.feed("ATSH7E0\r0105\r");
+    elmEmulator.loop();
+    Shim::advanceTime(1000000); //no ECU answers so the wait runs out, and so does collecting for the cache
+    elmEmulator.loop();
+    elmEmulator.loop();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    CAN0.takeSent(); //our request
+
+    uint32_t passiveBefore = elmEmulator.getCache().getStats().passiveFills;
+    injectFrame(0x7E0, otherRequest);
+    injectFrame(0x7E8, speed);
+    injectFrame(0x7E0, vinRequest);
+    injectFrame(0x7E8, vinFirst);
+    waitForRxTask();
+    canManager.loop();
+    elmEmulator.loop();
+    injectFrame(0x7E8, vinNext[0]); //the other tester's flow control would have come in between
+    injectFrame(0x7E8, vinNext[1]);
+    waitForRxTask();
+    canManager.loop();
+    elmEmulator.loop();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    TEST_ASSERT_EQUAL(0, CAN0.takeSent().size());
+    TEST_ASSERT_EQUAL(passiveBefore + 1, elmEmulator.getCache().getStats().passiveFills);
+    settings.elmCacheMode = ELM_CACHE_OFF;
+}
+
+//asks the ECU at 7E0 with the cache on and answers from 7E8. What went on the bus
+static size_t requestsSent(const char *command, const uint8_t *answer)
+{
+    client.feed(command);
+    elmEmulator.loop();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    size_t sent = CAN0.takeSent().size();
+    if (sent) injectFrame(0x7E8, answer);
+    waitForRxTask();
+    canManager.loop();
+    elmEmulator.loop();
+    return sent;
+}
+
+//Only reads come from the cache. A second tester present or security access seed request still has to reach the
+//ECU, while the same PID read again doesn't
+static void test_cache_only_reads()
+{
+    const uint8_t rpm[8] = {0x04, 0x41, 0x0C, 0x1A, 0xF8, 0, 0, 0};
+    const uint8_t testerPresent[8] = {0x02, 0x7E, 0x00, 0, 0, 0, 0, 0};
+    const uint8_t seed[8] = {0x04, 0x67, 0x01, 0x12, 0x34, 0, 0, 0};
+    const uint8_t session[8] = {0x06, 0x50, 0x03, 0x00, 0x32, 0x01, 0xF4, 0};
+    settings.elmCacheMode = ELM_CACHE_ON;
+    settings.elmCacheTtl = 500;
+    Shim::stopClock(5000000);
+    elmEmulator.getCache().clear();
+    client.feed("ATSH7E0\r");
+    elmEmulator.loop();
+    client.output.clear();
+
+    //the clock is stopped so everything stays inside its TTL
+    TEST_ASSERT_EQUAL(1, requestsSent("010C\r", rpm));
+    TEST_ASSERT_EQUAL(1, requestsSent("3E00\r", testerPresent));
+    TEST_ASSERT_EQUAL(1, requestsSent("2701\r", seed));
+    TEST_ASSERT_EQUAL(1, requestsSent("1003\r", session));
+    TEST_ASSERT_EQUAL(0, requestsSent("010C\r", rpm));
+    TEST_ASSERT_EQUAL(1, requestsSent("3E00\r", testerPresent));
+    TEST_ASSERT_EQUAL(1, requestsSent("2701\r", seed));
+    TEST_ASSERT_EQUAL(1, requestsSent("1003\r", session));
+    TEST_ASSERT_EQUAL(1, elmEmulator.getCache().getNumEntries()); //only 010C was ever kept
+    //every answer printed twice, the read the second time from the cache, the rest from the ECU again
+    TEST_ASSERT_EQUAL_STRING("7E8410C1AF8\r\r>7E87E00\r\r>7E867011234\r\r>7E85003003201F4\r\r>"
+                             "7E8410C1AF8\r\r>7E87E00\r\r>7E867011234\r\r>7E85003003201F4\r\r>", client.output.c_str());
+    settings.elmCacheMode = ELM_CACHE_OFF;
+}
+
+//Anything typed while an answer is awaited stops the wait there and then, with the prompt after STOPPED under the
+//line endings ATL asks for. The line is still carried out, echoed first if ATE is on
+static void test_interrupted_wait()
+{
+    Shim::stopClock(5000000); //no ECU answers and the wait never runs out
+    client.feed("ATE0\rATL1\rATSH7E0\r010C\r");
+    elmEmulator.loop();
+    client.output.clear();
+    client.feed("A");
+    elmEmulator.loop();
+    TEST_ASSERT_EQUAL_STRING("STOPPED\r\n\r\n>", client.output.c_str());
+    client.feed("TRV\r");
+    elmEmulator.loop();
+    TEST_ASSERT_EQUAL_STRING("STOPPED\r\n\r\n>14.2V\r\n>", client.output.c_str());
+
+    client.feed("ATE1\rATL0\r010C\r");
+    elmEmulator.loop();
+    client.output.clear();
+    client.feed("\n"); //the LF of a CR LF line end doesn't count as typing
+    elmEmulator.loop();
+    TEST_ASSERT_EQUAL_STRING("", client.output.c_str());
+    client.feed("ATRV\r");
+    elmEmulator.loop();
+    TEST_ASSERT_EQUAL_STRING("STOPPED\r\r>atrv\r14.2V\r>", client.output.c_str());
+
+    client.feed("ATE0\r");
+    elmEmulator.loop();
+    CAN0.takeSent();
+}
+
+//29 bit addressing. The answer to our own functional request gets its flow control, which goes to the ECU's physical
+//request ID. Another tester's 18DAF1xx traffic once our request is over gets nothing
+static void test_functional_answers_29_bit()
+{
+    const uint8_t vinFirst[8] = {0x10, 20, 0x49, 0x02, 0x01, 'W', 'V', 'W'};
+    const uint8_t vinNext[2][8] = {{0x21, 'Z', 'Z', 'Z', '1', 'K', 'Z', '1'}, {0x22, '2', '3', '4', '5', '6', '7', '8'}};
+    Shim::stopClock(5000000);
+    client.feed("ATSP7\rATCRA\rATSH18DB33F1\r0902\r");
+    client.output.clear();
+    elmEmulator.loop();
+    injectFrame(0x18DAF110, vinFirst, true);
+    waitForRxTask();
+    canManager.loop();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    std::vector<CAN_FRAME> sent = CAN0.takeSent();
+    TEST_ASSERT_EQUAL(2, sent.size()); //the request and the flow control
+    TEST_ASSERT_EQUAL_HEX32(0x18DB33F1, sent[0].id);
+    TEST_ASSERT_EQUAL_HEX32(0x18DA10F1, sent[1].id);
+    TEST_ASSERT_TRUE(sent[1].extended);
+    TEST_ASSERT_EQUAL_HEX8(0x30, sent[1].data.uint8[0]);
+
+    injectFrame(0x18DAF110, vinNext[0], true);
+    injectFrame(0x18DAF110, vinNext[1], true);
+    waitForRxTask();
+    canManager.loop();
+    elmEmulator.loop();
+    TEST_ASSERT_TRUE(client.output.find("18DAF1104902015756575A5A5A314B5A3132333435363738") != std::string::npos);
+    Shim::advanceTime(1000000); //a functional request waits out its timeout, then collecting for the cache ends too
+    elmEmulator.loop();
+    elmEmulator.loop();
+
+    //another tester asks the same ECU and one more
+    injectFrame(0x18DAF110, vinFirst, true);
+    injectFrame(0x18DAF118, vinFirst, true);
+    waitForRxTask();
+    canManager.loop();
+    for (int i = 0; i < 2; i++)
+    {
+        injectFrame(0x18DAF110, vinNext[i], true);
+        injectFrame(0x18DAF118, vinNext[i], true);
+    }
+    waitForRxTask();
+    canManager.loop();
+    elmEmulator.loop();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    TEST_ASSERT_EQUAL(0, CAN0.takeSent().size());
+
+    client.feed("ATSP6\rATSH7E0\r");
+    elmEmulator.loop();
+}
+
+int main(int argc, char **argv)
+{
+    setupTestSettings();
+    canManager.setup();
+    elmEmulator.setWiFiClient(&client);
+    UNITY_BEGIN();
+    RUN_TEST(test_counter_sees_string_replies);
+    RUN_TEST(test_commands_without_allocating);
+    RUN_TEST(test_cache_without_allocating);
+    RUN_TEST(test_passive_fill_sends_nothing);
+    RUN_TEST(test_cache_only_reads);
+    RUN_TEST(test_functional_answers_29_bit);
+    RUN_TEST(test_interrupted_wait);
+    int failures = UNITY_END();
+    Shim::stopTasks();
+    return failures;
+}
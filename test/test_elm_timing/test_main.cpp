@@ -0,0 +1,128 @@
+#include <unity.h>
+#include "elm_timing.h"
+
+//ElmTiming on its own: the ATAT0 / 1 / 2 timeouts, how the learned time moves and which request is forgotten first
+
+void setUp() {}
+void tearDown() {}
+
+static ElmTiming timing;
+static const uint8_t rpm[2] = {0x01, 0x0C};
+static const uint32_t atst = 0x32 * ELM_ST_UNIT;
+
+//ATAT0 and anything not learned yet wait the whole ATST time, 0 being the default
+static void test_whole_atst_time()
+{
+    timing.clear();
+    TEST_ASSERT_EQUAL(atst, timing.getTimeout(0x7E0, rpm, 2, 1, 0x32));
+    TEST_ASSERT_EQUAL(atst, timing.getTimeout(0x7E0, rpm, 2, 1, 0));
+    TEST_ASSERT_EQUAL(0x10 * ELM_ST_UNIT, timing.getTimeout(0x7E0, rpm, 2, 2, 0x10));
+    timing.noteLatency(0x7E0, rpm, 2, 20000);
+    TEST_ASSERT_EQUAL(atst, timing.getTimeout(0x7E0, rpm, 2, 0, 0x32));
+    TEST_ASSERT_EQUAL(0xFF * ELM_ST_UNIT, timing.getTimeout(0x7E0, rpm, 2, 0, 0xFF));
+}
+
+//ATAT1 waits twice the learned time and 10ms, ATAT2 one and a half times and 2ms. Neither goes under
+//ELM_ADAPTIVE_MIN nor over ATST
+static void test_adaptive_timeouts()
+{
+    timing.clear();
+    timing.noteLatency(0x7E0, rpm, 2, 50000);
+    TEST_ASSERT_EQUAL(2 * 50000 + 10000, timing.getTimeout(0x7E0, rpm, 2, 1, 0x32));
+    TEST_ASSERT_EQUAL(75000 + 2000, timing.getTimeout(0x7E0, rpm, 2, 2, 0x32));
+    TEST_ASSERT_EQUAL(0x10 * ELM_ST_UNIT, timing.getTimeout(0x7E0, rpm, 2, 1, 0x10));
+
+    timing.clear();
+    timing.noteLatency(0x7E0, rpm, 2, 1000);
+    TEST_ASSERT_EQUAL(2 * 1000 + 10000, timing.getTimeout(0x7E0, rpm, 2, 1, 0x32));
+    TEST_ASSERT_EQUAL(ELM_ADAPTIVE_MIN, timing.getTimeout(0x7E0, rpm, 2, 2, 0x32)); //3.5ms
+    timing.clear();
+    timing.noteLatency(0x7E0, rpm, 2, 0);
+    TEST_ASSERT_EQUAL(ELM_ADAPTIVE_MIN, timing.getTimeout(0x7E0, rpm, 2, 2, 0x32));
+    //ATST stays the ceiling however short
+    TEST_ASSERT_EQUAL(ELM_ST_UNIT, timing.getTimeout(0x7E0, rpm, 2, 1, 1));
+}
+
+//A slower answer is taken at once. A quicker one moves the estimate an eighth of the way
+static void test_decay()
+{
+    timing.clear();
+    timing.noteLatency(0x7E0, rpm, 2, 80000);
+    timing.noteLatency(0x7E0, rpm, 2, 40000);
+    TEST_ASSERT_EQUAL(75000, timing.getLatency(0x7E0, rpm, 2));
+    timing.noteLatency(0x7E0, rpm, 2, 43000);
+    TEST_ASSERT_EQUAL(71000, timing.getLatency(0x7E0, rpm, 2));
+    timing.noteLatency(0x7E0, rpm, 2, 100000);
+    TEST_ASSERT_EQUAL(100000, timing.getLatency(0x7E0, rpm, 2));
+    for (int i = 0; i < 100; i++) timing.noteLatency(0x7E0, rpm, 2, 10000);
+    TEST_ASSERT_TRUE(timing.getLatency(0x7E0, rpm, 2) < 10008);
+    TEST_ASSERT_TRUE(timing.getLatency(0x7E0, rpm, 2) >= 10000);
+}
+
+//The same bytes to another address or with another length are another request. Lengths outside 1 - 3 aren't kept
+static void test_requests_kept_apart()
+{
+    const uint8_t vin[3] = {0x22, 0xF1, 0x90};
+    timing.clear();
+    timing.noteLatency(0x7E0, rpm, 2, 30000);
+    timing.noteLatency(0x7DF, rpm, 2, 60000);
+    timing.noteLatency(0x7E0, vin, 3, 90000);
+    timing.noteLatency(0x7E0, vin, 2, 15000);
+    TEST_ASSERT_EQUAL(30000, timing.getLatency(0x7E0, rpm, 2));
+    TEST_ASSERT_EQUAL(60000, timing.getLatency(0x7DF, rpm, 2));
+    TEST_ASSERT_EQUAL(90000, timing.getLatency(0x7E0, vin, 3));
+    TEST_ASSERT_EQUAL(15000, timing.getLatency(0x7E0, vin, 2));
+    TEST_ASSERT_EQUAL(0, timing.getLatency(0x7E8, rpm, 2));
+
+    const uint8_t longer[4] = {0x22, 0xF1, 0x90, 0x00};
+    timing.noteLatency(0x7E0, longer, 4, 1000);
+    timing.noteLatency(0x7E0, longer, 0, 1000);
+    TEST_ASSERT_EQUAL(0, timing.getLatency(0x7E0, longer, 4));
+    TEST_ASSERT_EQUAL(atst, timing.getTimeout(0x7E0, longer, 4, 1, 0x32));
+}
+
+//A full table gives up the request noted longest ago. Noting a request again makes it the newest, looking up its
+//timeout doesn't
+static void test_lru_eviction()
+{
+    timing.clear();
+    uint8_t pid[2] = {0x01, 0};
+    for (int i = 0; i < ELM_TIMING_ENTRIES; i++)
+    {
+        pid[1] = i;
+        timing.noteLatency(0x7E0, pid, 2, 1000 + i);
+    }
+    pid[1] = 0;
+    timing.noteLatency(0x7E0, pid, 2, 1000); //PID 0 is now the newest, PID 1 the oldest
+    pid[1] = 2;
+    timing.getTimeout(0x7E0, pid, 2, 1, 0x32);
+
+    pid[1] = 0x40;
+    timing.noteLatency(0x7E0, pid, 2, 5000);
+    TEST_ASSERT_EQUAL(5000, timing.getLatency(0x7E0, pid, 2));
+    pid[1] = 1;
+    TEST_ASSERT_EQUAL(0, timing.getLatency(0x7E0, pid, 2));
+    pid[1] = 0;
+    TEST_ASSERT_EQUAL(1000, timing.getLatency(0x7E0, pid, 2));
+
+    pid[1] = 0x41;
+    timing.noteLatency(0x7E0, pid, 2, 6000);
+    pid[1] = 2;
+    TEST_ASSERT_EQUAL(0, timing.getLatency(0x7E0, pid, 2));
+    for (int i = 3; i < ELM_TIMING_ENTRIES; i++)
+    {
+        pid[1] = i;
+        TEST_ASSERT_EQUAL(1000 + i, timing.getLatency(0x7E0, pid, 2));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_whole_atst_time);
+    RUN_TEST(test_adaptive_timeouts);
+    RUN_TEST(test_decay);
+    RUN_TEST(test_requests_kept_apart);
+    RUN_TEST(test_lru_eviction);
+    return UNITY_END();
+}
@@ -0,0 +1,275 @@
+#include <unity.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+#include "frame_bits.h"
+
+//FrameBits against lengths worked out by hand and against a plain bit by bit model of the frame: every bit pushed
+//one at a time, the CRC a bit at a time and stuffing counted straight off the list
+
+void setUp() {}
+void tearDown() {}
+
+static void put(std::vector<int> &bits, uint32_t value, int count)
+{
+    for (int i = count - 1; i >= 0; i--) bits.push_back((value >> i) & 1);
+}
+
+static uint32_t modelClassic(uint32_t id, bool extended, bool rtr, uint8_t length, const uint8_t *data)
+{
+    std::vector<int> bits;
+    put(bits, 0, 1);
+    if (extended)
+    {
+        put(bits, id >> 18, 11);
+        put(bits, 3, 2);
+        put(bits, id, 18);
+        put(bits, rtr, 1);
+        put(bits, 0, 2);
+    }
+    else
+    {
+        put(bits, id, 11);
+        put(bits, rtr, 1);
+        put(bits, 0, 2);
+    }
+    put(bits, length, 4);
+    if (!rtr) for (int i = 0; i < length; i++) put(bits, data[i], 8);
+    uint16_t crc = 0;
+    for (int bit : bits)
+    {
+        int next = bit ^ ((crc >> 14) & 1);
+        crc = (crc << 1) & 0x7FFF;
+        if (next) crc ^= 0x4599;
+    }
+    put(bits, crc, 15);
+
+    uint32_t stuffed = 0;
+    int last = -1, run = 0;
+    for (int bit : bits)
+    {
+        run = (bit == last) ? run + 1 : 1;
+        last = bit;
+        if (run == 5)
+        {
+            stuffed++;
+            last = !bit;
+            run = 1;
+        }
+    }
+    return bits.size() + stuffed + 13;
+}
+
+//stuff bits in bits [from, to), carrying the run on from the bits before
+static uint32_t modelStuff(const std::vector<int> &bits, size_t from, size_t to, int &last, int &run)
+{
+    uint32_t stuffed = 0;
+    for (size_t i = from; i < to; i++)
+    {
+        run = (bits[i] == last) ? run + 1 : 1;
+        last = bits[i];
+        if (run == 5)
+        {
+            stuffed++;
+            last = !bits[i];
+            run = 1;
+        }
+    }
+    return stuffed;
+}
+
+//FD the same way up to the end of the data. The CRC field has its fixed stuff bits and no others
+static void modelFd(uint32_t id, bool extended, bool brs, uint8_t length, const uint8_t *data, uint32_t &nominal,
+                    uint32_t &dataBits)
+{
+    std::vector<int> bits;
+    put(bits, 0, 1);
+    if (extended)
+    {
+        put(bits, id >> 18, 11);
+        put(bits, 3, 2);
+        put(bits, id, 18);
+    }
+    else put(bits, id, 11);
+    put(bits, 0, extended ? 1 : 2); //RRS, and IDE for a standard ID
+    put(bits, 1, 1);
+    put(bits, 0, 1);
+    put(bits, brs, 1);
+    size_t arbitrationEnd = bits.size();
+    put(bits, 0, 1);
+    uint8_t padded = FrameBits::fdPaddedLength(length);
+    put(bits, padded <= 8 ? padded : padded <= 24 ? 9 + (padded - 12) / 4 : padded == 32 ? 13 : padded == 48 ? 14 : 15, 4);
+    for (int i = 0; i < padded; i++) put(bits, i < length ? data[i] : 0xCC, 8);
+
+    int last = -1, run = 0;
+    uint32_t arbitration = arbitrationEnd + modelStuff(bits, 0, arbitrationEnd, last, run);
+    uint32_t dataPhase = bits.size() - arbitrationEnd + modelStuff(bits, arbitrationEnd, bits.size(), last, run);
+    dataPhase += (padded > 16) ? 4 + 21 + 7 + 1 : 4 + 17 + 6 + 1;
+    nominal = arbitration + 12 + (brs ? 0 : dataPhase);
+    dataBits = brs ? dataPhase : 0;
+}
+
+//Without stuffing a standard frame is 47 bits plus 8 a byte and an extended one 67 plus 8 a byte. Stuffing adds
+//at most one bit in four after the first of everything from SOF to the end of the CRC
+static void test_classic_bounds()
+{
+    uint8_t data[8];
+    srand(1);
+    for (int i = 0; i < 20000; i++)
+    {
+        bool extended = rand() & 1;
+        uint32_t id = rand() & (extended ? 0x1FFFFFFF : 0x7FF);
+        uint8_t length = rand() % 9;
+        for (int b = 0; b < 8; b++) data[b] = rand();
+        uint32_t stuffable = (extended ? 54 : 34) + length * 8;
+        uint32_t bits = FrameBits::classic(id, extended, false, length, data);
+        TEST_ASSERT_TRUE(bits >= stuffable + 13);
+        TEST_ASSERT_TRUE(bits <= stuffable + 13 + (stuffable - 1) / 4);
+    }
+}
+
+//Lengths that follow from the bit pattern alone. 0x555 alternates all through the arbitration field, then RTR, IDE,
+//r0 and a DLC of 0 make seven dominant bits in a row: one stuff bit before the CRC
+static void test_classic_known()
+{
+    const uint8_t none[8] = {0};
+    TEST_ASSERT_EQUAL(modelClassic(0x555, false, false, 0, none), FrameBits::classic(0x555, false, false, 0, none));
+    TEST_ASSERT_TRUE(FrameBits::classic(0x555, false, false, 0, none) >= 47 + 1);
+
+    //a remote frame carries no data, whatever its DLC says
+    const uint8_t junk[8] = {0xFF, 0, 0xFF, 0, 0xFF, 0, 0xFF, 0};
+    TEST_ASSERT_EQUAL(modelClassic(0x123, false, true, 8, junk), FrameBits::classic(0x123, false, true, 8, junk));
+    TEST_ASSERT_TRUE(FrameBits::classic(0x123, false, true, 8, junk) < 47 + 8);
+
+    //lengths past 8 are a classic DLC of 8
+    TEST_ASSERT_EQUAL(FrameBits::classic(0x123, false, false, 8, junk), FrameBits::classic(0x123, false, false, 15, junk));
+}
+
+//All recessive or all dominant, the payload alone needs a stuff bit after every fifth bit of its own and one in four
+//after that. Nothing goes past the worst case of 135 and 160 bits for 8 bytes
+static void test_classic_worst_case()
+{
+    uint8_t ones[8], zeros[8];
+    memset(ones, 0xFF, 8);
+    memset(zeros, 0, 8);
+    const uint32_t ids[] = {0x000, 0x7FF, 0x0F0};
+    for (uint32_t id : ids)
+    {
+        uint32_t bits = FrameBits::classic(id, false, false, 8, ones);
+        TEST_ASSERT_EQUAL(modelClassic(id, false, false, 8, ones), bits);
+        TEST_ASSERT_TRUE(bits >= 111 + 64 / 5);
+        TEST_ASSERT_TRUE(bits <= 135);
+        bits = FrameBits::classic(id, false, false, 8, zeros);
+        TEST_ASSERT_EQUAL(modelClassic(id, false, false, 8, zeros), bits);
+        TEST_ASSERT_TRUE(bits >= 111 + 64 / 5);
+        TEST_ASSERT_TRUE(bits <= 135);
+    }
+    uint32_t bits = FrameBits::classic(0x1FFFFFFF, true, false, 8, ones);
+    TEST_ASSERT_EQUAL(modelClassic(0x1FFFFFFF, true, false, 8, ones), bits);
+    TEST_ASSERT_TRUE(bits <= 160);
+    //the extended ID, SRR and IDE all recessive are 31 bits in a row on their own
+    TEST_ASSERT_TRUE(bits >= 131 + 30 / 5 + 64 / 5);
+}
+
+//The byte at a time stuffing and CRC tables give what the bit by bit model does, for every kind of classic frame
+static void test_classic_matches_model()
+{
+    uint8_t data[8];
+    srand(2);
+    for (int i = 0; i < 20000; i++)
+    {
+        bool extended = rand() & 1;
+        bool rtr = (rand() % 8) == 0;
+        uint32_t id = rand() & (extended ? 0x1FFFFFFF : 0x7FF);
+        uint8_t length = rand() % 9;
+        //runs of equal bits are what stuffing is about, so mostly 00 and FF with some noise in between
+        for (int b = 0; b < 8; b++) data[b] = (rand() % 3) ? ((rand() & 1) ? 0xFF : 0) : rand();
+        TEST_ASSERT_EQUAL(modelClassic(id, extended, rtr, length, data),
+                          FrameBits::classic(id, extended, rtr, length, data));
+    }
+}
+
+//0x555 and a payload of 0x55 never make five equal bits in a row, so these are the bare field lengths. Arbitration
+//is SOF, 11 ID bits, RRS, IDE, FDF, res and BRS, the trailer after the CRC delimiter 12 bits at the nominal rate.
+//The data phase is ESI, DLC, the padded payload, then 4 bits of stuff count and a CRC17 (up to 16 bytes) or CRC21
+//with a fixed stuff bit before every 4 bits, and the CRC delimiter
+static void test_fd_known()
+{
+    uint8_t data[64];
+    memset(data, 0x55, sizeof(data));
+    uint32_t nominal, dataBits;
+
+    FrameBits::fd(0x555, false, true, 8, data, nominal, dataBits);
+    TEST_ASSERT_EQUAL(17 + 12, nominal);
+    TEST_ASSERT_EQUAL(1 + 4 + 64 + 21 + 6 + 1, dataBits);
+
+    FrameBits::fd(0x555, false, true, 10, data, nominal, dataBits); //padded to 12 with 0xCC
+    TEST_ASSERT_EQUAL(17 + 12, nominal);
+    TEST_ASSERT_EQUAL(1 + 4 + 96 + 21 + 6 + 1, dataBits);
+
+    FrameBits::fd(0x555, false, true, 20, data, nominal, dataBits);
+    TEST_ASSERT_EQUAL(17 + 12, nominal);
+    TEST_ASSERT_EQUAL(1 + 4 + 160 + 25 + 7 + 1, dataBits);
+
+    //without BRS the whole frame is nominal
+    FrameBits::fd(0x555, false, false, 8, data, nominal, dataBits);
+    TEST_ASSERT_EQUAL(17 + 12 + 1 + 4 + 64 + 21 + 6 + 1, nominal);
+    TEST_ASSERT_EQUAL(0, dataBits);
+
+    TEST_ASSERT_EQUAL(12, FrameBits::fdPaddedLength(9));
+    TEST_ASSERT_EQUAL(24, FrameBits::fdPaddedLength(21));
+    TEST_ASSERT_EQUAL(32, FrameBits::fdPaddedLength(25));
+    TEST_ASSERT_EQUAL(48, FrameBits::fdPaddedLength(33));
+    TEST_ASSERT_EQUAL(64, FrameBits::fdPaddedLength(49));
+    TEST_ASSERT_EQUAL(8, FrameBits::fdPaddedLength(8));
+}
+
+//With BRS the nominal part is the arbitration and trailer and doesn't depend on the payload, without it the whole
+//frame is nominal. Both match the bit by bit model and stuffing stays within one bit in four
+static void test_fd_matches_model()
+{
+    uint8_t data[64];
+    srand(3);
+    for (int i = 0; i < 20000; i++)
+    {
+        bool extended = rand() & 1;
+        bool brs = rand() & 1;
+        uint32_t id = rand() & (extended ? 0x1FFFFFFF : 0x7FF);
+        uint8_t length = rand() % 65;
+        for (int b = 0; b < 64; b++) data[b] = (rand() & 1) ? ((rand() & 1) ? 0xFF : 0) : rand();
+        uint32_t nominal, dataBits, modelNominal, modelData;
+        FrameBits::fd(id, extended, brs, length, data, nominal, dataBits);
+        modelFd(id, extended, brs, length, data, modelNominal, modelData);
+        TEST_ASSERT_EQUAL(modelNominal, nominal);
+        TEST_ASSERT_EQUAL(modelData, dataBits);
+        if (!brs)
+        {
+            TEST_ASSERT_EQUAL(0, dataBits);
+            continue;
+        }
+
+        uint32_t empty, emptyData;
+        FrameBits::fd(id, extended, true, 0, data, empty, emptyData);
+        TEST_ASSERT_EQUAL(empty, nominal);
+        uint32_t arbitration = extended ? 36 : 17;
+        TEST_ASSERT_TRUE(nominal >= arbitration + 12);
+        TEST_ASSERT_TRUE(nominal <= arbitration + 12 + (arbitration - 1) / 4);
+        uint8_t padded = FrameBits::fdPaddedLength(length);
+        uint32_t crc = (padded > 16) ? 25 + 7 + 1 : 21 + 6 + 1;
+        uint32_t stuffable = 5 + padded * 8;
+        TEST_ASSERT_TRUE(dataBits >= stuffable + crc);
+        TEST_ASSERT_TRUE(dataBits <= stuffable + crc + (stuffable + 4) / 4);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_classic_bounds);
+    RUN_TEST(test_classic_known);
+    RUN_TEST(test_classic_worst_case);
+    RUN_TEST(test_classic_matches_model);
+    RUN_TEST(test_fd_known);
+    RUN_TEST(test_fd_matches_model);
+    return UNITY_END();
+}
@@ -0,0 +1,292 @@
+#include <unity.h>
+#include "frame_encoder.h"
+#include "gvret_protocol.h"
+#include <chrono>
+#include <random>
+
+void setUp() {}
+void tearDown() {}
+
+static CAN_FRAME makeFrame(uint32_t id, bool extended, uint8_t length)
+{
+    CAN_FRAME frame;
+    frame.id = id;
+    frame.extended = extended;
+    frame.length = length;
+    for (int i = 0; i < 8; i++) frame.data.uint8[i] = (i < length) ? 0x11 * (i + 1) : 0xEE;
+    return frame;
+}
+
+static void test_binary_classic()
+{
+    uint8_t out[FrameEncoder::MAX_BINARY_LENGTH];
+    CAN_FRAME frame = makeFrame(0x12345678, true, 3);
+    const uint8_t expected[] = {0xF1, PROTO_BUILD_CAN_FRAME, 0x04, 0x03, 0x02, 0x01, 0x78, 0x56, 0x34, 0x92,
+                                0x13, 0x11, 0x22, 0x33, 0x00};
+    size_t length = FrameEncoder::encodeBinary(out, frame, 1, 0x01020304);
+    TEST_ASSERT_EQUAL(sizeof(expected), length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, out, length);
+}
+
+static void test_binary_fd()
+{
+    uint8_t out[FrameEncoder::MAX_BINARY_LENGTH];
+    CAN_FRAME_FD frame;
+    frame.id = 0x7DF;
+    frame.length = 12;
+    for (int i = 0; i < 12; i++) frame.data.uint8[i] = i;
+    size_t length = FrameEncoder::encodeBinary(out, frame, 2, 10);
+    TEST_ASSERT_EQUAL(12 + 12 + 1, length);
+    TEST_ASSERT_EQUAL_HEX8(PROTO_BUILD_FD_FRAME, out[1]);
+    TEST_ASSERT_EQUAL_HEX8(12, out[10]);
+    TEST_ASSERT_EQUAL_HEX8(2, out[11]);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(frame.data.uint8, &out[12], 12);
+}
+
+static void test_text()
+{
+    uint8_t out[FrameEncoder::MAX_TEXT_LENGTH + 1];
+    CAN_FRAME frame = makeFrame(0x7E8, false, 3);
+    frame.data.uint8[1] = 0x05;
+    size_t length = FrameEncoder::encodeText(out, frame, 0, 123456);
+    out[length] = 0;
+    TEST_ASSERT_EQUAL_STRING("123456 - 7e8 S 0 3 11 5 33\r\n", (char *)out);
+
+    frame = makeFrame(0x1FFFFFFF, true, 0);
+    length = FrameEncoder::encodeText(out, frame, 1, 0x80000000);
+    out[length] = 0;
+    TEST_ASSERT_EQUAL_STRING("-2147483648 - 1fffffff X 1 0\r\n", (char *)out);
+}
+
+static void test_numbers()
+{
+    uint8_t out[12];
+    TEST_ASSERT_EQUAL(1, FrameEncoder::writeDecimal(out, 0));
+    TEST_ASSERT_EQUAL_HEX8('0', out[0]);
+    TEST_ASSERT_EQUAL(10, FrameEncoder::writeDecimal(out, 4294967295u));
+    TEST_ASSERT_EQUAL_MEMORY("4294967295", out, 10);
+    TEST_ASSERT_EQUAL(11, FrameEncoder::writeSignedDecimal(out, INT32_MIN));
+    TEST_ASSERT_EQUAL_MEMORY("-2147483648", out, 11);
+    TEST_ASSERT_EQUAL(1, FrameEncoder::writeHex(out, 0));
+    TEST_ASSERT_EQUAL_HEX8('0', out[0]);
+    TEST_ASSERT_EQUAL(8, FrameEncoder::writeHex(out, 0xdeadbeef));
+    TEST_ASSERT_EQUAL_MEMORY("deadbeef", out, 8);
+}
+
+//first frame of a slot defines it, the same ID again only carries the timestamp and payload
+static void test_compressed_slots()
+{
+    CompressedStreamEncoder encoder;
+    uint8_t out[CompressedStreamEncoder::MAX_LENGTH];
+    CAN_FRAME frame = makeFrame(0x123, false, 2);
+
+    size_t length = encoder.encode(out, frame, 0, 300);
+    TEST_ASSERT_EQUAL(2 + 1 + 2 + 5 + 2, length);
+    TEST_ASSERT_EQUAL_HEX8(PROTO_COMPRESSED_FRAME, out[1]);
+    TEST_ASSERT_TRUE(out[2] & 0x40);
+    TEST_ASSERT_EQUAL_HEX8(0xAC, out[3]); //300 as LEB128
+    TEST_ASSERT_EQUAL_HEX8(0x02, out[4]);
+
+    length = encoder.encode(out, frame, 0, 310);
+    TEST_ASSERT_EQUAL(2 + 1 + 1 + 2, length);
+    TEST_ASSERT_FALSE(out[2] & 0x40);
+    TEST_ASSERT_EQUAL_HEX8(20, out[3]); //+10 zigzag coded
+
+    length = encoder.encode(out, frame, 0, 307);
+    TEST_ASSERT_EQUAL_HEX8(5, out[3]); //-3
+
+    //a record that couldn't be queued is taken back, so the next one still has the slot and timestamp the host has
+    CAN_FRAME other = makeFrame(0x123, false, 3);
+    encoder.encode(out, other, 0, 400);
+    encoder.undo();
+    length = encoder.encode(out, frame, 0, 317);
+    TEST_ASSERT_EQUAL(2 + 1 + 1 + 2, length);
+    TEST_ASSERT_FALSE(out[2] & 0x40);
+    TEST_ASSERT_EQUAL_HEX8(20, out[3]);
+}
+
+//the text format as it was built before the table encoder, one sprintf per piece
+template <class FrameType>
+static size_t sprintfText(char *out, const FrameType &frame, int whichBus, uint32_t timestamp)
+{
+    int length = sprintf(out, "%d - %x", (int32_t)timestamp, frame.id);
+    length += sprintf(&out[length], frame.extended ? " X " : " S ");
+    length += sprintf(&out[length], "%i %i", whichBus, frame.length);
+    for (int c = 0; c < frame.length; c++) length += sprintf(&out[length], " %x", frame.data.uint8[c]);
+    length += sprintf(&out[length], "\r\n");
+    return length;
+}
+
+static CAN_FRAME randomFrame(std::mt19937 &rng)
+{
+    CAN_FRAME frame;
+    frame.extended = rng() & 1;
+    frame.id = rng() & (frame.extended ? 0x1FFFFFFF : 0x7FF);
+    frame.length = rng() % 9;
+    for (int i = 0; i < 8; i++) frame.data.uint8[i] = (rng() & 1) ? rng() : rng() & 0xF; //plenty of one digit bytes
+    return frame;
+}
+
+static void test_text_matches_sprintf()
+{
+    std::mt19937 rng(1234);
+    uint8_t table[FrameEncoder::MAX_TEXT_LENGTH];
+    char reference[FrameEncoder::MAX_TEXT_LENGTH + 1];
+
+    for (int i = 0; i < 200000; i++)
+    {
+        CAN_FRAME frame = randomFrame(rng);
+        uint32_t timestamp = (i < 10) ? (uint32_t)i * 0x1999999A : rng();
+        int bus = rng() % 5;
+        size_t length = FrameEncoder::encodeText(table, frame, bus, timestamp);
+        size_t refLength = sprintfText(reference, frame, bus, timestamp);
+        TEST_ASSERT_EQUAL(refLength, length);
+        TEST_ASSERT_EQUAL_MEMORY(reference, table, length);
+    }
+
+    CAN_FRAME_FD fd;
+    fd.id = 0x18DAF110;
+    fd.extended = true;
+    fd.length = 64;
+    for (int i = 0; i < 64; i++) fd.data.uint8[i] = i * 5;
+    size_t length = FrameEncoder::encodeText(table, fd, 4, 0xFFFFFFFF);
+    TEST_ASSERT_EQUAL(sprintfText(reference, fd, 4, 0xFFFFFFFF), length);
+    TEST_ASSERT_EQUAL_MEMORY(reference, table, length);
+}
+
+//Host numbers, not ESP32 ones, but the ratio shows whether the table encoder still earns its keep
+static void test_text_speed()
+{
+    const int frames = 1000;
+    const int rounds = 200;
+    std::mt19937 rng(99);
+    CAN_FRAME input[frames];
+    for (int i = 0; i < frames; i++) input[i] = randomFrame(rng);
+    uint8_t table[FrameEncoder::MAX_TEXT_LENGTH];
+    char reference[FrameEncoder::MAX_TEXT_LENGTH + 1];
+    volatile size_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < frames; i++) sink += sprintfText(reference, input[i], 0, i * 1000);
+    auto mid = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < frames; i++) sink += FrameEncoder::encodeText(table, input[i], 0, i * 1000);
+    auto end = std::chrono::steady_clock::now();
+
+    double sprintfNs = std::chrono::duration<double, std::nano>(mid - start).count() / (frames * rounds);
+    double tableNs = std::chrono::duration<double, std::nano>(end - mid).count() / (frames * rounds);
+    char message[120];
+    snprintf(message, sizeof(message), "sprintf %.0f ns/frame, table %.0f ns/frame, %.1fx", sprintfNs, tableNs, sprintfNs / tableNs);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(tableNs < sprintfNs);
+}
+
+//the binary records as commbuffer built them before FrameEncoder, one byte at a time. Works on a copy since the old
+//code set bit 31 in the caller's frame
+template <class FrameType>
+static size_t byteWiseBinary(uint8_t *buff, FrameType frame, int whichBus, uint32_t now, bool fd)
+{
+    size_t buffLength = 0;
+    if (frame.extended) frame.id |= 1 << 31;
+    buff[buffLength++] = 0xF1;
+    buff[buffLength++] = fd ? PROTO_BUILD_FD_FRAME : 0;
+    buff[buffLength++] = (uint8_t)(now & 0xFF);
+    buff[buffLength++] = (uint8_t)(now >> 8);
+    buff[buffLength++] = (uint8_t)(now >> 16);
+    buff[buffLength++] = (uint8_t)(now >> 24);
+    buff[buffLength++] = (uint8_t)(frame.id & 0xFF);
+    buff[buffLength++] = (uint8_t)(frame.id >> 8);
+    buff[buffLength++] = (uint8_t)(frame.id >> 16);
+    buff[buffLength++] = (uint8_t)(frame.id >> 24);
+    if (fd) {
+        buff[buffLength++] = frame.length;
+        buff[buffLength++] = (uint8_t)(whichBus);
+    } else {
+        buff[buffLength++] = frame.length + (uint8_t)(whichBus << 4);
+    }
+    for (int c = 0; c < frame.length; c++) {
+        buff[buffLength++] = frame.data.uint8[c];
+    }
+    buff[buffLength++] = 0;
+    return buffLength;
+}
+
+static CAN_FRAME_FD randomFdFrame(std::mt19937 &rng)
+{
+    static const uint8_t lengths[] = {0, 1, 8, 12, 16, 20, 24, 32, 48, 64};
+    CAN_FRAME_FD frame;
+    frame.extended = rng() & 1;
+    frame.id = rng() & (frame.extended ? 0x1FFFFFFF : 0x7FF);
+    frame.length = lengths[rng() % sizeof(lengths)];
+    for (int i = 0; i < 64; i++) frame.data.uint8[i] = rng();
+    return frame;
+}
+
+static void test_binary_matches_byte_wise()
+{
+    std::mt19937 rng(4321);
+    uint8_t out[FrameEncoder::MAX_BINARY_LENGTH];
+    uint8_t reference[FrameEncoder::MAX_BINARY_LENGTH];
+
+    for (int i = 0; i < 500000; i++)
+    {
+        CAN_FRAME frame = randomFrame(rng);
+        uint32_t timestamp = rng();
+        int bus = rng() % 5;
+        size_t length = FrameEncoder::encodeBinary(out, frame, bus, timestamp);
+        TEST_ASSERT_EQUAL(byteWiseBinary(reference, frame, bus, timestamp, false), length);
+        TEST_ASSERT_EQUAL_MEMORY(reference, out, length);
+    }
+    for (int i = 0; i < 100000; i++)
+    {
+        CAN_FRAME_FD frame = randomFdFrame(rng);
+        uint32_t timestamp = rng();
+        int bus = rng() % 5;
+        size_t length = FrameEncoder::encodeBinary(out, frame, bus, timestamp);
+        TEST_ASSERT_EQUAL(byteWiseBinary(reference, frame, bus, timestamp, true), length);
+        TEST_ASSERT_EQUAL_MEMORY(reference, out, length);
+    }
+}
+
+static void test_binary_speed()
+{
+    const int frames = 1000;
+    const int rounds = 2000;
+    std::mt19937 rng(77);
+    CAN_FRAME input[frames];
+    for (int i = 0; i < frames; i++) input[i] = randomFrame(rng);
+    uint8_t out[FrameEncoder::MAX_BINARY_LENGTH];
+    volatile uint8_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < frames; i++) sink += out[byteWiseBinary(out, input[i], 0, i * 1000, false) - 2];
+    auto mid = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < frames; i++) sink += out[FrameEncoder::encodeBinary(out, input[i], 0, i * 1000) - 2];
+    auto end = std::chrono::steady_clock::now();
+
+    double byteNs = std::chrono::duration<double, std::nano>(mid - start).count() / (frames * rounds);
+    double encoderNs = std::chrono::duration<double, std::nano>(end - mid).count() / (frames * rounds);
+    char message[120];
+    snprintf(message, sizeof(message), "byte wise %.1f ns/frame, FrameEncoder %.1f ns/frame, %.1fx", byteNs, encoderNs,
+             byteNs / encoderNs);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(encoderNs <= byteNs * 1.1);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_binary_classic);
+    RUN_TEST(test_binary_fd);
+    RUN_TEST(test_text);
+    RUN_TEST(test_numbers);
+    RUN_TEST(test_compressed_slots);
+    RUN_TEST(test_text_matches_sprintf);
+    RUN_TEST(test_text_speed);
+    RUN_TEST(test_binary_matches_byte_wise);
+    RUN_TEST(test_binary_speed);
+    return UNITY_END();
+}
@@ -0,0 +1,113 @@
+#include <unity.h>
+#include <string.h>
+#include "frame_reducer.h"
+
+//FrameReducer on its own. The way fanOutFrame() uses it: pass() for every frame, sent() when a sink took it
+
+void setUp() {}
+void tearDown() {}
+
+static FrameReducer reducer;
+
+//pass() and, if it let the frame through, sent()
+static bool offer(int bus, uint32_t id, uint8_t value, uint32_t timestamp, bool extended = false, uint8_t length = 8)
+{
+    uint8_t data[8] = {value, 0, 0, 0, 0, 0, 0, 0};
+    if (!reducer.pass(bus, id, extended, data, length, timestamp)) return false;
+    reducer.sent();
+    return true;
+}
+
+//Unchanged payloads are held back until the refresh is due. A new payload or length goes straight out
+static void test_changes()
+{
+    reducer.setMode(REDUCE_CHANGES, 100, 1000);
+    TEST_ASSERT_TRUE(offer(0, 0x100, 1, 0));
+    TEST_ASSERT_FALSE(offer(0, 0x100, 1, 10000));
+    TEST_ASSERT_FALSE(offer(0, 0x100, 1, 999999));
+    TEST_ASSERT_TRUE(offer(0, 0x100, 2, 1000000));
+    TEST_ASSERT_FALSE(offer(0, 0x100, 2, 1000100));
+    TEST_ASSERT_TRUE(offer(0, 0x100, 2, 1000100, false, 7));
+    TEST_ASSERT_TRUE(offer(0, 0x100, 2, 2000100, false, 7)); //refresh
+    TEST_ASSERT_EQUAL(3, reducer.getFramesSuppressed());
+
+    reducer.setMode(REDUCE_CHANGES, 100, 0); //never refreshed
+    TEST_ASSERT_TRUE(offer(0, 0x100, 1, 0));
+    TEST_ASSERT_FALSE(offer(0, 0x100, 1, 100000000));
+}
+
+//One frame per interval for each bus and ID. Buses, IDs and standard / extended are all kept apart
+static void test_rate()
+{
+    reducer.setMode(REDUCE_RATE, 100, 0);
+    TEST_ASSERT_TRUE(offer(0, 0x100, 1, 0));
+    TEST_ASSERT_TRUE(offer(1, 0x100, 1, 0));
+    TEST_ASSERT_TRUE(offer(0, 0x101, 1, 0));
+    TEST_ASSERT_TRUE(offer(0, 0x100, 1, 0, true));
+    TEST_ASSERT_FALSE(offer(0, 0x100, 2, 99999)); //a change makes no difference here
+    TEST_ASSERT_TRUE(offer(0, 0x100, 2, 100000));
+    TEST_ASSERT_FALSE(offer(0, 0x100, 2, 150000));
+    TEST_ASSERT_TRUE(offer(0, 0x100, 2, 0xFFFFFFF0));
+    TEST_ASSERT_FALSE(offer(0, 0x100, 2, 0x10)); //the clock wrapping is no different
+    TEST_ASSERT_TRUE(offer(0, 0x100, 2, 0xFFFFFFF0 + 100000));
+}
+
+//A frame no sink took is not remembered, so the next frame with the same payload still goes out instead of waiting
+//for the refresh. Whatever a sink did take is then held back as usual
+static void test_refused_not_remembered()
+{
+    uint8_t data[8] = {5, 0, 0, 0, 0, 0, 0, 0};
+    reducer.setMode(REDUCE_CHANGES, 100, 1000);
+    TEST_ASSERT_TRUE(reducer.pass(0, 0x200, false, data, 8, 0)); //first of its ID, refused
+    TEST_ASSERT_TRUE(reducer.pass(0, 0x200, false, data, 8, 10000));
+    reducer.sent();
+    TEST_ASSERT_FALSE(reducer.pass(0, 0x200, false, data, 8, 20000));
+
+    data[0] = 6; //a change refused everywhere
+    TEST_ASSERT_TRUE(reducer.pass(0, 0x200, false, data, 8, 30000));
+    TEST_ASSERT_TRUE(reducer.pass(0, 0x200, false, data, 8, 40000));
+    reducer.sent();
+    TEST_ASSERT_FALSE(reducer.pass(0, 0x200, false, data, 8, 50000));
+    reducer.sent(); //nothing let through since the last sent(), so nothing changes
+    TEST_ASSERT_FALSE(reducer.pass(0, 0x200, false, data, 8, 60000));
+
+    reducer.setMode(REDUCE_RATE, 100, 0);
+    TEST_ASSERT_TRUE(reducer.pass(0, 0x200, false, data, 8, 0));
+    reducer.sent();
+    TEST_ASSERT_TRUE(reducer.pass(0, 0x200, false, data, 8, 100000)); //refused
+    TEST_ASSERT_TRUE(reducer.pass(0, 0x200, false, data, 8, 120000));
+    reducer.sent();
+    TEST_ASSERT_FALSE(reducer.pass(0, 0x200, false, data, 8, 200000));
+}
+
+//IDs past what the table holds always go out rather than being lost
+static void test_table_full()
+{
+    reducer.setMode(REDUCE_CHANGES, 100, 0);
+    for (uint32_t id = 0; id < REDUCER_TABLE_SIZE; id++) offer(0, id, 1, 0);
+    uint32_t used = reducer.getTableUsed();
+    TEST_ASSERT_TRUE(used < REDUCER_TABLE_SIZE);
+    int heldBack = 0;
+    for (uint32_t id = 0; id < REDUCER_TABLE_SIZE; id++) if (!offer(0, id, 1, 1000)) heldBack++;
+    TEST_ASSERT_EQUAL(used, heldBack);
+    TEST_ASSERT_EQUAL(used, reducer.getTableUsed());
+}
+
+static void test_off()
+{
+    reducer.setMode(REDUCE_OFF, 100, 1000);
+    for (int i = 0; i < 10; i++) TEST_ASSERT_TRUE(offer(0, 0x100, 1, i));
+    TEST_ASSERT_EQUAL(0, reducer.getFramesSuppressed());
+    TEST_ASSERT_EQUAL(0, reducer.getTableUsed());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_changes);
+    RUN_TEST(test_rate);
+    RUN_TEST(test_refused_not_remembered);
+    RUN_TEST(test_table_full);
+    RUN_TEST(test_off);
+    return UNITY_END();
+}
@@ -0,0 +1,167 @@
+#include <unity.h>
+#include <string.h>
+#include "gateway.h"
+
+//The gateway's rule table, payload rewrite and loop guard on their own, without the RX task around them
+
+void setUp() {}
+void tearDown() {}
+
+static GATEWAY_RULE makeRule(int srcBus, int dstBus, uint32_t id, uint32_t mask, bool extended = false)
+{
+    GATEWAY_RULE rule;
+    memset(&rule, 0, sizeof(rule));
+    rule.srcBus = srcBus;
+    rule.dstBus = dstBus;
+    rule.id = id;
+    rule.mask = mask;
+    rule.extended = extended;
+    rule.enabled = true;
+    return rule;
+}
+
+//Lower slots win where rules overlap, standard and extended IDs never match each other's rules and each bus only
+//sees its own rules
+static void test_routes()
+{
+    GATEWAY_RULE rules[NUM_GATEWAY_RULES];
+    memset(rules, 0, sizeof(rules));
+    rules[0] = makeRule(0, 1, 0x123, 0x7FF);
+    rules[1] = makeRule(0, 1, 0x100, 0x700);
+    rules[2] = makeRule(0, 1, 0, 0);    //everything else standard on bus 0
+    rules[3] = makeRule(0, 1, 0x18DAF100, 0x1FFFFF00, true);
+    rules[4] = makeRule(0, 1, 0x18DAF110, 0x1FFFFFFF, true); //shadowed by slot 3
+    rules[5] = makeRule(1, 0, 0x7E8, 0xFFFFFFFF); //mask bits above the ID don't matter
+    rules[6] = makeRule(1, 0, 0x7E8, 0x7F8);  //the rest of 7E8 - 7EF
+    rules[6].block = true;
+    GatewayRoutes routes;
+    routes.compile(rules, NUM_GATEWAY_RULES);
+
+    TEST_ASSERT_EQUAL(0, routes.route(0, 0x123, false));
+    TEST_ASSERT_EQUAL(1, routes.route(0, 0x124, false));
+    TEST_ASSERT_EQUAL(1, routes.route(0, 0x1FF, false));
+    TEST_ASSERT_EQUAL(2, routes.route(0, 0x200, false));
+    TEST_ASSERT_EQUAL(2, routes.route(0, 0x000, false));
+    TEST_ASSERT_EQUAL(3, routes.route(0, 0x18DAF110, true));
+    TEST_ASSERT_EQUAL(3, routes.route(0, 0x18DAF1FF, true));
+    TEST_ASSERT_EQUAL(-1, routes.route(0, 0x18DAF010, true));
+    TEST_ASSERT_EQUAL(-1, routes.route(0, 0x123, true));  //standard rules only take standard frames
+
+    TEST_ASSERT_EQUAL(5, routes.route(1, 0x7E8, false));
+    TEST_ASSERT_EQUAL(6, routes.route(1, 0x7E9, false));
+    TEST_ASSERT_TRUE(routes.getRule(6).block);
+    TEST_ASSERT_EQUAL(-1, routes.route(1, 0x123, false));
+    TEST_ASSERT_EQUAL(-1, routes.route(1, 0x18DAF110, true));
+    TEST_ASSERT_TRUE(routes.hasRules(0));
+    TEST_ASSERT_TRUE(routes.hasRules(1));
+    TEST_ASSERT_FALSE(routes.hasRules(2));
+}
+
+//Rules that can't forward anything are left out: disabled, back to the bus they came from or to a bus that can't
+//exist. A block rule needs no destination
+static void test_rules_left_out()
+{
+    GATEWAY_RULE rules[4];
+    rules[0] = makeRule(0, 1, 0x100, 0x7FF);
+    rules[0].enabled = false;
+    rules[1] = makeRule(0, 0, 0x100, 0x7FF);
+    rules[2] = makeRule(0, GATEWAY_BUSES, 0x100, 0x7FF);
+    rules[3] = makeRule(GATEWAY_BUSES, 0, 0x100, 0x7FF);
+    GatewayRoutes routes;
+    routes.compile(rules, 4);
+    TEST_ASSERT_EQUAL(-1, routes.route(0, 0x100, false));
+    TEST_ASSERT_FALSE(routes.hasRules(0));
+
+    rules[1].block = true;
+    routes.compile(rules, 4);
+    TEST_ASSERT_EQUAL(1, routes.route(0, 0x100, false));
+    TEST_ASSERT_EQUAL(-1, routes.route(0, 0x101, false));
+}
+
+//every set of routes is told apart from the one before
+static void test_generations()
+{
+    GatewayRoutes first, second;
+    TEST_ASSERT_TRUE(first.getGeneration() != 0);
+    TEST_ASSERT_TRUE(second.getGeneration() != 0);
+    TEST_ASSERT_TRUE(first.getGeneration() != second.getGeneration());
+}
+
+//ID bits under newIdMask and payload bits under dataMask are replaced, nothing else is touched
+static void test_rewrite()
+{
+    GATEWAY_RULE rule = makeRule(0, 1, 0, 0);
+    uint32_t id = 0x123;
+    uint8_t data[8] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88};
+    GatewayRoutes::rewrite(rule, id, false, data, 8);
+    TEST_ASSERT_EQUAL_HEX32(0x123, id);
+    const uint8_t untouched[8] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88};
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(untouched, data, 8);
+
+    rule.newId = 0xFFFFF456;
+    rule.newIdMask = 0xFFFFF00F; //low nibble from newId, and bits above 11 that a standard ID can't keep
+    rule.dataMask[0] = 0xF0;
+    rule.dataValue[0] = 0xAB;
+    rule.dataMask[2] = 0xFF;
+    rule.dataValue[2] = 0x00;
+    rule.dataMask[7] = 0x01;
+    rule.dataValue[7] = 0x01;
+    GatewayRoutes::rewrite(rule, id, false, data, 3); //bytes past the length stay as they were
+    TEST_ASSERT_EQUAL_HEX32(0x126, id);
+    const uint8_t rewritten[8] = {0xA1, 0x22, 0x00, 0x44, 0x55, 0x66, 0x77, 0x88};
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(rewritten, data, 8);
+
+    id = 0x18DAF110;
+    rule.newId = 0x18DA10F1;
+    rule.newIdMask = 0xFFFFFFFF;
+    GatewayRoutes::rewrite(rule, id, true, data, 8);
+    TEST_ASSERT_EQUAL_HEX32(0x18DA10F1, id);
+    TEST_ASSERT_EQUAL_HEX8(0x89, data[7]);
+
+    uint8_t fd[12];
+    memset(fd, 0x55, sizeof(fd));
+    rule.dataMask[0] = 0xFF;
+    GatewayRoutes::rewrite(rule, id, true, fd, 12); //only the classic payload is ever rewritten
+    TEST_ASSERT_EQUAL_HEX8(0xAB, fd[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x55, fd[8]);
+    TEST_ASSERT_EQUAL_HEX8(0x55, fd[11]);
+}
+
+//Only the same frame coming back on the bus it was sent to within GATEWAY_LOOP_WINDOW is a loop, and only once
+static void test_loop_guard()
+{
+    GatewayLoopGuard guard;
+    const uint8_t data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    uint8_t other[8];
+    memcpy(other, data, 8);
+    other[7] = 9;
+    const uint32_t now = 1000000;
+
+    TEST_ASSERT_FALSE(guard.isLoop(1, 0x123, false, data, 8, now)); //nothing sent yet
+    guard.sent(1, 0x123, false, data, 8, now);
+    TEST_ASSERT_FALSE(guard.isLoop(0, 0x123, false, data, 8, now + 10));  //other bus
+    TEST_ASSERT_FALSE(guard.isLoop(1, 0x124, false, data, 8, now + 10));  //other ID
+    TEST_ASSERT_FALSE(guard.isLoop(1, 0x123, true, data, 8, now + 10));   //same number, extended
+    TEST_ASSERT_FALSE(guard.isLoop(1, 0x123, false, other, 8, now + 10)); //other payload
+    TEST_ASSERT_FALSE(guard.isLoop(1, 0x123, false, data, 7, now + 10));  //other length
+    TEST_ASSERT_TRUE(guard.isLoop(1, 0x123, false, data, 8, now + GATEWAY_LOOP_WINDOW));
+    TEST_ASSERT_FALSE(guard.isLoop(1, 0x123, false, data, 8, now + GATEWAY_LOOP_WINDOW)); //caught, starts fresh
+
+    guard.sent(1, 0x123, false, data, 8, now);
+    TEST_ASSERT_FALSE(guard.isLoop(1, 0x123, false, data, 8, now + GATEWAY_LOOP_WINDOW + 1)); //too late to be ours
+
+    //the clock wrapping in between changes nothing
+    guard.sent(2, 0x18DAF110, true, data, 8, 0xFFFFFF00);
+    TEST_ASSERT_TRUE(guard.isLoop(2, 0x18DAF110, true, data, 8, 0x100));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_routes);
+    RUN_TEST(test_rules_left_out);
+    RUN_TEST(test_generations);
+    RUN_TEST(test_rewrite);
+    RUN_TEST(test_loop_guard);
+    return UNITY_END();
+}
@@ -0,0 +1,166 @@
+#include <unity.h>
+#include "test_support.h"
+#include "gvret_comm.h"
+#include "can_manager.h"
+#include <chrono>
+#include <vector>
+
+static GVRET_Comm_Handler handler;
+
+void setUp()
+{
+    setupTestSettings();
+    handler.clearBufferedBytes();
+}
+
+void tearDown() {}
+
+static void send(const uint8_t *bytes, size_t length)
+{
+    for (size_t i = 0; i < length; i++) handler.processIncomingByte(bytes[i]);
+}
+
+//a reply either goes in whole or not at all, never the first few bytes of it
+static void test_reply_is_never_split()
+{
+    static uint8_t filler[WIFI_BUFF_SIZE];
+    const uint8_t getParams[] = {0xF1, PROTO_GET_CANBUS_PARAMS};
+    const uint8_t keepAlive[] = {0xF1, PROTO_KEEPALIVE};
+
+    TEST_ASSERT_TRUE(handler.sendBytesToBuffer(filler, WIFI_BUFF_SIZE - 5));
+    send(getParams, sizeof(getParams));
+    TEST_ASSERT_EQUAL(WIFI_BUFF_SIZE - 5, handler.numAvailableBytes());
+    send(keepAlive, sizeof(keepAlive));
+    TEST_ASSERT_EQUAL(WIFI_BUFF_SIZE - 1, handler.numAvailableBytes());
+
+    handler.clearBufferedBytes();
+    send(getParams, sizeof(getParams));
+    uint8_t reply[32];
+    TEST_ASSERT_EQUAL(12, drainBuffer(handler, reply, sizeof(reply)));
+    TEST_ASSERT_EQUAL_HEX8(0xF1, reply[0]);
+    TEST_ASSERT_EQUAL_HEX8(6, reply[1]);
+    TEST_ASSERT_EQUAL_HEX8(1, reply[2]);
+    TEST_ASSERT_EQUAL_UINT32(500000, reply[3] | (reply[4] << 8) | (reply[5] << 16) | (reply[6] << 24));
+}
+
+//The whole ID table is far bigger than the buffer. It goes out over several loop() passes with nothing in between,
+//not even frames, and a command sent behind the request is answered once it is done
+static void test_long_answer_over_several_passes()
+{
+    IdStatsTable &stats = canManager.getIdStats();
+    const int ids = 300;
+    stats.clear();
+    for (int i = 0; i < ids; i++)
+    {
+        uint8_t data[8] = {(uint8_t)i};
+        stats.update(i & 1, 0x100 + i, false, data, 8, i * 1000);
+    }
+
+    const uint8_t request[] = {0xF1, PROTO_GET_ID_STATS, 0xFF, 0xF1, PROTO_KEEPALIVE};
+    handler.setBinaryMode(true);
+    handler.processIncomingBytes(request, sizeof(request));
+    TEST_ASSERT_TRUE(handler.isAnswerPending());
+
+    std::vector<uint8_t> out;
+    uint8_t chunk[WIFI_BUFF_SIZE];
+    CAN_FRAME frame;
+    frame.id = 0x7FF;
+    frame.length = 0;
+    int passes = 0;
+    while (handler.isAnswerPending() && passes < 100)
+    {
+        handler.sendFrameToBuffer(frame, 0); //refused while the answer is going out
+        size_t length = drainBuffer(handler, chunk, sizeof(chunk));
+        out.insert(out.end(), chunk, chunk + length);
+        handler.loop();
+        passes++;
+    }
+    size_t length = drainBuffer(handler, chunk, sizeof(chunk));
+    out.insert(out.end(), chunk, chunk + length);
+    handler.setBinaryMode(false);
+
+    TEST_ASSERT_FALSE(handler.isAnswerPending());
+    TEST_ASSERT_GREATER_THAN(3, passes);
+    TEST_ASSERT_EQUAL(8 + ids * ID_STATS_RECORD_LENGTH + 4, out.size());
+    TEST_ASSERT_EQUAL_HEX8(0xF1, out[0]);
+    TEST_ASSERT_EQUAL_HEX8(PROTO_GET_ID_STATS, out[1]);
+    TEST_ASSERT_EQUAL(ids, out[2] | (out[3] << 8));
+    for (int i = 0; i < ids; i++)
+    {
+        const uint8_t *record = &out[8 + i * ID_STATS_RECORD_LENGTH];
+        TEST_ASSERT_EQUAL(0x100 + i, record[1] | (record[2] << 8));
+        TEST_ASSERT_EQUAL_HEX8(i, record[26]);
+    }
+    const uint8_t *keepAlive = &out[8 + ids * ID_STATS_RECORD_LENGTH];
+    TEST_ASSERT_EQUAL_HEX8(0xF1, keepAlive[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x09, keepAlive[1]);
+    stats.clear();
+}
+
+//a SavvyCAN replay: PROTO_BUILD_CAN_FRAME records with 0 - 8 data bytes on both buses, standard and extended
+static std::vector<uint8_t> replayRecords(int count)
+{
+    std::vector<uint8_t> out;
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t id = (i & 4) ? ((0x18DA0000 + i) | (1ul << 31)) : (0x100 + (i & 0x3FF));
+        uint8_t length = i % 9;
+        const uint8_t header[] = {0xF1, PROTO_BUILD_CAN_FRAME, (uint8_t)id, (uint8_t)(id >> 8), (uint8_t)(id >> 16),
+                                  (uint8_t)(id >> 24), (uint8_t)(i & 1), length};
+        out.insert(out.end(), header, header + sizeof(header));
+        for (int c = 0; c < length; c++) out.push_back(i + c);
+        out.push_back(0);
+    }
+    return out;
+}
+
+//frames the parser handed to canManager, whether the TX queues took them or not
+static uint32_t framesSeen()
+{
+    uint32_t total = 0;
+    for (int bus = 0; bus < 2; bus++) total += canManager.getTxCounters(bus).queued + canManager.getTxCounters(bus).dropped;
+    return total;
+}
+
+//Host numbers, but the ratio is what the bulk parser is for. Nothing drains the TX queues here so once they are
+//full every frame is a quick drop, which leaves the parser as the thing being timed
+static void test_replay_commands_per_second()
+{
+    const int records = 200000;
+    const int rounds = 5;
+    const size_t chunk = 1460; //a TCP segment
+    std::vector<uint8_t> replay = replayRecords(records);
+    canManager.setTxPolicy(TX_PRIO_BULK, TX_DROP);
+
+    uint32_t before = framesSeen();
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (size_t i = 0; i < replay.size(); i++) handler.processIncomingByte(replay[i]);
+    auto mid = std::chrono::steady_clock::now();
+    uint32_t byteFrames = framesSeen() - before;
+    for (int r = 0; r < rounds; r++)
+        for (size_t pos = 0; pos < replay.size(); pos += chunk)
+            handler.processIncomingBytes(&replay[pos], (replay.size() - pos < chunk) ? replay.size() - pos : chunk);
+    auto end = std::chrono::steady_clock::now();
+    uint32_t bulkFrames = framesSeen() - before - byteFrames;
+    canManager.setTxPolicy(TX_PRIO_BULK, TX_BLOCK);
+
+    TEST_ASSERT_EQUAL(records * rounds, byteFrames);
+    TEST_ASSERT_EQUAL(records * rounds, bulkFrames);
+    double byteRate = byteFrames / std::chrono::duration<double>(mid - start).count();
+    double bulkRate = bulkFrames / std::chrono::duration<double>(end - mid).count();
+    char message[120];
+    snprintf(message, sizeof(message), "byte at a time %.2fM commands/s, bulk %.2fM commands/s, %.1fx",
+             byteRate / 1e6, bulkRate / 1e6, bulkRate / byteRate);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(bulkRate > byteRate);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_reply_is_never_split);
+    RUN_TEST(test_long_answer_over_several_passes);
+    RUN_TEST(test_replay_commands_per_second);
+    return UNITY_END();
+}
@@ -0,0 +1,418 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <initializer_list>
+#include <deque>
+#include <vector>
+#include "isotp.h"
+
+//A bus with a simulated ECU on it, another tester talking to that ECU and the device. Each of them is an IsoTpEngine
+//and every frame one of them sends is seen by all the others, the way it would be on a real bus. Time is a counter
+//moved along by hand.
+
+typedef struct {
+    int node;
+    uint32_t id;
+    uint8_t data[8];
+    uint32_t time;
+} SIM_FRAME;
+
+enum { NODE_ECU, NODE_TESTER, NODE_DEVICE, NUM_NODES };
+
+static std::deque<SIM_FRAME> wire;
+static std::vector<SIM_FRAME> sentBy[NUM_NODES];
+static IsoTpEngine *engines[NUM_NODES];
+static int nodeIds[NUM_NODES] = {NODE_ECU, NODE_TESTER, NODE_DEVICE};
+static uint32_t now;
+static int refusals[NUM_NODES]; //frames a node's TX queue turns away before it takes any again
+
+static bool simSend(void *context, int bus, uint32_t id, bool extended, const uint8_t *data)
+{
+    SIM_FRAME frame;
+    frame.node = *(int *)context;
+    if (refusals[frame.node] > 0)
+    {
+        refusals[frame.node]--;
+        return false;
+    }
+    frame.id = id;
+    frame.time = now;
+    memcpy(frame.data, data, 8);
+    wire.push_back(frame);
+    sentBy[frame.node].push_back(frame);
+    return true;
+}
+
+//100us on: every node ticks and the next frame on the wire, if any, reaches every node but the sender
+static void step()
+{
+    now += 100;
+    for (int n = 0; n < NUM_NODES; n++) if (engines[n]) engines[n]->tick(now);
+    if (wire.empty()) return;
+    SIM_FRAME frame = wire.front();
+    wire.pop_front();
+    for (int n = 0; n < NUM_NODES; n++)
+    {
+        if (n != frame.node && engines[n]) engines[n]->handleFrame(0, frame.id, false, frame.data, 8, now);
+    }
+}
+
+//delivers everything on the wire, and whatever that sets off
+static void runBus(int maxSteps = 10000)
+{
+    for (int i = 0; i < maxSteps; i++) step();
+}
+
+//The ECU answers 0x22 F1 90 (read VIN) with a 20 byte message and 0x22 F1 91 with a 100 byte one
+static int ecuSession;
+static void ecuReceive(void *context, int session, const uint8_t *data, uint16_t length)
+{
+    IsoTpEngine *ecu = (IsoTpEngine *)context;
+    uint8_t answer[100];
+    uint16_t answerLength = (data[2] == 0x90) ? 20 : 100;
+    answer[0] = data[0] + 0x40;
+    answer[1] = data[1];
+    answer[2] = data[2];
+    for (int i = 3; i < answerLength; i++) answer[i] = i;
+    ecu->send(session, answer, answerLength, now);
+}
+
+typedef struct {
+    int count;
+    uint16_t length;
+    uint8_t data[ISOTP_MAX_PAYLOAD];
+} RECEIVED;
+
+static RECEIVED received[NUM_NODES];
+
+static void keepMessage(void *context, int session, const uint8_t *data, uint16_t length)
+{
+    RECEIVED &r = received[*(int *)context];
+    r.count++;
+    r.length = length;
+    memcpy(r.data, data, length);
+}
+
+static IsoTpEngine ecu, tester, device;
+
+//The device doesn't know the ECU in advance. Its listener opens a session for whatever answers on 7E8 - 7EF
+static int deviceAccept(void *context, int bus, uint32_t id, bool extended)
+{
+    return device.open(bus, id - 8, id, extended, keepMessage, &nodeIds[NODE_DEVICE]);
+}
+
+void setUp()
+{
+    wire.clear();
+    now = 0;
+    ecu = IsoTpEngine();
+    tester = IsoTpEngine();
+    device = IsoTpEngine();
+    engines[NODE_ECU] = &ecu;
+    engines[NODE_TESTER] = &tester;
+    engines[NODE_DEVICE] = &device;
+    for (int n = 0; n < NUM_NODES; n++)
+    {
+        sentBy[n].clear();
+        received[n].count = 0;
+        refusals[n] = 0;
+        engines[n]->setSender(simSend, &nodeIds[n]);
+    }
+    ecuSession = ecu.open(0, 0x7E8, 0x7E0, false, ecuReceive, &ecu);
+    ecu.setFlowControl(ecuSession, 0, 0);
+}
+
+void tearDown() {}
+
+static void checkAnswer(const RECEIVED &r, uint16_t length)
+{
+    TEST_ASSERT_EQUAL(1, r.count);
+    TEST_ASSERT_EQUAL(length, r.length);
+    TEST_ASSERT_EQUAL_HEX8(0x62, r.data[0]);
+    for (int i = 3; i < length; i++) TEST_ASSERT_EQUAL_HEX8(i, r.data[i]);
+}
+
+//The device's own request gets its whole multi-frame answer. It sends the request and the flow controls, in blocks
+//of 4 here, and nothing else
+static void test_own_request_gets_flow_control()
+{
+    engines[NODE_TESTER] = nullptr;
+    int session = device.open(0, 0x7E0, 0x7E8, false, keepMessage, &nodeIds[NODE_DEVICE]);
+    device.setFlowControl(session, 4, 0);
+    const uint8_t request[] = {0x22, 0xF1, 0x91};
+    TEST_ASSERT_TRUE(device.send(session, request, sizeof(request), now));
+    runBus();
+
+    checkAnswer(received[NODE_DEVICE], 100);
+    //request, then a flow control for the first frame and after every block of 4 of the 14 consecutive frames
+    TEST_ASSERT_EQUAL(1 + 1 + 3, sentBy[NODE_DEVICE].size());
+    for (size_t i = 1; i < sentBy[NODE_DEVICE].size(); i++)
+    {
+        TEST_ASSERT_EQUAL_HEX32(0x7E0, sentBy[NODE_DEVICE][i].id);
+        TEST_ASSERT_EQUAL_HEX8(0x30, sentBy[NODE_DEVICE][i].data[0]);
+    }
+}
+
+//Another tester's conversation with the ECU is only listened in on, through a listener and through a session the
+//device used for a request of its own earlier. The device hears the whole answer but never puts a frame on the bus
+static void test_other_testers_conversation_is_passive()
+{
+    int testerSession = tester.open(0, 0x7E0, 0x7E8, false, keepMessage, &nodeIds[NODE_TESTER]);
+    const uint8_t vin[] = {0x22, 0xF1, 0x90};
+    const uint8_t big[] = {0x22, 0xF1, 0x91};
+
+    device.listen(0, 0x7E8, 0x7F8, false, deviceAccept, nullptr);
+    TEST_ASSERT_TRUE(tester.send(testerSession, vin, sizeof(vin), now));
+    runBus();
+    tester.expectAnswer(testerSession, false);
+    checkAnswer(received[NODE_TESTER], 20);
+    checkAnswer(received[NODE_DEVICE], 20);
+
+    //the device asked something once, long ago, and has stopped waiting for it
+    int deviceSession = device.open(0, 0x7E0, 0x7E8, false, keepMessage, &nodeIds[NODE_DEVICE]);
+    TEST_ASSERT_TRUE(device.send(deviceSession, vin, sizeof(vin), now));
+    runBus();
+    device.expectAnswer(deviceSession, false);
+    sentBy[NODE_DEVICE].clear();
+    received[NODE_TESTER].count = 0;
+    received[NODE_DEVICE].count = 0;
+
+    TEST_ASSERT_TRUE(tester.send(testerSession, big, sizeof(big), now));
+    runBus();
+    checkAnswer(received[NODE_TESTER], 100);
+    checkAnswer(received[NODE_DEVICE], 100);
+    TEST_ASSERT_EQUAL(0, sentBy[NODE_DEVICE].size());
+    TEST_ASSERT_EQUAL(0, device.getBuffersInUse());
+}
+
+//Answers to a functional request come in on sessions the listener opens. They get flow control while the listener
+//expects answers and not once that is over
+static void test_functional_answers()
+{
+    int listener = device.listen(0, 0x7E8, 0x7F8, false, deviceAccept, nullptr);
+    const uint8_t vin[] = {0x22, 0xF1, 0x90};
+
+    device.expectAnswers(listener, true);
+    TEST_ASSERT_TRUE(device.sendFunctional(0, 0x7DF, false, vin, sizeof(vin)));
+    //the simulated ECU only listens on 7E0, so the request is passed on by hand
+    SIM_FRAME request = wire.front();
+    wire.pop_front();
+    ecu.handleFrame(0, 0x7E0, false, request.data, 8, now);
+    runBus();
+    checkAnswer(received[NODE_DEVICE], 20);
+    TEST_ASSERT_EQUAL(2, sentBy[NODE_DEVICE].size()); //the request and one flow control
+
+    device.expectAnswers(listener, false);
+    for (int i = 0; i < ISOTP_SESSIONS; i++) device.expectAnswer(i, false);
+    sentBy[NODE_DEVICE].clear();
+    received[NODE_DEVICE].count = 0;
+    int testerSession = tester.open(0, 0x7E0, 0x7E8, false, keepMessage, &nodeIds[NODE_TESTER]);
+    TEST_ASSERT_TRUE(tester.send(testerSession, vin, sizeof(vin), now));
+    runBus();
+    checkAnswer(received[NODE_DEVICE], 20);
+    TEST_ASSERT_EQUAL(0, sentBy[NODE_DEVICE].size());
+}
+
+//The tester sends straight to the device, with the ECU off the bus. The device is the receiver here, so it is the
+//one expecting a message and doing the flow control
+static int testerSession, deviceSession;
+static uint8_t message[ISOTP_MAX_PAYLOAD];
+
+static void openPeers(uint8_t blockSize, uint8_t stMin)
+{
+    engines[NODE_ECU] = nullptr;
+    testerSession = tester.open(0, 0x7E0, 0x7E8, false, keepMessage, &nodeIds[NODE_TESTER]);
+    deviceSession = device.open(0, 0x7E8, 0x7E0, false, keepMessage, &nodeIds[NODE_DEVICE]);
+    device.setFlowControl(deviceSession, blockSize, stMin);
+    device.expectAnswer(deviceSession, true);
+    for (int i = 0; i < ISOTP_MAX_PAYLOAD; i++) message[i] = (i * 7) ^ (i >> 8);
+}
+
+static void checkMessage(const RECEIVED &r, uint16_t length)
+{
+    TEST_ASSERT_EQUAL(1, r.count);
+    TEST_ASSERT_EQUAL(length, r.length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(message, r.data, length);
+}
+
+//steps until the device has the message, returns how long that took
+static uint32_t transfer(uint16_t length)
+{
+    uint32_t start = now;
+    TEST_ASSERT_TRUE(tester.send(testerSession, message, length, now));
+    for (int i = 0; i < 100000 && received[NODE_DEVICE].count == 0; i++) step();
+    return now - start;
+}
+
+//The largest message there is, in blocks of 8 with no STmin. The sequence number wraps 36 times on the way. With
+//one frame on the bus per 100us step nothing may sit idle: the time taken is the frames sent and no more
+static void test_block_transfer_throughput()
+{
+    openPeers(8, 0);
+    uint32_t took = transfer(ISOTP_MAX_PAYLOAD);
+    checkMessage(received[NODE_DEVICE], ISOTP_MAX_PAYLOAD);
+
+    const size_t consecutive = (ISOTP_MAX_PAYLOAD - 6 + 6) / 7; //what the first frame leaves, 7 bytes a frame rounded up
+    TEST_ASSERT_EQUAL(1 + consecutive, sentBy[NODE_TESTER].size());
+    TEST_ASSERT_EQUAL(1 + (consecutive - 1) / 8, sentBy[NODE_DEVICE].size()); //none after the last block
+    size_t frames = sentBy[NODE_TESTER].size() + sentBy[NODE_DEVICE].size();
+    TEST_ASSERT_EQUAL(frames * 100, took);
+    printf("%u bytes in %u frames, %.1f kB/s at one frame per 100us\n", (unsigned)ISOTP_MAX_PAYLOAD,
+           (unsigned)frames, ISOTP_MAX_PAYLOAD * 1000.0 / took);
+    TEST_ASSERT_EQUAL(0, tester.getBuffersInUse());
+    TEST_ASSERT_EQUAL(0, device.getBuffersInUse());
+}
+
+//Consecutive frames in a block are never closer than the STmin the receiver asked for, and no further apart than
+//the tick after it. Both the 100us and the millisecond ranges
+static void test_stmin_pacing()
+{
+    const uint8_t stMins[] = {0xF3, 0x02};
+    const uint32_t gaps[] = {300, 2000};
+    for (int k = 0; k < 2; k++)
+    {
+        setUp();
+        openPeers(0, stMins[k]);
+        transfer(100);
+        checkMessage(received[NODE_DEVICE], 100);
+        TEST_ASSERT_EQUAL(1 + 14, sentBy[NODE_TESTER].size());
+        for (size_t i = 2; i < sentBy[NODE_TESTER].size(); i++)
+        {
+            uint32_t gap = sentBy[NODE_TESTER][i].time - sentBy[NODE_TESTER][i - 1].time;
+            TEST_ASSERT_TRUE(gap >= gaps[k]);
+            TEST_ASSERT_TRUE(gap <= gaps[k] + 100);
+        }
+    }
+}
+
+static void flowControlToTester(uint8_t status)
+{
+    const uint8_t fc[8] = {(uint8_t)(0x30 | status), 0, 0, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA};
+    tester.handleFrame(0, 0x7E8, false, fc, 8, now);
+}
+
+//WAIT holds the sender off and restarts its timeout, up to ISOTP_MAX_WAITS of them. One more, or an OVERFLOW,
+//ends the message as failed and gives the buffer back
+static void test_flow_control_wait_and_overflow()
+{
+    openPeers(0, 0);
+    engines[NODE_DEVICE] = nullptr; //the flow control comes by hand
+    TEST_ASSERT_TRUE(tester.send(testerSession, message, 20, now));
+    for (int i = 0; i < ISOTP_MAX_WAITS; i++)
+    {
+        flowControlToTester(1);
+        now += ISOTP_TIMEOUT - 1000;
+        tester.tick(now);
+        TEST_ASSERT_TRUE(tester.isBusy(testerSession));
+    }
+    flowControlToTester(0);
+    TEST_ASSERT_FALSE(tester.isBusy(testerSession));
+    TEST_ASSERT_EQUAL(1, tester.getSession(testerSession).sent);
+    TEST_ASSERT_EQUAL(0, tester.getSession(testerSession).errors);
+
+    TEST_ASSERT_TRUE(tester.send(testerSession, message, 20, now));
+    for (int i = 0; i <= ISOTP_MAX_WAITS; i++) flowControlToTester(1);
+    TEST_ASSERT_FALSE(tester.isBusy(testerSession));
+    TEST_ASSERT_EQUAL(1, tester.getSession(testerSession).errors);
+
+    TEST_ASSERT_TRUE(tester.send(testerSession, message, 20, now));
+    flowControlToTester(2);
+    TEST_ASSERT_FALSE(tester.isBusy(testerSession));
+    TEST_ASSERT_EQUAL(2, tester.getSession(testerSession).errors);
+    TEST_ASSERT_EQUAL(1, tester.getSession(testerSession).sent);
+    TEST_ASSERT_EQUAL(0, tester.getBuffersInUse());
+}
+
+static void frameToDevice(uint32_t id, std::initializer_list<uint8_t> bytes)
+{
+    uint8_t frame[8];
+    memset(frame, 0xAA, 8);
+    memcpy(frame, bytes.begin(), bytes.size());
+    device.handleFrame(0, id, false, frame, 8, now);
+}
+
+//A consecutive frame out of sequence drops the message and its buffer. The next one comes through fine
+static void test_sequence_error()
+{
+    openPeers(0, 0);
+    frameToDevice(0x7E0, {0x10, 20, 1, 2, 3, 4, 5, 6});
+    frameToDevice(0x7E0, {0x22, 13, 14, 15, 16, 17, 18, 19});
+    TEST_ASSERT_FALSE(device.isBusy(deviceSession));
+    TEST_ASSERT_EQUAL(1, device.getSession(deviceSession).errors);
+    TEST_ASSERT_EQUAL(0, device.getBuffersInUse());
+    frameToDevice(0x7E0, {0x23, 20}); //the rest of the dropped message goes nowhere
+    TEST_ASSERT_EQUAL(0, received[NODE_DEVICE].count);
+
+    frameToDevice(0x7E0, {0x10, 20, 1, 2, 3, 4, 5, 6});
+    frameToDevice(0x7E0, {0x21, 7, 8, 9, 10, 11, 12, 13});
+    frameToDevice(0x7E0, {0x22, 14, 15, 16, 17, 18, 19, 20});
+    TEST_ASSERT_EQUAL(1, received[NODE_DEVICE].count);
+    TEST_ASSERT_EQUAL(20, received[NODE_DEVICE].length);
+    for (int i = 0; i < 20; i++) TEST_ASSERT_EQUAL(i + 1, received[NODE_DEVICE].data[i]);
+    TEST_ASSERT_EQUAL(1, device.getSession(deviceSession).errors);
+}
+
+//With every buffer taken a first frame gets an OVERFLOW flow control, or nothing when only listening in, and send()
+//refuses a multi-frame message. A finished message frees its buffer for the next
+static void test_pool_exhaustion()
+{
+    engines[NODE_ECU] = nullptr;
+    int sessions[ISOTP_BUFFERS + 2];
+    for (int i = 0; i < ISOTP_BUFFERS + 2; i++)
+    {
+        sessions[i] = device.open(0, 0x700 + i, 0x780 + i, false, keepMessage, &nodeIds[NODE_DEVICE]);
+        device.expectAnswer(sessions[i], i <= ISOTP_BUFFERS);
+    }
+    for (int i = 0; i < ISOTP_BUFFERS + 2; i++) frameToDevice(0x780 + i, {0x10, 20, 1, 2, 3, 4, 5, 6});
+    TEST_ASSERT_EQUAL(ISOTP_BUFFERS, device.getBuffersInUse());
+    TEST_ASSERT_EQUAL(ISOTP_BUFFERS + 1, sentBy[NODE_DEVICE].size()); //not a frame for the passive one
+    for (int i = 0; i < ISOTP_BUFFERS; i++) TEST_ASSERT_EQUAL_HEX8(0x30, sentBy[NODE_DEVICE][i].data[0]);
+    TEST_ASSERT_EQUAL_HEX32(0x700 + ISOTP_BUFFERS, sentBy[NODE_DEVICE][ISOTP_BUFFERS].id);
+    TEST_ASSERT_EQUAL_HEX8(0x32, sentBy[NODE_DEVICE][ISOTP_BUFFERS].data[0]);
+    TEST_ASSERT_EQUAL(1, device.getSession(sessions[ISOTP_BUFFERS]).errors);
+    TEST_ASSERT_EQUAL(1, device.getSession(sessions[ISOTP_BUFFERS + 1]).errors);
+    TEST_ASSERT_FALSE(device.isBusy(sessions[ISOTP_BUFFERS]));
+    TEST_ASSERT_FALSE(device.send(sessions[ISOTP_BUFFERS], message, 20, now));
+    TEST_ASSERT_TRUE(device.send(sessions[ISOTP_BUFFERS], message, 7, now)); //a single frame needs no buffer
+
+    frameToDevice(0x780, {0x21, 7, 8, 9, 10, 11, 12, 13});
+    frameToDevice(0x780, {0x22, 14, 15, 16, 17, 18, 19, 20});
+    TEST_ASSERT_EQUAL(1, received[NODE_DEVICE].count);
+    TEST_ASSERT_EQUAL(ISOTP_BUFFERS - 1, device.getBuffersInUse());
+    frameToDevice(0x780 + ISOTP_BUFFERS, {0x10, 20, 1, 2, 3, 4, 5, 6});
+    TEST_ASSERT_TRUE(device.isBusy(sessions[ISOTP_BUFFERS]));
+    TEST_ASSERT_EQUAL_HEX8(0x30, sentBy[NODE_DEVICE].back().data[0]);
+}
+
+//A flow control the TX queue turns away goes out on a later tick, for the first frame and at the end of a block,
+//instead of leaving the sender to time out
+static void test_flow_control_retried()
+{
+    openPeers(4, 0);
+    refusals[NODE_DEVICE] = 3;
+    TEST_ASSERT_TRUE(tester.send(testerSession, message, 100, now));
+    while (sentBy[NODE_DEVICE].empty() && now < ISOTP_TIMEOUT) step();
+    TEST_ASSERT_EQUAL(1, sentBy[NODE_DEVICE].size());
+    refusals[NODE_DEVICE] = 3; //the one after the first block
+    for (int i = 0; i < 100000 && received[NODE_DEVICE].count == 0; i++) step();
+    checkMessage(received[NODE_DEVICE], 100);
+    TEST_ASSERT_TRUE(now < ISOTP_TIMEOUT);
+    TEST_ASSERT_EQUAL(0, tester.getSession(testerSession).errors);
+    TEST_ASSERT_EQUAL(0, device.getSession(deviceSession).errors);
+    TEST_ASSERT_EQUAL(1 + 3, sentBy[NODE_DEVICE].size()); //none twice
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_own_request_gets_flow_control);
+    RUN_TEST(test_other_testers_conversation_is_passive);
+    RUN_TEST(test_functional_answers);
+    RUN_TEST(test_block_transfer_throughput);
+    RUN_TEST(test_stmin_pacing);
+    RUN_TEST(test_flow_control_wait_and_overflow);
+    RUN_TEST(test_sequence_error);
+    RUN_TEST(test_pool_exhaustion);
+    RUN_TEST(test_flow_control_retried);
+    return UNITY_END();
+}
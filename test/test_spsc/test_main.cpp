@@ -0,0 +1,134 @@
+#include <unity.h>
+#include <thread>
+#include "frame_queue.h"
+#include "commbuffer.h"
+
+//One producer thread and one consumer thread hammer the same queue, which is how the RX task / loop() and loop() /
+//TransportWriter use them. Every entry carries its sequence number so a lost, repeated, reordered or torn entry
+//shows up. Nothing is locked on either side.
+
+#define ENTRIES 2000000
+
+void setUp() {}
+void tearDown() {}
+
+typedef struct {
+    uint32_t seq;
+    uint32_t check;
+    uint8_t payload[24];
+} ENTRY;
+
+static void fill(ENTRY &e, uint32_t seq)
+{
+    e.seq = seq;
+    for (int i = 0; i < 24; i++) e.payload[i] = seq * 7 + i;
+    e.check = ~seq;
+}
+
+static bool intact(const ENTRY &e)
+{
+    if (e.check != ~e.seq) return false;
+    for (int i = 0; i < 24; i++) if (e.payload[i] != (uint8_t)(e.seq * 7 + i)) return false;
+    return true;
+}
+
+static void test_frame_queue_two_threads()
+{
+    static FrameQueue<ENTRY, 256> queue;
+    uint32_t badEntries = 0;
+    uint32_t outOfOrder = 0;
+
+    std::thread producer([]() {
+        for (uint32_t seq = 0; seq < ENTRIES; seq++)
+        {
+            ENTRY *e;
+            while (!(e = queue.reserve())) std::this_thread::yield();
+            fill(*e, seq);
+            queue.commit();
+        }
+    });
+
+    uint32_t expected = 0;
+    while (expected < ENTRIES)
+    {
+        ENTRY *e = queue.front();
+        if (!e)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (!intact(*e)) badEntries++;
+        if (e->seq != expected) outOfOrder++;
+        expected = e->seq + 1;
+        queue.pop();
+    }
+    producer.join();
+
+    TEST_ASSERT_EQUAL(0, badEntries);
+    TEST_ASSERT_EQUAL(0, outOfOrder);
+    TEST_ASSERT_NULL(queue.front());
+    TEST_ASSERT_GREATER_THAN(0, queue.getHighWater());
+    TEST_ASSERT_LESS_OR_EQUAL(256, queue.getHighWater());
+}
+
+//Records of 1 - 40 bytes, each starting with its length and sequence number. The consumer drains in whatever
+//contiguous spans it is offered, exactly like TransportWriter, and reassembles the stream
+static void test_commbuffer_two_threads()
+{
+    static CommBuffer buffer;
+    const uint32_t records = ENTRIES / 4;
+
+    std::thread producer([records]() {
+        uint8_t record[40];
+        for (uint32_t seq = 0; seq < records; seq++)
+        {
+            uint8_t length = 6 + seq % 35;
+            record[0] = length;
+            memcpy(&record[1], &seq, 4);
+            for (int i = 5; i < length; i++) record[i] = seq + i;
+            while (!buffer.sendBytesToBuffer(record, length)) std::this_thread::yield();
+        }
+    });
+
+    uint8_t pending[80];
+    size_t pendingLength = 0;
+    uint32_t expected = 0;
+    uint32_t bad = 0;
+    while (expected < records)
+    {
+        size_t chunk = buffer.numContiguousBytes();
+        if (!chunk)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (chunk > sizeof(pending) - pendingLength) chunk = sizeof(pending) - pendingLength;
+        memcpy(&pending[pendingLength], buffer.getBufferedBytes(), chunk);
+        buffer.consumeBytes(chunk);
+        pendingLength += chunk;
+        while (pendingLength && pendingLength >= pending[0])
+        {
+            uint8_t length = pending[0];
+            uint32_t seq;
+            memcpy(&seq, &pending[1], 4);
+            if (seq != expected || length != 6 + seq % 35) bad++;
+            for (int i = 5; i < length; i++) if (pending[i] != (uint8_t)(seq + i)) bad++;
+            expected++;
+            memmove(pending, &pending[length], pendingLength - length);
+            pendingLength -= length;
+        }
+    }
+    producer.join();
+
+    TEST_ASSERT_EQUAL(0, bad);
+    TEST_ASSERT_EQUAL(0, pendingLength);
+    TEST_ASSERT_EQUAL(0, buffer.numAvailableBytes());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_queue_two_threads);
+    RUN_TEST(test_commbuffer_two_threads);
+    return UNITY_END();
+}
@@ -0,0 +1,241 @@
+//0.4 s of traffic on two buses the way the device timestamps it: 10 ms to 1 s periodic IDs with rolling
+//counters and XOR checksums, slowly moving signals, static IDs and a burst of ISO-TP consecutive frames.
+//{ timestamp, ID with bit 31 = extended, bus, length, data }
+static const struct {
+    uint32_t timestamp;
+    uint32_t id;
+    uint8_t bus;
+    uint8_t length;
+    uint8_t data[8];
+} capture[] = {
+    {4431, 0x120, 0, 8, {0x11, 0x36, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x5F}},
+    {5036, 0xF1, 0, 6, {0x9A, 0x8C, 0x45, 0x80, 0x33, 0xFD, 0x00, 0x00}},
+    {7354, 0x8CF00400, 1, 8, {0x11, 0x91, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA6}},
+    {7835, 0xC9, 0, 8, {0x51, 0x9A, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x79}},
+    {14345, 0x17D, 0, 8, {0xF1, 0xA7, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xAD}},
+    {14512, 0x120, 0, 8, {0x12, 0x37, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x5D}},
+    {14994, 0xF1, 0, 6, {0x9A, 0x8D, 0x45, 0x80, 0x33, 0xFD, 0x00, 0x00}},
+    {17245, 0x1E9, 0, 8, {0x74, 0x79, 0xB7, 0x74, 0xD7, 0xEF, 0x9E, 0x92}},
+    {17388, 0x8CF00400, 1, 8, {0x12, 0x92, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA6}},
+    {17780, 0xC9, 0, 8, {0x52, 0x9A, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7A}},
+    {24349, 0x2A0, 0, 3, {0xB8, 0x24, 0xA7, 0x00, 0x00, 0x00, 0x00, 0x00}},
+    {24555, 0x120, 0, 8, {0x13, 0x37, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x5C}},
+    {24948, 0xF1, 0, 6, {0x9A, 0x8D, 0x44, 0x80, 0x33, 0xFD, 0x00, 0x00}},
+    {27450, 0x8CF00400, 1, 8, {0x13, 0x92, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA7}},
+    {27833, 0xC9, 0, 8, {0x53, 0x9B, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7A}},
+    {34229, 0x17D, 0, 8, {0xF2, 0xA7, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xAE}},
+    {34564, 0x120, 0, 8, {0x14, 0x38, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x54}},
+    {35076, 0xF1, 0, 6, {0x9A, 0x8D, 0x44, 0x80, 0x35, 0xFD, 0x00, 0x00}},
+    {37204, 0x1E9, 0, 8, {0x73, 0x79, 0xB7, 0x74, 0xD7, 0xEF, 0x9E, 0x92}},
+    {37421, 0x8CF00400, 1, 8, {0x14, 0x91, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA3}},
+    {37753, 0xC9, 0, 8, {0x54, 0x9B, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7D}},
+    {44448, 0x120, 0, 8, {0x15, 0x38, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x55}},
+    {44955, 0xF1, 0, 6, {0x9A, 0x8D, 0x44, 0x82, 0x35, 0xFD, 0x00, 0x00}},
+    {47374, 0x8CF00400, 1, 8, {0x15, 0x91, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA2}},
+    {47738, 0xC9, 0, 8, {0x55, 0x9A, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7D}},
+    {54222, 0x17D, 0, 8, {0xF3, 0xA6, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xAE}},
+    {54485, 0x120, 0, 8, {0x16, 0x39, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x57}},
+    {54951, 0xF1, 0, 6, {0x98, 0x8D, 0x44, 0x82, 0x35, 0xFD, 0x00, 0x00}},
+    {57212, 0x1E9, 0, 8, {0x73, 0x79, 0xB7, 0x73, 0xD7, 0xEF, 0x9E, 0x92}},
+    {57446, 0x8CF00400, 1, 8, {0x16, 0x91, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA1}},
+    {57806, 0xC9, 0, 8, {0x56, 0x9A, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7E}},
+    {64568, 0x120, 0, 8, {0x17, 0x39, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x56}},
+    {64990, 0xF1, 0, 6, {0x98, 0x8D, 0x44, 0x82, 0x33, 0xFD, 0x00, 0x00}},
+    {67410, 0x8CF00400, 1, 8, {0x17, 0x91, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA0}},
+    {67790, 0xC9, 0, 8, {0x57, 0x9A, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7F}},
+    {74275, 0x17D, 0, 8, {0xF4, 0xA7, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xA8}},
+    {74298, 0x2A0, 0, 3, {0xB8, 0x24, 0xAA, 0x00, 0x00, 0x00, 0x00, 0x00}},
+    {74535, 0x120, 0, 8, {0x18, 0x38, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x58}},
+    {74959, 0xF1, 0, 6, {0x98, 0x8D, 0x44, 0x82, 0x33, 0xFE, 0x00, 0x00}},
+    {77187, 0x1E9, 0, 8, {0x73, 0x79, 0xB9, 0x73, 0xD7, 0xEF, 0x9E, 0x92}},
+    {77265, 0x3C1, 0, 8, {0x32, 0x72, 0x78, 0x54, 0x97, 0x46, 0xC5, 0x37}},
+    {77359, 0x8CF00400, 1, 8, {0x18, 0x91, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xAF}},
+    {77820, 0xC9, 0, 8, {0x58, 0x99, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x73}},
+    {82683, 0x4C1, 0, 4, {0xAA, 0x78, 0x0A, 0x8C, 0x00, 0x00, 0x00, 0x00}},
+    {84430, 0x120, 0, 8, {0x19, 0x38, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x59}},
+    {84997, 0xF1, 0, 6, {0x98, 0x8D, 0x44, 0x82, 0x31, 0xFE, 0x00, 0x00}},
+    {87456, 0x8CF00400, 1, 8, {0x19, 0x90, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xAF}},
+    {87736, 0xC9, 0, 8, {0x59, 0x99, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x72}},
+    {94297, 0x17D, 0, 8, {0xF5, 0xA7, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xA9}},
+    {94511, 0x120, 0, 8, {0x1A, 0x38, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x5A}},
+    {94979, 0xF1, 0, 6, {0x98, 0x8D, 0x44, 0x83, 0x31, 0xFE, 0x00, 0x00}},
+    {97205, 0x98FEF100, 1, 8, {0x61, 0x40, 0x42, 0x76, 0x81, 0x0C, 0x35, 0xD8}},
+    {97244, 0x1E9, 0, 8, {0x73, 0x79, 0xB9, 0x73, 0xD9, 0xEF, 0x9E, 0x92}},
+    {97472, 0x8CF00400, 1, 8, {0x1A, 0x90, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xAC}},
+    {97800, 0xC9, 0, 8, {0x5A, 0x9A, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x72}},
+    {104560, 0x120, 0, 8, {0x1B, 0x39, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x5A}},
+    {104969, 0xF1, 0, 6, {0x98, 0x8A, 0x44, 0x83, 0x31, 0xFE, 0x00, 0x00}},
+    {107418, 0x8CF00400, 1, 8, {0x1B, 0x90, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xAD}},
+    {107789, 0xC9, 0, 8, {0x5B, 0x9B, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x72}},
+    {114270, 0x17D, 0, 8, {0xF6, 0xA7, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xAA}},
+    {114538, 0x120, 0, 8, {0x1C, 0x39, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x5D}},
+    {115080, 0xF1, 0, 6, {0x98, 0x8A, 0x44, 0x83, 0x2E, 0xFE, 0x00, 0x00}},
+    {117130, 0x1E9, 0, 8, {0x73, 0x79, 0xBC, 0x73, 0xD9, 0xEF, 0x9E, 0x92}},
+    {117462, 0x8CF00400, 1, 8, {0x1C, 0x91, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xAB}},
+    {117784, 0xC9, 0, 8, {0x5C, 0x9B, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x75}},
+    {124324, 0x2A0, 0, 3, {0xB8, 0x24, 0xAA, 0x00, 0x00, 0x00, 0x00, 0x00}},
+    {124514, 0x120, 0, 8, {0x1D, 0x39, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x5C}},
+    {124944, 0xF1, 0, 6, {0x98, 0x8A, 0x44, 0x83, 0x30, 0xFE, 0x00, 0x00}},
+    {127486, 0x8CF00400, 1, 8, {0x1D, 0x92, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA9}},
+    {127807, 0xC9, 0, 8, {0x5D, 0x9A, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x75}},
+    {134326, 0x17D, 0, 8, {0xF7, 0xA7, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xAB}},
+    {134435, 0x120, 0, 8, {0x1E, 0x38, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x5E}},
+    {135080, 0xF1, 0, 6, {0x98, 0x8A, 0x44, 0x83, 0x2D, 0xFE, 0x00, 0x00}},
+    {137178, 0x1E9, 0, 8, {0x73, 0x79, 0xBC, 0x73, 0xD9, 0xEF, 0x9E, 0x92}},
+    {137392, 0x8CF00400, 1, 8, {0x1E, 0x92, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xAA}},
+    {137846, 0xC9, 0, 8, {0x5E, 0x9B, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x77}},
+    {144474, 0x120, 0, 8, {0x1F, 0x38, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x5F}},
+    {145017, 0xF1, 0, 6, {0x98, 0x8B, 0x44, 0x83, 0x2D, 0xFE, 0x00, 0x00}},
+    {147400, 0x8CF00400, 1, 8, {0x1F, 0x91, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA8}},
+    {147805, 0xC9, 0, 8, {0x5F, 0x9B, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x76}},
+    {150000, 0x7E8, 0, 8, {0x21, 0x62, 0x40, 0x47, 0xEB, 0x35, 0xCC, 0xEE}},
+    {151000, 0x7E8, 0, 8, {0x22, 0xD1, 0xE0, 0xF9, 0xA5, 0xA3, 0x79, 0x58}},
+    {152000, 0x7E8, 0, 8, {0x23, 0x71, 0xD3, 0x0D, 0xEB, 0xBB, 0x16, 0x9C}},
+    {153000, 0x7E8, 0, 8, {0x24, 0x53, 0x8C, 0x76, 0x70, 0xDF, 0xEC, 0xB0}},
+    {154000, 0x7E8, 0, 8, {0x25, 0x2C, 0xEB, 0x99, 0xAC, 0x08, 0x66, 0xF3}},
+    {154284, 0x17D, 0, 8, {0xF8, 0xA7, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xA4}},
+    {154438, 0x120, 0, 8, {0x10, 0x39, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x51}},
+    {155000, 0x7E8, 0, 8, {0x26, 0x68, 0x90, 0xE0, 0xDA, 0x2A, 0x4A, 0xF7}},
+    {155008, 0xF1, 0, 6, {0x95, 0x8B, 0x44, 0x83, 0x2D, 0xFE, 0x00, 0x00}},
+    {156000, 0x7E8, 0, 8, {0x27, 0xD6, 0x99, 0x8A, 0xAF, 0x2E, 0x4E, 0x60}},
+    {157000, 0x7E8, 0, 8, {0x28, 0x2A, 0x10, 0xFE, 0x6F, 0x53, 0x50, 0x2A}},
+    {157239, 0x1E9, 0, 8, {0x73, 0x79, 0xBC, 0x73, 0xD7, 0xEF, 0x9E, 0x92}},
+    {157418, 0x8CF00400, 1, 8, {0x10, 0x92, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA4}},
+    {157753, 0xC9, 0, 8, {0x50, 0x9B, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x79}},
+    {158000, 0x7E8, 0, 8, {0x29, 0x83, 0xCC, 0x4D, 0xA4, 0x9F, 0xA7, 0xAE}},
+    {159000, 0x7E8, 0, 8, {0x2A, 0xFB, 0x5F, 0xE1, 0x7B, 0xC7, 0xE6, 0x28}},
+    {164538, 0x120, 0, 8, {0x11, 0x39, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x50}},
+    {164952, 0xF1, 0, 6, {0x93, 0x8B, 0x44, 0x83, 0x2D, 0xFE, 0x00, 0x00}},
+    {167422, 0x8CF00400, 1, 8, {0x11, 0x93, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA4}},
+    {167758, 0xC9, 0, 8, {0x51, 0x9B, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x78}},
+    {174293, 0x2A0, 0, 3, {0xB8, 0x24, 0xAC, 0x00, 0x00, 0x00, 0x00, 0x00}},
+    {174359, 0x17D, 0, 8, {0xF9, 0xA6, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xA4}},
+    {174442, 0x120, 0, 8, {0x12, 0x39, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x53}},
+    {174990, 0xF1, 0, 6, {0x95, 0x8B, 0x44, 0x83, 0x2D, 0xFE, 0x00, 0x00}},
+    {177179, 0x1E9, 0, 8, {0x73, 0x79, 0xBC, 0x73, 0xD7, 0xEF, 0xA0, 0x92}},
+    {177318, 0x3C1, 0, 8, {0x32, 0x72, 0x78, 0x54, 0x97, 0x46, 0xC5, 0x37}},
+    {177373, 0x8CF00400, 1, 8, {0x12, 0x93, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA7}},
+    {177767, 0xC9, 0, 8, {0x52, 0x9B, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7B}},
+    {182667, 0x4C1, 0, 4, {0xAA, 0x78, 0x08, 0x8C, 0x00, 0x00, 0x00, 0x00}},
+    {184421, 0x120, 0, 8, {0x13, 0x39, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x52}},
+    {184985, 0xF1, 0, 6, {0x95, 0x8B, 0x44, 0x83, 0x2B, 0xFE, 0x00, 0x00}},
+    {187426, 0x8CF00400, 1, 8, {0x13, 0x94, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA1}},
+    {187846, 0xC9, 0, 8, {0x53, 0x9C, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7D}},
+    {194275, 0x17D, 0, 8, {0xFA, 0xA6, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xA7}},
+    {194462, 0x120, 0, 8, {0x14, 0x39, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x55}},
+    {195058, 0xF1, 0, 6, {0x95, 0x8B, 0x44, 0x81, 0x2B, 0xFE, 0x00, 0x00}},
+    {197176, 0x98FEF100, 1, 8, {0x61, 0x40, 0x41, 0x76, 0x81, 0x0C, 0x35, 0xD8}},
+    {197200, 0x1E9, 0, 8, {0x73, 0x79, 0xBC, 0x73, 0xD7, 0xEF, 0xA0, 0x92}},
+    {197376, 0x8CF00400, 1, 8, {0x14, 0x95, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA7}},
+    {197729, 0xC9, 0, 8, {0x54, 0x9B, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7D}},
+    {204474, 0x120, 0, 8, {0x15, 0x38, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x55}},
+    {205053, 0xF1, 0, 6, {0x95, 0x8B, 0x43, 0x81, 0x2B, 0xFE, 0x00, 0x00}},
+    {207427, 0x8CF00400, 1, 8, {0x15, 0x95, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA6}},
+    {207760, 0xC9, 0, 8, {0x55, 0x9C, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7B}},
+    {214347, 0x17D, 0, 8, {0xFB, 0xA6, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xA6}},
+    {214480, 0x120, 0, 8, {0x16, 0x38, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x56}},
+    {214992, 0xF1, 0, 6, {0x95, 0x8B, 0x43, 0x81, 0x2B, 0xFE, 0x00, 0x00}},
+    {217203, 0x1E9, 0, 8, {0x74, 0x79, 0xBC, 0x73, 0xD7, 0xEF, 0xA0, 0x92}},
+    {217418, 0x8CF00400, 1, 8, {0x16, 0x95, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA5}},
+    {217819, 0xC9, 0, 8, {0x56, 0x9C, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x78}},
+    {224291, 0x2A0, 0, 3, {0xB5, 0x24, 0xAC, 0x00, 0x00, 0x00, 0x00, 0x00}},
+    {224525, 0x120, 0, 8, {0x17, 0x37, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x58}},
+    {225051, 0xF1, 0, 6, {0x95, 0x8B, 0x43, 0x82, 0x2B, 0xFE, 0x00, 0x00}},
+    {227388, 0x8CF00400, 1, 8, {0x17, 0x96, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA7}},
+    {227735, 0xC9, 0, 8, {0x57, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x78}},
+    {234266, 0x17D, 0, 8, {0xFC, 0xA6, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xA1}},
+    {234527, 0x120, 0, 8, {0x18, 0x37, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x57}},
+    {234971, 0xF1, 0, 6, {0x95, 0x8B, 0x43, 0x83, 0x2B, 0xFE, 0x00, 0x00}},
+    {237141, 0x1E9, 0, 8, {0x74, 0x7C, 0xBC, 0x73, 0xD7, 0xEF, 0xA0, 0x92}},
+    {237410, 0x8CF00400, 1, 8, {0x18, 0x96, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA8}},
+    {237795, 0xC9, 0, 8, {0x58, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x77}},
+    {244554, 0x120, 0, 8, {0x19, 0x36, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x57}},
+    {245016, 0xF1, 0, 6, {0x95, 0x89, 0x43, 0x83, 0x2B, 0xFE, 0x00, 0x00}},
+    {247473, 0x8CF00400, 1, 8, {0x19, 0x95, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xAA}},
+    {247737, 0xC9, 0, 8, {0x59, 0x9C, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x77}},
+    {254353, 0x17D, 0, 8, {0xFD, 0xA5, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xA3}},
+    {254457, 0x120, 0, 8, {0x1A, 0x37, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x55}},
+    {254982, 0xF1, 0, 6, {0x95, 0x89, 0x43, 0x81, 0x2B, 0xFE, 0x00, 0x00}},
+    {257189, 0x1E9, 0, 8, {0x74, 0x7C, 0xBC, 0x73, 0xD7, 0xEF, 0xA0, 0x92}},
+    {257378, 0x8CF00400, 1, 8, {0x1A, 0x95, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA9}},
+    {257800, 0xC9, 0, 8, {0x5A, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x75}},
+    {264513, 0x120, 0, 8, {0x1B, 0x37, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x54}},
+    {264940, 0xF1, 0, 6, {0x95, 0x89, 0x43, 0x81, 0x2B, 0xFE, 0x00, 0x00}},
+    {267461, 0x8CF00400, 1, 8, {0x1B, 0x95, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA8}},
+    {267786, 0xC9, 0, 8, {0x5B, 0x9E, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x77}},
+    {274330, 0x17D, 0, 8, {0xFE, 0xA4, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xA1}},
+    {274337, 0x2A0, 0, 3, {0xB5, 0x24, 0xAE, 0x00, 0x00, 0x00, 0x00, 0x00}},
+    {274460, 0x120, 0, 8, {0x1C, 0x37, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x53}},
+    {274937, 0xF1, 0, 6, {0x94, 0x89, 0x43, 0x81, 0x2B, 0xFE, 0x00, 0x00}},
+    {277126, 0x1E9, 0, 8, {0x74, 0x7C, 0xBC, 0x76, 0xD7, 0xEF, 0xA0, 0x92}},
+    {277337, 0x3C1, 0, 8, {0x32, 0x72, 0x78, 0x54, 0x97, 0x46, 0xC5, 0x37}},
+    {277438, 0x8CF00400, 1, 8, {0x1C, 0x96, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xAC}},
+    {277744, 0xC9, 0, 8, {0x5C, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x73}},
+    {282678, 0x4C1, 0, 4, {0xAA, 0x78, 0x06, 0x8C, 0x00, 0x00, 0x00, 0x00}},
+    {284426, 0x120, 0, 8, {0x1D, 0x36, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x53}},
+    {285066, 0xF1, 0, 6, {0x94, 0x8C, 0x43, 0x81, 0x2B, 0xFE, 0x00, 0x00}},
+    {287443, 0x8CF00400, 1, 8, {0x1D, 0x96, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xAD}},
+    {287785, 0xC9, 0, 8, {0x5D, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x72}},
+    {294279, 0x17D, 0, 8, {0xFF, 0xA4, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xA0}},
+    {294491, 0x120, 0, 8, {0x1E, 0x36, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x50}},
+    {294946, 0xF1, 0, 6, {0x94, 0x8C, 0x43, 0x83, 0x2B, 0xFE, 0x00, 0x00}},
+    {297158, 0x98FEF100, 1, 8, {0x61, 0x40, 0x41, 0x76, 0x81, 0x0C, 0x35, 0xD7}},
+    {297173, 0x1E9, 0, 8, {0x74, 0x7C, 0xBC, 0x76, 0xD4, 0xEF, 0xA0, 0x92}},
+    {297372, 0x8CF00400, 1, 8, {0x1E, 0x96, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xAE}},
+    {297849, 0xC9, 0, 8, {0x5E, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x71}},
+    {304482, 0x120, 0, 8, {0x1F, 0x35, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x52}},
+    {305055, 0xF1, 0, 6, {0x94, 0x8D, 0x43, 0x83, 0x2B, 0xFE, 0x00, 0x00}},
+    {307431, 0x8CF00400, 1, 8, {0x1F, 0x96, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xAF}},
+    {307726, 0xC9, 0, 8, {0x5F, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x70}},
+    {314286, 0x17D, 0, 8, {0xF0, 0xA5, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xAE}},
+    {314523, 0x120, 0, 8, {0x10, 0x34, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x5C}},
+    {315077, 0xF1, 0, 6, {0x94, 0x8D, 0x43, 0x83, 0x2B, 0xFE, 0x00, 0x00}},
+    {317218, 0x1E9, 0, 8, {0x74, 0x7C, 0xBC, 0x79, 0xD4, 0xEF, 0xA0, 0x92}},
+    {317453, 0x8CF00400, 1, 8, {0x10, 0x96, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA0}},
+    {317702, 0xC9, 0, 8, {0x50, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7F}},
+    {324266, 0x2A0, 0, 3, {0xB8, 0x24, 0xAE, 0x00, 0x00, 0x00, 0x00, 0x00}},
+    {324519, 0x120, 0, 8, {0x11, 0x34, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x5D}},
+    {325022, 0xF1, 0, 6, {0x94, 0x8D, 0x43, 0x83, 0x2B, 0xFE, 0x00, 0x00}},
+    {327444, 0x8CF00400, 1, 8, {0x11, 0x97, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA0}},
+    {327813, 0xC9, 0, 8, {0x51, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7E}},
+    {334331, 0x17D, 0, 8, {0xF1, 0xA6, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xAC}},
+    {334534, 0x120, 0, 8, {0x12, 0x33, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x59}},
+    {335024, 0xF1, 0, 6, {0x95, 0x8D, 0x43, 0x83, 0x2B, 0xFE, 0x00, 0x00}},
+    {337227, 0x1E9, 0, 8, {0x74, 0x7C, 0xBA, 0x79, 0xD4, 0xEF, 0xA0, 0x92}},
+    {337369, 0x8CF00400, 1, 8, {0x12, 0x97, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA3}},
+    {337790, 0xC9, 0, 8, {0x52, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7D}},
+    {344490, 0x120, 0, 8, {0x13, 0x33, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x58}},
+    {344977, 0xF1, 0, 6, {0x95, 0x8D, 0x43, 0x83, 0x2A, 0xFE, 0x00, 0x00}},
+    {347453, 0x8CF00400, 1, 8, {0x13, 0x98, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xAD}},
+    {347721, 0xC9, 0, 8, {0x53, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7C}},
+    {354319, 0x17D, 0, 8, {0xF2, 0xA6, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xAF}},
+    {354458, 0x120, 0, 8, {0x14, 0x34, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x58}},
+    {354964, 0xF1, 0, 6, {0x95, 0x8E, 0x43, 0x83, 0x2A, 0xFE, 0x00, 0x00}},
+    {357225, 0x1E9, 0, 8, {0x74, 0x7C, 0xBA, 0x79, 0xD1, 0xEF, 0xA0, 0x92}},
+    {357339, 0x8CF00400, 1, 8, {0x14, 0x99, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xAB}},
+    {357773, 0xC9, 0, 8, {0x54, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7B}},
+    {364451, 0x120, 0, 8, {0x15, 0x35, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x58}},
+    {364971, 0xF1, 0, 6, {0x95, 0x8E, 0x43, 0x80, 0x2A, 0xFE, 0x00, 0x00}},
+    {367451, 0x8CF00400, 1, 8, {0x15, 0x98, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xAB}},
+    {367819, 0xC9, 0, 8, {0x55, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7A}},
+    {374231, 0x2A0, 0, 3, {0xB5, 0x24, 0xAE, 0x00, 0x00, 0x00, 0x00, 0x00}},
+    {374288, 0x17D, 0, 8, {0xF3, 0xA5, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xAD}},
+    {374441, 0x120, 0, 8, {0x16, 0x36, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x58}},
+    {375023, 0xF1, 0, 6, {0x95, 0x8B, 0x43, 0x80, 0x2A, 0xFE, 0x00, 0x00}},
+    {377175, 0x1E9, 0, 8, {0x74, 0x79, 0xBA, 0x79, 0xD1, 0xEF, 0xA0, 0x92}},
+    {377316, 0x3C1, 0, 8, {0x32, 0x72, 0x78, 0x54, 0x97, 0x46, 0xC5, 0x37}},
+    {377370, 0x8CF00400, 1, 8, {0x16, 0x98, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA8}},
+    {377824, 0xC9, 0, 8, {0x56, 0x9E, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x7A}},
+    {382647, 0x4C1, 0, 4, {0xAA, 0x7A, 0x06, 0x8C, 0x00, 0x00, 0x00, 0x00}},
+    {384547, 0x120, 0, 8, {0x17, 0x37, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x58}},
+    {385063, 0xF1, 0, 6, {0x95, 0x8B, 0x42, 0x80, 0x2A, 0xFE, 0x00, 0x00}},
+    {387468, 0x8CF00400, 1, 8, {0x17, 0x98, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA9}},
+    {387807, 0xC9, 0, 8, {0x57, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x78}},
+    {394344, 0x17D, 0, 8, {0xF4, 0xA6, 0x51, 0x13, 0x3E, 0x3D, 0xBA, 0xA9}},
+    {394569, 0x120, 0, 8, {0x18, 0x37, 0xAB, 0x53, 0x75, 0x79, 0x8C, 0x57}},
+    {395056, 0xF1, 0, 6, {0x95, 0x8A, 0x42, 0x80, 0x2A, 0xFE, 0x00, 0x00}},
+    {397205, 0x1E9, 0, 8, {0x74, 0x79, 0xBC, 0x79, 0xD1, 0xEF, 0xA0, 0x92}},
+    {397232, 0x98FEF100, 1, 8, {0x61, 0x40, 0x41, 0x76, 0x81, 0x0C, 0x35, 0xD9}},
+    {397464, 0x8CF00400, 1, 8, {0x18, 0x97, 0x5F, 0xC4, 0xFD, 0xB8, 0xF8, 0xA9}},
+    {397719, 0xC9, 0, 8, {0x58, 0x9D, 0x66, 0xD1, 0x87, 0x7D, 0xFF, 0x77}},
+};
@@ -0,0 +1,241 @@
+#include <unity.h>
+#include <vector>
+#include "test_support.h"
+#include "gvret_comm.h"
+#include "gvret_protocol.h"
+#include "../../tools/gvret_decode/gvret_stream_decoder.h"
+#include "capture.h"
+
+//The recorded traffic goes through the device's encoders exactly as it would towards a host and back through the
+//decoder in tools/. Every frame has to come out as it went in, in every stream mode.
+
+#define CAPTURE_FRAMES  (sizeof(capture) / sizeof(capture[0]))
+
+static GVRET_Comm_Handler handler;
+
+void setUp()
+{
+    setupTestSettings();
+    handler.clearBufferedBytes();
+    handler.setBinaryMode(true);
+}
+
+void tearDown() {}
+
+static CAN_FRAME captureFrame(int i)
+{
+    CAN_FRAME frame;
+    frame.id = capture[i].id & 0x7FFFFFFF;
+    frame.extended = capture[i].id >> 31;
+    frame.length = capture[i].length;
+    frame.timestamp = capture[i].timestamp;
+    memcpy(frame.data.uint8, capture[i].data, 8);
+    return frame;
+}
+
+//host asks for the mode, then the whole capture streams out. Returns the bytes that went over the link
+static std::vector<uint8_t> streamCapture(uint8_t mode)
+{
+    const uint8_t setMode[] = {0xF1, PROTO_SET_STREAM_MODE, mode};
+    handler.processIncomingBytes(setMode, sizeof(setMode));
+    std::vector<uint8_t> link;
+    uint8_t out[WIFI_BUFF_SIZE];
+    for (size_t i = 0; i < CAPTURE_FRAMES; i++)
+    {
+        CAN_FRAME frame = captureFrame(i);
+        handler.sendFrameToBuffer(frame, capture[i].bus);
+        size_t length = drainBuffer(handler, out, sizeof(out));
+        link.insert(link.end(), out, out + length);
+    }
+    return link;
+}
+
+static void checkDecoded(const std::vector<DecodedFrame> &decoded)
+{
+    TEST_ASSERT_EQUAL(CAPTURE_FRAMES, decoded.size());
+    for (size_t i = 0; i < CAPTURE_FRAMES; i++)
+    {
+        TEST_ASSERT_EQUAL_HEX32(capture[i].id & 0x7FFFFFFF, decoded[i].id);
+        TEST_ASSERT_EQUAL(capture[i].id >> 31, decoded[i].extended);
+        TEST_ASSERT_EQUAL(capture[i].bus, decoded[i].bus);
+        TEST_ASSERT_EQUAL(capture[i].timestamp, decoded[i].timestamp);
+        TEST_ASSERT_EQUAL(capture[i].length, decoded[i].length);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(capture[i].data, decoded[i].data, capture[i].length);
+    }
+}
+
+static std::vector<DecodedFrame> decodeAll(GvretStreamDecoder &decoder, const std::vector<uint8_t> &link, size_t piece)
+{
+    std::vector<DecodedFrame> decoded;
+    for (size_t pos = 0; pos < link.size(); pos += piece)
+    {
+        size_t length = (link.size() - pos < piece) ? link.size() - pos : piece;
+        TEST_ASSERT_TRUE(decoder.feed(&link[pos], length, [&decoded](const DecodedFrame &frame) {
+            decoded.push_back(frame);
+        }));
+    }
+    return decoded;
+}
+
+static void test_round_trip_every_mode()
+{
+    const uint8_t modes[] = {0, STREAM_COMPRESSED, STREAM_COMPRESSED | STREAM_XOR};
+    size_t sizes[3];
+    for (int m = 0; m < 3; m++)
+    {
+        std::vector<uint8_t> link = streamCapture(modes[m]);
+        sizes[m] = link.size();
+        GvretStreamDecoder decoder;
+        checkDecoded(decodeAll(decoder, link, 4096));
+        TEST_ASSERT_EQUAL(0, decoder.getSkippedBytes());
+    }
+    char message[120];
+    snprintf(message, sizeof(message), "%u frames: plain %u bytes, compressed %u, compressed + XOR %u",
+             (unsigned)CAPTURE_FRAMES, (unsigned)sizes[0], (unsigned)sizes[1], (unsigned)sizes[2]);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN(sizes[0], sizes[1]);
+    TEST_ASSERT_LESS_OR_EQUAL(sizes[1], sizes[2]);
+}
+
+//records cut anywhere, down to a byte at a time, as a serial port would hand them over
+static void test_split_anywhere()
+{
+    std::vector<uint8_t> link = streamCapture(STREAM_COMPRESSED | STREAM_XOR);
+    for (size_t piece = 1; piece < 24; piece += 3)
+    {
+        GvretStreamDecoder decoder;
+        checkDecoded(decodeAll(decoder, link, piece));
+    }
+}
+
+//the same host session switching modes: each echo resets the decoder along with the device's dictionary
+static void test_mode_changes_in_one_session()
+{
+    std::vector<uint8_t> link = streamCapture(STREAM_COMPRESSED | STREAM_XOR);
+    std::vector<uint8_t> second = streamCapture(STREAM_COMPRESSED);
+    std::vector<uint8_t> third = streamCapture(0);
+    link.insert(link.end(), second.begin(), second.end());
+    link.insert(link.end(), third.begin(), third.end());
+
+    GvretStreamDecoder decoder;
+    std::vector<DecodedFrame> decoded = decodeAll(decoder, link, 1000);
+    TEST_ASSERT_EQUAL(3 * CAPTURE_FRAMES, decoded.size());
+    for (int pass = 0; pass < 3; pass++)
+        checkDecoded(std::vector<DecodedFrame>(decoded.begin() + pass * CAPTURE_FRAMES,
+                                               decoded.begin() + (pass + 1) * CAPTURE_FRAMES));
+}
+
+//FD frames stay normal records in compressed mode and don't disturb the slots around them
+static void test_fd_between_compressed()
+{
+    const uint8_t setMode[] = {0xF1, PROTO_SET_STREAM_MODE, STREAM_COMPRESSED | STREAM_XOR};
+    handler.processIncomingBytes(setMode, sizeof(setMode));
+    CAN_FRAME first = captureFrame(0);
+    CAN_FRAME_FD fd;
+    fd.id = 0x18DAF110;
+    fd.extended = true;
+    fd.length = 48;
+    fd.timestamp = 5000;
+    for (int i = 0; i < 48; i++) fd.data.uint8[i] = i * 3;
+    CAN_FRAME again = first;
+    again.timestamp = first.timestamp + 10000;
+    again.data.uint8[2] ^= 0x40;
+
+    handler.sendFrameToBuffer(first, 0);
+    handler.sendFrameToBuffer(fd, 1);
+    handler.sendFrameToBuffer(again, 0);
+    uint8_t out[512];
+    size_t length = drainBuffer(handler, out, sizeof(out));
+
+    GvretStreamDecoder decoder;
+    std::vector<DecodedFrame> decoded;
+    TEST_ASSERT_TRUE(decoder.feed(out, length, [&decoded](const DecodedFrame &frame) { decoded.push_back(frame); }));
+    TEST_ASSERT_EQUAL(3, decoded.size());
+    TEST_ASSERT_TRUE(decoded[1].fd);
+    TEST_ASSERT_EQUAL(48, decoded[1].length);
+    TEST_ASSERT_EQUAL(1, decoded[1].bus);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(fd.data.uint8, decoded[1].data, 48);
+    TEST_ASSERT_EQUAL(again.timestamp, decoded[2].timestamp);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(again.data.uint8, decoded[2].data, again.length);
+}
+
+//The host stops reading now and then and something else crowds the link. Records that don't fit are refused, a backlog is thrown away by the consumer
+//once and cleared by the producer once. The host gets a stream it can follow the whole way and every frame that
+//reached it comes out as it went in
+static void test_drops_keep_sync()
+{
+    const uint8_t setMode[] = {0xF1, PROTO_SET_STREAM_MODE, STREAM_COMPRESSED | STREAM_XOR};
+    handler.processIncomingBytes(setMode, sizeof(setMode));
+    std::vector<uint8_t> link;
+    std::vector<size_t> delivered, queued;
+    uint8_t out[WIFI_BUFF_SIZE];
+    static uint8_t filler[WIFI_BUFF_SIZE]; //zeros, which the decoder skips like text
+    int refused = 0;
+    for (size_t i = 0; i <= CAPTURE_FRAMES; i++)
+    {
+        bool drain = (i == 60 || i == 150 || i == CAPTURE_FRAMES);
+        if (i == 30 || i == 120 || i == 190) handler.sendBytesToBuffer(filler, handler.numFreeBytes() - 60); //a few more fit
+        if (i == 100) handler.discardBytes(handler.numAvailableBytes());
+        if (i == 200) handler.clearBufferedBytes();
+        if (i == 100 || i == 200) queued.clear();
+        if (drain)
+        {
+            size_t length = drainBuffer(handler, out, sizeof(out));
+            link.insert(link.end(), out, out + length);
+            delivered.insert(delivered.end(), queued.begin(), queued.end());
+            queued.clear();
+        }
+        if (i == CAPTURE_FRAMES) break;
+        CAN_FRAME frame = captureFrame(i);
+        if (handler.sendFrameToBuffer(frame, capture[i].bus)) queued.push_back(i);
+        else refused++;
+    }
+    TEST_ASSERT_GREATER_THAN(0, refused);
+
+    GvretStreamDecoder decoder;
+    std::vector<DecodedFrame> decoded = decodeAll(decoder, link, 64);
+    TEST_ASSERT_EQUAL(delivered.size(), decoded.size());
+    for (size_t n = 0; n < decoded.size(); n++)
+    {
+        size_t i = delivered[n];
+        TEST_ASSERT_EQUAL_HEX32(capture[i].id & 0x7FFFFFFF, decoded[n].id);
+        TEST_ASSERT_EQUAL(capture[i].bus, decoded[n].bus);
+        TEST_ASSERT_EQUAL(capture[i].timestamp, decoded[n].timestamp);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(capture[i].data, decoded[n].data, capture[i].length);
+    }
+}
+
+//frames slightly out of order step the timestamp back, and the 32 bit clock wrapping carries on past 2^32
+static void test_timestamps_back_and_wrapping()
+{
+    const uint8_t setMode[] = {0xF1, PROTO_SET_STREAM_MODE, STREAM_COMPRESSED};
+    handler.processIncomingBytes(setMode, sizeof(setMode));
+    const uint32_t stamps[] = {0xFFFFF000, 0xFFFFF400, 0xFFFFF100, 0x00000200, 0x00000100};
+    const uint64_t expected[] = {0xFFFFF000, 0xFFFFF400, 0xFFFFF100, 0x100000200ull, 0x100000100ull};
+    CAN_FRAME frame = captureFrame(0);
+    for (int i = 0; i < 5; i++)
+    {
+        frame.timestamp = stamps[i];
+        TEST_ASSERT_TRUE(handler.sendFrameToBuffer(frame, 0));
+    }
+    uint8_t out[256];
+    size_t length = drainBuffer(handler, out, sizeof(out));
+
+    GvretStreamDecoder decoder;
+    std::vector<DecodedFrame> decoded;
+    TEST_ASSERT_TRUE(decoder.feed(out, length, [&decoded](const DecodedFrame &frame) { decoded.push_back(frame); }));
+    TEST_ASSERT_EQUAL(5, decoded.size());
+    for (int i = 0; i < 5; i++) TEST_ASSERT_EQUAL_UINT64(expected[i], decoded[i].timestamp);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_every_mode);
+    RUN_TEST(test_split_anywhere);
+    RUN_TEST(test_mode_changes_in_one_session);
+    RUN_TEST(test_fd_between_compressed);
+    RUN_TEST(test_drops_keep_sync);
+    RUN_TEST(test_timestamps_back_and_wrapping);
+    return UNITY_END();
+}
@@ -0,0 +1,36 @@
+//Turns a raw capture of the device's binary GVRET stream (plain or compressed) into one text line per frame, in the
+//same layout the device uses in text mode.
+//
+//    g++ -O2 -o gvret_decode tools/gvret_decode/gvret_decode.cpp
+//    gvret_decode capture.bin > capture.txt      (or read from stdin)
+#include <stdio.h>
+#include "gvret_stream_decoder.h"
+
+int main(int argc, char **argv)
+{
+    FILE *in = stdin;
+    if (argc > 1 && !(in = fopen(argv[1], "rb")))
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    GvretStreamDecoder decoder;
+    uint8_t buff[4096];
+    size_t length;
+    uint32_t frames = 0;
+    bool ok = true;
+    while ((length = fread(buff, 1, sizeof(buff), in)) > 0)
+    {
+        ok &= decoder.feed(buff, length, [&frames](const DecodedFrame &frame) {
+            printf("%lu - %x %s %i %i", (unsigned long)frame.timestamp, frame.id, frame.extended ? "X" : "S",
+                   frame.bus, frame.length);
+            for (int c = 0; c < frame.length; c++) printf(" %x", frame.data[c]);
+            printf("\n");
+            frames++;
+        });
+    }
+    fprintf(stderr, "%u frames, %u bytes skipped%s\n", frames, decoder.getSkippedBytes(),
+            ok ? "" : ", stream could not be followed in places");
+    return ok ? 0 : 2;
+}
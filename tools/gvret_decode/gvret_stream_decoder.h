@@ -0,0 +1,218 @@
+#pragma once
+//Host side decoder for the binary GVRET stream the device sends, compressed records included (see
+//CompressedStreamEncoder in src/frame_encoder.h for the format). Header only and plain C++ so a capture tool or the
+//native tests can pull it in without any of the firmware.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+struct DecodedFrame
+{
+    uint64_t timestamp; //microseconds. PROTO_BUILD_CAN_FRAME / FD records only carry 32 bits of it
+    uint32_t id;
+    bool extended;
+    bool fd;
+    uint8_t bus;
+    uint8_t length;
+    uint8_t data[64];
+};
+
+class GvretStreamDecoder
+{
+public:
+    GvretStreamDecoder() { reset(); }
+
+    //forget everything, as if the device had just had its stream mode set
+    void reset()
+    {
+        for (int i = 0; i < NUM_SLOTS; i++) slots[i].valid = false;
+        lastTimestamp = 0;
+        haveTimestamp = false;
+    }
+
+    //Feed bytes as they come off the link, in any size of piece. Complete frames are handed to onFrame, anything that
+    //isn't a frame record is skipped. Returns false once the stream stops making sense (a compressed record for a
+    //slot that was never defined or an unknown record), after which the caller should reset on the next
+    //PROTO_SET_STREAM_MODE echo it sends. The device sends that echo on its own too, after it had to throw away
+    //records it had already queued.
+    template <class Callback>
+    bool feed(const uint8_t *bytes, size_t length, Callback onFrame)
+    {
+        pending.insert(pending.end(), bytes, bytes + length);
+        size_t pos = 0;
+        bool ok = true;
+        while (pos < pending.size())
+        {
+            if (pending[pos] != 0xF1)
+            {
+                pos++; //text or noise between records
+                skipped++;
+                continue;
+            }
+            DecodedFrame frame;
+            bool isFrame = false;
+            int used = parseRecord(&pending[pos], pending.size() - pos, frame, isFrame);
+            if (used == 0) break; //record not complete yet
+            if (used < 0)
+            {
+                ok = false;
+                pos++;
+                skipped++;
+                continue;
+            }
+            if (isFrame) onFrame(frame);
+            pos += used;
+        }
+        pending.erase(pending.begin(), pending.begin() + pos);
+        return ok;
+    }
+
+    uint32_t getSkippedBytes() { return skipped; }
+
+private:
+    enum
+    {
+        BUILD_CAN_FRAME = 0,
+        BUILD_FD_FRAME = 20,
+        SET_STREAM_MODE = 23,
+        COMPRESSED_FRAME = 24,
+        TX_STATUS = 31,
+        BUS_EVENT = 32,
+        DROP_STATS = 34,
+        NUM_SLOTS = 63
+    };
+
+    struct Slot {
+        uint32_t id;
+        uint8_t bus;
+        uint8_t length;
+        bool valid;
+        uint8_t data[8];
+    };
+
+    Slot slots[NUM_SLOTS];
+    uint64_t lastTimestamp;
+    bool haveTimestamp;     //the first record after a reset has the full timestamp, the rest signed differences
+    uint32_t skipped = 0;
+    std::vector<uint8_t> pending;
+
+    static uint32_t get32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+    //bytes used by the record at rec, 0 if it isn't all there yet, -1 if it can't be decoded
+    int parseRecord(const uint8_t *rec, size_t avail, DecodedFrame &frame, bool &isFrame)
+    {
+        if (avail < 2) return 0;
+        switch (rec[1])
+        {
+        case BUILD_CAN_FRAME:
+        {
+            if (avail < 11) return 0;
+            size_t length = rec[10] & 0xF;
+            if (length > 8) return -1;
+            if (avail < 12 + length) return 0;
+            fillFrame(frame, get32(&rec[2]), get32(&rec[6]), rec[10] >> 4, length, &rec[11]);
+            isFrame = true;
+            return 12 + length;
+        }
+        case BUILD_FD_FRAME:
+        {
+            if (avail < 12) return 0;
+            size_t length = rec[10];
+            if (length > 64) return -1;
+            if (avail < 13 + length) return 0;
+            fillFrame(frame, get32(&rec[2]), get32(&rec[6]), rec[11], length, &rec[12]);
+            frame.fd = true;
+            isFrame = true;
+            return 13 + length;
+        }
+        case SET_STREAM_MODE: //the device resets its encoder before it echoes the mode
+            if (avail < 3) return 0;
+            reset();
+            return 3;
+        case COMPRESSED_FRAME:
+            return parseCompressed(rec, avail, frame, isFrame);
+        case TX_STATUS:
+            return (avail < 8) ? 0 : 8;
+        case BUS_EVENT:
+            return (avail < 12) ? 0 : 12;
+        case DROP_STATS:
+        {
+            if (avail < 8) return 0;
+            size_t length = 8 + rec[6] * 8 + rec[7] * (3 + rec[6] * 12);
+            return (avail < length) ? 0 : length;
+        }
+        default: //replies to the host's own requests aren't expected in a capture
+            return -1;
+        }
+    }
+
+    int parseCompressed(const uint8_t *rec, size_t avail, DecodedFrame &frame, bool &isFrame)
+    {
+        size_t pos = 2;
+        if (avail <= pos) return 0;
+        uint8_t header = rec[pos++];
+        uint8_t slotNum = header & 0x3F;
+        if (slotNum >= NUM_SLOTS) return -1;
+
+        uint32_t delta = 0;
+        for (int shift = 0; ; shift += 7)
+        {
+            if (avail <= pos) return 0;
+            if (shift > 28) return -1;
+            uint8_t b = rec[pos++];
+            delta |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) break;
+        }
+
+        Slot slot = slots[slotNum];
+        if (header & 0x40)
+        {
+            if (avail < pos + 5) return 0;
+            slot.id = get32(&rec[pos]);
+            slot.length = rec[pos + 4] & 0xF;
+            slot.bus = rec[pos + 4] >> 4;
+            if (slot.length > 8) return -1;
+            slot.valid = true;
+            pos += 5;
+        }
+        if (!slot.valid) return -1;
+
+        if (header & 0x80)
+        {
+            if (avail <= pos) return 0;
+            uint8_t mask = rec[pos++];
+            int changed = __builtin_popcount(mask);
+            if (avail < pos + changed) return 0;
+            for (int c = 0; c < 8; c++) if (mask & (1 << c)) slot.data[c] ^= rec[pos++];
+        }
+        else
+        {
+            if (avail < pos + slot.length) return 0;
+            memcpy(slot.data, &rec[pos], slot.length);
+            pos += slot.length;
+        }
+
+        //only now that the whole record is here does the decoder state move on
+        slots[slotNum] = slot;
+        if (haveTimestamp) lastTimestamp += (int64_t)(int32_t)((delta >> 1) ^ (0u - (delta & 1)));
+        else lastTimestamp = delta;
+        haveTimestamp = true;
+        fillFrame(frame, 0, slot.id, slot.bus, slot.length, slot.data);
+        frame.timestamp = lastTimestamp;
+        isFrame = true;
+        return pos;
+    }
+
+    static void fillFrame(DecodedFrame &frame, uint32_t timestamp, uint32_t wireID, uint8_t bus, size_t length,
+                          const uint8_t *data)
+    {
+        frame.timestamp = timestamp;
+        frame.id = wireID & 0x7FFFFFFF;
+        frame.extended = (wireID >> 31) != 0;
+        frame.fd = false;
+        frame.bus = bus;
+        frame.length = length;
+        memcpy(frame.data, data, length);
+    }
+};